@@ -0,0 +1,170 @@
+﻿// <copyright file="fanoutbench.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <WinSock2.h>
+#include <ws2ipdef.h>
+#include <WS2tcpip.h>
+
+#include "fanout.h"
+
+
+/// <summary>
+/// The number of events sent for each measurement.
+/// </summary>
+static constexpr std::size_t events = 10000;
+
+
+/// <summary>
+/// Creates a non-blocking UDP socket bound to an ephemeral port on the IPv4
+/// loopback interface and answer its address.
+/// </summary>
+static SOCKET make_socket(_Out_ sockaddr_in& address,
+        _In_ const DWORD flags) {
+    auto retval = ::WSASocket(AF_INET, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0,
+        flags);
+    if (retval == INVALID_SOCKET) {
+        return retval;
+    }
+
+    ::ZeroMemory(&address, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+    ::bind(retval, reinterpret_cast<const sockaddr *>(&address),
+        sizeof(address));
+
+    int len = sizeof(address);
+    ::getsockname(retval, reinterpret_cast<sockaddr *>(&address), &len);
+
+    u_long nonblocking = 1;
+    ::ioctlsocket(retval, FIONBIO, &nonblocking);
+
+    return retval;
+}
+
+
+/// <summary>
+/// Sends <see cref="events"/> datagrams of the size of a move to all
+/// <paramref name="clients"/> and answer the events per second.
+/// </summary>
+template<class TSend, class TCommit>
+static double measure(_In_ const std::vector<sockaddr_in>& clients,
+        _In_ TSend&& send,
+        _In_ TCommit&& commit,
+        _Out_ std::size_t& failures) {
+    char datagram[16] = { 0 };
+    failures = 0;
+
+    const auto begin = std::chrono::steady_clock::now();
+    for (std::size_t e = 0; e < events; ++e) {
+        // Make the datagrams differ between events like real moves.
+        *reinterpret_cast<std::uint32_t *>(datagram) = static_cast<
+            std::uint32_t>(e);
+
+        for (auto& c : clients) {
+            if (send(reinterpret_cast<const sockaddr *>(&c),
+                    static_cast<int>(sizeof(c)),
+                    datagram,
+                    static_cast<int>(sizeof(datagram))) != 0) {
+                ++failures;
+            }
+        }
+
+        commit();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    const auto dt = std::chrono::duration<double>(end - begin).count();
+    return (dt > 0.0) ? events / dt : 0.0;
+}
+
+
+/// <summary>
+/// Measures the events per second the server can fan out to an increasing
+/// number of clients on the loopback interface, both with one
+/// <c>sendto</c> per client and batched using <see cref="fanout"/>.
+/// </summary>
+int main(void) {
+    WSADATA wsa_data;
+    if (::WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        std::fprintf(stderr, "Failed to initialise Winsock.\n");
+        return -1;
+    }
+
+    sockaddr_in server_address;
+    auto server = make_socket(server_address,
+        WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO);
+    if (server == INVALID_SOCKET) {
+        server = make_socket(server_address, WSA_FLAG_OVERLAPPED);
+    }
+
+    fanout batch;
+    const auto status = batch.open(server);
+    if (status != 0) {
+        std::printf("Registered I/O is not available (error %d), so both "
+            "columns measure sendto.\n", status);
+    }
+
+    std::printf("%8s %18s %18s %10s\n", "clients", "sendto [events/s]",
+        "batched [events/s]", "failures");
+
+    for (std::size_t cnt = 1; cnt <= 512; cnt *= 2) {
+        std::vector<sockaddr_in> addresses(cnt);
+        std::vector<SOCKET> clients(cnt);
+        for (std::size_t i = 0; i < cnt; ++i) {
+            clients[i] = make_socket(addresses[i], WSA_FLAG_OVERLAPPED);
+        }
+
+        // Drain the clients in the background such that the measurement is
+        // not dominated by the loopback dropping datagrams.
+        std::atomic<bool> running(true);
+        std::thread drain([&clients, &running](void) {
+            char buffer[64];
+            while (running.load(std::memory_order_acquire)) {
+                for (auto c : clients) {
+                    while (::recv(c, buffer, sizeof(buffer), 0) > 0);
+                }
+            }
+        });
+
+        std::size_t direct_failures = 0;
+        const auto direct = measure(addresses,
+            [server](const sockaddr *a, int l, const char *d, int s) {
+                return (::sendto(server, d, s, 0, a, l) == SOCKET_ERROR)
+                    ? ::WSAGetLastError()
+                    : 0;
+            },
+            [](void) { },
+            direct_failures);
+
+        std::size_t batched_failures = 0;
+        const auto batched = measure(addresses,
+            [&batch](const sockaddr *a, int l, const char *d, int s) {
+                return batch.send(a, l, d, s);
+            },
+            [&batch](void) { batch.commit(); },
+            batched_failures);
+
+        running.store(false, std::memory_order_release);
+        drain.join();
+        for (auto c : clients) {
+            ::closesocket(c);
+        }
+
+        std::printf("%8zu %18.0f %18.0f %10zu\n", cnt, direct, batched,
+            direct_failures + batched_failures);
+    }
+
+    ::closesocket(server);
+    ::WSACleanup();
+    return 0;
+}
@@ -0,0 +1,183 @@
+﻿// <copyright file="inprocbench.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <WinSock2.h>
+#include <ws2ipdef.h>
+#include <WS2tcpip.h>
+
+#include <mmp_configuration.h>
+#include <mmpinproc.h>
+#include <mmpmsg.h>
+
+#include "inproc_transport.h"
+#include "server.h"
+#include "settings.h"
+
+
+/// <summary>
+/// The number of moves sent for each measurement, which is less than the
+/// capacity of the queues such that no datagram is lost.
+/// </summary>
+static constexpr std::size_t events = 1000;
+
+
+/// <summary>
+/// The outcome of a single measurement.
+/// </summary>
+struct result {
+    std::size_t delivered;
+    double rate;
+    std::size_t reordered;
+};
+
+
+/// <summary>
+/// Answer an IPv4 address on the loopback network.
+/// </summary>
+static sockaddr_storage make_address(_In_ const std::uint32_t host,
+        _In_ const std::uint16_t port) {
+    sockaddr_storage retval;
+    ::ZeroMemory(&retval, sizeof(retval));
+    auto& a = reinterpret_cast<sockaddr_in&>(retval);
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = ::htonl(host);
+    a.sin_port = ::htons(port);
+    return retval;
+}
+
+
+/// <summary>
+/// Connects <paramref name="cnt"/> clients to a server with the given
+/// number of sender <paramref name="shards"/> through an in-process network,
+/// sends <see cref="events"/> moves and answer how many datagrams per second
+/// the server fanned out and whether they arrived in order.
+/// </summary>
+static bool measure(_Out_ result& result,
+        _In_ const std::size_t cnt,
+        _In_ const std::uint32_t shards) {
+    using namespace visus::mmp;
+    ::ZeroMemory(&result, sizeof(result));
+
+    auto network = inproc::network::create();
+    const auto address = make_address(INADDR_LOOPBACK, mmp_default_port);
+    auto endpoint = network->bind(address);
+    if (endpoint == nullptr) {
+        return false;
+    }
+
+    // Heartbeats are disabled, because they would interleave with the moves.
+    const auto config = nlohmann::json {
+        { "Heartbeat", 0 },
+        { "ShardThreshold", 1 },
+        { "Shards", shards }
+    }.get<settings>();
+    server server(config, NULL,
+        std::make_unique<inproc_transport>(endpoint));
+
+    std::vector<std::shared_ptr<inproc::endpoint>> clients;
+    clients.reserve(cnt);
+    for (std::size_t c = 0; c < cnt; ++c) {
+        clients.push_back(network->bind(make_address(0x7f000002, 0)));
+        if (clients.back() == nullptr) {
+            return false;
+        }
+
+        // The clients only take moves in the basic format such that the
+        // server does not send them anything else.
+        mmp_msg_connect msg;
+        msg.capabilities = ::htonl(mmp_capability_none);
+        clients.back()->send(address, &msg, sizeof(msg));
+    }
+
+    {
+        const auto deadline = std::chrono::steady_clock::now()
+            + std::chrono::seconds(5);
+        while (server.backpressure().size() < cnt) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    const auto begin = std::chrono::steady_clock::now();
+    for (std::size_t e = 0; e < events; ++e) {
+        mmp_msg_mouse_move msg;
+        msg.x = ::htonl(static_cast<std::int32_t>(e));
+        server.send(msg);
+    }
+
+    // The sender threads might still be busy, so we wait until every client
+    // got every move or until nothing arrives any more.
+    inproc::datagram datagram;
+    auto end = begin;
+    for (auto& c : clients) {
+        mmp_seq_no last = 0;
+        std::size_t received = 0;
+        while ((received < events)
+                && c->receive(datagram, std::chrono::milliseconds(100))) {
+            end = std::chrono::steady_clock::now();
+            if (datagram.data.size() < sizeof(mmp_msg_mouse_move)) {
+                continue;
+            }
+
+            mmp_msg_mouse_move msg;
+            std::memcpy(&msg, datagram.data.data(), sizeof(msg));
+            const auto seq = ::ntohl(msg.sequence_number);
+            if (seq <= last) {
+                ++result.reordered;
+            }
+            last = seq;
+            ++received;
+        }
+
+        result.delivered += received;
+    }
+
+    const auto elapsed = std::chrono::duration<double>(end - begin).count();
+    result.rate = (elapsed > 0.0)
+        ? static_cast<double>(result.delivered) / elapsed
+        : 0.0;
+    return true;
+}
+
+
+/// <summary>
+/// Measures the throughput of the fan-out of the server for different
+/// numbers of clients and sender threads without any network, such that
+/// only the protocol logic of the server is measured.
+/// </summary>
+int main(void) {
+    WSADATA wsa_data;
+    if (::WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        return -1;
+    }
+
+    std::printf("Clients\tShards\tDatagrams/s\tDelivered\tReordered\n");
+    for (std::size_t cnt : { 1, 16, 256, 1024 }) {
+        for (std::uint32_t shards : { 0, 4 }) {
+            result r;
+            if (!measure(r, cnt, shards)) {
+                std::printf("%zu\t%u\tfailed\n", cnt, shards);
+                continue;
+            }
+
+            std::printf("%zu\t%u\t%.0f\t%zu/%zu\t%zu\n", cnt, shards,
+                r.rate, r.delivered, cnt * events, r.reordered);
+        }
+    }
+
+    ::WSACleanup();
+    return 0;
+}
@@ -0,0 +1,124 @@
+﻿// <copyright file="broadcast_ring.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "broadcast_ring.h"
+
+#include <type_traits>
+
+
+static_assert(std::is_trivially_copyable<broadcast_ring::event>::value,
+    "Events must be trivially copyable to be read under a sequence lock.");
+
+
+/*
+ * broadcast_ring::capacity
+ */
+constexpr std::size_t broadcast_ring::capacity;
+
+
+/*
+ * broadcast_ring::max_datagram
+ */
+constexpr std::size_t broadcast_ring::max_datagram;
+
+
+/*
+ * broadcast_ring::broadcast_ring
+ */
+broadcast_ring::broadcast_ring(void)
+        : _published(0), _slots(capacity), _state_sequence(0),
+        _stopped(false), _waiting(0) {
+    for (auto& s : this->_slots) {
+        s.sequence.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+/*
+ * broadcast_ring::load_state
+ */
+void broadcast_ring::load_state(_Out_ mmp_msg_state& state) const noexcept {
+    visus::mmp::shm::seqlock_load(this->_state_sequence, this->_state, state);
+}
+
+
+/*
+ * broadcast_ring::publish
+ */
+void broadcast_ring::publish(_In_ const event& event) noexcept {
+    // Note: publishing is sequentially consistent with registering a waiting
+    // reader, which then either sees the event or is woken.
+    visus::mmp::shm::seqlock_publish(this->_published, this->_slots.data(),
+            capacity, [&event](slot& s) {
+        s.event = event;
+    });
+
+    if (this->_waiting.load() != 0) {
+        std::lock_guard<std::mutex> l(this->_lock);
+        this->_event.notify_all();
+    }
+}
+
+
+/*
+ * broadcast_ring::published
+ */
+std::uint64_t broadcast_ring::published(void) const noexcept {
+    return this->_published.load(std::memory_order_acquire);
+}
+
+
+/*
+ * broadcast_ring::read
+ */
+broadcast_ring::read_status broadcast_ring::read(
+        _Inout_ std::uint64_t& cursor,
+        _Out_ event& event) const noexcept {
+    return visus::mmp::shm::seqlock_read(this->_published,
+            this->_slots.data(), capacity, cursor, [&event](const slot& s) {
+        event = s.event;
+    });
+}
+
+
+/*
+ * broadcast_ring::stop
+ */
+void broadcast_ring::stop(void) noexcept {
+    std::lock_guard<std::mutex> l(this->_lock);
+    this->_stopped = true;
+    this->_event.notify_all();
+}
+
+
+/*
+ * broadcast_ring::store_state
+ */
+void broadcast_ring::store_state(_In_ const mmp_msg_state& state) noexcept {
+    visus::mmp::shm::seqlock_store(this->_state_sequence, this->_state, state);
+}
+
+
+/*
+ * broadcast_ring::wait
+ */
+bool broadcast_ring::wait(_In_ const std::uint64_t cursor,
+        _In_ const time_point deadline) {
+    std::unique_lock<std::mutex> l(this->_lock);
+    auto ready = [this, cursor](void) {
+        return this->_stopped || (this->_published.load() > cursor);
+    };
+
+    ++this->_waiting;
+    if (deadline == (time_point::max)()) {
+        this->_event.wait(l, ready);
+    } else {
+        this->_event.wait_until(l, deadline, ready);
+    }
+    --this->_waiting;
+
+    return !this->_stopped;
+}
@@ -0,0 +1,187 @@
+﻿// <copyright file="broadcast_ring.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include <Windows.h>
+
+#include <mmpmsg.h>
+#include <mmpshm.h>
+
+
+/// <summary>
+/// Publishes the events of the server to all sender threads, each of which
+/// reads them at its own pace.
+/// </summary>
+/// <remarks>
+/// <para>The ring holds the most recent <see cref="capacity"/> events in
+/// slots guarded by a sequence lock each, which works exactly like the one
+/// of the ring in shared memory. The lock of the ring is only used for
+/// putting readers to sleep and waking them.</para>
+/// <para>A reader that has fallen further behind than
+/// <see cref="capacity"/> is told that it has been lapped, because any
+/// button event in between is lost. It must resynchronise from the state
+/// recorded by <see cref="store_state"/>.</para>
+/// <para>There must only be one writer at a time, which the server
+/// guarantees by publishing under its client lock.</para>
+/// </remarks>
+class broadcast_ring final {
+
+public:
+
+    /// <summary>
+    /// The clock used for the deadlines of the readers.
+    /// </summary>
+    typedef std::chrono::steady_clock clock;
+
+    /// <summary>
+    /// The type used for deadlines.
+    /// </summary>
+    typedef clock::time_point time_point;
+
+    /// <summary>
+    /// The size of the largest datagram that fits into an event.
+    /// </summary>
+    static constexpr std::size_t max_datagram = 64;
+
+    /// <summary>
+    /// An event in all the wire formats the server sends it in.
+    /// </summary>
+    /// <remarks>
+    /// The event is trivially copyable such that readers can copy it while
+    /// the writer might modify it.
+    /// </remarks>
+    struct event {
+        /// <summary>
+        /// The capabilities a client must have negotiated to receive the
+        /// respective format, ordered from best to worst.
+        /// </summary>
+        std::array<mmp_capabilities, 3> capabilities;
+
+        /// <summary>
+        /// The number of formats.
+        /// </summary>
+        std::size_t count;
+
+        /// <summary>
+        /// The datagrams of the formats.
+        /// </summary>
+        std::array<std::array<char, max_datagram>, 3> data;
+
+        /// <summary>
+        /// Indicates whether the event is a move, which is only sent to the
+        /// clients whose region of interest and pacing admit it.
+        /// </summary>
+        bool filtered;
+
+        /// <summary>
+        /// The position of the mouse after the event.
+        /// </summary>
+        POINT position;
+
+        /// <summary>
+        /// The sizes of the datagrams in bytes.
+        /// </summary>
+        std::array<std::size_t, 3> size;
+    };
+
+    /// <summary>
+    /// The possible results of reading from the ring, which are the same as
+    /// for the ring in shared memory. A reader that has been lapped should
+    /// resynchronise from <see cref="load_state"/>.
+    /// </summary>
+    typedef visus::mmp::shm::read_status read_status;
+
+    /// <summary>
+    /// The number of events retained.
+    /// </summary>
+    static constexpr std::size_t capacity = 256;
+
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    broadcast_ring(void);
+
+    broadcast_ring(const broadcast_ring&) = delete;
+
+    /// <summary>
+    /// Copies the state recorded by <see cref="store_state"/>.
+    /// </summary>
+    void load_state(_Out_ mmp_msg_state& state) const noexcept;
+
+    /// <summary>
+    /// Appends a copy of the given <paramref name="event"/> and wakes all
+    /// readers that are waiting.
+    /// </summary>
+    void publish(_In_ const event& event) noexcept;
+
+    /// <summary>
+    /// Answer the number of events published so far, which is the cursor
+    /// of a reader that starts with the next event.
+    /// </summary>
+    std::uint64_t published(void) const noexcept;
+
+    /// <summary>
+    /// Copies the event at <paramref name="cursor"/> and advances the
+    /// cursor.
+    /// </summary>
+    /// <param name="cursor">The cursor of the reader.</param>
+    /// <param name="event">Receives the event.</param>
+    /// <returns>Whether an event was read and whether events have been lost
+    /// before it.</returns>
+    read_status read(_Inout_ std::uint64_t& cursor,
+        _Out_ event& event) const noexcept;
+
+    /// <summary>
+    /// Wakes all readers and makes them stop.
+    /// </summary>
+    void stop(void) noexcept;
+
+    /// <summary>
+    /// Records the state of the server, which must be done before the
+    /// events it reflects are published.
+    /// </summary>
+    void store_state(_In_ const mmp_msg_state& state) noexcept;
+
+    /// <summary>
+    /// Blocks until an event after <paramref name="cursor"/> has been
+    /// published, <paramref name="deadline"/> has passed or the ring has
+    /// been stopped.
+    /// </summary>
+    /// <param name="cursor">The cursor of the reader.</param>
+    /// <param name="deadline">The time when the reader has other work.
+    /// </param>
+    /// <returns><see langword="false" /> if the ring has been stopped,
+    /// <see langword="true" /> otherwise.</returns>
+    bool wait(_In_ const std::uint64_t cursor,
+        _In_ const time_point deadline);
+
+    broadcast_ring& operator =(const broadcast_ring&) = delete;
+
+private:
+
+    struct slot {
+        std::atomic<std::uint64_t> sequence;
+        broadcast_ring::event event;
+    };
+
+    std::condition_variable _event;
+    std::mutex _lock;
+    std::atomic<std::uint64_t> _published;
+    std::vector<slot> _slots;
+    mmp_msg_state _state;
+    std::atomic<std::uint64_t> _state_sequence;
+    bool _stopped;
+    std::atomic<std::size_t> _waiting;
+};
@@ -6,11 +6,32 @@
 
 #include "client.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
 
 /*
  * client::client
  */
-client::client(_In_ const sockaddr_storage& address) : _address(address) {
+client::client(_In_ const sockaddr_storage& address,
+        _In_ const std::uint32_t version,
+        _In_ const mmp_capabilities capabilities,
+        _In_ const RECT& region,
+        _In_ const std::uint32_t rate)
+        : _address(address), _capabilities(capabilities), _inside(true),
+        _pacing(rate), _region(region), _version(version) {
+    // Keep only the parts of the address that identify the peer, exactly like
+    // a client replicated from the primary, such that a client is the same no
+    // matter how the server learnt about it.
+    const auto packed = this->pack();
+    const visus::mmp::wire::view<mmp_msg_replica_client> view(
+        reinterpret_cast<const char *>(&packed), sizeof(packed));
+    if (!client::unpack(this->_address, view)) {
+        this->_address = address;
+    }
+
     this->update();
 }
 
@@ -41,6 +62,105 @@ client::time_point client::last_update(void) const noexcept {
 }
 
 
+/*
+ * client::pack
+ */
+mmp_msg_replica_client client::pack(void) const noexcept {
+    mmp_msg_replica_client retval;
+    retval.version = ::htonl(this->_version);
+    retval.capabilities = ::htonl(this->_capabilities);
+    retval.left = static_cast<std::int32_t>(::htonl(this->_region.left));
+    retval.top = static_cast<std::int32_t>(::htonl(this->_region.top));
+    retval.width = ::htonl(this->_region.right - this->_region.left);
+    retval.height = ::htonl(this->_region.bottom - this->_region.top);
+    retval.rate = ::htonl(this->_pacing.rate());
+
+    switch (this->_address.ss_family) {
+        case AF_INET: {
+            auto& a = reinterpret_cast<const sockaddr_in&>(this->_address);
+            retval.family = ::htons(4);
+            retval.port = a.sin_port;
+            ::memcpy(retval.address, &a.sin_addr, sizeof(a.sin_addr));
+            } break;
+
+        case AF_INET6: {
+            auto& a = reinterpret_cast<const sockaddr_in6&>(this->_address);
+            retval.family = ::htons(6);
+            retval.port = a.sin6_port;
+            retval.scope_id = ::htonl(a.sin6_scope_id);
+            ::memcpy(retval.address, &a.sin6_addr, sizeof(a.sin6_addr));
+            } break;
+    }
+
+    return retval;
+}
+
+
+/*
+ * client::sees
+ */
+bool client::sees(_In_ const POINT position) const noexcept {
+    if (::IsRectEmpty(&this->_region)) {
+        return true;
+    }
+
+    // The first move outside the region is sent as well, because the client
+    // would otherwise not learn that the mouse has left.
+    const auto inside = (::PtInRect(&this->_region, position) != FALSE);
+    const auto retval = inside || this->_inside;
+    this->_inside = inside;
+    return retval;
+}
+
+
+/*
+ * client::unpack
+ */
+bool client::unpack(_Out_ sockaddr_storage& dst,
+        _In_ const visus::mmp::wire::view<mmp_msg_replica_client>& src)
+        noexcept {
+    ::ZeroMemory(&dst, sizeof(dst));
+
+    switch (src.family()) {
+        case 4: {
+            auto& a = reinterpret_cast<sockaddr_in&>(dst);
+            a.sin_family = AF_INET;
+            a.sin_port = ::htons(src.port());
+            ::memcpy(&a.sin_addr, src.address(), sizeof(a.sin_addr));
+            } return true;
+
+        case 6: {
+            auto& a = reinterpret_cast<sockaddr_in6&>(dst);
+            a.sin6_family = AF_INET6;
+            a.sin6_port = ::htons(src.port());
+            a.sin6_scope_id = src.scope_id();
+            ::memcpy(&a.sin6_addr, src.address(), sizeof(a.sin6_addr));
+            } return true;
+
+        default:
+            return false;
+    }
+}
+
+
+/*
+ * client::unpack_region
+ */
+RECT client::unpack_region(
+        _In_ const visus::mmp::wire::view<mmp_msg_replica_client>& src)
+        noexcept {
+    const auto right = static_cast<std::int64_t>(src.left()) + src.width();
+    const auto bottom = static_cast<std::int64_t>(src.top()) + src.height();
+    const std::int64_t max = (std::numeric_limits<LONG>::max)();
+
+    RECT retval;
+    ::SetRect(&retval, src.left(), src.top(),
+        static_cast<LONG>((std::min)(right, max)),
+        static_cast<LONG>((std::min)(bottom, max)));
+    return retval;
+}
+
+
 /*
  * client::update
  */
@@ -13,8 +13,14 @@
 #include <WinSock2.h>
 #include <ws2ipdef.h>
 
+#include <mmpmsg.h>
+#include <mmpwire.h>
+
 #include <wil/resource.h>
 
+#include "outbox.h"
+#include "pacer.h"
+#include "retransmitter.h"
 #include "settings.h"
 
 
@@ -45,7 +51,21 @@ public:
     /// Initialises a new instance.
     /// </summary>
     /// <param name="address">The address of the client.</param>
-    client(_In_ const sockaddr_storage& address);
+    /// <param name="version">The protocol version the client has announced in
+    /// its connect message.</param>
+    /// <param name="capabilities">The capabilities negotiated with the client,
+    /// i.e. the ones it requested that are also supported by the server.
+    /// </param>
+    /// <param name="region">The region of interest of the client. If this is
+    /// empty, the client receives all moves.</param>
+    /// <param name="rate">The maximum number of moves per second the client
+    /// wants to receive. If this is zero, the client receives all moves.
+    /// </param>
+    client(_In_ const sockaddr_storage& address,
+        _In_ const std::uint32_t version = 0,
+        _In_ const mmp_capabilities capabilities = mmp_capability_none,
+        _In_ const RECT& region = RECT(),
+        _In_ const std::uint32_t rate = 0);
 
     /// <summary>
     /// Gets the address of the client.
@@ -63,6 +83,27 @@ public:
         return (clock::now() - this->last_update());
     }
 
+    /// <summary>
+    /// Gets the datagrams that could not yet be sent to the client, because
+    /// the socket was busy.
+    /// </summary>
+    /// <remarks>
+    /// The backlog is not part of the identity of the client, which is why it
+    /// can be modified while the client is stored in a set.
+    /// </remarks>
+    /// <returns>The outbound queue of the client.</returns>
+    inline outbox& backlog(void) const noexcept {
+        return this->_backlog;
+    }
+
+    /// <summary>
+    /// Gets the capabilities negotiated with the client.
+    /// </summary>
+    /// <returns>The capabilities the server may use for the client.</returns>
+    inline mmp_capabilities capabilities(void) const noexcept {
+        return this->_capabilities;
+    }
+
     /// <summary>
     /// Gets the length of the address in bytes.
     /// </summary>
@@ -75,11 +116,106 @@ public:
     /// <returns></returns>
     time_point last_update(void) const noexcept;
 
+    /// <summary>
+    /// Gets the pacing of the moves sent to the client.
+    /// </summary>
+    /// <remarks>
+    /// The pacing is not part of the identity of the client, which is why it
+    /// can be modified while the client is stored in a set.
+    /// </remarks>
+    /// <returns>The pacing state of the client.</returns>
+    inline pacer& pacing(void) const noexcept {
+        return this->_pacing;
+    }
+
+    /// <summary>
+    /// Packs the identity of the client into the representation that is used
+    /// for replicating it to a standby and for persisting it in the journal.
+    /// </summary>
+    /// <remarks>
+    /// Only the family, the port, the scope and the IP address are retained,
+    /// such that the undefined parts of the address storage never leave the
+    /// server. The region of interest and the current rate are packed as
+    /// well, because a client that has been restored from them keeps its
+    /// capabilities and would otherwise receive every move.
+    /// </remarks>
+    /// <returns>The client in network-byte order.</returns>
+    mmp_msg_replica_client pack(void) const noexcept;
+
+    /// <summary>
+    /// Gets the button events sent to the client that have not yet been
+    /// acknowledged.
+    /// </summary>
+    /// <remarks>
+    /// The pending events are not part of the identity of the client, which
+    /// is why they can be modified while the client is stored in a set.
+    /// </remarks>
+    /// <returns>The retransmission state of the client.</returns>
+    inline retransmitter& pending(void) const noexcept {
+        return this->_pending;
+    }
+
+    /// <summary>
+    /// Gets the region of interest of the client.
+    /// </summary>
+    /// <returns>The region of interest, which is empty if the client wants
+    /// to receive all moves.</returns>
+    inline const RECT& region(void) const noexcept {
+        return this->_region;
+    }
+
+    /// <summary>
+    /// Answer whether a move to the given <paramref name="position"/> must be
+    /// sent to the client, which is the case if the position is within its
+    /// region of interest or if the mouse is just leaving the region.
+    /// </summary>
+    /// <remarks>
+    /// Whether the mouse is in the region is not part of the identity of the
+    /// client, which is why the method can update it while the client is
+    /// stored in a set.
+    /// </remarks>
+    /// <param name="position">The new position of the mouse.</param>
+    /// <returns><see langword="true" /> if the move must be sent,
+    /// <see langword="false" /> if the client is not interested.</returns>
+    bool sees(_In_ const POINT position) const noexcept;
+
+    /// <summary>
+    /// Restores the address of a client packed by <see cref="pack"/>.
+    /// </summary>
+    /// <param name="dst">Receives the address, which is zero except for the
+    /// family, the port, the scope and the IP address.</param>
+    /// <param name="src">A view on the packed client.</param>
+    /// <returns><see langword="true" /> if the address was restored,
+    /// <see langword="false" /> if the family is not supported.</returns>
+    static bool unpack(_Out_ sockaddr_storage& dst,
+        _In_ const visus::mmp::wire::view<mmp_msg_replica_client>& src)
+        noexcept;
+
+    /// <summary>
+    /// Restores the region of interest of a client packed by
+    /// <see cref="pack"/>.
+    /// </summary>
+    /// <param name="src">A view on the packed client.</param>
+    /// <returns>The region of interest, which is clamped such that its right
+    /// and bottom edges cannot overflow.</returns>
+    static RECT unpack_region(
+        _In_ const visus::mmp::wire::view<mmp_msg_replica_client>& src)
+        noexcept;
+
     /// <summary>
     /// Updates the timestamp of when the client was last seen.
     /// </summary>
     void update(void) noexcept;
 
+    /// <summary>
+    /// Gets the protocol version the client has announced.
+    /// </summary>
+    /// <returns>The protocol version of the client, which is zero for clients
+    /// that predate the negotiation.</returns>
+    inline std::uint32_t version(void) const noexcept {
+        return this->_version;
+    }
+
     /// <summary>
     /// Gets a pointer to the address of the client.
     /// </summary>
@@ -93,7 +229,14 @@ private:
     typedef duration::rep timestamp;
 
     sockaddr_storage _address;
+    mutable outbox _backlog;
+    mmp_capabilities _capabilities;
+    mutable bool _inside;
     std::atomic<timestamp> _last_update;
+    mutable pacer _pacing;
+    mutable retransmitter _pending;
+    RECT _region;
+    std::uint32_t _version;
 
     friend struct std::less<client>;
 };
@@ -0,0 +1,216 @@
+﻿// <copyright file="client_journal.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "client_journal.h"
+
+#include <map>
+
+#include <Windows.h>
+
+#include "mmptrace.h"
+
+
+/*
+ * client_journal::compaction_slack
+ */
+constexpr std::size_t client_journal::compaction_slack;
+
+
+/*
+ * client_journal::client_journal
+ */
+client_journal::client_journal(_In_ const std::uint16_t port)
+    : _records(0) {
+    try {
+        this->_path = path(port);
+    } catch (...) {
+        MMP_TRACE(L"Failed to determine the location of the client journal.");
+    }
+}
+
+
+/*
+ * client_journal::add
+ */
+void client_journal::add(_In_ const client& client) noexcept {
+    this->append(operation::add, client);
+}
+
+
+/*
+ * client_journal::compact
+ */
+bool client_journal::compact(_In_ const std::set<client>& clients) noexcept {
+    if (this->_path.empty()
+            || (this->_records <= 2 * clients.size() + compaction_slack)) {
+        return false;
+    }
+
+    try {
+        MMP_TRACE(L"Compacting %u journal records into %u clients.",
+            static_cast<unsigned int>(this->_records),
+            static_cast<unsigned int>(clients.size()));
+        const auto tmp = this->_path + L".tmp";
+
+        {
+            std::ofstream stream(tmp, std::ios::binary | std::ios::trunc);
+            for (auto& c : clients) {
+                const record r { magic, operation::add, c.pack() };
+                stream.write(reinterpret_cast<const char *>(&r), sizeof(r));
+            }
+
+            if (!stream.flush()) {
+                MMP_TRACE(L"Failed to write the compacted client journal.");
+                return false;
+            }
+        }
+
+        // Replace the journal atomically such that a crash during compaction
+        // leaves either the old or the new one.
+        this->_stream.close();
+        if (!::MoveFileExW(tmp.c_str(), this->_path.c_str(),
+                MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+            MMP_TRACE(L"Failed to replace the client journal: %u.",
+                ::GetLastError());
+            return false;
+        }
+
+        this->_records = clients.size();
+        return true;
+    } catch (...) {
+        MMP_TRACE(L"Failed to compact the client journal.");
+        return false;
+    }
+}
+
+
+/*
+ * client_journal::load
+ */
+std::vector<client_journal::entry> client_journal::load(void) noexcept {
+    std::vector<entry> retval;
+
+    if (this->_path.empty()) {
+        return retval;
+    }
+
+    try {
+        std::map<sockaddr_storage, entry> clients;
+        std::ifstream stream(this->_path, std::ios::binary);
+        record r;
+
+        // A truncated record at the end results from a crash while appending,
+        // so we just stop there.
+        while (stream.read(reinterpret_cast<char *>(&r), sizeof(r))) {
+            ++this->_records;
+
+            if (r.magic != magic) {
+                MMP_TRACE(L"Skipping invalid record in the client journal.");
+                continue;
+            }
+
+            const visus::mmp::wire::view<mmp_msg_replica_client> c(
+                reinterpret_cast<const char *>(&r.client), sizeof(r.client));
+            sockaddr_storage address;
+            if (!client::unpack(address, c)) {
+                MMP_TRACE(L"Skipping record with an unsupported address.");
+                continue;
+            }
+
+            switch (r.op) {
+                case operation::add: {
+                    auto& e = clients[address];
+                    e.address = address;
+                    e.capabilities = c.capabilities();
+                    e.rate = c.rate();
+                    e.region = client::unpack_region(c);
+                    e.version = c.version();
+                    } break;
+
+                case operation::remove:
+                    clients.erase(address);
+                    break;
+            }
+        }
+
+        retval.reserve(clients.size());
+        for (auto& c : clients) {
+            retval.push_back(c.second);
+        }
+
+        MMP_TRACE(L"Restored %u clients from %u journal records.",
+            static_cast<unsigned int>(retval.size()),
+            static_cast<unsigned int>(this->_records));
+    } catch (...) {
+        MMP_TRACE(L"Failed to read the client journal.");
+        retval.clear();
+    }
+
+    return retval;
+}
+
+
+/*
+ * client_journal::remove
+ */
+void client_journal::remove(_In_ const client& client) noexcept {
+    this->append(operation::remove, client);
+}
+
+
+/*
+ * client_journal::path
+ */
+std::wstring client_journal::path(_In_ const std::uint16_t port) {
+    std::wstring retval(MAX_PATH, L'\0');
+    auto len = ::GetEnvironmentVariableW(L"LOCALAPPDATA", &retval[0],
+        static_cast<DWORD>(retval.size()));
+    if (len > retval.size()) {
+        retval.resize(len);
+        len = ::GetEnvironmentVariableW(L"LOCALAPPDATA", &retval[0],
+            static_cast<DWORD>(retval.size()));
+    }
+    if ((len == 0) || (len > retval.size())) {
+        return std::wstring();
+    }
+
+    retval.resize(len);
+    retval += L"\\Magic Mouse Pad";
+
+    // Note: this fails if the directory already exists, which is fine.
+    ::CreateDirectoryW(retval.c_str(), nullptr);
+
+    // Note: the extension differs from the one of the raw layout used by
+    // earlier versions, which is therefore never misread.
+    retval += L"\\clients-" + std::to_wstring(port) + L".journal";
+    return retval;
+}
+
+
+/*
+ * client_journal::append
+ */
+void client_journal::append(_In_ const operation op,
+        _In_ const client& client) noexcept {
+    if (this->_path.empty()) {
+        return;
+    }
+
+    try {
+        if (!this->_stream.is_open()) {
+            this->_stream.open(this->_path, std::ios::binary | std::ios::app);
+        }
+
+        const record r { magic, op, client.pack() };
+
+        // Flush every record such that it survives a crash of the server.
+        this->_stream.write(reinterpret_cast<const char *>(&r), sizeof(r));
+        this->_stream.flush();
+        ++this->_records;
+    } catch (...) {
+        MMP_TRACE(L"Failed to append to the client journal.");
+    }
+}
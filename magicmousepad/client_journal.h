@@ -0,0 +1,135 @@
+﻿// <copyright file="client_journal.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <cinttypes>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <WinSock2.h>
+#include <ws2ipdef.h>
+
+#include <mmpmsg.h>
+
+#include "client.h"
+
+
+/// <summary>
+/// Persists the clients registered with the server in an append-only file
+/// such that a restarted server can resume sending to them immediately.
+/// </summary>
+/// <remarks>
+/// <para>There is one file per port in the local application data of the
+/// user. Every connect, every change of the rate and every eviction appends a
+/// record, and the file is rewritten with only the live clients once the
+/// obsolete records outnumber them.</para>
+/// <para>The instance is not thread-safe; the server protects it with its
+/// client lock. All failures to read or write the journal are silently
+/// ignored, because clients can always connect again.</para>
+/// </remarks>
+class client_journal final {
+
+public:
+
+    /// <summary>
+    /// A client restored from the journal.
+    /// </summary>
+    struct entry {
+        sockaddr_storage address;
+        mmp_capabilities capabilities;
+        std::uint32_t rate;
+        RECT region;
+        std::uint32_t version;
+    };
+
+    /// <summary>
+    /// The number of obsolete records that are always tolerated before the
+    /// journal is compacted.
+    /// </summary>
+    static constexpr std::size_t compaction_slack = 64;
+
+    /// <summary>
+    /// Initialises a new instance for the server on the given
+    /// <paramref name="port"/>.
+    /// </summary>
+    /// <param name="port">The port of the server in host-byte order.</param>
+    explicit client_journal(_In_ const std::uint16_t port);
+
+    /// <summary>
+    /// Records that <paramref name="client"/> has connected.
+    /// </summary>
+    void add(_In_ const client& client) noexcept;
+
+    /// <summary>
+    /// Rewrites the journal with the given <paramref name="clients"/> if the
+    /// obsolete records outnumber them by more than
+    /// <see cref="compaction_slack"/>.
+    /// </summary>
+    /// <param name="clients">The clients currently registered.</param>
+    /// <returns><see langword="true" /> if the journal was compacted,
+    /// <see langword="false" /> otherwise.</returns>
+    bool compact(_In_ const std::set<client>& clients) noexcept;
+
+    /// <summary>
+    /// Replays the journal and answer the clients that were registered when
+    /// the previous instance of the server stopped.
+    /// </summary>
+    /// <returns>The clients to be restored.</returns>
+    std::vector<entry> load(void) noexcept;
+
+    /// <summary>
+    /// Records that <paramref name="client"/> has been evicted.
+    /// </summary>
+    void remove(_In_ const client& client) noexcept;
+
+private:
+
+    /// <summary>
+    /// The operations recorded in the journal.
+    /// </summary>
+    enum class operation : std::uint32_t {
+        add = 1,
+        remove = 2
+    };
+
+    /// <summary>
+    /// A single record in the journal file.
+    /// </summary>
+    /// <remarks>
+    /// The client is stored in its packed form rather than as raw address
+    /// storage, because the padding of the latter is undefined.
+    /// </remarks>
+    struct record {
+        std::uint32_t magic;
+        operation op;
+        mmp_msg_replica_client client;
+    };
+
+    /// <summary>
+    /// Identifies a valid record of the current layout.
+    /// </summary>
+    static constexpr std::uint32_t magic = 0x4a4d4d03;
+
+    /// <summary>
+    /// Answer the path of the journal for the given <paramref name="port"/>,
+    /// creating the directory if necessary.
+    /// </summary>
+    /// <returns>The path of the journal, or an empty string if the location
+    /// for application data could not be determined.</returns>
+    static std::wstring path(_In_ const std::uint16_t port);
+
+    /// <summary>
+    /// Appends a record for <paramref name="client"/> to the journal.
+    /// </summary>
+    void append(_In_ const operation op, _In_ const client& client) noexcept;
+
+    std::wstring _path;
+    std::size_t _records;
+    std::ofstream _stream;
+};
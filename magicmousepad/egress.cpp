@@ -0,0 +1,357 @@
+﻿// <copyright file="egress.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "egress.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+
+#include <iphlpapi.h>
+
+#include <wil/result.h>
+
+#include "mmptrace.h"
+
+
+/*
+ * egress::egress
+ */
+egress::egress(void) noexcept : _socket(INVALID_SOCKET) { }
+
+
+/*
+ * egress::commit
+ */
+void egress::commit(
+        _Inout_ std::vector<std::pair<sockaddr_storage, int>>& outcomes)
+        noexcept {
+    this->_fallback.commit();
+    this->_fallback.collect(outcomes);
+    for (auto& r : this->_routes) {
+        r.batch->commit();
+        r.batch->collect(outcomes);
+    }
+}
+
+
+/*
+ * egress::open
+ */
+int egress::open(_In_ const SOCKET fallback,
+        _In_ const sockaddr *address) noexcept {
+    const auto retval = this->_fallback.open(fallback);
+    this->_routes.clear();
+    this->_socket = fallback;
+
+    // A server bound to a specific address has been told which interface to
+    // use, so it must not send from the others.
+    if (!egress::wildcard(address)) {
+        return retval;
+    }
+
+    const auto family = address->sa_family;
+    const auto port = ::ntohs((family == AF_INET6)
+        ? reinterpret_cast<const sockaddr_in6 *>(address)->sin6_port
+        : reinterpret_cast<const sockaddr_in *>(address)->sin_port);
+
+    try {
+        for (auto& r : egress::interfaces(family)) {
+            const auto status = egress::create(r, port);
+            if (status != 0) {
+                MMP_TRACE(L"Failed to open a socket for interface %u: %d.",
+                    r.index, status);
+                continue;
+            }
+
+            this->_routes.push_back(std::move(r));
+        }
+    } catch (const std::exception& e) {
+        MMP_TRACE(L"Failed to enumerate the network interfaces: %hs",
+            e.what());
+        this->_routes.clear();
+    }
+
+    if (this->_routes.size() < 2) {
+        // The routing table already picks the only interface there is.
+        this->_routes.clear();
+
+    } else {
+        MMP_TRACE(L"Routing clients through %u network interfaces.",
+            static_cast<unsigned int>(this->_routes.size()));
+        std::stable_sort(this->_routes.begin(), this->_routes.end(),
+            [](const route& l, const route& r) {
+                return (l.prefix > r.prefix);
+            });
+    }
+
+    return retval;
+}
+
+
+/*
+ * egress::send
+ */
+int egress::send(_In_ const client& client,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept {
+    auto route = this->find(client.address());
+    auto& batch = (route != nullptr) ? *route->batch : this->_fallback;
+    return batch.send(client, client.address_length(), data, size);
+}
+
+
+/*
+ * egress::socket
+ */
+SOCKET egress::socket(_In_ const sockaddr_storage& peer) const noexcept {
+    auto route = this->find(peer);
+    return (route != nullptr) ? route->socket.get() : this->_socket;
+}
+
+
+/*
+ * egress::sockets
+ */
+std::vector<SOCKET> egress::sockets(void) const {
+    std::vector<SOCKET> retval;
+    retval.reserve(this->_routes.size());
+    for (auto& r : this->_routes) {
+        retval.push_back(r.socket.get());
+    }
+    return retval;
+}
+
+
+/*
+ * egress::create
+ */
+int egress::create(_Inout_ route& route, _In_ const std::uint16_t port) {
+    const auto family = route.address.ss_family;
+
+    // Registered I/O allows for batching, but it is not available on all
+    // systems.
+    route.socket.reset(::WSASocket(family,
+        SOCK_DGRAM,
+        IPPROTO_UDP,
+        nullptr,
+        0,
+        WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO));
+    if (!route.socket) {
+        route.socket.reset(::WSASocket(family,
+            SOCK_DGRAM,
+            IPPROTO_UDP,
+            nullptr,
+            0,
+            WSA_FLAG_OVERLAPPED));
+    }
+    if (!route.socket) {
+        return ::WSAGetLastError();
+    }
+
+    int len = 0;
+    switch (family) {
+        case AF_INET: {
+            auto& a = reinterpret_cast<sockaddr_in&>(route.address);
+            a.sin_port = ::htons(port);
+            len = sizeof(a);
+            } break;
+
+        case AF_INET6: {
+            auto& a = reinterpret_cast<sockaddr_in6&>(route.address);
+            a.sin6_port = ::htons(port);
+            len = sizeof(a);
+            } break;
+    }
+
+    if (::bind(route.socket.get(),
+            reinterpret_cast<const sockaddr *>(&route.address),
+            len) == SOCKET_ERROR) {
+        return ::WSAGetLastError();
+    }
+
+    {
+        u_long nonblocking = 1;
+        if (::ioctlsocket(route.socket.get(), FIONBIO, &nonblocking)
+                == SOCKET_ERROR) {
+            return ::WSAGetLastError();
+        }
+    }
+
+    // Binding to the address of the interface only selects the source
+    // address, but the weak host model might still send through another
+    // interface, which is why the interface is pinned as well. Note that
+    // IPv4 expects the index in network-byte order.
+    {
+        const auto level = (family == AF_INET6) ? IPPROTO_IPV6 : IPPROTO_IP;
+        const auto option = (family == AF_INET6)
+            ? IPV6_UNICAST_IF
+            : IP_UNICAST_IF;
+        const DWORD index = (family == AF_INET6)
+            ? route.index
+            : ::htonl(route.index);
+        if (::setsockopt(route.socket.get(),
+                level,
+                option,
+                reinterpret_cast<const char *>(&index),
+                sizeof(index)) == SOCKET_ERROR) {
+            MMP_TRACE(L"Failed to pin socket to interface %u: %d.",
+                route.index, ::WSAGetLastError());
+        }
+    }
+
+    route.batch = std::make_unique<fanout>();
+    route.batch->open(route.socket.get());
+
+    return 0;
+}
+
+
+/*
+ * egress::interfaces
+ */
+std::vector<egress::route> egress::interfaces(_In_ const int family) {
+    std::vector<route> retval;
+
+    const auto flags = GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST
+        | GAA_FLAG_SKIP_DNS_SERVER;
+    ULONG len = 0;
+
+    {
+        auto status = ::GetAdaptersAddresses(family, flags, nullptr, nullptr,
+            &len);
+        THROW_WIN32_IF(status, status != ERROR_BUFFER_OVERFLOW);
+    }
+
+    std::vector<BYTE> buffer(len);
+    auto adapters = reinterpret_cast<IP_ADAPTER_ADDRESSES *>(buffer.data());
+
+    THROW_IF_WIN32_ERROR(::GetAdaptersAddresses(family, flags, nullptr,
+        adapters, &len));
+
+    for (auto adapter = adapters;
+            adapter != nullptr;
+            adapter = adapter->Next) {
+        if ((adapter->OperStatus != IfOperStatusUp)
+                || (adapter->IfType == IF_TYPE_SOFTWARE_LOOPBACK)) {
+            continue;
+        }
+
+        for (auto address = adapter->FirstUnicastAddress;
+                address != nullptr;
+                address = address->Next) {
+            auto a = address->Address.lpSockaddr;
+            if ((a == nullptr) || (a->sa_family != family)) {
+                continue;
+            }
+
+            // Link-local prefixes are the same on all interfaces, so they
+            // cannot tell the interfaces apart.
+            if ((family == AF_INET6) && IN6_IS_ADDR_LINKLOCAL(
+                    &reinterpret_cast<sockaddr_in6 *>(a)->sin6_addr)) {
+                continue;
+            }
+
+            retval.emplace_back();
+            auto& r = retval.back();
+            ::memset(&r.address, 0, sizeof(r.address));
+            ::memcpy(&r.address, a, address->Address.iSockaddrLength);
+            r.index = (family == AF_INET6)
+                ? adapter->Ipv6IfIndex
+                : adapter->IfIndex;
+            r.prefix = address->OnLinkPrefixLength;
+        }
+    }
+
+    return retval;
+}
+
+
+/*
+ * egress::matches
+ */
+bool egress::matches(_In_ const route& route,
+        _In_ const sockaddr_storage& peer) noexcept {
+    if (route.address.ss_family != peer.ss_family) {
+        return false;
+    }
+
+    const std::uint8_t *l = nullptr;
+    const std::uint8_t *r = nullptr;
+    std::size_t len = 0;
+
+    switch (peer.ss_family) {
+        case AF_INET: {
+            auto& a = reinterpret_cast<const sockaddr_in&>(route.address);
+            auto& p = reinterpret_cast<const sockaddr_in&>(peer);
+            l = reinterpret_cast<const std::uint8_t *>(&a.sin_addr);
+            r = reinterpret_cast<const std::uint8_t *>(&p.sin_addr);
+            len = sizeof(a.sin_addr);
+            } break;
+
+        case AF_INET6: {
+            auto& a = reinterpret_cast<const sockaddr_in6&>(route.address);
+            auto& p = reinterpret_cast<const sockaddr_in6&>(peer);
+            l = reinterpret_cast<const std::uint8_t *>(&a.sin6_addr);
+            r = reinterpret_cast<const std::uint8_t *>(&p.sin6_addr);
+            len = sizeof(a.sin6_addr);
+            } break;
+
+        default:
+            return false;
+    }
+
+    std::size_t bits = route.prefix;
+    for (std::size_t i = 0; (i < len) && (bits > 0); ++i) {
+        const auto mask = (bits >= 8)
+            ? static_cast<std::uint8_t>(0xff)
+            : static_cast<std::uint8_t>(0xff << (8 - bits));
+        if (((l[i] ^ r[i]) & mask) != 0) {
+            return false;
+        }
+
+        bits = (bits >= 8) ? bits - 8 : 0;
+    }
+
+    return true;
+}
+
+
+/*
+ * egress::wildcard
+ */
+bool egress::wildcard(_In_ const sockaddr *address) noexcept {
+    switch (address->sa_family) {
+        case AF_INET:
+            return (reinterpret_cast<const sockaddr_in *>(address)
+                ->sin_addr.s_addr == INADDR_ANY);
+
+        case AF_INET6:
+            return (IN6_IS_ADDR_UNSPECIFIED(
+                &reinterpret_cast<const sockaddr_in6 *>(address)->sin6_addr)
+                != FALSE);
+
+        default:
+            return false;
+    }
+}
+
+
+/*
+ * egress::find
+ */
+const egress::route *egress::find(
+        _In_ const sockaddr_storage& peer) const noexcept {
+    // Note: the routes are ordered by descending prefix length, so the first
+    // match is the longest one.
+    for (auto& r : this->_routes) {
+        if (egress::matches(r, peer)) {
+            return &r;
+        }
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,155 @@
+﻿// <copyright file="egress.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <cinttypes>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <WinSock2.h>
+#include <ws2ipdef.h>
+
+#include <wil/resource.h>
+
+#include "client.h"
+#include "fanout.h"
+
+
+/// <summary>
+/// Sends datagrams to each client through the local interface on its subnet
+/// if the host has several network interfaces.
+/// </summary>
+/// <remarks>
+/// <para>There is a socket bound to the address of each interface that is up,
+/// which is pinned to the interface using <c>IP_UNICAST_IF</c> such that the
+/// traffic stays on the network the client is on, and each of the sockets
+/// batches its sends using its own <see cref="fanout"/>. A client is routed
+/// through the interface whose on-link prefix matches its address the
+/// longest. Clients that are not on any of the subnets, e.g. those on the
+/// loopback interface or behind a router, use the fallback socket, which is
+/// the one of the server. If there is only a single interface, or if the
+/// server is bound to a specific address rather than the wildcard, all
+/// datagrams go through the fallback socket.</para>
+/// <para>The instance is not thread-safe, but the sockets do not change
+/// after <see cref="open"/>.</para>
+/// </remarks>
+class egress final {
+
+public:
+
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    egress(void) noexcept;
+
+    egress(const egress&) = delete;
+
+    /// <summary>
+    /// Hands all sends deferred since the last call to the kernel.
+    /// </summary>
+    /// <param name="outcomes">Receives the outcomes collected by the batches
+    /// of all sockets.</param>
+    void commit(
+        _Inout_ std::vector<std::pair<sockaddr_storage, int>>& outcomes)
+        noexcept;
+
+    /// <summary>
+    /// Starts sending via <paramref name="fallback"/> and, if it is bound to
+    /// the wildcard address, creates the sockets for all interfaces of its
+    /// family.
+    /// </summary>
+    /// <param name="fallback">The socket of the server, which remains owned
+    /// by the caller.</param>
+    /// <param name="address">The address <paramref name="fallback"/> is
+    /// bound to. The sockets of the interfaces are bound to its port, so
+    /// they receive the datagrams sent to the address of their interface,
+    /// and the caller must read from <see cref="sockets"/> as well.</param>
+    /// <returns>Zero if the datagrams sent via the fallback socket are
+    /// batched, a system error code if they are sent one by one.</returns>
+    int open(_In_ const SOCKET fallback,
+        _In_ const sockaddr *address) noexcept;
+
+    /// <summary>
+    /// Sends <paramref name="data"/> to <paramref name="client"/> through
+    /// the interface on its subnet with the next <see cref="commit"/>.
+    /// </summary>
+    /// <returns>Zero in case of success, the socket error otherwise.</returns>
+    int send(_In_ const client& client,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept;
+
+    /// <summary>
+    /// Answer the socket to respond to <paramref name="peer"/> with.
+    /// </summary>
+    SOCKET socket(_In_ const sockaddr_storage& peer) const noexcept;
+
+    /// <summary>
+    /// Answer the sockets of the interfaces, not including the fallback
+    /// socket.
+    /// </summary>
+    std::vector<SOCKET> sockets(void) const;
+
+    egress& operator =(const egress&) = delete;
+
+private:
+
+    /// <summary>
+    /// A local interface along with the socket bound to its address.
+    /// </summary>
+    struct route {
+        sockaddr_storage address;
+        std::unique_ptr<fanout> batch;
+        ULONG index;
+        std::uint8_t prefix;
+
+        // Note: the socket must be declared after the batch, because it must
+        // be closed before the batch is destroyed.
+        wil::unique_socket socket;
+    };
+
+    /// <summary>
+    /// Creates the socket for <paramref name="route"/> and binds it to the
+    /// address of the interface and the given <paramref name="port"/>.
+    /// </summary>
+    /// <returns>Zero in case of success, the socket error otherwise.</returns>
+    static int create(_Inout_ route& route, _In_ const std::uint16_t port);
+
+    /// <summary>
+    /// Enumerates the unicast addresses of all interfaces of the given
+    /// <paramref name="family"/> that are up, except for loopback and
+    /// link-local ones.
+    /// </summary>
+    /// <exception cref="wil::ResultException">If the interfaces could not
+    /// be enumerated.</exception>
+    static std::vector<route> interfaces(_In_ const int family);
+
+    /// <summary>
+    /// Answer whether <paramref name="peer"/> is on the subnet of
+    /// <paramref name="route"/>.
+    /// </summary>
+    static bool matches(_In_ const route& route,
+        _In_ const sockaddr_storage& peer) noexcept;
+
+    /// <summary>
+    /// Answer whether <paramref name="address"/> is the wildcard address of
+    /// its family.
+    /// </summary>
+    static bool wildcard(_In_ const sockaddr *address) noexcept;
+
+    /// <summary>
+    /// Answer the route with the longest prefix matching
+    /// <paramref name="peer"/>.
+    /// </summary>
+    /// <returns>The route, or <see langword="nullptr" /> if the fallback
+    /// socket must be used.</returns>
+    const route *find(_In_ const sockaddr_storage& peer) const noexcept;
+
+    fanout _fallback;
+    std::vector<route> _routes;
+    SOCKET _socket;
+};
@@ -0,0 +1,328 @@
+﻿// <copyright file="fanout.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "fanout.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+
+/*
+ * fanout::capacity
+ */
+constexpr std::size_t fanout::capacity;
+
+
+/*
+ * fanout::max_datagram
+ */
+constexpr std::size_t fanout::max_datagram;
+
+
+/*
+ * fanout::max_datagrams
+ */
+constexpr std::size_t fanout::max_datagrams;
+
+
+/*
+ * fanout::fanout
+ */
+fanout::fanout(void) noexcept
+    : _address_buffer(RIO_INVALID_BUFFERID),
+    _completions(RIO_INVALID_CQ),
+    _data_buffer(RIO_INVALID_BUFFERID),
+    _deferred(false),
+    _failures(0),
+    _queue(RIO_INVALID_RQ),
+    _rio({ 0 }),
+    _socket(INVALID_SOCKET) { }
+
+
+/*
+ * fanout::~fanout
+ */
+fanout::~fanout(void) noexcept {
+    // Note: the request queue is freed along with the socket.
+    if (this->_address_buffer != RIO_INVALID_BUFFERID) {
+        this->_rio.RIODeregisterBuffer(this->_address_buffer);
+    }
+    if (this->_data_buffer != RIO_INVALID_BUFFERID) {
+        this->_rio.RIODeregisterBuffer(this->_data_buffer);
+    }
+    if (this->_completions != RIO_INVALID_CQ) {
+        this->_rio.RIOCloseCompletionQueue(this->_completions);
+    }
+}
+
+
+/*
+ * fanout::collect
+ */
+void fanout::collect(
+        _Inout_ std::vector<std::pair<sockaddr_storage, int>>& outcomes)
+        noexcept {
+    try {
+        outcomes.insert(outcomes.end(), this->_outcomes.begin(),
+            this->_outcomes.end());
+    } catch (...) {
+        // A recipient that keeps failing is reported again later.
+    }
+
+    this->_outcomes.clear();
+}
+
+
+/*
+ * fanout::commit
+ */
+void fanout::commit(void) noexcept {
+    if (this->_deferred) {
+        this->_rio.RIOSendEx(this->_queue,
+            nullptr, 0,
+            nullptr,
+            nullptr,
+            nullptr,
+            nullptr,
+            RIO_MSG_COMMIT_ONLY,
+            nullptr);
+        this->_deferred = false;
+    }
+
+    if (this->batched()) {
+        this->reap();
+    }
+}
+
+
+/*
+ * fanout::open
+ */
+int fanout::open(_In_ const SOCKET socket) noexcept {
+    this->_socket = socket;
+
+    {
+        GUID id = WSAID_MULTIPLE_RIO;
+        DWORD cnt = 0;
+        this->_rio.cbSize = sizeof(this->_rio);
+        if (::WSAIoctl(socket,
+                SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER,
+                &id, sizeof(id),
+                &this->_rio, sizeof(this->_rio),
+                &cnt,
+                nullptr,
+                nullptr) == SOCKET_ERROR) {
+            return ::WSAGetLastError();
+        }
+    }
+
+    try {
+        this->_addresses.resize(capacity);
+        this->_buffers.resize(max_datagrams);
+        this->_data.resize(max_datagrams * max_datagram);
+        this->_failing.reserve(capacity);
+        this->_free.reserve(capacity);
+        this->_outcomes.reserve(capacity);
+    } catch (...) {
+        return ERROR_OUTOFMEMORY;
+    }
+
+    this->_address_buffer = this->_rio.RIORegisterBuffer(
+        reinterpret_cast<PCHAR>(this->_addresses.data()),
+        static_cast<DWORD>(this->_addresses.size() * sizeof(SOCKADDR_INET)));
+    if (this->_address_buffer == RIO_INVALID_BUFFERID) {
+        return ::WSAGetLastError();
+    }
+
+    this->_data_buffer = this->_rio.RIORegisterBuffer(this->_data.data(),
+        static_cast<DWORD>(this->_data.size()));
+    if (this->_data_buffer == RIO_INVALID_BUFFERID) {
+        return ::WSAGetLastError();
+    }
+
+    // The completion queue must hold all sends in flight plus the single
+    // receive the request queue requires, which is never posted.
+    this->_completions = this->_rio.RIOCreateCompletionQueue(
+        static_cast<DWORD>(capacity + 1), nullptr);
+    if (this->_completions == RIO_INVALID_CQ) {
+        return ::WSAGetLastError();
+    }
+
+    // This fails unless the socket was created for registered I/O.
+    this->_queue = this->_rio.RIOCreateRequestQueue(socket,
+        1, 1,
+        static_cast<ULONG>(capacity), 1,
+        this->_completions,
+        this->_completions,
+        nullptr);
+    if (this->_queue == RIO_INVALID_RQ) {
+        return ::WSAGetLastError();
+    }
+
+    for (std::uint32_t i = 0; i < capacity; ++i) {
+        this->_free.push_back(i);
+    }
+
+    return 0;
+}
+
+
+/*
+ * fanout::send
+ */
+int fanout::send(_In_reads_bytes_(address_length) const sockaddr *address,
+        _In_ const int address_length,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept {
+    if (!this->batched()
+            || (size > static_cast<int>(max_datagram))
+            || (address_length > static_cast<int>(sizeof(SOCKADDR_INET)))) {
+        this->commit();
+        return (::sendto(this->_socket,
+            data, size,
+            0,
+            address, address_length) == SOCKET_ERROR)
+            ? ::WSAGetLastError()
+            : 0;
+    }
+
+    if (this->_free.empty()) {
+        this->reap();
+        if (this->_free.empty()) {
+            return WSAENOBUFS;
+        }
+    }
+
+    // Reuse the buffer of an identical datagram, which is typically the
+    // same event sent to the previous client, or find an unused one.
+    auto matches = [this, data, size](const buffer& b) {
+        const auto i = &b - this->_buffers.data();
+        return (b.length == size) && (::memcmp(data,
+            this->_data.data() + i * max_datagram, size) == 0);
+    };
+    auto unused = [](const buffer& b) { return (b.references == 0); };
+
+    auto b = std::find_if(this->_buffers.begin(), this->_buffers.end(),
+        matches);
+    if (b == this->_buffers.end()) {
+        b = std::find_if(this->_buffers.begin(), this->_buffers.end(), unused);
+        if (b == this->_buffers.end()) {
+            this->reap();
+            b = std::find_if(this->_buffers.begin(), this->_buffers.end(),
+                unused);
+        }
+        if (b == this->_buffers.end()) {
+            return WSAENOBUFS;
+        }
+
+        const auto i = b - this->_buffers.begin();
+        ::memcpy(this->_data.data() + i * max_datagram, data, size);
+        b->length = size;
+    }
+
+    const auto i = static_cast<std::uint32_t>(b - this->_buffers.begin());
+    const auto a = this->_free.back();
+    ::memset(&this->_addresses[a], 0, sizeof(SOCKADDR_INET));
+    ::memcpy(&this->_addresses[a], address, address_length);
+
+    RIO_BUF payload;
+    payload.BufferId = this->_data_buffer;
+    payload.Offset = static_cast<ULONG>(i * max_datagram);
+    payload.Length = static_cast<ULONG>(size);
+
+    RIO_BUF remote;
+    remote.BufferId = this->_address_buffer;
+    remote.Offset = static_cast<ULONG>(a * sizeof(SOCKADDR_INET));
+    remote.Length = static_cast<ULONG>(sizeof(SOCKADDR_INET));
+
+    // The request context identifies the buffers to be released once the
+    // send has completed.
+    const auto context = (static_cast<ULONG_PTR>(i) << 16) | a;
+    if (!this->_rio.RIOSendEx(this->_queue,
+            &payload, 1,
+            nullptr,
+            &remote,
+            nullptr,
+            nullptr,
+            RIO_MSG_DEFER | RIO_MSG_DONT_NOTIFY,
+            reinterpret_cast<PVOID>(context))) {
+        return ::WSAGetLastError();
+    }
+
+    this->_free.pop_back();
+    ++b->references;
+    this->_deferred = true;
+    return 0;
+}
+
+
+/*
+ * fanout::reap
+ */
+void fanout::reap(void) noexcept {
+    std::array<RIORESULT, 64> results;
+
+    while (true) {
+        const auto cnt = this->_rio.RIODequeueCompletion(this->_completions,
+            results.data(), static_cast<ULONG>(results.size()));
+        if ((cnt == 0) || (cnt == RIO_CORRUPT_CQ)) {
+            break;
+        }
+
+        for (ULONG i = 0; i < cnt; ++i) {
+            // The address of the recipient remains in its slot until the slot
+            // is released.
+            const auto context = static_cast<ULONG_PTR>(
+                results[i].RequestContext);
+            const auto a = static_cast<std::uint32_t>(context & 0xFFFF);
+            this->report(this->_addresses[a], results[i].Status);
+            --this->_buffers[context >> 16].references;
+            this->_free.push_back(a);
+        }
+    }
+}
+
+
+/*
+ * fanout::report
+ */
+void fanout::report(_In_ const SOCKADDR_INET& peer,
+        _In_ const int error) noexcept {
+    auto it = std::find_if(this->_failing.begin(), this->_failing.end(),
+        [&peer](const SOCKADDR_INET& f) {
+            return (::memcmp(&f, &peer, sizeof(f)) == 0);
+        });
+
+    if (error == 0) {
+        // As long as no send has failed, this is all a success costs. If the
+        // recovery cannot be reported now, it is with the next success.
+        if ((it == this->_failing.end())
+                || (this->_outcomes.size() >= this->_outcomes.capacity())) {
+            return;
+        }
+
+        this->_failing.erase(it);
+
+    } else {
+        ++this->_failures;
+
+        if ((it == this->_failing.end())
+                && (this->_failing.size() < this->_failing.capacity())) {
+            this->_failing.push_back(peer);
+        }
+
+        if (this->_outcomes.size() >= this->_outcomes.capacity()) {
+            return;
+        }
+    }
+
+    // Note: the storage is reserved such that this cannot throw.
+    this->_outcomes.emplace_back();
+    auto& o = this->_outcomes.back();
+    ::memcpy(&o.first, &peer, sizeof(peer));
+    o.second = error;
+}
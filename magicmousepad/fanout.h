@@ -0,0 +1,172 @@
+﻿// <copyright file="fanout.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <cinttypes>
+#include <utility>
+#include <vector>
+
+#include <WinSock2.h>
+#include <MSWSock.h>
+#include <ws2ipdef.h>
+
+
+/// <summary>
+/// Sends datagrams to many clients in a single kernel call using registered
+/// I/O on a UDP socket.
+/// </summary>
+/// <remarks>
+/// <para>Every <see cref="send"/> is deferred until the next
+/// <see cref="commit"/>, which hands all of them to the kernel at once. The
+/// datagrams and the addresses are copied to buffers that are registered
+/// with the kernel once such that they need not be probed and locked for
+/// every send. Identical datagrams share a buffer, so an event sent to all
+/// clients is copied only once.</para>
+/// <para>If the socket has not been created with
+/// <c>WSA_FLAG_REGISTERED_IO</c> or the system does not support registered
+/// I/O, the datagrams are sent immediately using <c>sendto</c>.</para>
+/// <para>As the kernel reports failures of batched sends only after the
+/// commit, the instance remembers the recipients of failed sends until
+/// <see cref="collect"/> hands them to the owner of the clients.</para>
+/// <para>The instance is not thread-safe; the server protects it with its
+/// client lock.</para>
+/// </remarks>
+class fanout final {
+
+public:
+
+    /// <summary>
+    /// The maximum number of sends that can be in flight.
+    /// </summary>
+    static constexpr std::size_t capacity = 1024;
+
+    /// <summary>
+    /// The size of the largest datagram that is batched. Larger ones are
+    /// sent immediately.
+    /// </summary>
+    static constexpr std::size_t max_datagram = 2048;
+
+    /// <summary>
+    /// The number of distinct datagrams that can be in flight.
+    /// </summary>
+    static constexpr std::size_t max_datagrams = 64;
+
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    fanout(void) noexcept;
+
+    fanout(const fanout&) = delete;
+
+    /// <summary>
+    /// Finalises the instance.
+    /// </summary>
+    /// <remarks>
+    /// The socket must have been closed before, because the completion queue
+    /// must not be destroyed while it is in use.
+    /// </remarks>
+    ~fanout(void) noexcept;
+
+    /// <summary>
+    /// Answer whether the datagrams are batched rather than sent one by one.
+    /// </summary>
+    inline bool batched(void) const noexcept {
+        return (this->_queue != RIO_INVALID_RQ);
+    }
+
+    /// <summary>
+    /// Moves the outcomes of committed sends that have completed since the
+    /// last call to <paramref name="outcomes"/>.
+    /// </summary>
+    /// <remarks>
+    /// Only failed sends are reported, along with the first successful send
+    /// to a recipient after a failure, which tells the caller that the
+    /// recipient has recovered.
+    /// </remarks>
+    /// <param name="outcomes">Receives the address of the recipient and the
+    /// socket error, which is zero if the send succeeded.</param>
+    void collect(_Inout_ std::vector<std::pair<sockaddr_storage, int>>&
+        outcomes) noexcept;
+
+    /// <summary>
+    /// Hands all sends deferred since the last call to the kernel.
+    /// </summary>
+    void commit(void) noexcept;
+
+    /// <summary>
+    /// Answer the number of batched sends that failed after they had been
+    /// committed.
+    /// </summary>
+    inline std::uint64_t failures(void) const noexcept {
+        return this->_failures;
+    }
+
+    /// <summary>
+    /// Starts sending on the given <paramref name="socket"/>.
+    /// </summary>
+    /// <param name="socket">The UDP socket to send on, which remains owned
+    /// by the caller.</param>
+    /// <returns>Zero if the datagrams are batched, a system error code if
+    /// they are sent one by one.</returns>
+    int open(_In_ const SOCKET socket) noexcept;
+
+    /// <summary>
+    /// Sends <paramref name="data"/> to <paramref name="address"/> with the
+    /// next <see cref="commit"/>.
+    /// </summary>
+    /// <remarks>
+    /// Datagrams that are too large to be batched are sent immediately after
+    /// committing the ones deferred before, such that they do not overtake
+    /// them.
+    /// </remarks>
+    /// <param name="address">The address of the recipient.</param>
+    /// <param name="address_length">The length of the address in bytes.
+    /// </param>
+    /// <param name="data">The datagram, which is copied.</param>
+    /// <param name="size">The size of the datagram in bytes.</param>
+    /// <returns>Zero in case of success, the socket error otherwise, which
+    /// is <c>WSAENOBUFS</c> if too many sends are in flight.</returns>
+    int send(_In_reads_bytes_(address_length) const sockaddr *address,
+        _In_ const int address_length,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept;
+
+    fanout& operator =(const fanout&) = delete;
+
+private:
+
+    struct buffer {
+        int length;
+        std::size_t references;
+    };
+
+    /// <summary>
+    /// Releases the buffers of all sends that have completed.
+    /// </summary>
+    void reap(void) noexcept;
+
+    /// <summary>
+    /// Records the outcome of a completed send to <paramref name="peer"/> if
+    /// the owner of the clients must learn about it.
+    /// </summary>
+    void report(_In_ const SOCKADDR_INET& peer, _In_ const int error) noexcept;
+
+    std::vector<SOCKADDR_INET> _addresses;
+    RIO_BUFFERID _address_buffer;
+    std::vector<buffer> _buffers;
+    RIO_CQ _completions;
+    std::vector<char> _data;
+    RIO_BUFFERID _data_buffer;
+    bool _deferred;
+    std::vector<SOCKADDR_INET> _failing;
+    std::uint64_t _failures;
+    std::vector<std::uint32_t> _free;
+    std::vector<std::pair<sockaddr_storage, int>> _outcomes;
+    RIO_RQ _queue;
+    RIO_EXTENSION_FUNCTION_TABLE _rio;
+    SOCKET _socket;
+};
@@ -0,0 +1,99 @@
+﻿// <copyright file="inproc_transport.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "inproc_transport.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+/*
+ * inproc_transport::inproc_transport
+ */
+inproc_transport::inproc_transport(
+        _In_ std::shared_ptr<visus::mmp::inproc::endpoint> endpoint) noexcept
+    : _endpoint(std::move(endpoint)) { }
+
+
+/*
+ * inproc_transport::commit
+ */
+void inproc_transport::commit(
+        _Inout_ std::vector<std::pair<sockaddr_storage, int>>& outcomes)
+        noexcept {
+    // Datagrams are delivered or rejected by the send itself.
+    UNREFERENCED_PARAMETER(outcomes);
+}
+
+
+/*
+ * inproc_transport::fork
+ */
+std::unique_ptr<transport> inproc_transport::fork(void) const {
+    // The sender threads send from the address of the server, which is safe,
+    // because the network synchronises the delivery.
+    return std::make_unique<inproc_transport>(this->_endpoint);
+}
+
+
+/*
+ * inproc_transport::receive
+ */
+int inproc_transport::receive(_Out_writes_bytes_(size) char *buffer,
+        _In_ const int size,
+        _Out_ sockaddr_storage& peer,
+        _In_ const std::chrono::milliseconds timeout) noexcept {
+    visus::mmp::inproc::datagram datagram;
+
+    try {
+        if (!this->_endpoint->receive(datagram, timeout)) {
+            return 0;
+        }
+    } catch (...) {
+        return 0;
+    }
+
+    const auto retval = (std::min)(size,
+        static_cast<int>(datagram.data.size()));
+    std::memcpy(buffer, datagram.data.data(), retval);
+    peer = datagram.peer;
+    return retval;
+}
+
+
+/*
+ * inproc_transport::send
+ */
+int inproc_transport::send(_In_ const client& client,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept {
+    return this->send(client.address(), data, size);
+}
+
+
+/*
+ * inproc_transport::send
+ */
+int inproc_transport::send(_In_ const sockaddr_storage& peer,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept {
+    using visus::mmp::inproc::delivery;
+
+    try {
+        switch (this->_endpoint->send(peer, data, size)) {
+            case delivery::full:
+                return WSAEWOULDBLOCK;
+
+            case delivery::unreachable:
+                return WSAECONNRESET;
+
+            default:
+                return 0;
+        }
+    } catch (...) {
+        return WSAENOBUFS;
+    }
+}
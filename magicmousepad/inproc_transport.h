@@ -0,0 +1,56 @@
+﻿// <copyright file="inproc_transport.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <mmpinproc.h>
+
+#include "transport.h"
+
+
+/// <summary>
+/// The transport exchanging datagrams with clients in the same process
+/// through the memory queues of a <see cref="visus::mmp::inproc::network"/>.
+/// </summary>
+/// <remarks>
+/// A full queue is reported like a busy socket such that the datagram is
+/// queued for the client, whereas a client that has gone away is evicted
+/// like one whose port is unreachable.
+/// </remarks>
+class inproc_transport final : public transport {
+
+public:
+
+    /// <summary>
+    /// Initialises a new instance sending from and receiving at the given
+    /// <paramref name="endpoint"/>.
+    /// </summary>
+    explicit inproc_transport(
+        _In_ std::shared_ptr<visus::mmp::inproc::endpoint> endpoint) noexcept;
+
+    void commit(
+        _Inout_ std::vector<std::pair<sockaddr_storage, int>>& outcomes)
+        noexcept override;
+
+    std::unique_ptr<transport> fork(void) const override;
+
+    int receive(_Out_writes_bytes_(size) char *buffer,
+        _In_ const int size,
+        _Out_ sockaddr_storage& peer,
+        _In_ const std::chrono::milliseconds timeout) noexcept override;
+
+    int send(_In_ const client& client,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept override;
+
+    int send(_In_ const sockaddr_storage& peer,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept override;
+
+private:
+
+    std::shared_ptr<visus::mmp::inproc::endpoint> _endpoint;
+};
@@ -0,0 +1,136 @@
+﻿// <copyright file="outbox.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "outbox.h"
+
+#include <algorithm>
+
+#include <WinSock2.h>
+
+
+/*
+ * outbox::capacity
+ */
+constexpr std::size_t outbox::capacity;
+
+
+/*
+ * outbox::max_stall
+ */
+constexpr std::chrono::milliseconds outbox::max_stall;
+
+
+/*
+ * outbox::retry_interval
+ */
+constexpr std::chrono::milliseconds outbox::retry_interval;
+
+
+/*
+ * outbox::transient
+ */
+bool outbox::transient(_In_ const int error) noexcept {
+    switch (error) {
+        case WSAEHOSTUNREACH:
+        case WSAENETDOWN:
+        case WSAENETUNREACH:
+        case WSAENOBUFS:
+        case WSAEWOULDBLOCK:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+
+/*
+ * outbox::outbox
+ */
+outbox::outbox(void) noexcept : _deferred(0), _dropped(0), _failed(0),
+    _failing((time_point::max)()) { }
+
+
+/*
+ * outbox::backpressure
+ */
+outbox::counters outbox::backpressure(void) const noexcept {
+    counters retval;
+    retval.deferred = this->_deferred;
+    retval.dropped = this->_dropped;
+    retval.failed = this->_failed;
+    retval.queued = this->_entries.size();
+    return retval;
+}
+
+
+/*
+ * outbox::complete
+ */
+bool outbox::complete(_In_ const int error,
+        _In_ const time_point now) noexcept {
+    if (error == 0) {
+        this->_failing = (time_point::max)();
+        return true;
+    }
+
+    ++this->_failed;
+    if (!transient(error)) {
+        return false;
+    }
+
+    if (this->_failing == (time_point::max)()) {
+        this->_failing = now;
+    }
+
+    return (now - this->_failing < max_stall);
+}
+
+
+/*
+ * outbox::push
+ */
+void outbox::push(_In_reads_bytes_(size) const char *data,
+        _In_ const std::size_t size,
+        _In_ const bool move,
+        _In_ const time_point now) {
+    if (this->_entries.empty()) {
+        // The time since the queue started to fill counts as no progress.
+        this->_progress = now;
+        this->_retry = now + retry_interval;
+    }
+
+    ++this->_deferred;
+
+    // Only the most recent position matters, so a move replaces all moves
+    // that have not yet been sent.
+    if (move) {
+        const auto end = std::remove_if(this->_entries.begin(),
+            this->_entries.end(),
+            [](const entry& e) { return e.move; });
+        this->_dropped += std::distance(end, this->_entries.end());
+        this->_entries.erase(end, this->_entries.end());
+    }
+
+    if (this->_entries.size() >= capacity) {
+        // There is at most one move left, which goes first. Otherwise, the
+        // oldest datagram is dropped, and the retransmitter will repeat it if
+        // the client acknowledges buttons.
+        auto it = std::find_if(this->_entries.begin(), this->_entries.end(),
+            [](const entry& e) { return e.move; });
+        if (it == this->_entries.end()) {
+            it = this->_entries.begin();
+        }
+
+        this->_entries.erase(it);
+        ++this->_dropped;
+    }
+
+    this->_entries.emplace_back();
+    auto& e = this->_entries.back();
+    e.data.assign(data, data + size);
+    e.move = move;
+}
@@ -0,0 +1,218 @@
+﻿// <copyright file="outbox.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <chrono>
+#include <cinttypes>
+#include <deque>
+#include <vector>
+
+
+/// <summary>
+/// Holds the datagrams for a single client that could not be sent because
+/// the non-blocking socket of the server was busy.
+/// </summary>
+/// <remarks>
+/// <para>The queue is small, because mouse input becomes useless quickly.
+/// A move supersedes all moves queued before it, and if the queue is full,
+/// moves are dropped before any other datagram. Only if the queue has not
+/// made any progress for <see cref="max_stall"/>, the client should be
+/// evicted. The same holds for datagrams that the socket accepted, but
+/// reported as failed later, which is how batched sends fail.</para>
+/// <para>The instance is not thread-safe; the server protects it with its
+/// client lock.</para>
+/// </remarks>
+class outbox final {
+
+public:
+
+    /// <summary>
+    /// The clock used for the retries.
+    /// </summary>
+    typedef std::chrono::steady_clock clock;
+
+    /// <summary>
+    /// The type used for intervals.
+    /// </summary>
+    typedef clock::duration duration;
+
+    /// <summary>
+    /// The type used for deadlines.
+    /// </summary>
+    typedef clock::time_point time_point;
+
+    /// <summary>
+    /// The backpressure a client has experienced so far.
+    /// </summary>
+    struct counters {
+        /// <summary>
+        /// The number of datagrams that could not be sent immediately.
+        /// </summary>
+        std::uint64_t deferred;
+
+        /// <summary>
+        /// The number of queued datagrams that were superseded or dropped
+        /// because the queue was full.
+        /// </summary>
+        std::uint64_t dropped;
+
+        /// <summary>
+        /// The number of datagrams the socket accepted, but could not
+        /// deliver.
+        /// </summary>
+        std::uint64_t failed;
+
+        /// <summary>
+        /// The number of datagrams currently queued.
+        /// </summary>
+        std::size_t queued;
+    };
+
+    /// <summary>
+    /// The maximum number of datagrams queued.
+    /// </summary>
+    static constexpr std::size_t capacity = 16;
+
+    /// <summary>
+    /// The time without any progress after which the client is considered
+    /// unreachable.
+    /// </summary>
+    static constexpr std::chrono::milliseconds max_stall
+        = std::chrono::milliseconds(2000);
+
+    /// <summary>
+    /// The time between two attempts to send the queued datagrams.
+    /// </summary>
+    static constexpr std::chrono::milliseconds retry_interval
+        = std::chrono::milliseconds(5);
+
+    /// <summary>
+    /// Answer whether the given socket error is expected to go away on its
+    /// own, i.e. whether the datagram should be queued rather than the
+    /// client be evicted.
+    /// </summary>
+    /// <param name="error">The error reported by the socket.</param>
+    /// <returns><see langword="true" /> if the error is transient,
+    /// <see langword="false" /> otherwise.</returns>
+    static bool transient(_In_ const int error) noexcept;
+
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    outbox(void) noexcept;
+
+    /// <summary>
+    /// Answer the backpressure counters.
+    /// </summary>
+    counters backpressure(void) const noexcept;
+
+    /// <summary>
+    /// Records the outcome of a datagram that the socket had accepted and
+    /// reports later.
+    /// </summary>
+    /// <param name="error">The socket error, which is zero if the datagram
+    /// has been sent after previous ones had failed.</param>
+    /// <param name="now">The current time.</param>
+    /// <returns><see langword="true" /> if the client can be kept,
+    /// <see langword="false" /> if it should be evicted, because the error is
+    /// permanent or because its datagrams have been failing for
+    /// <see cref="max_stall"/>.</returns>
+    bool complete(_In_ const int error, _In_ const time_point now) noexcept;
+
+    /// <summary>
+    /// Answer when the queued datagrams should be sent again.
+    /// </summary>
+    /// <returns>The time of the next attempt, or
+    /// <see cref="time_point::max"/> if nothing is queued.</returns>
+    inline time_point deadline(void) const noexcept {
+        return this->_entries.empty() ? (time_point::max)() : this->_retry;
+    }
+
+    /// <summary>
+    /// Answer whether nothing is queued.
+    /// </summary>
+    inline bool empty(void) const noexcept {
+        return this->_entries.empty();
+    }
+
+    /// <summary>
+    /// Sends the queued datagrams in order until the first one fails.
+    /// </summary>
+    /// <typeparam name="TSend">A functor accepting a pointer to the datagram
+    /// and its size in bytes and returning zero in case of success or the
+    /// socket error otherwise.</typeparam>
+    /// <param name="now">The current time.</param>
+    /// <param name="send">The functor sending the datagram.</param>
+    /// <returns>Zero if the queue is empty afterwards, the socket error that
+    /// stopped it otherwise.</returns>
+    template<class TSend>
+    int flush(_In_ const time_point now, _In_ TSend&& send);
+
+    /// <summary>
+    /// Sends a datagram after the ones that are already queued, or queues it
+    /// if the socket is busy.
+    /// </summary>
+    /// <typeparam name="TSend">A functor accepting a pointer to the datagram
+    /// and its size in bytes and returning zero in case of success or the
+    /// socket error otherwise.</typeparam>
+    /// <param name="data">The datagram.</param>
+    /// <param name="size">The size of the datagram in bytes.</param>
+    /// <param name="move">Indicates whether the datagram is a move, which
+    /// supersedes the moves queued before.</param>
+    /// <param name="now">The current time.</param>
+    /// <param name="send">The functor sending the datagram.</param>
+    /// <returns><see langword="true" /> if the datagram was sent or queued,
+    /// <see langword="false" /> if the client should be evicted, because it
+    /// cannot be reached or has not made any progress for
+    /// <see cref="max_stall"/>.</returns>
+    template<class TSend>
+    bool post(_In_reads_bytes_(size) const char *data,
+        _In_ const std::size_t size,
+        _In_ const bool move,
+        _In_ const time_point now,
+        _In_ TSend&& send);
+
+    /// <summary>
+    /// Queues a datagram that could not be sent.
+    /// </summary>
+    /// <param name="data">The datagram.</param>
+    /// <param name="size">The size of the datagram in bytes.</param>
+    /// <param name="move">Indicates whether the datagram is a move, which
+    /// supersedes all moves queued before and which is dropped first if the
+    /// queue is full.</param>
+    /// <param name="now">The current time.</param>
+    void push(_In_reads_bytes_(size) const char *data,
+        _In_ const std::size_t size,
+        _In_ const bool move,
+        _In_ const time_point now);
+
+    /// <summary>
+    /// Answer whether the queue has not made any progress for
+    /// <see cref="max_stall"/>.
+    /// </summary>
+    /// <param name="now">The current time.</param>
+    inline bool stalled(_In_ const time_point now) const noexcept {
+        return !this->_entries.empty() && (now - this->_progress >= max_stall);
+    }
+
+private:
+
+    struct entry {
+        std::vector<char> data;
+        bool move;
+    };
+
+    std::uint64_t _deferred;
+    std::uint64_t _dropped;
+    std::deque<entry> _entries;
+    std::uint64_t _failed;
+    time_point _failing;
+    time_point _progress;
+    time_point _retry;
+};
+
+#include "outbox.inl"
@@ -0,0 +1,53 @@
+﻿// <copyright file="outbox.inl" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+
+/*
+ * outbox::flush
+ */
+template<class TSend>
+int outbox::flush(_In_ const time_point now, _In_ TSend&& send) {
+    while (!this->_entries.empty()) {
+        auto& e = this->_entries.front();
+        const auto retval = send(e.data.data(), e.data.size());
+        if (retval != 0) {
+            this->_retry = now + retry_interval;
+            return retval;
+        }
+
+        this->_entries.pop_front();
+        this->_progress = now;
+    }
+
+    return 0;
+}
+
+
+/*
+ * outbox::post
+ */
+template<class TSend>
+bool outbox::post(_In_reads_bytes_(size) const char *data,
+        _In_ const std::size_t size,
+        _In_ const bool move,
+        _In_ const time_point now,
+        _In_ TSend&& send) {
+    // The new datagram must not overtake the ones that are already queued.
+    auto status = this->flush(now, send);
+    if (status == 0) {
+        status = send(data, size);
+    }
+    if (status == 0) {
+        return true;
+    }
+
+    if (!transient(status)) {
+        return false;
+    }
+
+    this->push(data, size, move, now);
+    return !this->stalled(now);
+}
@@ -0,0 +1,67 @@
+﻿// <copyright file="pacer.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "pacer.h"
+
+#include <algorithm>
+
+
+/*
+ * pacer::pacer
+ */
+pacer::pacer(_In_ const std::uint32_t rate) noexcept
+    : _deferred(false),
+    _interval(duration::zero()),
+    _next(time_point::min()),
+    _rate(0) {
+    this->rate(rate);
+}
+
+
+/*
+ * pacer::admit
+ */
+bool pacer::admit(_In_ const time_point now) noexcept {
+    if (now >= this->_next) {
+        this->_deferred = false;
+        this->_next = now + this->_interval;
+        return true;
+    } else {
+        this->_deferred = true;
+        return false;
+    }
+}
+
+
+/*
+ * pacer::flush
+ */
+bool pacer::flush(_In_ const time_point now) noexcept {
+    if (!this->_deferred || (now < this->_next)) {
+        return false;
+    }
+
+    this->_deferred = false;
+    this->_next = now + this->_interval;
+    return true;
+}
+
+
+/*
+ * pacer::rate
+ */
+void pacer::rate(_In_ const std::uint32_t rate) noexcept {
+    this->_rate = rate;
+    this->_interval = (rate > 0)
+        ? std::chrono::duration_cast<duration>(std::chrono::seconds(1)) / rate
+        : duration::zero();
+
+    // A move that is already waiting is due once the new interval has passed
+    // since the last one, which may be earlier than before.
+    if (this->_next != time_point::min()) {
+        this->_next = (std::min)(this->_next, clock::now() + this->_interval);
+    }
+}
@@ -0,0 +1,105 @@
+﻿// <copyright file="pacer.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <chrono>
+#include <cinttypes>
+
+
+/// <summary>
+/// Limits the moves sent to a single client to the rate the client has
+/// declared and remembers whether a move has been held back.
+/// </summary>
+/// <remarks>
+/// The pacer does not store the moves it holds back, because only the most
+/// recent position matters; the server builds a single move from its current
+/// state once the slot of the client opens. The instance is not thread-safe;
+/// the server protects it with its client lock.
+/// </remarks>
+class pacer final {
+
+public:
+
+    /// <summary>
+    /// The clock used for the slots.
+    /// </summary>
+    typedef std::chrono::steady_clock clock;
+
+    /// <summary>
+    /// The type used for the interval between two moves.
+    /// </summary>
+    typedef clock::duration duration;
+
+    /// <summary>
+    /// The type used for deadlines.
+    /// </summary>
+    typedef clock::time_point time_point;
+
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    /// <param name="rate">The maximum number of moves per second. If this is
+    /// zero, all moves are admitted.</param>
+    explicit pacer(_In_ const std::uint32_t rate = 0) noexcept;
+
+    /// <summary>
+    /// Answer whether a move may be sent at <paramref name="now"/>. If not,
+    /// the move is marked as deferred.
+    /// </summary>
+    /// <param name="now">The current time.</param>
+    /// <returns><see langword="true" /> if the move must be sent now,
+    /// <see langword="false" /> if it has been coalesced.</returns>
+    bool admit(_In_ const time_point now) noexcept;
+
+    /// <summary>
+    /// Answer when the deferred move is due.
+    /// </summary>
+    /// <returns>The time when the slot opens, or
+    /// <see cref="time_point::max"/> if no move has been deferred.</returns>
+    inline time_point deadline(void) const noexcept {
+        return this->_deferred ? this->_next : time_point::max();
+    }
+
+    /// <summary>
+    /// Forgets about the deferred move, because the client has received a
+    /// newer position in another message.
+    /// </summary>
+    inline void discard(void) noexcept {
+        this->_deferred = false;
+    }
+
+    /// <summary>
+    /// Answer whether the deferred move is due at <paramref name="now"/>. If
+    /// so, the slot is consumed and the caller must send the move.
+    /// </summary>
+    /// <param name="now">The current time.</param>
+    /// <returns><see langword="true" /> if the deferred move must be sent,
+    /// <see langword="false" /> otherwise.</returns>
+    bool flush(_In_ const time_point now) noexcept;
+
+    /// <summary>
+    /// Answer the maximum number of moves per second.
+    /// </summary>
+    /// <returns>The rate, which is zero if the rate is unlimited.</returns>
+    inline std::uint32_t rate(void) const noexcept {
+        return this->_rate;
+    }
+
+    /// <summary>
+    /// Changes the maximum number of moves per second.
+    /// </summary>
+    /// <param name="rate">The new rate. If this is zero, all moves are
+    /// admitted from now on.</param>
+    void rate(_In_ const std::uint32_t rate) noexcept;
+
+private:
+
+    bool _deferred;
+    duration _interval;
+    time_point _next;
+    std::uint32_t _rate;
+};
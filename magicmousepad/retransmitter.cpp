@@ -0,0 +1,98 @@
+﻿// <copyright file="retransmitter.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "retransmitter.h"
+
+#include <algorithm>
+
+
+/*
+ * retransmitter::retransmitter
+ */
+retransmitter::retransmitter(void) noexcept
+    : _srtt(duration::zero()),
+    _rttvar(duration::zero()),
+    _timeout(std::chrono::milliseconds(100)) { }
+
+
+/*
+ * retransmitter::acknowledge
+ */
+bool retransmitter::acknowledge(_In_ const mmp_seq_no sequence_number,
+        _In_ const time_point now) {
+    auto it = std::find_if(this->_entries.begin(), this->_entries.end(),
+        [sequence_number](const entry& e) {
+            return (e.sequence_number == sequence_number);
+        });
+    if (it == this->_entries.end()) {
+        return false;
+    }
+
+    // Karn's algorithm: the round-trip time of retransmitted events is
+    // ambiguous, so it must not be used for the estimate.
+    if (it->attempts == 0) {
+        const auto r = now - it->sent;
+
+        if (this->_srtt == duration::zero()) {
+            this->_srtt = r;
+            this->_rttvar = r / 2;
+        } else {
+            const auto d = (this->_srtt > r) ? (this->_srtt - r)
+                : (r - this->_srtt);
+            this->_rttvar = (3 * this->_rttvar + d) / 4;
+            this->_srtt = (7 * this->_srtt + r) / 8;
+        }
+
+        // On a local network, the RFC's minimum of one second is far too
+        // conservative for mouse input, so we clamp to a much tighter range.
+        const duration min_timeout = std::chrono::milliseconds(10);
+        const duration max_timeout = std::chrono::seconds(1);
+        this->_timeout = (std::min)((std::max)(this->_srtt + 4 * this->_rttvar,
+            min_timeout), max_timeout);
+    }
+
+    this->_entries.erase(it);
+    return true;
+}
+
+
+/*
+ * retransmitter::deadline
+ */
+retransmitter::time_point retransmitter::deadline(void) const noexcept {
+    auto retval = (time_point::max)();
+
+    for (auto& e : this->_entries) {
+        if (e.deadline < retval) {
+            retval = e.deadline;
+        }
+    }
+
+    return retval;
+}
+
+
+/*
+ * retransmitter::track
+ */
+void retransmitter::track(_In_ const mmp_seq_no sequence_number,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const std::size_t size,
+        _In_ const time_point now) {
+    if (this->_entries.size() >= capacity) {
+        // The entries are appended in the order they are sent, so the first
+        // one is the oldest.
+        this->_entries.erase(this->_entries.begin());
+    }
+
+    this->_entries.emplace_back();
+    auto& e = this->_entries.back();
+    e.attempts = 0;
+    e.data.assign(data, data + size);
+    e.deadline = now + this->_timeout;
+    e.sent = now;
+    e.sequence_number = sequence_number;
+}
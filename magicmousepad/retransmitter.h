@@ -0,0 +1,138 @@
+﻿// <copyright file="retransmitter.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <chrono>
+#include <cinttypes>
+#include <vector>
+
+#include <mmpmsg.h>
+
+
+/// <summary>
+/// Keeps track of the button events sent to a single client that have not yet
+/// been acknowledged and determines when they need to be retransmitted.
+/// </summary>
+/// <remarks>
+/// The retransmission timeout is derived from the round-trip time measured
+/// for the acknowledgements as described in RFC 6298. The instance is not
+/// thread-safe; the server protects it with its client lock.
+/// </remarks>
+class retransmitter final {
+
+public:
+
+    /// <summary>
+    /// The clock used for measuring round-trip times and deadlines.
+    /// </summary>
+    typedef std::chrono::steady_clock clock;
+
+    /// <summary>
+    /// The type used for round-trip times and timeouts.
+    /// </summary>
+    typedef clock::duration duration;
+
+    /// <summary>
+    /// The type used for deadlines.
+    /// </summary>
+    typedef clock::time_point time_point;
+
+    /// <summary>
+    /// The maximum number of unacknowledged events tracked. If the table is
+    /// full, the oldest event is dropped.
+    /// </summary>
+    static constexpr std::size_t capacity = 16;
+
+    /// <summary>
+    /// The number of retransmissions before an event is given up.
+    /// </summary>
+    static constexpr unsigned int max_attempts = 8;
+
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    retransmitter(void) noexcept;
+
+    /// <summary>
+    /// Removes the event with the given <paramref name="sequence_number"/>
+    /// from the table and updates the round-trip time estimate.
+    /// </summary>
+    /// <param name="sequence_number">The sequence number of the event that
+    /// was acknowledged, in host-byte order.</param>
+    /// <param name="now">The time when the acknowledgement was received.
+    /// </param>
+    /// <returns><see langword="true" /> if the event was pending,
+    /// <see langword="false" /> if it was unknown, e.g. because the
+    /// acknowledgement is a duplicate.</returns>
+    bool acknowledge(_In_ const mmp_seq_no sequence_number,
+        _In_ const time_point now);
+
+    /// <summary>
+    /// Answer the earliest time when an event needs to be retransmitted.
+    /// </summary>
+    /// <returns>The earliest deadline, or <see cref="time_point::max"/> if
+    /// no event is pending.</returns>
+    time_point deadline(void) const noexcept;
+
+    /// <summary>
+    /// Answer whether no event is pending.
+    /// </summary>
+    inline bool empty(void) const noexcept {
+        return this->_entries.empty();
+    }
+
+    /// <summary>
+    /// Invokes <paramref name="send"/> for all events whose deadline has
+    /// passed and schedules their next retransmission with exponential
+    /// back-off. Events that have been retransmitted
+    /// <see cref="max_attempts"/> times are removed.
+    /// </summary>
+    /// <typeparam name="TSend">A functor accepting a pointer to the datagram
+    /// and its size in bytes.</typeparam>
+    /// <param name="now">The current time.</param>
+    /// <param name="send">The functor sending the datagram.</param>
+    /// <returns>The number of events that have been given up.</returns>
+    template<class TSend>
+    std::size_t retransmit(_In_ const time_point now, _In_ TSend&& send);
+
+    /// <summary>
+    /// Answer the current retransmission timeout.
+    /// </summary>
+    inline duration timeout(void) const noexcept {
+        return this->_timeout;
+    }
+
+    /// <summary>
+    /// Adds an event that has just been sent to the table.
+    /// </summary>
+    /// <param name="sequence_number">The sequence number of the event in
+    /// host-byte order.</param>
+    /// <param name="data">The datagram as it was sent.</param>
+    /// <param name="size">The size of the datagram in bytes.</param>
+    /// <param name="now">The time when the datagram was sent.</param>
+    void track(_In_ const mmp_seq_no sequence_number,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const std::size_t size,
+        _In_ const time_point now);
+
+private:
+
+    struct entry {
+        unsigned int attempts;
+        std::vector<char> data;
+        time_point deadline;
+        time_point sent;
+        mmp_seq_no sequence_number;
+    };
+
+    std::vector<entry> _entries;
+    duration _srtt;
+    duration _rttvar;
+    duration _timeout;
+};
+
+#include "retransmitter.inl"
@@ -0,0 +1,33 @@
+﻿// <copyright file="retransmitter.inl" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+
+/*
+ * retransmitter::retransmit
+ */
+template<class TSend>
+std::size_t retransmitter::retransmit(_In_ const time_point now,
+        _In_ TSend&& send) {
+    std::size_t retval = 0;
+
+    for (auto it = this->_entries.begin(); it != this->_entries.end();) {
+        if (it->deadline > now) {
+            ++it;
+
+        } else if (it->attempts >= max_attempts) {
+            it = this->_entries.erase(it);
+            ++retval;
+
+        } else {
+            send(it->data.data(), it->data.size());
+            ++it->attempts;
+            it->deadline = now + this->_timeout * (1 << it->attempts);
+            ++it;
+        }
+    }
+
+    return retval;
+}
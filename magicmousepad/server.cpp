@@ -6,23 +6,103 @@
 
 #include "server.h"
 
+#include <algorithm>
 #include <array>
+#include <cassert>
+#include <chrono>
 #include <limits>
+#include <random>
 
 #include <mmp_configuration.h>
 #include <mmpthreadname.h>
+#include <mmpwire.h>
 #include <iphlpapi.h>
 #include <Windows.h>
 
 #include "mmptrace.h"
+#include "udp_transport.h"
 
 
 /*
  * server::server
  */
-server::server(_In_ const settings& settings, _In_opt_ HWND window)
-        : _running(true), _sequence_number(0), _window(window) {
+server::server(_In_ const settings& settings,
+        _In_opt_ HWND window,
+        _In_ std::unique_ptr<transport>&& transport)
+        : _heartbeat(settings.heartbeat()),
+        _history_depth((std::min)(settings.history(), mmp_history_max)),
+        _primary({ 0 }),
+        _primary_deadline((retransmitter::time_point::max)()),
+        _probation((retransmitter::time_point::max)()),
+        _running(true),
+        _sequence_number(1),
+        _shard_threshold(settings.shard_threshold()),
+        _sharded(false),
+        _standby(false),
+        _timestamp(0),
+        _transport(std::move(transport)),
+        _window(window) {
+    // Note: the sequence number starts at one such that the snapshot, which
+    // holds the number of the last event sent, is valid before any event.
+
+    // Reserve the history up front, because recording an event must not
+    // allocate while the event is being sent.
+    this->_history.reserve(this->_history_depth);
+    this->_history_buffer.reserve(sizeof(mmp_msg_mouse_history)
+        + this->_history_depth * sizeof(mmp_msg_history_entry));
+
+    // The random epoch allows clients to tell a restarted server from one
+    // that has only been silent. Zero is reserved for servers that predate
+    // sessions.
+    {
+        std::random_device rng;
+        std::uint32_t epoch = 0;
+        while (epoch == 0) {
+            epoch = rng();
+        }
+        MMP_TRACE(L"Starting session 0x%08x.", epoch);
+        this->_state.epoch = ::htonl(epoch);
+    }
+
+    // Resume sending to the clients of the previous instance right away. As
+    // we cannot know whether they are still there, they must connect again
+    // within three heartbeats, which they do once the first heartbeat tells
+    // them about the new session.
+    if ((settings.journal() != 0) && (this->_heartbeat.count() > 0)) {
+        auto port = get_port(settings.address());
+        if (port == 0) {
+            port = mmp_default_port;
+        }
+
+        this->_journal = std::make_unique<client_journal>(port);
+        for (auto& e : this->_journal->load()) {
+            this->_clients.emplace(e.address, e.version, e.capabilities,
+                e.region, e.rate);
+            this->_restored.insert(e.address);
+        }
+
+        if (!this->_restored.empty()) {
+            this->_probation = retransmitter::clock::now()
+                + 3 * this->_heartbeat;
+        }
+    } else if (settings.journal() != 0) {
+        MMP_TRACE(L"The client journal requires heartbeats.");
+    }
+
+    // A standby stays passive until the primary, whose address is resolved by
+    // the server thread, has been silent for three heartbeats.
+    if (!settings.primary().empty() && (this->_heartbeat.count() > 0)) {
+        MMP_TRACE(L"Running as hot standby for %s.",
+            settings.primary().c_str());
+        this->_standby = true;
+        this->_primary_deadline = retransmitter::clock::now()
+            + 3 * this->_heartbeat;
+    } else if (!settings.primary().empty()) {
+        MMP_TRACE(L"A hot standby requires heartbeats.");
+    }
+
     this->_server = std::thread(&server::serve, this, settings);
+    this->_retransmitter = std::thread(&server::retransmit, this);
 }
 
 
@@ -31,40 +111,189 @@ server::server(_In_ const settings& settings, _In_opt_ HWND window)
  */
 server::~server(void) noexcept {
     this->_running.store(false, std::memory_order_release);
-    this->_socket.reset();
+    this->_ring.stop();
+
+    std::thread beacon;
+    std::vector<std::unique_ptr<shard>> shards;
+    {
+        // Acquire the lock such that the retransmitter and the beacon cannot
+        // miss the notification between checking the flag and starting to
+        // wait. The beacon is started by the server thread under the lock
+        // unless the server is stopping, so it cannot appear after we took it.
+        std::lock_guard<std::mutex> l(this->_lock);
+        this->_beacon_signal.notify_all();
+        this->_retransmit.notify_all();
+        beacon = std::move(this->_beacon);
+        shards = std::move(this->_shards);
+        this->_sharded = false;
+    }
+    if (beacon.joinable()) {
+        beacon.join();
+    }
+
+    // Note: the shards must be joined without holding the lock, because
+    // they acquire it when giving up a client.
+    shards.clear();
+
+    if (this->_retransmitter.joinable()) {
+        this->_retransmitter.join();
+    }
+
     if (this->_server.joinable()) {
         this->_server.join();
     }
 }
 
 
+/*
+ * server::backpressure
+ */
+std::vector<std::pair<sockaddr_storage, outbox::counters>>
+server::backpressure(void) {
+    std::vector<std::pair<sockaddr_storage, outbox::counters>> retval;
+
+    std::lock_guard<std::mutex> l(this->_lock);
+    retval.reserve(this->_clients.size());
+    if (this->_sharded) {
+        for (auto& s : this->_shards) {
+            s->backpressure(retval);
+        }
+    } else {
+        for (auto& c : this->_clients) {
+            retval.emplace_back(c.address(), c.backlog().backpressure());
+        }
+    }
+
+    return retval;
+}
+
+
 /*
  * server::send
  */
-void server::send(_In_reads_(cnt) const char *data,
-        _In_ const int cnt) noexcept {
-    std::lock_guard<std::mutex> lock(this->_lock);
-    for (auto it = this->_clients.begin(); it != this->_clients.end();) {
-        if (::sendto(this->_socket.get(),
-                data, cnt,
-                0,
-                *it, it->address_length()) == SOCKET_ERROR) {
-            // We just remove all clients that have failed.
-            it = this->_clients.erase(it);
-        } else {
+void server::send(_In_reads_(cnt) const datagram *datagrams,
+        _In_ const std::size_t cnt,
+        _In_ const bool reliable,
+        _In_ const bool filtered) noexcept {
+    assert(datagrams != nullptr);
+    assert(cnt > 0);
+
+    // Tracking button events for retransmission and deferring datagrams
+    // allocate memory. If this fails, the clients that have not been served
+    // yet miss the event, but they resynchronise from the next heartbeat or
+    // history, which is still better than terminating the server.
+    try {
+        const auto now = retransmitter::clock::now();
+        const auto sequence_number = ::ntohl(this->_state.sequence_number);
+        const POINT position = {
+            static_cast<std::int32_t>(::ntohl(this->_state.x)),
+            static_cast<std::int32_t>(::ntohl(this->_state.y))
+        };
+        auto deferred = false;
+        auto tracked = false;
+
+        // Local clients read the timestamped format from shared memory, where
+        // nothing is lost unless they fall behind, in which case they
+        // resynchronise from the state.
+        if (this->_shared) {
+            auto d = server::format(datagrams, cnt, mmp_capability_timestamp);
+            this->_shared->state(this->_state);
+            this->_shared->publish(d->data, d->size);
+        }
+
+        if (this->_sharded) {
+            // The shards fan out the event on their own threads, but the
+            // retransmission state of the clients is protected by our lock, so
+            // reliable events are tracked here. A shard that falls behind
+            // resynchronises from the state, so it must be recorded first.
+            auto& e = this->_outgoing;
+            assert(cnt <= e.data.size());
+            e.count = cnt;
+            for (std::size_t i = 0; i < cnt; ++i) {
+                assert(datagrams[i].size <= broadcast_ring::max_datagram);
+                e.capabilities[i] = datagrams[i].capabilities;
+                ::memcpy(e.data[i].data(), datagrams[i].data,
+                    datagrams[i].size);
+                e.size[i] = datagrams[i].size;
+            }
+            e.filtered = filtered;
+            e.position = position;
+            this->_ring.store_state(this->_state);
+            this->_ring.publish(e);
+
+            if (reliable) {
+                for (auto& c : this->_clients) {
+                    if ((c.capabilities() & mmp_capability_ack) != 0) {
+                        auto d = server::format(datagrams, cnt,
+                            c.capabilities());
+                        c.pending().track(sequence_number, d->data, d->size,
+                            now);
+                        tracked = true;
+                    }
+                }
+            }
+
+            if (tracked) {
+                this->_retransmit.notify_one();
+            }
+            return;
+        }
+
+        for (auto it = this->_clients.begin(); it != this->_clients.end();) {
+            if (filtered) {
+                if (!it->sees(position)) {
+                    ++it;
+                    continue;
+                }
+
+                // The retransmitter only needs to be woken for the first move
+                // that is deferred, because it flushes the latest position
+                // anyway.
+                auto& pacing = it->pacing();
+                const auto idle = (pacing.deadline()
+                    == (pacer::time_point::max)());
+                if (!pacing.admit(now)) {
+                    deferred = deferred || idle;
+                    ++it;
+                    continue;
+                }
+            } else {
+                it->pacing().discard();
+            }
+
+            auto d = server::format(datagrams, cnt, it->capabilities());
+            if (!this->post(*it, d->data, d->size, filtered, now)) {
+                it = this->evict(it);
+                continue;
+            }
+
+            if (reliable && ((it->capabilities() & mmp_capability_ack) != 0)) {
+                it->pending().track(sequence_number, d->data, d->size, now);
+                tracked = true;
+            }
+
             ++it;
         }
+
+        this->commit();
+
+        if (deferred || tracked) {
+            this->_retransmit.notify_one();
+        }
+    } catch (...) {
+        MMP_TRACE(L"Failed to send an event to all clients.");
     }
 }
 
 
 /*
- * server::addresses
+ * server::broadcast_addresses
  */
-std::vector<sockaddr_storage> server::addresses(void) {
-    std::vector<sockaddr_storage> retval;
+std::vector<sockaddr_in> server::broadcast_addresses(
+        _In_ const std::uint16_t port) {
+    std::vector<sockaddr_in> retval;
 
-    const auto family = AF_UNSPEC;
+    const auto family = AF_INET;
     const auto flags = GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST
         | GAA_FLAG_SKIP_DNS_SERVER;
     ULONG len = 0;
@@ -85,34 +314,30 @@ std::vector<sockaddr_storage> server::addresses(void) {
             adapter != nullptr;
             adapter = adapter->Next) {
         if (adapter->OperStatus != IfOperStatusUp) {
-            // Skip adapters that are not up, because the client cannot connect
-            // to them.
             continue;
         }
 
         for (auto address = adapter->FirstUnicastAddress;
                 address != nullptr;
                 address = address->Next) {
-            if (address->Address.lpSockaddr == nullptr) {
-                // Skip adapters that do not have a valid address.
+            if ((address->Address.lpSockaddr == nullptr)
+                    || (address->Address.lpSockaddr->sa_family != family)) {
+                // Broadcast works only with IPv4.
                 continue;
             }
 
-            switch (address->Address.lpSockaddr->sa_family) {
-                case AF_INET:
-                    retval.emplace_back();
-                    ::memcpy(&retval.back(),
-                        address->Address.lpSockaddr,
-                        sizeof(sockaddr_in));
-                    break;
-
-                case AF_INET6:
-                    retval.emplace_back();
-                    ::memcpy(&retval.back(),
-                        address->Address.lpSockaddr,
-                        sizeof(sockaddr_in6));
-                    break;
-            }
+            const auto prefix = address->OnLinkPrefixLength;
+            const auto mask = ::htonl((prefix == 0)
+                ? 0
+                : static_cast<u_long>(~0UL << (32 - prefix)));
+
+            retval.emplace_back();
+            ::memset(&retval.back(), 0, sizeof(sockaddr_in));
+            retval.back().sin_family = family;
+            retval.back().sin_addr = reinterpret_cast<sockaddr_in *>(
+                address->Address.lpSockaddr)->sin_addr;
+            retval.back().sin_addr.s_addr |= ~mask;
+            retval.back().sin_port = ::htons(port);
         }
     }
 
@@ -131,6 +356,26 @@ void server::copy_port(_In_ sockaddr_storage& dst,
 }
 
 
+/*
+ * server::format
+ */
+const server::datagram *server::format(
+        _In_reads_(cnt) const datagram *datagrams,
+        _In_ const std::size_t cnt,
+        _In_ const mmp_capabilities capabilities) noexcept {
+    assert(datagrams != nullptr);
+    assert(cnt > 0);
+    auto retval = datagrams;
+    for (auto end = datagrams + cnt - 1; retval != end; ++retval) {
+        if ((retval->capabilities & capabilities) == retval->capabilities) {
+            break;
+        }
+    }
+
+    return retval;
+}
+
+
 /*
  * server::get_port
  */
@@ -178,6 +423,16 @@ void server::set_port(_In_ sockaddr *dst, _In_ const std::uint16_t port) {
 }
 
 
+/*
+ * server::timestamp
+ */
+std::uint64_t server::timestamp(void) noexcept {
+    using namespace std::chrono;
+    const auto now = steady_clock::now().time_since_epoch();
+    return duration_cast<microseconds>(now).count();
+}
+
+
 /*
  * server::to_string
  */
@@ -214,69 +469,501 @@ std::wstring server::to_string(_In_ const sockaddr_storage& address) {
 }
 
 
-///*
-// * server::address
-// */
-//sockaddr_storage server::address(_In_ const sockaddr_storage& peer) {
-//    // Determines the common prefix length of 'lhs' and 'rhs'.
-//    auto common_prefix = [](const sockaddr_storage& lhs,
-//            const sockaddr_storage& rhs) {
-//        std::size_t retval = 0;
-//        if (lhs.ss_family != rhs.ss_family) {
-//            return retval;
-//        }
-//
-//        const std::uint8_t *l = nullptr;
-//        std::size_t len = 0;
-//        const std::uint8_t *r = nullptr;
-//
-//        switch (lhs.ss_family) {
-//            case AF_INET: {
-//                auto& a = reinterpret_cast<const sockaddr_in&>(lhs);
-//                l = reinterpret_cast<const std::uint8_t *>(&a.sin_addr);
-//                len = sizeof(a.sin_addr);
-//                } break;
-//
-//            case AF_INET6: {
-//                auto& a = reinterpret_cast<const sockaddr_in6&>(lhs);
-//                l = reinterpret_cast<const std::uint8_t *>(&a.sin6_addr);
-//                len = sizeof(a.sin6_addr);
-//                } break;
-//
-//            default:
-//                return retval;
-//        }
-//        assert(l != nullptr);
-//        assert(r != nullptr);
-//
-//        for (std::size_t i = 0; i < len; ++i) {
-//            if (l[i] == r[i]) {
-//                retval += 8;
-//
-//            } else {
-//                for (int bit = 7; (bit >= 0); --bit) {
-//                    if ((l[i] & (1 << bit)) == (r[i] & (1 << bit))) {
-//                        ++retval;
-//                    } else {
-//                        break;
-//                    }
-//                }
-//            }
-//        }
-//
-//        return retval;
-//    };
-//
-//    // Sorts the addresses such that the one with the longest common prefix
-//    // comes first.
-//    std::sort(this->_addresses.begin(), this->_addresses.end(),
-//        [&peer, common_prefix](const sockaddr_storage& l,
-//                const sockaddr_storage& r) {
-//            return (common_prefix(l, peer) > common_prefix(r, peer));
-//        });
-//
-//    return this->_addresses.front();
-//}
+/*
+ * server::abandon
+ */
+void server::abandon(_In_ const sockaddr_storage& address) {
+    std::lock_guard<std::mutex> l(this->_lock);
+    auto it = this->_clients.find(client(address));
+    if (it != this->_clients.end()) {
+        this->evict(it);
+        ::SendMessage(this->_window, WM_PAINT, 0, 0);
+    }
+}
+
+
+/*
+ * server::announcement
+ */
+mmp_msg_announce server::announcement(
+        _In_ const std::uint32_t token) const noexcept {
+    mmp_msg_announce retval;
+    retval.sequence_number = this->_state.sequence_number;
+    retval.load = ::htonl(static_cast<std::uint32_t>(this->_clients.size()));
+    retval.token = ::htonl(token);
+    retval.epoch = this->_state.epoch;
+    return retval;
+}
+
+
+/*
+ * server::beacon
+ */
+void server::beacon(_In_ const std::chrono::milliseconds interval,
+        _In_ const std::uint16_t port) {
+    mmp_set_thread_name(-1, "Magic mouse pad beacon");
+    MMP_TRACE(L"Sending beacons to port %u every %lld ms.", port,
+        static_cast<long long>(interval.count()));
+    std::unique_lock<std::mutex> l(this->_lock);
+
+    while (this->_running.load(std::memory_order_acquire)) {
+        if (this->_standby) {
+            this->_beacon_signal.wait_for(l, interval, [this](void) {
+                return !this->_running.load(std::memory_order_acquire);
+            });
+            continue;
+        }
+
+        const auto msg = this->announcement(0);
+        l.unlock();
+
+        // Note: the adapters are enumerated every time, because they might
+        // have changed since the last beacon.
+        try {
+            for (auto& a : broadcast_addresses(port)) {
+                sockaddr_storage peer { 0 };
+                ::memcpy(&peer, &a, sizeof(a));
+                this->transmit(peer,
+                    reinterpret_cast<const char *>(&msg),
+                    sizeof(msg));
+            }
+        } catch (const wil::ResultException& e) {
+            MMP_TRACE(L"Failed to retrieve broadcast addresses: %hs",
+                e.what());
+        }
+
+        l.lock();
+        this->_beacon_signal.wait_for(l, interval, [this](void) {
+            return !this->_running.load(std::memory_order_acquire);
+        });
+    }
+}
+
+
+/*
+ * server::commit
+ */
+void server::commit(void) {
+    if (!this->_transport) {
+        return;
+    }
+
+    this->_transport->commit(this->_outcomes);
+    if (this->_outcomes.empty()) {
+        return;
+    }
+
+    // Batched sends fail after they have been committed, which counts against
+    // the client like a send that failed immediately.
+    const auto now = retransmitter::clock::now();
+    for (auto& o : this->_outcomes) {
+        auto it = this->_clients.find(client(o.first));
+        if ((it != this->_clients.end())
+                && !it->backlog().complete(o.second, now)) {
+            this->evict(it);
+        }
+    }
+
+    this->_outcomes.clear();
+}
+
+
+/*
+ * server::drain
+ */
+void server::drain(_In_ const retransmitter::time_point now) {
+    for (auto it = this->_clients.begin(); it != this->_clients.end();) {
+        auto& backlog = it->backlog();
+        if (backlog.empty()) {
+            ++it;
+            continue;
+        }
+
+        const auto status = backlog.flush(now,
+                [this, it](const char *data, const std::size_t size) {
+            return this->transmit(*it, data, static_cast<int>(size));
+        });
+        if ((status != 0)
+                && (!outbox::transient(status) || backlog.stalled(now))) {
+            it = this->evict(it);
+            continue;
+        }
+
+        ++it;
+    }
+}
+
+
+/*
+ * server::evict
+ */
+std::set<client>::iterator server::evict(
+        _In_ std::set<client>::iterator it) {
+    const auto counters = it->backlog().backpressure();
+    MMP_TRACE(L"Evicting client that cannot be reached after %llu deferred, "
+        L"%llu dropped and %llu failed datagrams.", counters.deferred,
+        counters.dropped, counters.failed);
+
+    if (this->_journal) {
+        this->_journal->remove(*it);
+    }
+
+    this->unshard(it->address());
+    auto retval = this->_clients.erase(it);
+    this->reshard();
+    return retval;
+}
+
+
+/*
+ * server::heartbeat
+ */
+void server::heartbeat(void) {
+    mmp_msg_heartbeat msg;
+    msg.sequence_number = this->_state.sequence_number;
+    msg.epoch = this->_state.epoch;
+    const auto now = retransmitter::clock::now();
+
+    if (this->_shared) {
+        this->_shared->publish(reinterpret_cast<const char *>(&msg),
+            sizeof(msg));
+    }
+
+    // Note: clients that cannot be reached are evicted once their backlog
+    // has stalled, so the result can be ignored here.
+    for (auto& c : this->_clients) {
+        if ((c.capabilities() & mmp_capability_heartbeat) != 0) {
+            this->post(c,
+                reinterpret_cast<const char *>(&msg),
+                sizeof(msg),
+                false,
+                now);
+        }
+    }
+}
+
+
+/*
+ * server::history
+ */
+server::datagram server::history(_In_ const std::uint64_t timestamp,
+        _In_ const bool reliable) noexcept {
+    const auto cnt = this->_history.size();
+    const mmp_msg_mouse_history header(this->_state, timestamp,
+        static_cast<std::uint16_t>(cnt),
+        reliable ? mmp_history_flag_ack : 0);
+
+    this->_history_buffer.resize(sizeof(header)
+        + cnt * sizeof(mmp_msg_history_entry));
+    auto dst = this->_history_buffer.data();
+    ::memcpy(dst, &header, sizeof(header));
+    dst += sizeof(header);
+
+    for (auto& e : this->_history) {
+        ::memcpy(dst, &e, sizeof(e));
+        dst += sizeof(e);
+    }
+
+    // Remember the current event for the following messages. All fields are
+    // already in network-byte order in the state.
+    if (this->_history_depth > 0) {
+        if (this->_history.size() >= this->_history_depth) {
+            this->_history.pop_back();
+        }
+
+        // Note: the most recent event comes first, and inserting it cannot
+        // reallocate, because the capacity has been reserved.
+        mmp_msg_history_entry e;
+        e.sequence_number = this->_state.sequence_number;
+        e.x = this->_state.x;
+        e.y = this->_state.y;
+        e.buttons = this->_state.buttons;
+        this->_history.insert(this->_history.begin(), e);
+    }
+
+    return datagram(mmp_capability_history, this->_history_buffer);
+}
+
+
+/*
+ * server::least_loaded
+ */
+shard& server::least_loaded(void) {
+    assert(!this->_shards.empty());
+    auto it = std::min_element(this->_shards.begin(), this->_shards.end(),
+            [](const std::unique_ptr<shard>& l,
+            const std::unique_ptr<shard>& r) {
+        return (l->size() < r->size());
+    });
+    return **it;
+}
+
+
+/*
+ * server::mirror
+ */
+void server::mirror(_In_ const visus::mmp::wire::view<mmp_msg_replica>& msg) {
+    this->_state.sequence_number = ::htonl(msg.sequence_number());
+    this->_state.epoch = ::htonl(msg.epoch());
+    this->_state.x = ::htonl(msg.x());
+    this->_state.y = ::htonl(msg.y());
+    this->_state.buttons = ::htonl(msg.buttons());
+    this->_sequence_number.store(msg.sequence_number() + 1,
+        std::memory_order_release);
+
+    this->_clients.clear();
+    for (std::size_t i = 0; i < msg.clients(); ++i) {
+        const auto c = msg.client(i);
+        sockaddr_storage address;
+        if (!client::unpack(address, c)) {
+            continue;
+        }
+
+        this->_clients.emplace(address, c.version(), c.capabilities(),
+            client::unpack_region(c), c.rate());
+    }
+
+    // The clients of the primary replace the ones we might have restored.
+    this->_restored.clear();
+    this->_probation = (retransmitter::time_point::max)();
+    this->_primary_deadline = retransmitter::clock::now()
+        + 3 * this->_heartbeat;
+}
+
+
+/*
+ * server::pace
+ */
+void server::pace(_In_ const retransmitter::time_point now) {
+    // The coalesced move carries the latest position along with the time of
+    // the event that produced it rather than the time it is flushed.
+    mmp_msg_mouse_move move;
+    move.sequence_number = this->_state.sequence_number;
+    move.x = this->_state.x;
+    move.y = this->_state.y;
+    const auto ts = server::timestamped(move, this->_timestamp);
+
+    for (auto it = this->_clients.begin(); it != this->_clients.end();) {
+        if (!it->pacing().flush(now)) {
+            ++it;
+            continue;
+        }
+
+        const auto d = ((it->capabilities() & mmp_capability_timestamp) != 0)
+            ? datagram(mmp_capability_timestamp, ts)
+            : datagram(mmp_capability_none, move);
+        if (!this->post(*it, d.data, d.size, true, now)) {
+            it = this->evict(it);
+            continue;
+        }
+
+        ++it;
+    }
+}
+
+
+/*
+ * server::post
+ */
+bool server::post(_In_ const client& client,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size,
+        _In_ const bool move,
+        _In_ const retransmitter::time_point now) {
+    return client.backlog().post(data, size, move, now,
+            [this, &client](const char *data, const std::size_t size) {
+        return this->transmit(client, data, static_cast<int>(size));
+    });
+}
+
+
+/*
+ * server::replicate
+ */
+void server::replicate(void) {
+    if (this->_standbys.empty()) {
+        return;
+    }
+
+    const auto cnt = (std::min)(this->_clients.size(), max_replicated_clients);
+    if (cnt < this->_clients.size()) {
+        MMP_TRACE(L"Replicating only %u of %u clients.",
+            static_cast<unsigned int>(cnt),
+            static_cast<unsigned int>(this->_clients.size()));
+    }
+
+    const mmp_msg_replica header(this->_state, static_cast<std::uint32_t>(cnt));
+    std::vector<char> buffer(sizeof(header)
+        + cnt * sizeof(mmp_msg_replica_client));
+    auto dst = buffer.data();
+    ::memcpy(dst, &header, sizeof(header));
+    dst += sizeof(header);
+
+    auto it = this->_clients.begin();
+    for (std::size_t i = 0; i < cnt; ++i, ++it) {
+        const auto c = it->pack();
+        ::memcpy(dst, &c, sizeof(c));
+        dst += sizeof(c);
+    }
+
+    for (auto s = this->_standbys.begin(); s != this->_standbys.end();) {
+        if (this->transmit(*s, buffer.data(),
+                static_cast<int>(buffer.size())) != 0) {
+            MMP_TRACE(L"Removing standby that cannot be reached.");
+            s = this->_standbys.erase(s);
+        } else {
+            ++s;
+        }
+    }
+}
+
+
+/*
+ * server::reshard
+ */
+void server::reshard(void) {
+    if (this->_shards.empty() || this->_standby) {
+        return;
+    }
+
+    const auto cnt = this->_clients.size();
+
+    if (!this->_sharded) {
+        if (cnt >= this->_shard_threshold) {
+            MMP_TRACE(L"Distributing %u clients across %u sender threads.",
+                static_cast<unsigned int>(cnt),
+                static_cast<unsigned int>(this->_shards.size()));
+            std::size_t i = 0;
+            for (auto& c : this->_clients) {
+                this->_shards[i++ % this->_shards.size()]->add(c);
+            }
+            this->_sharded = true;
+        }
+        return;
+    }
+
+    // Returning to a single thread only at half of the threshold prevents
+    // the server from flapping if clients come and go around the threshold.
+    if (cnt < this->_shard_threshold / 2) {
+        MMP_TRACE(L"Fanning out to %u clients on a single thread.",
+            static_cast<unsigned int>(cnt));
+        for (auto& s : this->_shards) {
+            s->clear();
+        }
+        this->_sharded = false;
+        return;
+    }
+
+    while (true) {
+        auto range = std::minmax_element(this->_shards.begin(),
+                this->_shards.end(),
+                [](const std::unique_ptr<shard>& l,
+                const std::unique_ptr<shard>& r) {
+            return (l->size() < r->size());
+        });
+        if ((*range.second)->size() <= (*range.first)->size() + 1) {
+            break;
+        }
+
+        (*range.second)->transfer(**range.first);
+    }
+}
+
+
+/*
+ * server::retransmit
+ */
+void server::retransmit(void) {
+    mmp_set_thread_name(-1, "Magic mouse pad retransmitter");
+    std::unique_lock<std::mutex> l(this->_lock);
+
+    // Note: the first heartbeat is sent immediately such that clients restored
+    // from the journal learn about the new session as early as possible.
+    const auto heartbeats = (this->_heartbeat.count() > 0);
+    auto next_heartbeat = heartbeats
+        ? retransmitter::clock::now()
+        : (retransmitter::time_point::max)();
+
+    while (this->_running.load(std::memory_order_acquire)) {
+        auto deadline = (std::min)(next_heartbeat, this->_probation);
+        if (this->_standby) {
+            deadline = (std::min)(deadline, this->_primary_deadline);
+        }
+        for (auto& c : this->_clients) {
+            deadline = (std::min)(deadline, c.backlog().deadline());
+            deadline = (std::min)(deadline, c.pacing().deadline());
+            deadline = (std::min)(deadline, c.pending().deadline());
+        }
+
+        if (deadline == (retransmitter::time_point::max)()) {
+            this->_retransmit.wait(l);
+        } else {
+            this->_retransmit.wait_until(l, deadline);
+        }
+
+        const auto now = retransmitter::clock::now();
+        this->drain(now);
+        this->pace(now);
+
+        for (auto& c : this->_clients) {
+            const auto lost = c.pending().retransmit(now,
+                    [this, &c, now](const char *data, const std::size_t size) {
+                MMP_TRACE(L"Retransmitting unacknowledged button event.");
+                this->post(c, data, static_cast<int>(size), false, now);
+            });
+
+            if (lost > 0) {
+                MMP_TRACE(L"Giving up %u button events that have not been "
+                    L"acknowledged.", static_cast<unsigned int>(lost));
+            }
+        }
+
+        if (now >= this->_probation) {
+            for (auto& a : this->_restored) {
+                auto it = this->_clients.find(client(a));
+                if (it != this->_clients.end()) {
+                    MMP_TRACE(L"Evicting restored client that has not "
+                        L"connected again.");
+                    if (this->_journal) {
+                        this->_journal->remove(*it);
+                    }
+                    this->unshard(a);
+                    this->_clients.erase(it);
+                }
+            }
+
+            this->_restored.clear();
+            this->reshard();
+            this->_probation = (retransmitter::time_point::max)();
+        }
+
+        if (this->_standby && (now >= this->_primary_deadline)) {
+            this->take_over(now);
+            next_heartbeat = now;
+        }
+
+        if (heartbeats && (now >= next_heartbeat)) {
+            if (this->_standby) {
+                // Keep subscribing such that a restarted primary learns about
+                // us again.
+                const mmp_msg_standby msg;
+                this->transmit(this->_primary,
+                    reinterpret_cast<const char *>(&msg),
+                    sizeof(msg));
+            } else {
+                this->heartbeat();
+                this->replicate();
+            }
+            next_heartbeat = now + this->_heartbeat;
+
+            if (this->_journal) {
+                this->_journal->compact(this->_clients);
+            }
+        }
+
+        this->commit();
+    }
+}
 
 
 /*
@@ -289,7 +976,6 @@ void server::serve(_In_ settings settings) {
     try {
         std::array<char, (std::numeric_limits<std::uint16_t>::max)()> buffer;
         sockaddr_storage peer;
-        int cnt_peer = sizeof(peer);
         WSADATA wsa_data;
 
         MMP_TRACE(L"Initialising Winsock in thread 0x08x.",
@@ -297,17 +983,7 @@ void server::serve(_In_ settings settings) {
         THROW_IF_WIN32_ERROR(::WSAStartup(MAKEWORD(2, 2), &wsa_data));
         auto wsa_cleanup = wil::scope_exit([](void) { ::WSACleanup(); });
 
-        // Create a datagram socket using the configured address.
-        this->_socket.reset(::WSASocket(
-            settings.address()->sa_family,
-            SOCK_DGRAM,
-            IPPROTO_UDP,
-            nullptr,
-            0,
-            WSA_FLAG_OVERLAPPED));
-        THROW_LAST_ERROR_IF(!this->_socket);
-
-        // Bind the socket to the configured port such that it can wait for
+        // The server binds to the configured port such that it can wait for
         // incoming connections and discovery requests.
         switch (settings.address()->sa_family) {
             case AF_INET:
@@ -328,30 +1004,121 @@ void server::serve(_In_ settings settings) {
             set_port(settings.address(), mmp_default_port);
         }
 
-        THROW_LAST_ERROR_IF(::bind(this->_socket.get(),
-            settings.address(),
-            settings.address_length())
-            == SOCKET_ERROR);
-
-#if (defined(_DEBUG) || defined(DEBUG))
+        // Unless another transport has been injected, we create sockets on
+        // the configured address. They do not change afterwards, so they can
+        // be used without holding the lock.
+        udp_transport *udp = nullptr;
         {
-            sockaddr_storage addr { 0 };
-            int cnt_addr = sizeof(addr);
-            ::getsockname(this->_socket.get(),
-                reinterpret_cast<sockaddr *>(&addr),
-                &cnt_addr);
-            auto name = server::to_string(addr);
-            MMP_TRACE(L"Server bound to %s.", name.c_str());
+            std::lock_guard<std::mutex> l(this->_lock);
+            if (!this->_transport) {
+                auto t = std::make_unique<udp_transport>();
+                t->open(settings.address(), settings.address_length(), true);
+                udp = t.get();
+                this->_transport = std::move(t);
+            }
+        }
+
+        // Having bound the port makes us the only writer of the shared
+        // memory for this port, which we have not if the transport was
+        // injected.
+        if (udp != nullptr) {
+            std::lock_guard<std::mutex> l(this->_lock);
+            try {
+                this->_shared = std::make_unique<shared_ring>(
+                    get_port(settings.address()));
+                this->_shared->state(this->_state);
+            } catch (const wil::ResultException& e) {
+                MMP_TRACE(L"Local clients cannot use shared memory: %hs",
+                    e.what());
+            }
+        }
+
+        // The sender threads are started right away, but they only get
+        // clients once there are enough of them.
+        if (settings.shards() > 0) {
+            std::lock_guard<std::mutex> l(this->_lock);
+            if (this->_running.load(std::memory_order_acquire)) {
+                try {
+                    for (std::uint32_t i = 0; i < settings.shards(); ++i) {
+                        this->_shards.push_back(std::make_unique<shard>(
+                            this->_ring,
+                            this->_transport->fork(),
+                            [this](const sockaddr_storage& a) {
+                                this->abandon(a);
+                            }));
+                    }
+                } catch (const wil::ResultException& ex) {
+                    MMP_TRACE(L"Failed to create sender threads: %hs",
+                        ex.what());
+                    // Only the shards read the ring, so it can be stopped for
+                    // good, which is required to join the threads.
+                    this->_ring.stop();
+                    this->_shards.clear();
+                }
+
+                this->reshard();
+            }
+        }
+
+        // A standby needs the address of its primary to subscribe to it.
+        if (!settings.primary().empty() && (this->_heartbeat.count() > 0)) {
+            sockaddr_storage primary { 0 };
+            auto primary_len = static_cast<int>(sizeof(primary));
+            auto str = settings.primary();
+            THROW_LAST_ERROR_IF(::WSAStringToAddressW(&str[0],
+                settings.address()->sa_family,
+                nullptr,
+                reinterpret_cast<sockaddr *>(&primary),
+                &primary_len) == SOCKET_ERROR);
+
+            if (get_port(reinterpret_cast<sockaddr *>(&primary)) == 0) {
+                set_port(reinterpret_cast<sockaddr *>(&primary),
+                    mmp_default_port);
+            }
+
+            std::lock_guard<std::mutex> l(this->_lock);
+            this->_primary = primary;
+        }
+
+        // Periodically announce the server if configured. This is only
+        // possible via IPv4 broadcasts.
+        if (settings.beacon() > 0) {
+            auto status = 0;
+            if (settings.address()->sa_family != AF_INET) {
+                MMP_TRACE(L"Beacons are only supported for IPv4.");
+
+            } else if (udp == nullptr) {
+                MMP_TRACE(L"Beacons are only supported for UDP.");
+
+            } else if ((status = udp->broadcast()) != 0) {
+                MMP_TRACE(L"Failed to enable broadcasts for beacons: %d.",
+                    status);
+
+            } else {
+                const auto port = get_port(settings.address())
+                    + mmp_beacon_port_offset;
+                std::lock_guard<std::mutex> l(this->_lock);
+                if (this->_running.load(std::memory_order_acquire)) {
+                    this->_beacon = std::thread(&server::beacon, this,
+                        std::chrono::milliseconds(settings.beacon()),
+                        static_cast<std::uint16_t>(port));
+                }
+            }
         }
-#endif /* (defined(_DEBUG) || defined(DEBUG)) */
 
         while (this->_running.load(std::memory_order_acquire)) {
-            auto cnt = ::recvfrom(this->_socket.get(),
-                buffer.data(),
+            // The transport fills only the part of the address that belongs
+            // to the family of the peer, and nothing of the previous peer may
+            // remain in the rest, because the address is stored with new
+            // clients.
+            ::ZeroMemory(&peer, sizeof(peer));
+
+            // The timeout makes sure that the thread notices when the server
+            // is stopped.
+            const auto cnt = this->_transport->receive(buffer.data(),
                 static_cast<int>(buffer.size()),
-                0,
-                reinterpret_cast<sockaddr *>(&peer),
-                &cnt_peer);
+                peer,
+                std::chrono::milliseconds(100));
             if (cnt < sizeof(mmp_msg_id)) {
                 continue;
             }
@@ -365,26 +1132,203 @@ void server::serve(_In_ settings settings) {
                     // address back to the requestor. If the server has multiple
                     // addresses, it sends the one that is in the same subnet as
                     // the requestor.
-                    MMP_TRACE(L"Responding to discovery request.");
+                    // The token of the request is echoed such that the client
+                    // can measure the round-trip time, and clients predating
+                    // the server selection get zero from the view.
+                    // A standby stays invisible until it has taken over.
+                    const visus::mmp::wire::view<mmp_msg_discover> msg(
+                        buffer.data(), cnt);
                     mmp_msg_announce response;
-                    response.sequence_number = this->_sequence_number.load(
-                        std::memory_order_acquire);
-                    ::sendto(this->_socket.get(),
+                    {
+                        std::lock_guard<std::mutex> l(this->_lock);
+                        if (this->_standby) {
+                            break;
+                        }
+                        response = this->announcement(msg.token());
+                    }
+                    MMP_TRACE(L"Responding to discovery request.");
+                    this->transmit(peer,
                         reinterpret_cast<const char *>(&response),
-                        sizeof(response),
-                        0,
-                        reinterpret_cast<const sockaddr *>(&peer),
-                        cnt_peer);
+                        sizeof(response));
                     } break;
 
                 case mmp_msgid_connect: {
                     // In case of a connect request, we register the peer
-                    // address as a client.
-                    MMP_TRACE(L"Adding new client.");
+                    // address as a client. Clients that predate the protocol
+                    // negotiation send only the message ID, in which case the
+                    // view reports version zero without any capabilities.
+                    const visus::mmp::wire::view<mmp_msg_connect> msg(
+                        buffer.data(), cnt);
+                    const auto version = msg.version();
+                    const auto capabilities = msg.capabilities()
+                        & mmp_capabilities_supported;
+
+                    // The region is clamped such that its right and bottom
+                    // edges cannot overflow.
+                    RECT region = { 0 };
+                    if ((capabilities & mmp_capability_region) != 0) {
+                        const auto right = static_cast<std::int64_t>(
+                            msg.left()) + msg.width();
+                        const auto bottom = static_cast<std::int64_t>(
+                            msg.top()) + msg.height();
+                        const std::int64_t max = (std::numeric_limits<
+                            LONG>::max)();
+                        ::SetRect(&region, msg.left(), msg.top(),
+                            static_cast<LONG>((std::min)(right, max)),
+                            static_cast<LONG>((std::min)(bottom, max)));
+                    }
+
                     std::lock_guard<std::mutex> l(this->_lock);
-                    this->_clients.emplace(peer);
+                    if (this->_standby) {
+                        MMP_TRACE(L"Ignoring connect request as standby.");
+                        break;
+                    }
+
+                    MMP_TRACE(L"Adding new client with protocol version %u "
+                        L"and capabilities 0x%x.", version, capabilities);
+                    if (!::IsRectEmpty(&region)) {
+                        MMP_TRACE(L"The client is interested in (%d, %d) - "
+                            L"(%d, %d).", region.left, region.top,
+                            region.right, region.bottom);
+                    }
+                    // Erase a previous registration first, because the client
+                    // might have been restarted with different capabilities.
+                    this->unshard(peer);
+                    this->_clients.erase(client(peer));
+                    const auto rate = ((capabilities & mmp_capability_rate)
+                        != 0) ? msg.rate() : 0;
+                    if (rate > 0) {
+                        MMP_TRACE(L"The client receives at most %u moves per "
+                            L"second.", rate);
+                    }
+
+                    auto it = this->_clients.emplace(peer, version,
+                        capabilities, region, rate).first;
+                    this->_restored.erase(peer);
+                    if (this->_journal) {
+                        this->_journal->add(*it);
+                    }
+
+                    if (this->_sharded) {
+                        this->least_loaded().add(*it);
+                    }
+                    this->reshard();
+
+                    // Clients that support the snapshot get the current state
+                    // immediately. As we hold the lock, the snapshot is
+                    // guaranteed to precede any event sent to the new client.
+                    if ((capabilities & mmp_capability_state) != 0) {
+                        MMP_TRACE(L"Sending state snapshot.");
+                        this->post(*it,
+                            reinterpret_cast<const char *>(&this->_state),
+                            sizeof(this->_state),
+                            false,
+                            retransmitter::clock::now());
+                        this->commit();
+                    }
                     ::SendMessage(this->_window, WM_PAINT, 0, 0);
                     } break;
+
+                case mmp_msgid_ack: {
+                    const visus::mmp::wire::view<mmp_msg_ack> msg(
+                        buffer.data(), cnt);
+                    if (!msg.valid()) {
+                        MMP_TRACE(L"Ignoring truncated acknowledgement.");
+                        break;
+                    }
+
+                    const auto now = retransmitter::clock::now();
+                    std::lock_guard<std::mutex> l(this->_lock);
+                    auto it = this->_clients.find(client(peer));
+                    if ((it != this->_clients.end())
+                            && it->pending().acknowledge(msg.sequence_number(),
+                            now)) {
+                        MMP_TRACE(L"Button event %u was acknowledged, "
+                            L"retransmission timeout is now %lld us.",
+                            msg.sequence_number(),
+                            std::chrono::duration_cast<
+                            std::chrono::microseconds>(
+                            it->pending().timeout()).count());
+                    }
+                    } break;
+
+                case mmp_msgid_ping: {
+                    // Clocks are probed without taking the lock such that the
+                    // answer is not delayed by the input thread.
+                    const auto receive = timestamp();
+                    const visus::mmp::wire::view<mmp_msg_ping> msg(
+                        buffer.data(), cnt);
+                    if (!msg.valid()) {
+                        MMP_TRACE(L"Ignoring truncated ping.");
+                        break;
+                    }
+
+                    mmp_msg_pong response;
+                    response.token = ::htonl(msg.token());
+                    response.origin = ::mmp_hton64(msg.origin());
+                    response.receive = ::mmp_hton64(receive);
+                    response.transmit = ::mmp_hton64(timestamp());
+                    this->transmit(peer,
+                        reinterpret_cast<const char *>(&response),
+                        sizeof(response));
+                    } break;
+
+                case mmp_msgid_rate: {
+                    const visus::mmp::wire::view<mmp_msg_rate> msg(
+                        buffer.data(), cnt);
+                    if (!msg.valid()) {
+                        MMP_TRACE(L"Ignoring truncated rate update.");
+                        break;
+                    }
+
+                    std::lock_guard<std::mutex> l(this->_lock);
+                    auto it = this->_clients.find(client(peer));
+                    if ((it != this->_clients.end())
+                            && ((it->capabilities() & mmp_capability_rate)
+                            != 0)) {
+                        MMP_TRACE(L"The client now receives at most %u moves "
+                            L"per second.", msg.rate());
+                        it->pacing().rate(msg.rate());
+                        this->_retransmit.notify_one();
+
+                        // Persist the new rate such that a restarted server
+                        // does not flood the client.
+                        if (this->_journal) {
+                            this->_journal->add(*it);
+                        }
+
+                        if (this->_sharded) {
+                            for (auto& s : this->_shards) {
+                                s->rate(peer, msg.rate());
+                            }
+                        }
+                    }
+                    } break;
+
+                case mmp_msgid_standby: {
+                    // A standby subscribes to the replica once per heartbeat,
+                    // and the first subscription is answered immediately.
+                    std::lock_guard<std::mutex> l(this->_lock);
+                    if (!this->_standby
+                            && this->_standbys.insert(peer).second) {
+                        MMP_TRACE(L"Adding hot standby.");
+                        this->replicate();
+                    }
+                    } break;
+
+                case mmp_msgid_replica: {
+                    const visus::mmp::wire::view<mmp_msg_replica> msg(
+                        buffer.data(), cnt);
+                    if (!msg.valid()) {
+                        MMP_TRACE(L"Ignoring truncated replica.");
+                        break;
+                    }
+
+                    std::lock_guard<std::mutex> l(this->_lock);
+                    if (this->_standby) {
+                        this->mirror(msg);
+                    }
+                    } break;
             }
         }/* while (this->_running.load(std::memory_order_acquire)) */
 
@@ -392,3 +1336,109 @@ void server::serve(_In_ settings settings) {
         ::MessageBoxA(NULL, e.what(), nullptr, MB_ICONERROR | MB_OK);
     }
 }
+
+
+/*
+ * server::take_over
+ */
+void server::take_over(_In_ const retransmitter::time_point now) {
+    auto epoch = ::ntohl(this->_state.epoch) + 1;
+    if (epoch == 0) {
+        epoch = 1;
+    }
+
+    const auto silence = now - this->_primary_deadline + 3 * this->_heartbeat;
+    MMP_TRACE(L"Taking over from the primary after %lld ms of silence, "
+        L"starting session 0x%08x with %u clients.",
+        static_cast<long long>(std::chrono::duration_cast<
+            std::chrono::milliseconds>(silence).count()),
+        epoch, static_cast<unsigned int>(this->_clients.size()));
+    this->_standby = false;
+    this->_primary_deadline = (retransmitter::time_point::max)();
+    this->_state.epoch = ::htonl(epoch);
+    if (this->_shared) {
+        this->_shared->state(this->_state);
+    }
+
+    // The clients of the primary switch over once the first heartbeat of the
+    // new session reaches them. Those that do not within three heartbeats are
+    // considered gone like clients restored from the journal.
+    for (auto& c : this->_clients) {
+        this->_restored.insert(c.address());
+        if (this->_journal) {
+            this->_journal->add(c);
+        }
+    }
+
+    if (!this->_restored.empty()) {
+        this->_probation = now + 3 * this->_heartbeat;
+    }
+
+    this->reshard();
+}
+
+
+/*
+ * server::transmit
+ */
+int server::transmit(_In_ const client& client,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept {
+    return this->_transport
+        ? this->_transport->send(client, data, size)
+        : WSAENOTSOCK;
+}
+
+
+/*
+ * server::transmit
+ */
+int server::transmit(_In_ const sockaddr_storage& peer,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept {
+    return this->_transport
+        ? this->_transport->send(peer, data, size)
+        : WSAENOTSOCK;
+}
+
+
+/*
+ * server::unshard
+ */
+void server::unshard(_In_ const sockaddr_storage& address) {
+    if (this->_sharded) {
+        for (auto& s : this->_shards) {
+            if (s->remove(address)) {
+                break;
+            }
+        }
+    }
+}
+
+
+/*
+ * server::update_state
+ */
+void server::update_state(_In_ const mmp_msg_mouse_button& message) noexcept {
+    auto buttons = ::ntohl(this->_state.buttons);
+    if (message.down) {
+        buttons |= message.button;
+    } else {
+        buttons &= ~static_cast<std::uint32_t>(message.button);
+    }
+
+    this->_state.sequence_number = message.sequence_number;
+    this->_state.x = message.x;
+    this->_state.y = message.y;
+    this->_state.buttons = ::htonl(buttons);
+}
+
+
+/*
+ * server::update_state
+ */
+void server::update_state(_In_ const mmp_msg_mouse_move& message) noexcept {
+    this->_state.sequence_number = message.sequence_number;
+    this->_state.x = message.x;
+    this->_state.y = message.y;
+}
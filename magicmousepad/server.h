@@ -7,16 +7,26 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iterator>
 #include <memory>
 #include <mmpmsg.h>
+#include <mmpwire.h>
 #include <mutex>
 #include <stdexcept>
 #include <set>
 #include <thread>
+#include <utility>
 #include <vector>
 
+#include "broadcast_ring.h"
 #include "client.h"
+#include "client_journal.h"
 #include "settings.h"
+#include "shard.h"
+#include "shared_ring.h"
+#include "transport.h"
 
 
 /// <summary>
@@ -33,7 +43,12 @@ public:
     /// <param name="settings"></param>
     /// <param name="window">The handle of a window that will be invalidated
     /// whenever the client list changes.</param>
-    explicit server(_In_ const settings& settings, _In_opt_ HWND window = NULL);
+    /// <param name="transport">The transport to exchange datagrams with the
+    /// clients. If this is <see langword="nullptr" />, the server creates
+    /// UDP sockets on the configured address.</param>
+    explicit server(_In_ const settings& settings,
+        _In_opt_ HWND window = NULL,
+        _In_ std::unique_ptr<transport>&& transport = nullptr);
 
     /// <summary>
     /// Finalises the instance.
@@ -41,51 +56,452 @@ public:
     ~server(void) noexcept;
 
     /// <summary>
-    /// Sends the specified datagram to all connected clients.
+    /// Answer the backpressure each of the connected clients has experienced.
     /// </summary>
-    /// <param name="data"></param>
-    /// <param name="cnt"></param>
-    void send(_In_reads_(cnt) const char *data, _In_ const int cnt) noexcept;
+    /// <returns>The address and the backpressure counters of each client.
+    /// </returns>
+    std::vector<std::pair<sockaddr_storage, outbox::counters>> backpressure(
+        void);
 
     /// <summary>
-    /// Sends the specified message to all connected clients.
+    /// Sends the specified message to all connected clients, each of them in
+    /// the best format it has negotiated when connecting.
     /// </summary>
     /// <remarks>
     /// The method will update the sequence number in the message before sending
-    /// it.
+    /// it. Furthermore, the message is recorded in the state snapshot that is
+    /// sent to clients connecting later. Button events are retransmitted to
+    /// clients having negotiated <see cref="mmp_capability_ack"/> until they
+    /// are acknowledged, whereas moves are never delayed or repeated. Moves
+    /// are only sent to clients that have subscribed to a region of interest
+    /// while the mouse is in their region or just leaving it, and they are
+    /// coalesced down to the rate a client has declared. Once there are
+    /// enough clients, the fan-out is distributed across several sender
+    /// threads.
     /// </remarks>
     /// <typeparam name="TMessage"></typeparam>
     /// <param name="message"></param>
     template<class TMessage>
     inline void send(_In_ TMessage& message) noexcept {
+        // Note: the lock must be held while assigning the sequence number in
+        // order to keep it consistent with the snapshot.
+        std::lock_guard<std::mutex> lock(this->_lock);
+
+        // A standby must not disturb the state it mirrors from the primary.
+        if (this->_standby) {
+            return;
+        }
+
         message.sequence_number = ::htonl(this->_sequence_number++);
-        this->send(reinterpret_cast<const char *>(std::addressof(message)),
-            static_cast<int>(sizeof(TMessage)));
+        this->update_state(message);
+
+        const auto now = timestamp();
+        this->_timestamp = now;
+        const auto reliable = server::reliable(message);
+        const auto ts = server::timestamped(message, now);
+
+        // Note: the formats must be ordered from best to worst, because the
+        // first one matching the capabilities of a client is used.
+        const datagram datagrams[] = {
+            this->history(now, reliable),
+            datagram(mmp_capability_timestamp, ts),
+            datagram(mmp_capability_none, message)
+        };
+        this->send(datagrams, std::size(datagrams), reliable,
+            server::filtered(message));
     }
 
 private:
 
-    static std::vector<sockaddr_storage> addresses(void);
+    /// <summary>
+    /// A message encoded in one of the wire formats along with the
+    /// capabilities a client must have negotiated to receive it.
+    /// </summary>
+    struct datagram final {
+        mmp_capabilities capabilities;
+        const char *data;
+        int size;
+
+        template<class TMessage>
+        inline datagram(_In_ const mmp_capabilities capabilities,
+                _In_ const TMessage& message) noexcept
+            : capabilities(capabilities),
+            data(reinterpret_cast<const char *>(std::addressof(message))),
+            size(static_cast<int>(sizeof(TMessage))) { }
+
+        inline datagram(_In_ const mmp_capabilities capabilities,
+                _In_ const std::vector<char>& data) noexcept
+            : capabilities(capabilities),
+            data(data.data()),
+            size(static_cast<int>(data.size())) { }
+    };
+
+    /// <summary>
+    /// Find the IPv4 broadcast addresses of all active adapters on the system
+    /// using the given <paramref name="port"/>.
+    /// </summary>
+    /// <param name="port">The port in host-byte order.</param>
+    /// <returns>The broadcast addresses.</returns>
+    static std::vector<sockaddr_in> broadcast_addresses(
+        _In_ const std::uint16_t port);
+
+    /// <summary>
+    /// The maximum number of clients replicated to a standby, which keeps
+    /// <see cref="mmp_msg_replica"/> within a single datagram.
+    /// </summary>
+    static constexpr std::size_t max_replicated_clients = 1024;
+
+    /// <summary>
+    /// Answer the best of the given <paramref name="datagrams"/> for a client
+    /// with the given <paramref name="capabilities"/>.
+    /// </summary>
+    /// <remarks>
+    /// The last datagram must be the basic one that all clients support.
+    /// </remarks>
+    static const datagram *format(_In_reads_(cnt) const datagram *datagrams,
+        _In_ const std::size_t cnt,
+        _In_ const mmp_capabilities capabilities) noexcept;
 
     static void copy_port(_In_ sockaddr_storage& dst,
         _In_ const sockaddr *src);
 
+    /// <summary>
+    /// Answer whether the message is only sent to the clients whose region
+    /// of interest it affects.
+    /// </summary>
+    static inline constexpr bool filtered(
+            _In_ const mmp_msg_mouse_button&) noexcept {
+        return false;
+    }
+
+    /// <summary>
+    /// Answer whether the message is only sent to the clients whose region
+    /// of interest it affects.
+    /// </summary>
+    static inline constexpr bool filtered(
+            _In_ const mmp_msg_mouse_move&) noexcept {
+        return true;
+    }
+
     static std::uint16_t get_port(_In_ const sockaddr *src);
 
+    /// <summary>
+    /// Answer whether the message must be retransmitted until the client has
+    /// acknowledged it.
+    /// </summary>
+    static inline constexpr bool reliable(
+            _In_ const mmp_msg_mouse_button&) noexcept {
+        return true;
+    }
+
+    /// <summary>
+    /// Answer whether the message must be retransmitted until the client has
+    /// acknowledged it.
+    /// </summary>
+    static inline constexpr bool reliable(
+            _In_ const mmp_msg_mouse_move&) noexcept {
+        return false;
+    }
+
     static void set_port(_In_ sockaddr *dst, _In_ const std::uint16_t port);
 
+    static std::uint64_t timestamp(void) noexcept;
+
+    static inline mmp_msg_mouse_button_ts timestamped(
+            _In_ const mmp_msg_mouse_button& message,
+            _In_ const std::uint64_t timestamp) noexcept {
+        return mmp_msg_mouse_button_ts(message, timestamp);
+    }
+
+    static inline mmp_msg_mouse_move_ts timestamped(
+            _In_ const mmp_msg_mouse_move& message,
+            _In_ const std::uint64_t timestamp) noexcept {
+        return mmp_msg_mouse_move_ts(message, timestamp);
+    }
+
     static std::wstring to_string(_In_ const sockaddr_storage& address);
 
-    //sockaddr_storage address(_In_ const sockaddr_storage& peer);
+    /// <summary>
+    /// Evicts the client with the given <paramref name="address"/> that a
+    /// shard has given up, because it cannot be reached.
+    /// </summary>
+    /// <remarks>
+    /// This method is invoked on the thread of the shard and acquires
+    /// <see cref="_lock"/>.
+    /// </remarks>
+    void abandon(_In_ const sockaddr_storage& address);
+
+    /// <summary>
+    /// Answer the announcement describing the current state of the server.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    /// <param name="token">The token of the discovery request to be echoed
+    /// in host-byte order, or zero for a beacon.</param>
+    /// <returns>The announcement.</returns>
+    mmp_msg_announce announcement(
+        _In_ const std::uint32_t token) const noexcept;
+
+    /// <summary>
+    /// Broadcasts the announcement of the server to the given
+    /// <paramref name="port"/> at the given <paramref name="interval"/> in a
+    /// separate thread until the server is stopped.
+    /// </summary>
+    /// <param name="interval">The time between two beacons.</param>
+    /// <param name="port">The port clients listen for beacons on in
+    /// host-byte order.</param>
+    void beacon(_In_ const std::chrono::milliseconds interval,
+        _In_ const std::uint16_t port);
+
+    /// <summary>
+    /// Hands all datagrams sent to clients since the last call to the
+    /// transport.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void commit(void);
+
+    /// <summary>
+    /// Sends a heartbeat to all clients that have negotiated
+    /// <see cref="mmp_capability_heartbeat"/>.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void heartbeat(void);
+
+    /// <summary>
+    /// Sends the datagrams queued for clients while the socket was busy and
+    /// evicts the clients that have not made any progress for
+    /// <see cref="outbox::max_stall"/>.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    /// <param name="now">The current time.</param>
+    void drain(_In_ const retransmitter::time_point now);
+
+    /// <summary>
+    /// Removes the client <paramref name="it"/> points to and records this in
+    /// the journal.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    /// <param name="it">The client to be removed.</param>
+    /// <returns>The iterator to the next client.</returns>
+    std::set<client>::iterator evict(_In_ std::set<client>::iterator it);
+
+    /// <summary>
+    /// Encodes the current state along with the most recent events as
+    /// <see cref="mmp_msg_mouse_history"/> and records the current state as
+    /// the most recent event afterwards.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>. The datagram returned points
+    /// to <see cref="_history_buffer"/> and remains valid until the next call.
+    /// Both the history and the buffer are reserved for the configured depth
+    /// when the server is created, such that this method never allocates.
+    /// </remarks>
+    /// <param name="timestamp">The timestamp of the current event.</param>
+    /// <param name="reliable">Indicates whether the client must acknowledge
+    /// the datagram.</param>
+    /// <returns>The datagram for clients supporting the history.</returns>
+    datagram history(_In_ const std::uint64_t timestamp,
+        _In_ const bool reliable) noexcept;
+
+    /// <summary>
+    /// Answer the shard with the fewest clients.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>, and there must be at least
+    /// one shard.
+    /// </remarks>
+    shard& least_loaded(void);
+
+    /// <summary>
+    /// Adopts the session, the state and the clients of the primary from the
+    /// given replica while running as standby.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    /// <param name="msg">The replica received from the primary.</param>
+    void mirror(_In_ const visus::mmp::wire::view<mmp_msg_replica>& msg);
+
+    /// <summary>
+    /// Sends a move to the current position to all clients that have moves
+    /// deferred by their pacing and whose slot has opened at
+    /// <paramref name="now"/>.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    /// <param name="now">The current time.</param>
+    void pace(_In_ const retransmitter::time_point now);
+
+    /// <summary>
+    /// Sends a datagram to the given <paramref name="client"/> after the
+    /// datagrams queued for it, or queues it if the socket is busy.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    /// <param name="client">The recipient of the datagram.</param>
+    /// <param name="data">The datagram.</param>
+    /// <param name="size">The size of the datagram in bytes.</param>
+    /// <param name="move">Indicates whether the datagram is a move, which
+    /// supersedes the moves queued before.</param>
+    /// <param name="now">The current time.</param>
+    /// <returns><see langword="true" /> if the datagram was sent or queued,
+    /// <see langword="false" /> if the client should be evicted, because it
+    /// cannot be reached or has not made any progress for
+    /// <see cref="outbox::max_stall"/>.</returns>
+    bool post(_In_ const client& client,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size,
+        _In_ const bool move,
+        _In_ const retransmitter::time_point now);
+
+    /// <summary>
+    /// Sends the session, the state and the clients to all standbys.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void replicate(void);
+
+    /// <summary>
+    /// Distributes the clients across the shards once their number has
+    /// reached the threshold, returns to fanning out on a single thread once
+    /// it has fallen below half of the threshold and otherwise keeps the
+    /// shards balanced.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void reshard(void);
+
+    /// <summary>
+    /// Retransmits unacknowledged button events in a separate thread, which
+    /// also sends the heartbeats if these are enabled, flushes the moves
+    /// coalesced for paced clients, compacts the journal and evicts restored
+    /// clients that have not connected again.
+    /// </summary>
+    void retransmit(void);
+
+    /// <summary>
+    /// Sends one of the given <paramref name="datagrams"/> to each of the
+    /// connected clients, namely the first one the client has negotiated the
+    /// capabilities for.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/> and must have recorded the
+    /// message in <see cref="_state"/> before.
+    /// </remarks>
+    /// <param name="datagrams"></param>
+    /// <param name="cnt"></param>
+    /// <param name="reliable">If <see langword="true" />, the datagram is
+    /// tracked for retransmission for all clients supporting
+    /// <see cref="mmp_capability_ack"/>.</param>
+    /// <param name="filtered">If <see langword="true" />, the datagram is
+    /// only sent to clients that see the position in <see cref="_state"/>
+    /// and whose pacing admits it; otherwise, it cancels any move deferred by
+    /// the pacing, because it carries the position as well.</param>
+    void send(_In_reads_(cnt) const datagram *datagrams,
+        _In_ const std::size_t cnt,
+        _In_ const bool reliable,
+        _In_ const bool filtered) noexcept;
 
     void serve(_In_ settings settings);
 
+    /// <summary>
+    /// Makes the standby the primary after the primary has fallen silent,
+    /// which includes starting a new session with a higher epoch that makes
+    /// clients switch over.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    /// <param name="now">The current time.</param>
+    void take_over(_In_ const retransmitter::time_point now);
+
+    /// <summary>
+    /// Sends a datagram to the given <paramref name="client"/> without
+    /// blocking with the next <see cref="commit"/>.
+    /// </summary>
+    /// <returns>Zero in case of success, the socket error otherwise.</returns>
+    int transmit(_In_ const client& client,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept;
+
+    /// <summary>
+    /// Sends a datagram to the given <paramref name="peer"/> immediately.
+    /// </summary>
+    /// <returns>Zero in case of success, the socket error otherwise.</returns>
+    int transmit(_In_ const sockaddr_storage& peer,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept;
+
+    /// <summary>
+    /// Removes the client with the given <paramref name="address"/> from its
+    /// shard if the fan-out is distributed.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void unshard(_In_ const sockaddr_storage& address);
+
+    /// <summary>
+    /// Records the given message in the state snapshot.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    /// <param name="message"></param>
+    void update_state(_In_ const mmp_msg_mouse_button& message) noexcept;
+
+    /// <summary>
+    /// Records the given message in the state snapshot.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    /// <param name="message"></param>
+    void update_state(_In_ const mmp_msg_mouse_move& message) noexcept;
+
+    std::thread _beacon;
+    std::condition_variable _beacon_signal;
     std::set<client> _clients;
+    const std::chrono::milliseconds _heartbeat;
+    std::vector<mmp_msg_history_entry> _history;
+    std::vector<char> _history_buffer;
+    const std::uint32_t _history_depth;
+    std::unique_ptr<client_journal> _journal;
     std::mutex _lock;
+    std::vector<std::pair<sockaddr_storage, int>> _outcomes;
+    broadcast_ring::event _outgoing;
+    sockaddr_storage _primary;
+    retransmitter::time_point _primary_deadline;
+    retransmitter::time_point _probation;
+    std::set<sockaddr_storage> _restored;
+    std::condition_variable _retransmit;
+    std::thread _retransmitter;
+    broadcast_ring _ring;
     std::atomic<bool> _running;
     std::atomic<mmp_seq_no> _sequence_number;
-    wil::unique_socket _socket;
+    const std::size_t _shard_threshold;
+    bool _sharded;
+    std::vector<std::unique_ptr<shard>> _shards;
+    std::unique_ptr<shared_ring> _shared;
+    bool _standby;
+    std::set<sockaddr_storage> _standbys;
+    mmp_msg_state _state;
     std::thread _server;
+    std::uint64_t _timestamp;
+    std::unique_ptr<transport> _transport;
     HWND _window;
 
 };
@@ -12,7 +12,9 @@
 /*
  * settings::settings
  */
-settings::settings(void) noexcept : _height(0), _width(0) {
+settings::settings(void) noexcept : _beacon(0), _heartbeat(1000),
+        _height(0), _history(4), _journal(0), _shard_threshold(256),
+        _shards(0), _width(0) {
     ::memset(&this->_address, 0, sizeof(this->_address));
     this->_address.ss_family = AF_INET;
 }
@@ -77,7 +79,27 @@ void settings::load(_In_ HKEY key) {
         }
     }
 
+    get_uint(L"Beacon", this->_beacon);
+    get_uint(L"Heartbeat", this->_heartbeat);
     get_uint(L"Height", this->_height);
+    get_uint(L"History", this->_history);
+    get_uint(L"Journal", this->_journal);
+
+    {
+        DWORD size = 0;
+        if (::RegGetValueW(key, nullptr, L"Primary", RRF_RT_REG_SZ, nullptr,
+                nullptr, &size) == ERROR_SUCCESS) {
+            std::wstring value(size / sizeof(wchar_t), L'\0');
+            if (::RegGetValueW(key, nullptr, L"Primary", RRF_RT_REG_SZ,
+                    nullptr, &value[0], &size) == ERROR_SUCCESS) {
+                value.resize(::wcslen(value.c_str()));
+                this->_primary = value;
+            }
+        }
+    }
+
+    get_uint(L"ShardThreshold", this->_shard_threshold);
+    get_uint(L"Shards", this->_shards);
     get_uint(L"Width", this->_width);
 }
 
@@ -105,7 +127,18 @@ nlohmann::json nlohmann::adl_serializer<settings>::to_json(
             } break;
     }
 
+    retval["Beacon"] = value._beacon;
+    retval["Heartbeat"] = value._heartbeat;
     retval["Height"] = value._height;
+    retval["History"] = value._history;
+    retval["Journal"] = value._journal;
+    if (!value._primary.empty()) {
+        // Note: addresses are ASCII-only, so narrowing is safe.
+        retval["Primary"] = std::string(value._primary.begin(),
+            value._primary.end());
+    }
+    retval["ShardThreshold"] = value._shard_threshold;
+    retval["Shards"] = value._shards;
     retval["Width"] = value._width;
 
     return retval;
@@ -147,11 +180,61 @@ settings nlohmann::adl_serializer<settings>::from_json(
         } /* if (it != json.end()) */
     }
 
+    {
+        auto it = json.find("Beacon");
+        if (it != json.end()) {
+            retval._beacon = it->get<std::uint32_t>();
+        }
+    }
+
+    {
+        auto it = json.find("Heartbeat");
+        if (it != json.end()) {
+            retval._heartbeat = it->get<std::uint32_t>();
+        }
+    }
+
     {
         auto it = json.find("Height");
         retval._height = (it != json.end()) ? it->get<std::uint32_t>() : 0;
     }
 
+    {
+        auto it = json.find("History");
+        if (it != json.end()) {
+            retval._history = it->get<std::uint32_t>();
+        }
+    }
+
+    {
+        auto it = json.find("Journal");
+        if (it != json.end()) {
+            retval._journal = it->get<std::uint32_t>();
+        }
+    }
+
+    {
+        auto it = json.find("Primary");
+        if (it != json.end()) {
+            const auto value = it->get<std::string>();
+            retval._primary = std::wstring(value.begin(), value.end());
+        }
+    }
+
+    {
+        auto it = json.find("ShardThreshold");
+        if (it != json.end()) {
+            retval._shard_threshold = it->get<std::uint32_t>();
+        }
+    }
+
+    {
+        auto it = json.find("Shards");
+        if (it != json.end()) {
+            retval._shards = it->get<std::uint32_t>();
+        }
+    }
+
     {
         auto it = json.find("Width");
         retval._width = (it != json.end()) ? it->get<std::uint32_t>() : 0;
@@ -173,8 +256,36 @@ bool std::less<sockaddr_storage>::operator ()(_In_ const sockaddr_storage& lhs,
 
     } else if (dp > 0) {
         return false;
+    }
+
+    // Only the port, the address and the scope identify a peer. Everything
+    // else, including the padding of the storage, is undefined and must not
+    // affect the order.
+    switch (lhs.ss_family) {
+        case AF_INET: {
+            auto& l = reinterpret_cast<const sockaddr_in&>(lhs);
+            auto& r = reinterpret_cast<const sockaddr_in&>(rhs);
+            if (l.sin_port != r.sin_port) {
+                return (l.sin_port < r.sin_port);
+            }
+            return (::memcmp(&l.sin_addr, &r.sin_addr, sizeof(l.sin_addr)) < 0);
+            }
 
-    } else {
-        return (::memcmp(&lhs, &rhs, sizeof(sockaddr_storage)) < 0);
+        case AF_INET6: {
+            auto& l = reinterpret_cast<const sockaddr_in6&>(lhs);
+            auto& r = reinterpret_cast<const sockaddr_in6&>(rhs);
+            if (l.sin6_port != r.sin6_port) {
+                return (l.sin6_port < r.sin6_port);
+            }
+            const auto da = ::memcmp(&l.sin6_addr, &r.sin6_addr,
+                sizeof(l.sin6_addr));
+            if (da != 0) {
+                return (da < 0);
+            }
+            return (l.sin6_scope_id < r.sin6_scope_id);
+            }
+
+        default:
+            return (::memcmp(&lhs, &rhs, sizeof(sockaddr_storage)) < 0);
     }
 }
@@ -51,6 +51,27 @@ public:
     /// <returns></returns>
     int address_length(void) const noexcept;
 
+    /// <summary>
+    /// Gets the interval in milliseconds at which the server broadcasts its
+    /// announcement such that clients can discover it passively. If this
+    /// interval is zero, no beacons are sent.
+    /// </summary>
+    /// <returns></returns>
+    inline std::uint32_t beacon(void) const noexcept {
+        return this->_beacon;
+    }
+
+    /// <summary>
+    /// Gets the interval in milliseconds at which the server sends heartbeats
+    /// to clients that asked for them such that they can detect a restart or
+    /// a failure of the server. If this interval is zero, no heartbeats are
+    /// sent.
+    /// </summary>
+    /// <returns></returns>
+    inline std::uint32_t heartbeat(void) const noexcept {
+        return this->_heartbeat;
+    }
+
     /// <summary>
     /// Gets the height of the mouse pad in pixels. If this height is zero,
     /// the scrolling area is unbounded vertically.
@@ -60,6 +81,27 @@ public:
         return this->_height;
     }
 
+    /// <summary>
+    /// Gets the number of past events the server repeats in every message to
+    /// clients that asked for the loss-resilient format. Each of them adds
+    /// 16 bytes to every datagram.
+    /// </summary>
+    /// <returns></returns>
+    inline std::uint32_t history(void) const noexcept {
+        return this->_history;
+    }
+
+    /// <summary>
+    /// Gets whether the server persists its clients in a journal such that it
+    /// can resume sending to them after a restart. Restored clients must
+    /// connect again within three heartbeats, which is why the journal has no
+    /// effect unless heartbeats are enabled.
+    /// </summary>
+    /// <returns></returns>
+    inline std::uint32_t journal(void) const noexcept {
+        return this->_journal;
+    }
+
     /// <summary>
     /// Loads the settings from the given registry key.
     /// </summary>
@@ -67,6 +109,38 @@ public:
     /// be loaded.</param>
     void load(_In_ HKEY key);
 
+    /// <summary>
+    /// Gets the address of the primary server in the form accepted by
+    /// <c>WSAStringToAddress</c>, e.g. <c>192.168.0.1:14753</c>, if this
+    /// instance should run as hot standby. If the string is empty, the server
+    /// is a primary. A standby requires heartbeats to be enabled.
+    /// </summary>
+    /// <returns></returns>
+    inline const std::wstring& primary(void) const noexcept {
+        return this->_primary;
+    }
+
+    /// <summary>
+    /// Gets the number of sender threads that fan out the events once the
+    /// number of clients reaches <see cref="shard_threshold"/>. If this is
+    /// zero, the server always sends to all clients on a single thread.
+    /// </summary>
+    /// <returns></returns>
+    inline std::uint32_t shards(void) const noexcept {
+        return this->_shards;
+    }
+
+    /// <summary>
+    /// Gets the number of clients from which on the server fans out the
+    /// events on <see cref="shards"/> sender threads. The server returns to
+    /// a single thread once the number of clients falls below half of the
+    /// threshold.
+    /// </summary>
+    /// <returns></returns>
+    inline std::uint32_t shard_threshold(void) const noexcept {
+        return this->_shard_threshold;
+    }
+
     /// <summary>
     /// Gets the width of the mouse pad in pixels. If this width is zero,
     /// the scrolling area is unbounded horizontally.
@@ -79,7 +153,14 @@ public:
 private:
 
     sockaddr_storage _address;
+    std::uint32_t _beacon;
+    std::uint32_t _heartbeat;
     std::uint32_t _height;
+    std::uint32_t _history;
+    std::uint32_t _journal;
+    std::wstring _primary;
+    std::uint32_t _shard_threshold;
+    std::uint32_t _shards;
     std::uint32_t _width;
 
     friend struct nlohmann::adl_serializer<settings>;
@@ -0,0 +1,325 @@
+﻿// <copyright file="shard.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "shard.h"
+
+#include <algorithm>
+
+#include <mmpthreadname.h>
+
+#include "mmptrace.h"
+
+
+/*
+ * shard::shard
+ */
+shard::shard(_In_ broadcast_ring& ring,
+        _In_ std::unique_ptr<transport>&& transport,
+        _In_ eviction_handler&& evicted)
+        : _cursor(ring.published()),
+        _evicted(std::move(evicted)),
+        _ring(ring),
+        _transport(std::move(transport)) {
+    this->_latest.count = 0;
+
+    this->_thread = std::thread(&shard::run, this);
+}
+
+
+/*
+ * shard::~shard
+ */
+shard::~shard(void) noexcept {
+    if (this->_thread.joinable()) {
+        this->_thread.join();
+    }
+}
+
+
+/*
+ * shard::add
+ */
+void shard::add(_In_ const client& client) {
+    std::lock_guard<std::mutex> l(this->_lock);
+    this->_members.emplace(client.address(),
+        client.version(),
+        client.capabilities(),
+        client.region(),
+        client.pacing().rate());
+}
+
+
+/*
+ * shard::backpressure
+ */
+void shard::backpressure(
+        _Inout_ std::vector<
+            std::pair<sockaddr_storage, outbox::counters>>& dst) {
+    std::lock_guard<std::mutex> l(this->_lock);
+    for (auto& m : this->_members) {
+        dst.emplace_back(m.address(), m.backlog().backpressure());
+    }
+}
+
+
+/*
+ * shard::clear
+ */
+void shard::clear(void) noexcept {
+    std::lock_guard<std::mutex> l(this->_lock);
+    this->_members.clear();
+}
+
+
+/*
+ * shard::rate
+ */
+void shard::rate(_In_ const sockaddr_storage& address,
+        _In_ const std::uint32_t rate) {
+    std::lock_guard<std::mutex> l(this->_lock);
+    auto it = this->_members.find(client(address));
+    if (it != this->_members.end()) {
+        it->pacing().rate(rate);
+    }
+}
+
+
+/*
+ * shard::remove
+ */
+bool shard::remove(_In_ const sockaddr_storage& address) {
+    std::lock_guard<std::mutex> l(this->_lock);
+    return (this->_members.erase(client(address)) > 0);
+}
+
+
+/*
+ * shard::size
+ */
+std::size_t shard::size(void) {
+    std::lock_guard<std::mutex> l(this->_lock);
+    return this->_members.size();
+}
+
+
+/*
+ * shard::transfer
+ */
+void shard::transfer(_In_ shard& other) {
+    std::scoped_lock l(this->_lock, other._lock);
+    if (!this->_members.empty()) {
+        auto node = this->_members.extract(this->_members.begin());
+        other._members.insert(std::move(node));
+    }
+}
+
+
+/*
+ * shard::format
+ */
+std::size_t shard::format(_In_ const broadcast_ring::event& event,
+        _In_ const client& client) noexcept {
+    // The last format must always be the basic one that all clients support.
+    std::size_t retval = 0;
+    for (; retval < event.count - 1; ++retval) {
+        const auto c = event.capabilities[retval];
+        if ((c & client.capabilities()) == c) {
+            break;
+        }
+    }
+
+    return retval;
+}
+
+
+/*
+ * shard::complete
+ */
+void shard::complete(
+        _In_ const std::vector<std::pair<sockaddr_storage, int>>& outcomes,
+        _In_ const outbox::time_point now,
+        _Inout_ std::vector<sockaddr_storage>& evicted) {
+    for (auto& o : outcomes) {
+        auto it = this->_members.find(client(o.first));
+        if ((it != this->_members.end())
+                && !it->backlog().complete(o.second, now)) {
+            evicted.push_back(it->address());
+            this->_members.erase(it);
+        }
+    }
+}
+
+
+/*
+ * shard::fan_out
+ */
+void shard::fan_out(_In_ const broadcast_ring::event& event,
+        _In_ const outbox::time_point now,
+        _Inout_ std::vector<sockaddr_storage>& evicted) {
+    for (auto it = this->_members.begin(); it != this->_members.end();) {
+        if (event.filtered) {
+            if (!it->sees(event.position) || !it->pacing().admit(now)) {
+                ++it;
+                continue;
+            }
+        } else {
+            it->pacing().discard();
+        }
+
+        const auto f = shard::format(event, *it);
+        if (!this->post(*it, event.data[f].data(), event.size[f],
+                event.filtered, now)) {
+            evicted.push_back(it->address());
+            it = this->_members.erase(it);
+            continue;
+        }
+
+        ++it;
+    }
+}
+
+
+/*
+ * shard::flush
+ */
+void shard::flush(_In_ const outbox::time_point now,
+        _Inout_ std::vector<sockaddr_storage>& evicted) {
+    for (auto it = this->_members.begin(); it != this->_members.end();) {
+        auto& backlog = it->backlog();
+        auto keep = true;
+
+        if (!backlog.empty()) {
+            const auto status = backlog.flush(now,
+                    [this, it](const char *data, const std::size_t size) {
+                return this->_transport->send(*it, data,
+                    static_cast<int>(size));
+            });
+            keep = (status == 0)
+                || (outbox::transient(status) && !backlog.stalled(now));
+        }
+
+        // The deferred move is the most recent one the shard has seen.
+        if (keep && it->pacing().flush(now) && (this->_latest.count > 0)) {
+            const auto f = shard::format(this->_latest, *it);
+            keep = this->post(*it, this->_latest.data[f].data(),
+                this->_latest.size[f], true, now);
+        }
+
+        if (!keep) {
+            evicted.push_back(it->address());
+            it = this->_members.erase(it);
+            continue;
+        }
+
+        ++it;
+    }
+}
+
+
+/*
+ * shard::post
+ */
+bool shard::post(_In_ const client& client,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const std::size_t size,
+        _In_ const bool move,
+        _In_ const outbox::time_point now) {
+    return client.backlog().post(data, size, move, now,
+            [this, &client](const char *data, const std::size_t size) {
+        return this->_transport->send(client, data, static_cast<int>(size));
+    });
+}
+
+
+/*
+ * shard::resync
+ */
+void shard::resync(_In_ const outbox::time_point now,
+        _Inout_ std::vector<sockaddr_storage>& evicted) {
+    // The state is recorded before each event is published, so the state
+    // read after the cursor reflects at least all of the skipped events.
+    // Events that it already reflects might be sent again, which the clients
+    // recognise by their sequence numbers.
+    const auto cursor = this->_ring.published();
+    mmp_msg_state state;
+    this->_ring.load_state(state);
+    MMP_TRACE(L"Sender thread was lapped, resynchronising at event %llu.",
+        cursor);
+    this->_cursor = cursor;
+
+    for (auto it = this->_members.begin(); it != this->_members.end();) {
+        if ((it->capabilities() & mmp_capability_state) == 0) {
+            ++it;
+            continue;
+        }
+
+        if (!this->post(*it, reinterpret_cast<const char *>(&state),
+                sizeof(state), false, now)) {
+            evicted.push_back(it->address());
+            it = this->_members.erase(it);
+            continue;
+        }
+
+        ++it;
+    }
+}
+
+
+/*
+ * shard::run
+ */
+void shard::run(void) {
+    mmp_set_thread_name(-1, "Magic mouse pad sender");
+    broadcast_ring::event event;
+    std::vector<sockaddr_storage> evicted;
+    std::vector<std::pair<sockaddr_storage, int>> outcomes;
+
+    while (true) {
+        auto deadline = (outbox::time_point::max)();
+        {
+            std::lock_guard<std::mutex> l(this->_lock);
+            for (auto& m : this->_members) {
+                deadline = (std::min)(deadline, m.backlog().deadline());
+                deadline = (std::min)(deadline, m.pacing().deadline());
+            }
+        }
+
+        if (!this->_ring.wait(this->_cursor, deadline)) {
+            break;
+        }
+
+        const auto now = outbox::clock::now();
+        {
+            std::lock_guard<std::mutex> l(this->_lock);
+            for (auto status = this->_ring.read(this->_cursor, event);
+                    status != broadcast_ring::read_status::empty;
+                    status = this->_ring.read(this->_cursor, event)) {
+                if (status == broadcast_ring::read_status::lapped) {
+                    this->resync(now, evicted);
+                    continue;
+                }
+
+                this->fan_out(event, now, evicted);
+
+                if (event.filtered) {
+                    std::swap(this->_latest, event);
+                }
+            }
+
+            this->flush(now, evicted);
+            this->_transport->commit(outcomes);
+            this->complete(outcomes, now, evicted);
+            outcomes.clear();
+        }
+
+        // Note: the handler takes the lock of the server, which must never be
+        // acquired while holding the lock of a shard.
+        for (auto& a : evicted) {
+            this->_evicted(a);
+        }
+        evicted.clear();
+    }
+}
@@ -0,0 +1,199 @@
+﻿// <copyright file="shard.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <cinttypes>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <WinSock2.h>
+#include <ws2ipdef.h>
+
+#include "broadcast_ring.h"
+#include "client.h"
+#include "outbox.h"
+#include "transport.h"
+
+
+/// <summary>
+/// A sender thread that fans out the events published in a
+/// <see cref="broadcast_ring"/> to its own subset of the clients using its
+/// own transport.
+/// </summary>
+/// <remarks>
+/// <para>The shard owns a copy of each of its clients, whose region of
+/// interest, pacing and backlog are only used by the shard thread and
+/// protected by the lock of the shard. Button events are still tracked for
+/// retransmission by the server, because the retransmission state of a
+/// client is protected by the client lock of the server.</para>
+/// <para>If the transport is UDP, its sockets are bound to ephemeral ports,
+/// so clients receive the events from another port than the one of the
+/// server, which they ignore. Like the server, the shard has a socket for
+/// each interface if the host has several ones.</para>
+/// </remarks>
+class shard final {
+
+public:
+
+    /// <summary>
+    /// The callback invoked on the shard thread for a client that the shard
+    /// has given up, because it cannot be reached.
+    /// </summary>
+    typedef std::function<void(const sockaddr_storage&)> eviction_handler;
+
+    /// <summary>
+    /// Initialises a new instance and starts the sender thread.
+    /// </summary>
+    /// <param name="ring">The ring the events are published in, which must
+    /// live longer than the shard.</param>
+    /// <param name="transport">The transport to send the events with, which
+    /// is usually forked from the one of the server.</param>
+    /// <param name="evicted">The callback for evicted clients, which is
+    /// invoked without holding the lock of the shard.</param>
+    shard(_In_ broadcast_ring& ring,
+        _In_ std::unique_ptr<transport>&& transport,
+        _In_ eviction_handler&& evicted);
+
+    shard(const shard&) = delete;
+
+    /// <summary>
+    /// Finalises the instance.
+    /// </summary>
+    /// <remarks>
+    /// The ring must have been stopped before, because the sender thread is
+    /// joined.
+    /// </remarks>
+    ~shard(void) noexcept;
+
+    /// <summary>
+    /// Makes the shard send to the given <paramref name="client"/>.
+    /// </summary>
+    void add(_In_ const client& client);
+
+    /// <summary>
+    /// Appends the address and the backpressure counters of each client of
+    /// the shard to <paramref name="dst"/>.
+    /// </summary>
+    void backpressure(
+        _Inout_ std::vector<
+            std::pair<sockaddr_storage, outbox::counters>>& dst);
+
+    /// <summary>
+    /// Removes all clients from the shard.
+    /// </summary>
+    void clear(void) noexcept;
+
+    /// <summary>
+    /// Changes the maximum number of moves per second sent to the client
+    /// with the given <paramref name="address"/>.
+    /// </summary>
+    void rate(_In_ const sockaddr_storage& address,
+        _In_ const std::uint32_t rate);
+
+    /// <summary>
+    /// Removes the client with the given <paramref name="address"/>.
+    /// </summary>
+    /// <returns><see langword="true" /> if the client was a member of the
+    /// shard, <see langword="false" /> otherwise.</returns>
+    bool remove(_In_ const sockaddr_storage& address);
+
+    /// <summary>
+    /// Answer the number of clients in the shard.
+    /// </summary>
+    std::size_t size(void);
+
+    /// <summary>
+    /// Moves one client along with its state to the <paramref name="other"/>
+    /// shard.
+    /// </summary>
+    void transfer(_In_ shard& other);
+
+    shard& operator =(const shard&) = delete;
+
+private:
+
+    /// <summary>
+    /// Answer the index of the best format of <paramref name="event"/> the
+    /// given <paramref name="client"/> understands.
+    /// </summary>
+    static std::size_t format(_In_ const broadcast_ring::event& event,
+        _In_ const client& client) noexcept;
+
+    /// <summary>
+    /// Applies the <paramref name="outcomes"/> of committed sends to the
+    /// backlogs of the clients and evicts the ones that keep failing.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void complete(
+        _In_ const std::vector<std::pair<sockaddr_storage, int>>& outcomes,
+        _In_ const outbox::time_point now,
+        _Inout_ std::vector<sockaddr_storage>& evicted);
+
+    /// <summary>
+    /// Sends <paramref name="event"/> to all clients of the shard.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void fan_out(_In_ const broadcast_ring::event& event,
+        _In_ const outbox::time_point now,
+        _Inout_ std::vector<sockaddr_storage>& evicted);
+
+    /// <summary>
+    /// Sends the moves deferred by the pacing of the clients and the
+    /// datagrams queued while the socket was busy.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void flush(_In_ const outbox::time_point now,
+        _Inout_ std::vector<sockaddr_storage>& evicted);
+
+    /// <summary>
+    /// Sends a datagram to <paramref name="client"/> or queues it.
+    /// </summary>
+    /// <returns><see langword="false" /> if the client must be evicted.
+    /// </returns>
+    bool post(_In_ const client& client,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const std::size_t size,
+        _In_ const bool move,
+        _In_ const outbox::time_point now);
+
+    /// <summary>
+    /// Skips all events published so far and sends the current state to the
+    /// clients that support it, which is how the shard recovers from having
+    /// been lapped by the server.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void resync(_In_ const outbox::time_point now,
+        _Inout_ std::vector<sockaddr_storage>& evicted);
+
+    /// <summary>
+    /// Reads and sends the events published in the ring until it has been
+    /// stopped.
+    /// </summary>
+    void run(void);
+
+    std::uint64_t _cursor;
+    eviction_handler _evicted;
+    broadcast_ring::event _latest;
+    std::mutex _lock;
+    std::set<client> _members;
+    broadcast_ring& _ring;
+    std::thread _thread;
+    std::unique_ptr<transport> _transport;
+};
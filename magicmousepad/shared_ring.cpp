@@ -0,0 +1,90 @@
+﻿// <copyright file="shared_ring.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "shared_ring.h"
+
+#include <wil/result.h>
+
+#include "mmptrace.h"
+
+
+/*
+ * shared_ring::shared_ring
+ */
+shared_ring::shared_ring(_In_ const std::uint16_t port)
+        : _port(port) {
+    const auto name = visus::mmp::shm::mapping_name(port);
+    const auto size = static_cast<DWORD>(sizeof(ring_type));
+
+    this->_mapping.reset(::CreateFileMappingW(INVALID_HANDLE_VALUE,
+        nullptr,
+        PAGE_READWRITE,
+        0,
+        size,
+        name.c_str()));
+    THROW_LAST_ERROR_IF(!this->_mapping);
+
+    this->_view.reset(static_cast<ring_type *>(::MapViewOfFile(
+        this->_mapping.get(),
+        FILE_MAP_READ | FILE_MAP_WRITE,
+        0,
+        0,
+        size)));
+    THROW_LAST_ERROR_IF(!this->_view);
+
+    // Note: if clients still hold the ring of a previous instance of the
+    // server, its events are kept such that the clients can carry on.
+    this->_view->initialise();
+    this->_generations.fill(0);
+
+    MMP_TRACE(L"Publishing events in shared memory from position %llu.",
+        this->_view->published.load());
+}
+
+
+/*
+ * shared_ring::publish
+ */
+void shared_ring::publish(_In_reads_bytes_(size) const char *data,
+        _In_ const std::size_t size) noexcept {
+    if (!this->_view->publish(data, size,
+            [this](const std::size_t i) { this->wake(i); })) {
+        MMP_TRACE(L"A datagram of %u bytes does not fit into shared memory.",
+            static_cast<unsigned int>(size));
+    }
+}
+
+
+/*
+ * shared_ring::state
+ */
+void shared_ring::state(_In_ const mmp_msg_state& state) noexcept {
+    this->_view->store_state(state);
+}
+
+
+/*
+ * shared_ring::wake
+ */
+void shared_ring::wake(_In_ const std::size_t index) noexcept {
+    auto& event = this->_events[index];
+    const auto generation = this->_view->subscribers[index].generation.load(
+        std::memory_order_acquire);
+
+    if (!event || (generation != this->_generations[index])) {
+        try {
+            const auto name = visus::mmp::shm::event_name(this->_port, index);
+            event.reset(::OpenEventW(EVENT_MODIFY_STATE, FALSE, name.c_str()));
+        } catch (...) {
+            event.reset();
+        }
+        this->_generations[index] = generation;
+    }
+
+    if (event) {
+        ::SetEvent(event.get());
+    }
+}
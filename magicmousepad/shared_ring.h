@@ -0,0 +1,76 @@
+﻿// <copyright file="shared_ring.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <array>
+#include <cinttypes>
+
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <mmpmsg.h>
+#include <mmpshm.h>
+
+#include <wil/resource.h>
+
+
+/// <summary>
+/// Publishes the events of the server in shared memory for the clients on
+/// the same machine.
+/// </summary>
+/// <remarks>
+/// <para>The ring is a named file mapping in the session namespace, which
+/// is described in <c>mmpshm.h</c>. The server is its only writer, which is
+/// guaranteed by creating it only after the server socket has been bound to
+/// the port in its name.</para>
+/// <para>The instance is not thread-safe; the server protects it with its
+/// client lock.</para>
+/// </remarks>
+class shared_ring final {
+
+public:
+
+    /// <summary>
+    /// Creates or opens the ring of the server on the given
+    /// <paramref name="port"/>.
+    /// </summary>
+    /// <param name="port">The port of the server in host-byte order.</param>
+    /// <exception cref="wil::ResultException">If the file mapping could not
+    /// be created.</exception>
+    explicit shared_ring(_In_ const std::uint16_t port);
+
+    shared_ring(const shared_ring&) = delete;
+
+    /// <summary>
+    /// Appends the given datagram and wakes the readers waiting for it.
+    /// </summary>
+    void publish(_In_reads_bytes_(size) const char *data,
+        _In_ const std::size_t size) noexcept;
+
+    /// <summary>
+    /// Records the state sent to new clients.
+    /// </summary>
+    void state(_In_ const mmp_msg_state& state) noexcept;
+
+    shared_ring& operator =(const shared_ring&) = delete;
+
+private:
+
+    typedef visus::mmp::shm::ring ring_type;
+
+    /// <summary>
+    /// Sets the event of the subscriber with the given
+    /// <paramref name="index"/>, opening it first if the subscriber is new.
+    /// </summary>
+    void wake(_In_ const std::size_t index) noexcept;
+
+    std::array<wil::unique_handle, visus::mmp::shm::max_subscribers> _events;
+    std::array<std::uint32_t, visus::mmp::shm::max_subscribers> _generations;
+    wil::unique_handle _mapping;
+    const std::uint16_t _port;
+    wil::unique_mapview_ptr<ring_type> _view;
+};
@@ -0,0 +1,93 @@
+﻿// <copyright file="transport.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <WinSock2.h>
+#include <ws2ipdef.h>
+
+#include "client.h"
+
+
+/// <summary>
+/// The interface of the means by which the server exchanges datagrams with
+/// its clients.
+/// </summary>
+/// <remarks>
+/// <para>The server uses UDP unless another transport has been injected
+/// when it was constructed, which allows for running the protocol without
+/// a network stack, e.g. in benchmarks.</para>
+/// <para>Sending to clients and committing must be synchronised by the
+/// caller, whereas datagrams can be received and sent to peers immediately
+/// from any thread. Every sender thread uses its own instance created by
+/// <see cref="fork"/>.</para>
+/// </remarks>
+class transport {
+
+public:
+
+    /// <summary>
+    /// Finalises the instance.
+    /// </summary>
+    virtual ~transport(void) = default;
+
+    /// <summary>
+    /// Hands all datagrams sent to clients since the last call to the
+    /// kernel.
+    /// </summary>
+    /// <param name="outcomes">Receives the address of each client for which a
+    /// datagram committed before has failed, along with the socket error,
+    /// and of each client for which one has succeeded again afterwards,
+    /// along with zero.</param>
+    virtual void commit(
+        _Inout_ std::vector<std::pair<sockaddr_storage, int>>& outcomes)
+        noexcept = 0;
+
+    /// <summary>
+    /// Creates a transport that only sends, which is used by a sender
+    /// thread.
+    /// </summary>
+    /// <exception cref="wil::ResultException">If the transport could not be
+    /// created.</exception>
+    virtual std::unique_ptr<transport> fork(void) const = 0;
+
+    /// <summary>
+    /// Waits at most for <paramref name="timeout"/> for a datagram and
+    /// copies it into <paramref name="buffer"/>.
+    /// </summary>
+    /// <param name="buffer">The buffer receiving the datagram.</param>
+    /// <param name="size">The size of the buffer in bytes.</param>
+    /// <param name="peer">Receives the address of the sender.</param>
+    /// <param name="timeout">The maximum time to wait.</param>
+    /// <returns>The size of the datagram, or zero if none has been received.
+    /// </returns>
+    virtual int receive(_Out_writes_bytes_(size) char *buffer,
+        _In_ const int size,
+        _Out_ sockaddr_storage& peer,
+        _In_ const std::chrono::milliseconds timeout) noexcept = 0;
+
+    /// <summary>
+    /// Sends <paramref name="data"/> to <paramref name="client"/> with the
+    /// next <see cref="commit"/> without blocking.
+    /// </summary>
+    /// <returns>Zero in case of success, the socket error otherwise.</returns>
+    virtual int send(_In_ const client& client,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept = 0;
+
+    /// <summary>
+    /// Sends <paramref name="data"/> to <paramref name="peer"/> immediately.
+    /// </summary>
+    /// <returns>Zero in case of success, the socket error otherwise.</returns>
+    virtual int send(_In_ const sockaddr_storage& peer,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept = 0;
+};
@@ -0,0 +1,292 @@
+﻿// <copyright file="udp_transport.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "udp_transport.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include <iphlpapi.h>
+#include <WS2tcpip.h>
+
+#include <mmp_configuration.h>
+
+#include <wil/result.h>
+
+#include "mmptrace.h"
+
+
+/*
+ * udp_transport::udp_transport
+ */
+udp_transport::udp_transport(void) noexcept {
+    ::ZeroMemory(&this->_address, sizeof(this->_address));
+}
+
+
+/*
+ * udp_transport::broadcast
+ */
+int udp_transport::broadcast(void) noexcept {
+    const BOOL broadcast = TRUE;
+
+    // Beacons leave through the socket of the interface whose subnet they
+    // are broadcast to, so all of the sockets must be allowed to broadcast.
+    for (auto s : this->_sockets) {
+        if (::setsockopt(s,
+                SOL_SOCKET,
+                SO_BROADCAST,
+                reinterpret_cast<const char *>(&broadcast),
+                sizeof(broadcast)) == SOCKET_ERROR) {
+            return ::WSAGetLastError();
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * udp_transport::commit
+ */
+void udp_transport::commit(
+        _Inout_ std::vector<std::pair<sockaddr_storage, int>>& outcomes)
+        noexcept {
+    this->_egress.commit(outcomes);
+}
+
+
+/*
+ * udp_transport::fork
+ */
+std::unique_ptr<transport> udp_transport::fork(void) const {
+    // The sockets of the sender threads are bound to the address of the
+    // server, such that they use the same interfaces, but to ephemeral
+    // ports, so they do not receive anything the clients send to it.
+    auto address = this->_address;
+    int len = 0;
+    if (address.ss_family == AF_INET6) {
+        reinterpret_cast<sockaddr_in6&>(address).sin6_port = 0;
+        len = static_cast<int>(sizeof(sockaddr_in6));
+    } else {
+        reinterpret_cast<sockaddr_in&>(address).sin_port = 0;
+        len = static_cast<int>(sizeof(sockaddr_in));
+    }
+
+    auto retval = std::make_unique<udp_transport>();
+    retval->open(reinterpret_cast<const sockaddr *>(&address), len, false);
+    return retval;
+}
+
+
+/*
+ * udp_transport::open
+ */
+void udp_transport::open(_In_ const sockaddr *address,
+        _In_ const int length,
+        _In_ const bool discoverable) {
+    // Registered I/O allows for batching the fan-out, but it is not
+    // available on all systems.
+    this->_socket.reset(::WSASocket(
+        address->sa_family,
+        SOCK_DGRAM,
+        IPPROTO_UDP,
+        nullptr,
+        0,
+        WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO));
+    if (!this->_socket) {
+        this->_socket.reset(::WSASocket(
+            address->sa_family,
+            SOCK_DGRAM,
+            IPPROTO_UDP,
+            nullptr,
+            0,
+            WSA_FLAG_OVERLAPPED));
+    }
+    THROW_LAST_ERROR_IF(!this->_socket);
+    ::ZeroMemory(&this->_address, sizeof(this->_address));
+    ::memcpy(&this->_address, address, (std::min)(
+        static_cast<std::size_t>(length), sizeof(this->_address)));
+
+    THROW_LAST_ERROR_IF(::bind(this->_socket.get(), address, length)
+        == SOCKET_ERROR);
+
+    // The socket is non-blocking such that a client whose path is
+    // congested cannot stall the input thread; datagrams that cannot be
+    // sent are queued per client instead.
+    {
+        u_long nonblocking = 1;
+        THROW_LAST_ERROR_IF(::ioctlsocket(this->_socket.get(),
+            FIONBIO,
+            &nonblocking) == SOCKET_ERROR);
+    }
+
+    // If the host has several interfaces and we are bound to the wildcard
+    // address, each of them gets a socket on our port, which receives what
+    // clients on its subnet send to us and sends what we send to them.
+    {
+        const auto status = this->_egress.open(this->_socket.get(), address);
+        if (status != 0) {
+            MMP_TRACE(L"Registered I/O is not available (error %d), so "
+                L"datagrams are sent one by one.", status);
+        }
+    }
+
+    this->_sockets = this->_egress.sockets();
+    this->_sockets.push_back(this->_socket.get());
+
+#if (defined(_DEBUG) || defined(DEBUG))
+    {
+        sockaddr_storage addr { 0 };
+        int cnt_addr = sizeof(addr);
+        wchar_t name[INET6_ADDRSTRLEN + 8] = { 0 };
+        DWORD cnt_name = static_cast<DWORD>(std::size(name));
+        ::getsockname(this->_socket.get(),
+            reinterpret_cast<sockaddr *>(&addr),
+            &cnt_addr);
+        ::WSAAddressToStringW(reinterpret_cast<sockaddr *>(&addr),
+            cnt_addr, nullptr, name, &cnt_name);
+        MMP_TRACE(L"Socket bound to %s.", name);
+    }
+#endif /* (defined(_DEBUG) || defined(DEBUG)) */
+
+    // Clients on IPv6 networks cannot broadcast, so they send their
+    // discovery requests to a link-local multicast group instead.
+    if (discoverable && (address->sa_family == AF_INET6)) {
+        const auto cnt = join_discovery_group(this->_socket.get());
+        MMP_TRACE(L"Joined the IPv6 discovery group on %u interface(s).",
+            static_cast<unsigned int>(cnt));
+    }
+}
+
+
+/*
+ * udp_transport::receive
+ */
+int udp_transport::receive(_Out_writes_bytes_(size) char *buffer,
+        _In_ const int size,
+        _Out_ sockaddr_storage& peer,
+        _In_ const std::chrono::milliseconds timeout) noexcept {
+    // As the sockets are non-blocking, we need to wait for datagrams here.
+    auto socket = INVALID_SOCKET;
+    {
+        fd_set readable;
+        FD_ZERO(&readable);
+        for (auto s : this->_sockets) {
+            FD_SET(s, &readable);
+        }
+
+        timeval t;
+        t.tv_sec = static_cast<long>(timeout.count() / 1000);
+        t.tv_usec = static_cast<long>((timeout.count() % 1000) * 1000);
+        if (::select(0, &readable, nullptr, nullptr, &t) <= 0) {
+            return 0;
+        }
+
+        for (auto s : this->_sockets) {
+            if (FD_ISSET(s, &readable)) {
+                socket = s;
+                break;
+            }
+        }
+    }
+
+    int cnt_peer = sizeof(peer);
+    const auto retval = ::recvfrom(socket,
+        buffer,
+        size,
+        0,
+        reinterpret_cast<sockaddr *>(&peer),
+        &cnt_peer);
+    return (retval == SOCKET_ERROR) ? 0 : retval;
+}
+
+
+/*
+ * udp_transport::send
+ */
+int udp_transport::send(_In_ const client& client,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept {
+    return this->_egress.send(client, data, size);
+}
+
+
+/*
+ * udp_transport::send
+ */
+int udp_transport::send(_In_ const sockaddr_storage& peer,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept {
+    const auto len = (peer.ss_family == AF_INET6)
+        ? static_cast<int>(sizeof(sockaddr_in6))
+        : static_cast<int>(sizeof(sockaddr_in));
+    if (::sendto(this->_egress.socket(peer),
+            data,
+            size,
+            0,
+            reinterpret_cast<const sockaddr *>(&peer),
+            len) == SOCKET_ERROR) {
+        return ::WSAGetLastError();
+    }
+
+    return 0;
+}
+
+
+/*
+ * udp_transport::join_discovery_group
+ */
+std::size_t udp_transport::join_discovery_group(_In_ SOCKET socket) {
+    std::size_t retval = 0;
+
+    ipv6_mreq request;
+    ::memset(&request, 0, sizeof(request));
+    THROW_LAST_ERROR_IF(::inet_pton(AF_INET6, mmp_discovery_group_ipv6,
+        &request.ipv6mr_multiaddr) != 1);
+
+    const auto family = AF_INET6;
+    const auto flags = GAA_FLAG_SKIP_UNICAST | GAA_FLAG_SKIP_ANYCAST
+        | GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_DNS_SERVER;
+    ULONG len = 0;
+
+    {
+        auto status = ::GetAdaptersAddresses(family, flags, nullptr, nullptr,
+            &len);
+        THROW_WIN32_IF(status, status != ERROR_BUFFER_OVERFLOW);
+    }
+
+    std::vector<BYTE> buffer(len);
+    auto adapters = reinterpret_cast<IP_ADAPTER_ADDRESSES *>(buffer.data());
+
+    THROW_IF_WIN32_ERROR(::GetAdaptersAddresses(family, flags, nullptr,
+        adapters, &len));
+
+    for (auto adapter = adapters;
+            adapter != nullptr;
+            adapter = adapter->Next) {
+        if ((adapter->OperStatus != IfOperStatusUp)
+                || (adapter->Ipv6IfIndex == 0)
+                || ((adapter->Flags & IP_ADAPTER_NO_MULTICAST) != 0)) {
+            continue;
+        }
+
+        request.ipv6mr_interface = adapter->Ipv6IfIndex;
+        if (::setsockopt(socket,
+                IPPROTO_IPV6,
+                IPV6_JOIN_GROUP,
+                reinterpret_cast<const char *>(&request),
+                sizeof(request)) == SOCKET_ERROR) {
+            MMP_TRACE(L"Failed to join the discovery group on interface %u: "
+                L"%d.", adapter->Ipv6IfIndex, ::WSAGetLastError());
+        } else {
+            ++retval;
+        }
+    }
+
+    return retval;
+}
@@ -0,0 +1,95 @@
+﻿// <copyright file="udp_transport.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <vector>
+
+#include <WinSock2.h>
+
+#include <wil/resource.h>
+
+#include "egress.h"
+#include "transport.h"
+
+
+/// <summary>
+/// The transport exchanging datagrams with the clients via UDP sockets on
+/// all network interfaces.
+/// </summary>
+/// <remarks>
+/// The datagrams to the clients are routed and batched by an
+/// <see cref="egress"/>, and the transport receives on all of its sockets.
+/// </remarks>
+class udp_transport final : public transport {
+
+public:
+
+    /// <summary>
+    /// Initialises a new instance without any socket.
+    /// </summary>
+    udp_transport(void) noexcept;
+
+    /// <summary>
+    /// Enables the sockets to send broadcasts, which is required for
+    /// beacons.
+    /// </summary>
+    /// <returns>Zero in case of success, the socket error otherwise.</returns>
+    int broadcast(void) noexcept;
+
+    void commit(
+        _Inout_ std::vector<std::pair<sockaddr_storage, int>>& outcomes)
+        noexcept override;
+
+    std::unique_ptr<transport> fork(void) const override;
+
+    /// <summary>
+    /// Creates the sockets and binds them to <paramref name="address"/> and
+    /// the addresses of the network interfaces.
+    /// </summary>
+    /// <param name="address">The address to bind to.</param>
+    /// <param name="length">The length of <paramref name="address"/> in
+    /// bytes.</param>
+    /// <param name="discoverable">If <see langword="true" />, the transport
+    /// receives the discovery requests of IPv6 clients.</param>
+    /// <exception cref="wil::ResultException">If the socket could not be
+    /// created.</exception>
+    void open(_In_ const sockaddr *address,
+        _In_ const int length,
+        _In_ const bool discoverable);
+
+    int receive(_Out_writes_bytes_(size) char *buffer,
+        _In_ const int size,
+        _Out_ sockaddr_storage& peer,
+        _In_ const std::chrono::milliseconds timeout) noexcept override;
+
+    int send(_In_ const client& client,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept override;
+
+    int send(_In_ const sockaddr_storage& peer,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const int size) noexcept override;
+
+private:
+
+    /// <summary>
+    /// Makes the given IPv6 <paramref name="socket"/> a member of
+    /// <see cref="mmp_discovery_group_ipv6"/> on all active interfaces that
+    /// support multicast.
+    /// </summary>
+    /// <param name="socket">The socket to receive discovery requests.</param>
+    /// <returns>The number of interfaces the socket has joined the group on.
+    /// </returns>
+    static std::size_t join_discovery_group(_In_ SOCKET socket);
+
+    // Note: the socket must be declared after the egress, because it must be
+    // closed before the batches of the egress are destroyed.
+    sockaddr_storage _address;
+    egress _egress;
+    wil::unique_socket _socket;
+    std::vector<SOCKET> _sockets;
+};
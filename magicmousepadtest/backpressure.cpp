@@ -0,0 +1,94 @@
+﻿// <copyright file="backpressure.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "magicmousepadtest.h"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include <mmpinproc.h>
+#include <mmpmsg.h>
+
+#include "inproc_transport.h"
+#include "outbox.h"
+#include "server.h"
+#include "settings.h"
+
+
+/*
+ * slow_client_is_evicted
+ */
+void slow_client_is_evicted(void) {
+    using namespace visus::mmp;
+    using visus::mmp::test::make_address;
+    using visus::mmp::test::wait_until;
+
+    auto network = inproc::network::create();
+    const auto address = make_address(INADDR_LOOPBACK, mmp_default_port);
+    auto endpoint = network->bind(address);
+    auto client = network->bind(make_address(0x7f000002, 0));
+    if (!MMP_EXPECT(endpoint && client)) {
+        return;
+    }
+
+    const auto config = nlohmann::json {
+        { "Heartbeat", 0 }
+    }.get<settings>();
+    server server(config, NULL,
+        std::make_unique<inproc_transport>(endpoint));
+
+    {
+        const mmp_msg_connect msg;
+        client->send(address, &msg, sizeof(msg));
+    }
+    if (!MMP_EXPECT(wait_until([&server](void) {
+            return (server.backpressure().size() == 1);
+        }, std::chrono::seconds(1)))) {
+        return;
+    }
+
+    // A client that does not read fills its queue in the network, after which
+    // every send fails like a full socket buffer would.
+    const auto flood = [&server](void) {
+        mmp_msg_mouse_move msg;
+        for (std::size_t i = 0; i <= inproc::network::capacity; ++i) {
+            msg.x = ::htonl(static_cast<std::uint32_t>(i));
+            server.send(msg);
+        }
+    };
+
+    flood();
+    {
+        const auto backpressure = server.backpressure();
+        if (!MMP_EXPECT(backpressure.size() == 1)) {
+            return;
+        }
+        MMP_EXPECT(backpressure.front().second.deferred > 0);
+        MMP_EXPECT(backpressure.front().second.queued > 0);
+    }
+
+    // Once the client catches up, the deferred datagrams are sent and the
+    // client stays connected.
+    {
+        inproc::datagram datagram;
+        while (client->receive(datagram, std::chrono::milliseconds(100))) { }
+    }
+    MMP_EXPECT(wait_until([&server](void) {
+            const auto backpressure = server.backpressure();
+            return (backpressure.size() == 1)
+                && (backpressure.front().second.queued == 0);
+        }, std::chrono::seconds(1)));
+
+    // A client that does not catch up is only evicted after the outbox has
+    // made no progress for a while.
+    flood();
+    std::this_thread::sleep_for(outbox::max_stall / 2);
+    MMP_EXPECT(server.backpressure().size() == 1);
+    MMP_EXPECT(wait_until([&server](void) {
+            return server.backpressure().empty();
+        }, outbox::max_stall));
+}
@@ -0,0 +1,88 @@
+﻿// <copyright file="compatibility.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "magicmousepadtest.h"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+#include <mmp_configuration.h>
+#include <mmpinproc.h>
+#include <mmpmsg.h>
+
+#include "inproc_transport.h"
+#include "server.h"
+#include "settings.h"
+
+
+/*
+ * old_client_new_server
+ */
+void old_client_new_server(void) {
+    using namespace visus::mmp;
+    using visus::mmp::test::make_address;
+    using visus::mmp::test::wait_until;
+
+    auto network = inproc::network::create();
+    const auto address = make_address(INADDR_LOOPBACK, mmp_default_port);
+    auto endpoint = network->bind(address);
+    auto client = network->bind(make_address(0x7f000002, 0));
+    if (!MMP_EXPECT(endpoint && client)) {
+        return;
+    }
+
+    // Heartbeats are disabled, because an old client would not know them
+    // anyway and they would only interleave with what we expect.
+    const auto config = nlohmann::json {
+        { "Heartbeat", 0 }
+    }.get<settings>();
+    server server(config, NULL,
+        std::make_unique<inproc_transport>(endpoint));
+
+    // Before the negotiation, the connect message was only the message ID.
+    {
+        const auto id = ::htonl(mmp_msgid_connect);
+        client->send(address, &id, sizeof(id));
+    }
+    if (!MMP_EXPECT(wait_until([&server](void) {
+            return (server.backpressure().size() == 1);
+        }, std::chrono::seconds(1)))) {
+        return;
+    }
+
+    inproc::datagram datagram;
+    mmp_msg_id id;
+
+    {
+        mmp_msg_mouse_move msg;
+        msg.x = ::htonl(10);
+        msg.y = ::htonl(20);
+        server.send(msg);
+    }
+    if (MMP_EXPECT(client->receive(datagram, std::chrono::seconds(1)))) {
+        MMP_EXPECT(datagram.data.size() == sizeof(mmp_msg_mouse_move));
+        std::memcpy(&id, datagram.data.data(), sizeof(id));
+        MMP_EXPECT(::ntohl(id) == mmp_msgid_mouse_move);
+    }
+
+    {
+        mmp_msg_mouse_button msg;
+        msg.button = mmp_mouse_button_left;
+        msg.down = 1;
+        server.send(msg);
+    }
+    if (MMP_EXPECT(client->receive(datagram, std::chrono::seconds(1)))) {
+        MMP_EXPECT(datagram.data.size() == sizeof(mmp_msg_mouse_button));
+        std::memcpy(&id, datagram.data.data(), sizeof(id));
+        MMP_EXPECT(::ntohl(id) == mmp_msgid_mouse_button);
+    }
+
+    // The old client cannot acknowledge the button, so the server must not
+    // retransmit it or send anything else the client would not understand.
+    MMP_EXPECT(!client->receive(datagram, std::chrono::milliseconds(500)));
+    MMP_EXPECT(server.backpressure().size() == 1);
+}
@@ -0,0 +1,134 @@
+﻿// <copyright file="failover.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "magicmousepadtest.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include <mmpinproc.h>
+#include <mmpmsg.h>
+
+#include "inproc_transport.h"
+#include "server.h"
+#include "settings.h"
+
+
+/*
+ * standby_takes_over
+ */
+void standby_takes_over(void) {
+    using namespace visus::mmp;
+    using visus::mmp::test::make_address;
+    using visus::mmp::test::wait_until;
+
+    auto network = inproc::network::create();
+    const auto primary_address = make_address(0x7f000001, mmp_default_port);
+    const auto standby_address = make_address(0x7f000002, mmp_default_port);
+    auto primary_endpoint = network->bind(primary_address);
+    auto standby_endpoint = network->bind(standby_address);
+
+    // The padding of the client address is not zero, which the primary keeps
+    // seeing on every datagram, whereas the standby learns about the client
+    // from the replica, which carries only the significant parts.
+    auto client_address = make_address(0x7f000003, 0);
+    std::memset(reinterpret_cast<sockaddr_in&>(client_address).sin_zero,
+        0xcc, sizeof(sockaddr_in::sin_zero));
+    auto client = network->bind(client_address);
+    if (!MMP_EXPECT(primary_endpoint && standby_endpoint && client)) {
+        return;
+    }
+
+    const auto heartbeat = std::chrono::milliseconds(100);
+    auto primary = std::make_unique<server>(nlohmann::json {
+            { "Heartbeat", heartbeat.count() }
+        }.get<settings>(),
+        NULL,
+        std::make_unique<inproc_transport>(primary_endpoint));
+    server standby(nlohmann::json {
+            { "Heartbeat", heartbeat.count() },
+            { "Primary", "127.0.0.1" }
+        }.get<settings>(),
+        NULL,
+        std::make_unique<inproc_transport>(standby_endpoint));
+
+    {
+        const mmp_msg_connect msg;
+        client->send(primary_address, &msg, sizeof(msg));
+    }
+    if (!MMP_EXPECT(wait_until([&primary](void) {
+            return (primary->backpressure().size() == 1);
+        }, std::chrono::seconds(1)))) {
+        return;
+    }
+
+    // The standby subscribes once per heartbeat and receives the clients with
+    // the next replica.
+    if (!MMP_EXPECT(wait_until([&standby](void) {
+            return (standby.backpressure().size() == 1);
+        }, 10 * heartbeat))) {
+        return;
+    }
+
+    primary.reset();
+    primary_endpoint.reset();
+    const auto stopped = std::chrono::steady_clock::now();
+
+    // The first heartbeat of the standby after three silent heartbeats of the
+    // primary tells the client about the new session.
+    inproc::datagram datagram;
+    auto taken_over = false;
+    const auto deadline = stopped + 10 * heartbeat;
+    while (!taken_over && (std::chrono::steady_clock::now() < deadline)) {
+        if (client->receive(datagram, heartbeat)) {
+            mmp_msg_id id;
+            std::memcpy(&id, datagram.data.data(), sizeof(id));
+            auto& from = reinterpret_cast<const sockaddr_in&>(datagram.peer);
+            taken_over = (::ntohl(id) == mmp_msgid_heartbeat)
+                && (from.sin_addr.s_addr == ::htonl(0x7f000002));
+        }
+    }
+    if (!MMP_EXPECT(taken_over)) {
+        return;
+    }
+
+    // The standby takes over once the primary has been silent for three
+    // heartbeats and announces its session right away, so the client must
+    // hear from it within at most four heartbeats.
+    const auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - stopped);
+    std::printf("The standby took over after %lld ms.\n",
+        static_cast<long long>(latency.count()));
+    MMP_EXPECT(latency <= 4 * heartbeat);
+
+    {
+        const mmp_msg_connect msg;
+        client->send(standby_address, &msg, sizeof(msg));
+    }
+
+    // The client that connects again must be recognised as the replicated one
+    // and survive the probation of the restored clients.
+    std::this_thread::sleep_for(4 * heartbeat);
+    MMP_EXPECT(standby.backpressure().size() == 1);
+
+    {
+        mmp_msg_mouse_move msg;
+        msg.x = ::htonl(10);
+        msg.y = ::htonl(20);
+        standby.send(msg);
+    }
+
+    auto moved = false;
+    while (!moved && client->receive(datagram, std::chrono::seconds(1))) {
+        mmp_msg_id id;
+        std::memcpy(&id, datagram.data.data(), sizeof(id));
+        moved = (::ntohl(id) == mmp_msgid_mouse_move);
+    }
+    MMP_EXPECT(moved);
+}
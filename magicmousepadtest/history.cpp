@@ -0,0 +1,131 @@
+﻿// <copyright file="history.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "magicmousepadtest.h"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+#include <mmpinproc.h>
+#include <mmpmsg.h>
+#include <mmpwire.h>
+
+#include "inproc_transport.h"
+#include "server.h"
+#include "settings.h"
+
+
+/*
+ * client_recovers_from_history
+ */
+void client_recovers_from_history(void) {
+    using namespace visus::mmp;
+    using visus::mmp::test::make_address;
+    using visus::mmp::test::wait_until;
+
+    auto network = inproc::network::create();
+    const auto address = make_address(INADDR_LOOPBACK, mmp_default_port);
+    auto endpoint = network->bind(address);
+    auto client = network->bind(make_address(0x7f000002, 0));
+    if (!MMP_EXPECT(endpoint && client)) {
+        return;
+    }
+
+    const std::uint32_t depth = 4;
+    server server(nlohmann::json {
+            { "Heartbeat", 0 },
+            { "History", depth }
+        }.get<settings>(),
+        NULL,
+        std::make_unique<inproc_transport>(endpoint));
+
+    {
+        mmp_msg_connect msg;
+        msg.capabilities = ::htonl(mmp_capability_history);
+        client->send(address, &msg, sizeof(msg));
+    }
+    if (!MMP_EXPECT(wait_until([&server](void) {
+            return (server.backpressure().size() == 1);
+        }, std::chrono::seconds(1)))) {
+        return;
+    }
+
+    // The first move carries no history, the button the move and the last
+    // move both of them, newest first.
+    {
+        mmp_msg_mouse_move msg;
+        msg.x = ::htonl(10);
+        msg.y = ::htonl(20);
+        server.send(msg);
+    }
+    {
+        mmp_msg_mouse_button msg;
+        msg.button = mmp_mouse_button_left;
+        msg.down = 1;
+        msg.x = ::htonl(10);
+        msg.y = ::htonl(20);
+        server.send(msg);
+    }
+    {
+        mmp_msg_mouse_move msg;
+        msg.x = ::htonl(30);
+        msg.y = ::htonl(40);
+        server.send(msg);
+    }
+
+    // Only the last datagram is inspected, as if the others had been lost.
+    inproc::datagram datagram;
+    for (int i = 0; i < 3; ++i) {
+        if (!MMP_EXPECT(client->receive(datagram, std::chrono::seconds(1)))) {
+            return;
+        }
+    }
+
+    {
+        const wire::view<mmp_msg_mouse_history> msg(datagram.data.data(),
+            datagram.data.size());
+        if (!MMP_EXPECT(msg.valid())) {
+            return;
+        }
+        MMP_EXPECT(msg.x() == 30);
+        MMP_EXPECT(msg.y() == 40);
+        MMP_EXPECT(msg.buttons() == mmp_mouse_button_left);
+        if (!MMP_EXPECT(msg.history() == 2)) {
+            return;
+        }
+
+        const auto button = msg.entry(0);
+        MMP_EXPECT(button.sequence_number() == msg.sequence_number() - 1);
+        MMP_EXPECT(button.buttons() == mmp_mouse_button_left);
+
+        const auto move = msg.entry(1);
+        MMP_EXPECT(move.sequence_number() == msg.sequence_number() - 2);
+        MMP_EXPECT(move.x() == 10);
+        MMP_EXPECT(move.y() == 20);
+        MMP_EXPECT(move.buttons() == 0);
+    }
+
+    // The history never grows beyond the configured depth.
+    for (int i = 0; i < 2 * static_cast<int>(depth); ++i) {
+        mmp_msg_mouse_move msg;
+        msg.x = ::htonl(100 + i);
+        server.send(msg);
+        if (!MMP_EXPECT(client->receive(datagram, std::chrono::seconds(1)))) {
+            return;
+        }
+    }
+
+    {
+        const wire::view<mmp_msg_mouse_history> msg(datagram.data.data(),
+            datagram.data.size());
+        if (MMP_EXPECT(msg.valid() && (msg.history() == depth))) {
+            MMP_EXPECT(msg.entry(0).x() == msg.x() - 1);
+            MMP_EXPECT(msg.entry(depth - 1).x() == msg.x()
+                - static_cast<std::int32_t>(depth));
+        }
+    }
+}
@@ -0,0 +1,58 @@
+﻿// <copyright file="lapping.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "magicmousepadtest.h"
+
+#include <cinttypes>
+#include <memory>
+
+#include <mmpmsg.h>
+
+#include "broadcast_ring.h"
+
+
+/*
+ * lapped_sender_resynchronises
+ */
+void lapped_sender_resynchronises(void) {
+    auto ring = std::make_unique<broadcast_ring>();
+
+    mmp_msg_state state;
+    state.sequence_number = ::htonl(42);
+    ring->store_state(state);
+
+    const std::uint64_t extra = 10;
+    for (std::uint64_t i = 0; i < broadcast_ring::capacity + extra; ++i) {
+        broadcast_ring::event event { };
+        event.position.x = static_cast<LONG>(i);
+        ring->publish(event);
+    }
+
+    // A sender that has fallen behind by more than the capacity must skip
+    // to the oldest event that the writer cannot be writing to.
+    broadcast_ring::event event;
+    std::uint64_t cursor = 0;
+    MMP_EXPECT(ring->read(cursor, event)
+        == broadcast_ring::read_status::lapped);
+    MMP_EXPECT(cursor == extra + 1);
+    MMP_EXPECT(event.position.x == static_cast<LONG>(extra));
+
+    // All remaining events are read in order without being lapped again.
+    for (auto i = extra + 1; i < broadcast_ring::capacity + extra; ++i) {
+        if (!MMP_EXPECT(ring->read(cursor, event)
+                == broadcast_ring::read_status::read)) {
+            return;
+        }
+        MMP_EXPECT(event.position.x == static_cast<LONG>(i));
+    }
+    MMP_EXPECT(ring->read(cursor, event)
+        == broadcast_ring::read_status::empty);
+    MMP_EXPECT(cursor == ring->published());
+
+    mmp_msg_state resync;
+    ring->load_state(resync);
+    MMP_EXPECT(::ntohl(resync.sequence_number) == 42);
+}
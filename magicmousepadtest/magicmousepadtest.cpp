@@ -0,0 +1,30 @@
+﻿// <copyright file="magicmousepadtest.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "magicmousepadtest.h"
+
+
+/// <summary>
+/// Runs the tests of the server, which use an in-process network instead of
+/// sockets, and answer the number of failed expectations.
+/// </summary>
+int main(void) {
+    WSADATA wsa_data;
+    if (::WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        return -1;
+    }
+
+    client_recovers_from_history();
+    lapped_sender_resynchronises();
+    old_client_new_server();
+    pacing_coalesces_moves();
+    region_filters_moves();
+    slow_client_is_evicted();
+    standby_takes_over();
+
+    ::WSACleanup();
+    return visus::mmp::test::failures();
+}
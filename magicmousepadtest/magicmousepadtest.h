@@ -0,0 +1,60 @@
+﻿// <copyright file="magicmousepadtest.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <WinSock2.h>
+#include <ws2ipdef.h>
+#include <WS2tcpip.h>
+
+#include <mmptest.h>
+
+
+/// <summary>
+/// Sends events to a client supporting the history and checks that each
+/// datagram carries the preceding events, newest first, up to the configured
+/// depth.
+/// </summary>
+void client_recovers_from_history(void);
+
+/// <summary>
+/// Publishes more events than the broadcast ring holds and checks that a
+/// sender that has fallen behind is told so, continues with the oldest event
+/// still available and can resynchronise from the state.
+/// </summary>
+void lapped_sender_resynchronises(void);
+
+/// <summary>
+/// Connects a client that predates the negotiation to the server and checks
+/// that it is served the basic protocol.
+/// </summary>
+void old_client_new_server(void);
+
+/// <summary>
+/// Connects a client with a maximum rate and checks that a burst of moves is
+/// coalesced into the first and the latest one until the client lifts the
+/// limit.
+/// </summary>
+void pacing_coalesces_moves(void);
+
+/// <summary>
+/// Connects a client with a region of interest and checks that it only
+/// receives the moves inside the region and the first one leaving it.
+/// </summary>
+void region_filters_moves(void);
+
+/// <summary>
+/// Floods a client that does not read and checks that the server defers the
+/// datagrams, recovers once the client catches up and evicts the client only
+/// if it does not.
+/// </summary>
+void slow_client_is_evicted(void);
+
+/// <summary>
+/// Runs a primary and a hot standby, stops the primary and checks that the
+/// standby takes over its client.
+/// </summary>
+void standby_takes_over(void);
@@ -0,0 +1,120 @@
+﻿// <copyright file="pacing.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "magicmousepadtest.h"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <mmpinproc.h>
+#include <mmpmsg.h>
+#include <mmpwire.h>
+
+#include "inproc_transport.h"
+#include "server.h"
+#include "settings.h"
+
+
+/// <summary>
+/// Sends the moves to the positions from <paramref name="first"/> to
+/// <paramref name="last"/> and answers the horizontal positions the client
+/// has received within <paramref name="timeout"/>.
+/// </summary>
+static std::vector<std::int32_t> move(_In_ server& server,
+        _In_ visus::mmp::inproc::endpoint& client,
+        _In_ const std::int32_t first,
+        _In_ const std::int32_t last,
+        _In_ const std::chrono::milliseconds timeout) {
+    using namespace visus::mmp;
+
+    for (auto x = first; x <= last; ++x) {
+        mmp_msg_mouse_move msg;
+        msg.x = ::htonl(x);
+        server.send(msg);
+    }
+
+    std::vector<std::int32_t> retval;
+    inproc::datagram datagram;
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (client.receive(datagram, std::chrono::milliseconds(10))) {
+            const wire::view<mmp_msg_mouse_move> msg(datagram.data.data(),
+                datagram.data.size());
+            if (MMP_EXPECT(msg.valid())) {
+                retval.push_back(msg.x());
+            }
+        }
+    }
+
+    return retval;
+}
+
+
+/*
+ * pacing_coalesces_moves
+ */
+void pacing_coalesces_moves(void) {
+    using namespace visus::mmp;
+    using visus::mmp::test::make_address;
+    using visus::mmp::test::wait_until;
+
+    auto network = inproc::network::create();
+    const auto address = make_address(INADDR_LOOPBACK, mmp_default_port);
+    auto endpoint = network->bind(address);
+    auto client = network->bind(make_address(0x7f000002, 0));
+    if (!MMP_EXPECT(endpoint && client)) {
+        return;
+    }
+
+    server server(nlohmann::json {
+            { "Heartbeat", 0 }
+        }.get<settings>(),
+        NULL,
+        std::make_unique<inproc_transport>(endpoint));
+
+    {
+        mmp_msg_connect msg;
+        msg.capabilities = ::htonl(mmp_capability_rate);
+        msg.rate = ::htonl(10);
+        client->send(address, &msg, sizeof(msg));
+    }
+    if (!MMP_EXPECT(wait_until([&server](void) {
+            return (server.backpressure().size() == 1);
+        }, std::chrono::seconds(1)))) {
+        return;
+    }
+
+    // At ten moves per second, the first move of a burst is sent right away
+    // and the rest is coalesced into a single move to the latest position
+    // once the interval has passed.
+    {
+        const auto received = move(server, *client, 1, 20,
+            std::chrono::milliseconds(500));
+        if (MMP_EXPECT(!received.empty())) {
+            MMP_EXPECT(received.front() == 1);
+            MMP_EXPECT(received.back() == 20);
+        }
+        MMP_EXPECT(received.size() >= 2);
+        MMP_EXPECT(received.size() <= 3);
+    }
+
+    // Once the client lifts the limit, it receives every move again.
+    {
+        const mmp_msg_rate msg(0);
+        client->send(address, &msg, sizeof(msg));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    {
+        const auto received = move(server, *client, 21, 25,
+            std::chrono::milliseconds(200));
+        MMP_EXPECT(received == std::vector<std::int32_t>({
+            21, 22, 23, 24, 25 }));
+    }
+}
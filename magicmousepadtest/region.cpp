@@ -0,0 +1,99 @@
+﻿// <copyright file="region.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "magicmousepadtest.h"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <mmpinproc.h>
+#include <mmpmsg.h>
+#include <mmpwire.h>
+
+#include "inproc_transport.h"
+#include "server.h"
+#include "settings.h"
+
+
+/*
+ * region_filters_moves
+ */
+void region_filters_moves(void) {
+    using namespace visus::mmp;
+    using visus::mmp::test::make_address;
+    using visus::mmp::test::wait_until;
+
+    auto network = inproc::network::create();
+    const auto address = make_address(INADDR_LOOPBACK, mmp_default_port);
+    auto endpoint = network->bind(address);
+    auto client = network->bind(make_address(0x7f000002, 0));
+    if (!MMP_EXPECT(endpoint && client)) {
+        return;
+    }
+
+    server server(nlohmann::json {
+            { "Heartbeat", 0 }
+        }.get<settings>(),
+        NULL,
+        std::make_unique<inproc_transport>(endpoint));
+
+    {
+        mmp_msg_connect msg;
+        msg.capabilities = ::htonl(mmp_capability_region);
+        msg.left = ::htonl(100);
+        msg.top = ::htonl(100);
+        msg.width = ::htonl(100);
+        msg.height = ::htonl(100);
+        client->send(address, &msg, sizeof(msg));
+    }
+    if (!MMP_EXPECT(wait_until([&server](void) {
+            return (server.backpressure().size() == 1);
+        }, std::chrono::seconds(1)))) {
+        return;
+    }
+
+    // The client starts out as if the mouse was inside, so the first move
+    // outside tells it that the mouse has left. Afterwards, it only receives
+    // the moves inside and the first one leaving the region again.
+    const std::int32_t positions[] = { 10, 20, 150, 160, 300, 310 };
+    const std::vector<std::int32_t> expected = { 10, 150, 160, 300 };
+    for (auto p : positions) {
+        mmp_msg_mouse_move msg;
+        msg.x = ::htonl(p);
+        msg.y = ::htonl(p);
+        server.send(msg);
+    }
+
+    // Buttons are never filtered, so the button marks the end of the moves.
+    {
+        mmp_msg_mouse_button msg;
+        msg.button = mmp_mouse_button_left;
+        msg.down = 1;
+        msg.x = ::htonl(310);
+        msg.y = ::htonl(310);
+        server.send(msg);
+    }
+
+    std::vector<std::int32_t> received;
+    inproc::datagram datagram;
+    while (client->receive(datagram, std::chrono::seconds(1))) {
+        mmp_msg_id id;
+        std::memcpy(&id, datagram.data.data(), sizeof(id));
+        if (::ntohl(id) == mmp_msgid_mouse_button) {
+            break;
+        }
+
+        const wire::view<mmp_msg_mouse_move> msg(datagram.data.data(),
+            datagram.data.size());
+        if (MMP_EXPECT(msg.valid())) {
+            received.push_back(msg.x());
+        }
+    }
+
+    MMP_EXPECT(received == expected);
+}
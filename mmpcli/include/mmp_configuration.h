@@ -12,7 +12,9 @@
 #if !defined(__cplusplus)
 #include <stdbool.h>
 #endif /* !defined(__cplusplus) */
+#if defined(_WIN32)
 #include <WinSock2.h>
+#endif /* defined(_WIN32) */
 
 #include "mmpapi.h"
 #include "mmp_mouse_button.h"
@@ -54,6 +56,81 @@
 /// </summary>
 #define mmp_flag_set_start ((uint32_t) 0x00000008)
 
+/// <summary>
+/// If this flag is set in the <see cref="mmp_configuration"/>, the client asks
+/// the magic mouse pad for the loss-resilient message format, which carries
+/// the state of all buttons and the most recent events in every datagram.
+/// The client uses this information to report button events and moves that
+/// were lost on the network. The number of events repeated, and therefore
+/// the overhead, is configured on the magic mouse pad.
+/// </summary>
+#define mmp_flag_history ((uint32_t) 0x00000010)
+
+/// <summary>
+/// If this flag is set in the <see cref="mmp_configuration"/>, the client
+/// remembers the last magic mouse pad it discovered on a port in a file in
+/// the local application data of the user. Subsequent discoveries on the same
+/// port first probe the cached end point directly and fall back to
+/// broadcasting only if the server does not respond.
+/// </summary>
+#define mmp_flag_discovery_cache ((uint32_t) 0x00000020)
+
+/// <summary>
+/// If this flag is set in the <see cref="mmp_configuration"/>, the client
+/// first listens for the beacons magic mouse pads broadcast periodically to
+/// the discovery port plus <see cref="mmp_beacon_port_offset"/> and only
+/// starts broadcasting discovery requests if it does not hear a beacon within
+/// <see cref="mmp_configuration::rate_limit"/>.
+/// </summary>
+#define mmp_flag_passive_discovery ((uint32_t) 0x00000040)
+
+/// <summary>
+/// If this flag is set in the <see cref="mmp_configuration"/>, the client asks
+/// the magic mouse pad for periodic heartbeats. If the server falls silent for
+/// <see cref="mmp_configuration::heartbeat_timeout"/>, the client discovers
+/// and connects to it again without invalidating its handle, and if the
+/// server has been restarted in the meantime, the client resumes the new
+/// session from its current state.
+/// </summary>
+#define mmp_flag_reconnect ((uint32_t) 0x00000080)
+
+/// <summary>
+/// If this flag is set in the <see cref="mmp_configuration"/>, the client
+/// probes the clock of the magic mouse pad once per second in order to
+/// estimate its offset, which enables <see cref="mmp_get_clock"/> and the
+/// conversion of the timestamps of the server into local time.
+/// </summary>
+#define mmp_flag_clock ((uint32_t) 0x00000100)
+
+/// <summary>
+/// If this flag is set in the <see cref="mmp_configuration"/> along with
+/// <see cref="mmp_flag_local"/>, the client subscribes only to the moves
+/// within the local desktop extended by
+/// <see cref="mmp_configuration::margin"/>. The client still receives all
+/// button events and the moves entering and leaving its region. The flag has
+/// no effect if <see cref="mmp_flag_set_start"/> is set, because the mapping
+/// to the local desktop is not known when connecting in this case.
+/// </summary>
+#define mmp_flag_region ((uint32_t) 0x00000200)
+
+/// <summary>
+/// If the magic mouse pad runs on the same machine, the client reads its
+/// events from the shared memory of the server instead of receiving them via
+/// the loopback interface unless this flag is set in the
+/// <see cref="mmp_configuration"/>. The client always falls back to the
+/// network if the server does not provide shared memory.
+/// </summary>
+#define mmp_flag_no_shared_memory ((uint32_t) 0x00000400)
+
+/// <summary>
+/// On Linux, the client receives datagrams via io_uring if the kernel
+/// supports it unless this flag is set in the
+/// <see cref="mmp_configuration"/>. The client always falls back to reading
+/// from the socket if io_uring is not available. The flag has no effect on
+/// other platforms.
+/// </summary>
+#define mmp_flag_no_io_uring ((uint32_t) 0x00000800)
+
 
 /// <summary>
 /// The default port number to be used for the magic mouse pad.
@@ -63,12 +140,36 @@
 /// </remarks>
 #define mmp_default_port ((uint16_t) 14753)
 
+/// <summary>
+/// The IPv6 link-local multicast group the magic mouse pad joins in order to
+/// receive discovery requests from clients on IPv6 networks.
+/// </summary>
+#define mmp_discovery_group_ipv6 "ff02::6d6d:7064"
+
+/// <summary>
+/// The offset added to the discovery port to obtain the port to which the
+/// magic mouse pad sends its beacons.
+/// </summary>
+/// <remarks>
+/// The beacons cannot be sent to the discovery port itself, because clients
+/// on the same machine as the server would otherwise share the port with the
+/// server.
+/// </remarks>
+#define mmp_beacon_port_offset ((uint16_t) 1)
+
 
 /// <summary>
 /// Configures a magic mouse pad client.
 /// </summary>
 typedef struct MMPCLI_API mmp_configuration_t {
 
+    /// <summary>
+    /// The time in seconds a server discovered is remembered if
+    /// <see cref="mmp_flag_discovery_cache"/> is set. If this value is zero,
+    /// the entry is kept for one day.
+    /// </summary>
+    uint32_t cache_ttl;
+
     /// <summary>
     /// The address the client binds to.
     /// </summary>
@@ -84,12 +185,35 @@ typedef struct MMPCLI_API mmp_configuration_t {
     /// </summary>
     uint32_t flags;
 
+    /// <summary>
+    /// The time in milliseconds without any message from the server after
+    /// which the client considers the server to be gone if
+    /// <see cref="mmp_flag_reconnect"/> is set. If this value is zero, the
+    /// client waits for three seconds.
+    /// </summary>
+    uint32_t heartbeat_timeout;
+
     /// <summary>
     /// The height of the overall range the mouse can travel vertically in
     /// number of pixels.
     /// </summary>
     uint32_t height;
 
+    /// <summary>
+    /// The number of pixels by which the region of interest extends beyond the
+    /// local desktop in each direction if <see cref="mmp_flag_region"/> is
+    /// set.
+    /// </summary>
+    uint32_t margin;
+
+    /// <summary>
+    /// The maximum number of moves per second the client wants to receive. If
+    /// this is not zero, the server coalesces moves down to this rate, and
+    /// the client lowers it further at runtime if the callbacks cannot keep
+    /// up. If this is zero, the client receives all moves.
+    /// </summary>
+    uint32_t max_rate;
+
     /// <summary>
     /// The horizontal offset of the local instance in the overall range of
     /// pixels the mouse can travel. The client subtracts this offset from the
@@ -122,7 +246,10 @@ typedef struct MMPCLI_API mmp_configuration_t {
     /// <summary>
     /// The time in milliseconds before retrying discovery. This should be less
     /// than <paramref name="timeout"/>, but definitely greater than zero to
-    /// prevent the network from being flooded with discovery requests.
+    /// prevent the network from being flooded with discovery requests. After
+    /// the first magic mouse pad has responded, the client keeps collecting
+    /// responses for this time and connects to the server with the lowest
+    /// round-trip time and load.
     /// </summary>
     uint32_t rate_limit;
 
@@ -144,6 +271,15 @@ typedef struct MMPCLI_API mmp_configuration_t {
     /// </summary>
     struct sockaddr_storage server;
 
+    /// <summary>
+    /// The address of a hot standby of the magic mouse pad. If the standby
+    /// takes over, the client follows it like it follows the servers it has
+    /// discovered. The client does not follow any other server that claims to
+    /// have started a new session. If the address family is zero, there is
+    /// no standby.
+    /// </summary>
+    struct sockaddr_storage standby;
+
     /// <summary>
     /// The horizontal starting position when the first position from the magic
     /// mouse pad is received. Typically, callers would set this to the centre
@@ -175,20 +311,25 @@ typedef struct MMPCLI_API mmp_configuration_t {
     /// Default constructor for the configuration.
     /// </summary>
     inline mmp_configuration_t(void) noexcept
-        : client({ 0 }),
+        : cache_ttl(0),
+        client(),
         context(nullptr),
         flags(0),
+        heartbeat_timeout(0),
         height(0),
+        margin(0),
+        max_rate(0),
         offset_x(0),
         offset_y(0),
         on_mouse_button(nullptr),
         on_mouse_move(nullptr),
         rate_limit(0),
         reordering_buffer(0),
-        timeout(0),
-        server({ 0 }),
+        server(),
+        standby(),
         start_x(0),
         start_y(0),
+        timeout(0),
         width(0) { }
 #endif /* defined(__cplusplus) */
 
@@ -197,7 +338,7 @@ typedef struct MMPCLI_API mmp_configuration_t {
 
 #if defined(__cplusplus)
 extern "C" {
-#endif define(__cplusplus)
+#endif /* defined(__cplusplus) */
 
 /// <summary>
 /// Adjusts the <paramref name="configuration"/> to bind to the given client
@@ -313,6 +454,6 @@ _Success_(return == 0) MMPCLI_API int mmp_configure_serverw(
 
 #if defined(__cplusplus)
 } /* extern "C" */
-#endif define(__cplusplus)
+#endif /* defined(__cplusplus) */
 
 #endif /* !defined(_MMP_CONFIGURATION_H) */
@@ -23,8 +23,38 @@
 #endif /* defined(MMPCLI_EXPORTS) */
 
 #else /* defined(_WIN32) */
-
-#define MMPCLI_API
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <wchar.h>
+
+
+#define MMPCLI_API __attribute__((visibility("default")))
+
+/*
+ * Callbacks use the default calling convention of the platform.
+ */
+#if !defined(WINAPIV)
+#define WINAPIV
+#endif /* !defined(WINAPIV) */
+
+/*
+ * The source annotation language is only available with Visual C++, so we
+ * make the annotations used in the API vanish on all other compilers.
+ */
+#if !defined(_In_)
+#define _In_
+#define _In_opt_
+#define _In_opt_z_
+#define _In_reads_bytes_(s)
+#define _In_z_
+#define _Inout_
+#define _Out_
+#define _Out_opt_
+#define _Out_writes_bytes_(s)
+#define _Ret_valid_
+#define _Success_(e)
+#endif /* !defined(_In_) */
 
 #endif /* defined(_WIN32) */
 
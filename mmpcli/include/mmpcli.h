@@ -11,7 +11,7 @@
 #if defined(__cplusplus)
 #include <memory>
 #include <system_error>
-#endif define(__cplusplus)
+#endif /* defined(__cplusplus) */
 
 #include "mmp_configuration.h"
 
@@ -21,10 +21,35 @@
 /// </summary>
 typedef struct mmp_client *mmp_handle;
 
+/// <summary>
+/// The handle to a magic mouse pad relay.
+/// </summary>
+typedef struct mmp_relay *mmp_relay_handle;
+
+
+/// <summary>
+/// The callback that <see cref="mmp_connect_async"/> invokes exactly once
+/// when the connection has been established or has failed.
+/// </summary>
+/// <remarks>
+/// The callback is invoked on a background thread. It must not call
+/// <see cref="mmp_disconnect"/> on the handle it receives.
+/// </remarks>
+/// <param name="handle">The handle that has been returned by
+/// <see cref="mmp_connect_async"/>.</param>
+/// <param name="status">Zero in case of success, a system error code
+/// otherwise. If the connection attempt was cancelled by
+/// <see cref="mmp_disconnect"/>, this is the code for
+/// <c>ERROR_CANCELLED</c>.</param>
+/// <param name="context">The user-defined context pointer passed to
+/// <see cref="mmp_connect_async"/>.</param>
+typedef void (WINAPIV *mmp_connect_completion)(_In_ mmp_handle handle,
+    _In_ const int status, _In_opt_ void *context);
+
 
 #if defined(__cplusplus)
 extern "C" {
-#endif define(__cplusplus)
+#endif /* defined(__cplusplus) */
 
 /// <summary>
 /// Connects to the magic mouse pad configured in
@@ -39,6 +64,35 @@ _Success_(return == 0) MMPCLI_API int mmp_connect(
     _In_ mmp_configuration *configuration);
 
 
+/// <summary>
+/// Starts connecting to the magic mouse pad configured in
+/// <paramref name="configuration"/> in the background and returns a handle
+/// to the connection immediately.
+/// </summary>
+/// <remarks>
+/// Discovery and the connection to the server are performed on a background
+/// thread. Callers can learn about the outcome via the
+/// <paramref name="completion"/> callback or by waiting on the handle using
+/// <see cref="mmp_wait"/>. Passing the handle to
+/// <see cref="mmp_disconnect"/> cancels a pending connection attempt. The
+/// handle must be released using <see cref="mmp_disconnect"/> in any case.
+/// </remarks>
+/// <param name="handle">Receives the handle for the client.</param>
+/// <param name="configuration">The configuration for the mouse pad.</param>
+/// <param name="completion">An optional callback that is invoked once the
+/// connection has been established or has failed.</param>
+/// <param name="context">A user-defined context pointer that is passed to
+/// <paramref name="completion"/>.</param>
+/// <returns>Zero if the connection attempt has been started, a system error
+/// code otherwise. In the latter case, no handle is returned and the
+/// <paramref name="completion"/> callback is not invoked.</returns>
+_Success_(return == 0) MMPCLI_API int mmp_connect_async(
+    _Out_ mmp_handle *handle,
+    _In_ mmp_configuration *configuration,
+    _In_opt_ mmp_connect_completion completion,
+    _In_opt_ void *context);
+
+
 /// <summary>
 /// Disconnects from the magic mouse pad and releases all client-side resources.
 /// </summary>
@@ -48,9 +102,126 @@ _Success_(return == 0) MMPCLI_API int mmp_connect(
 _Success_(return == 0) MMPCLI_API int mmp_disconnect(
     _In_ mmp_handle handle);
 
+
+/// <summary>
+/// Answers the current estimate of the clock of the magic mouse pad relative
+/// to the monotonic clock of the client.
+/// </summary>
+/// <remarks>
+/// The clock is only estimated if <see cref="mmp_flag_clock"/> is set and the
+/// server supports it. The local monotonic clock is the one of
+/// <c>std::chrono::steady_clock</c> in microseconds, so a server timestamp
+/// <c>t</c> corresponds to the local time <c>t - offset</c>.
+/// </remarks>
+/// <param name="handle">The handle of the client.</param>
+/// <param name="offset">Receives the time in microseconds the clock of the
+/// server is ahead of the local one, which might be negative.</param>
+/// <param name="rtt">Optionally receives the round-trip time to the server
+/// in microseconds.</param>
+/// <param name="jitter">Optionally receives the jitter of the offset in
+/// microseconds, which is a measure for the accuracy of the estimate.</param>
+/// <returns>Zero in case of success, the code for <c>ERROR_NOT_READY</c>
+/// if the server has not answered any probe yet, or another system error
+/// code.</returns>
+_Success_(return == 0) MMPCLI_API int mmp_get_clock(
+    _In_ mmp_handle handle,
+    _Out_ int64_t *offset,
+    _Out_opt_ uint32_t *rtt,
+    _Out_opt_ uint32_t *jitter);
+
+
+/// <summary>
+/// Answers the time when the magic mouse pad generated the last timestamped
+/// event the client has received, converted to the monotonic clock of the
+/// client.
+/// </summary>
+/// <remarks>
+/// Subtracting the result from the current time on
+/// <c>std::chrono::steady_clock</c> in microseconds yields the end-to-end
+/// latency of the event.
+/// </remarks>
+/// <param name="handle">The handle of the client.</param>
+/// <param name="timestamp">Receives the time of the event in microseconds.
+/// </param>
+/// <returns>Zero in case of success, the code for <c>ERROR_NOT_READY</c>
+/// if no timestamped event has been received since the clock of the server
+/// was estimated, or another system error code.</returns>
+_Success_(return == 0) MMPCLI_API int mmp_get_timestamp(
+    _In_ mmp_handle handle,
+    _Out_ uint64_t *timestamp);
+
+
+/// <summary>
+/// Answers the latency a relay adds to the datagrams it forwards.
+/// </summary>
+/// <param name="handle">The handle of the relay.</param>
+/// <param name="mean">Receives the smoothed mean time in microseconds from
+/// receiving a datagram from the server until it has been sent to all
+/// clients of the relay.</param>
+/// <param name="max">Optionally receives the maximum of this time in
+/// microseconds.</param>
+/// <returns>Zero in case of success, a system error code otherwise.</returns>
+_Success_(return == 0) MMPCLI_API int mmp_relay_get_latency(
+    _In_ mmp_relay_handle handle,
+    _Out_ uint32_t *mean,
+    _Out_opt_ uint32_t *max);
+
+
+/// <summary>
+/// Subscribes to the magic mouse pad configured in
+/// <paramref name="upstream"/> and forwards everything it sends to the
+/// clients connecting to <paramref name="downstream"/>.
+/// </summary>
+/// <remarks>
+/// <para>A relay answers discovery and connect requests like the magic mouse
+/// pad itself and forwards the datagrams of the server unchanged, which
+/// allows for building a tree of relays with one local fan-out point per
+/// subnet. Clients on the downstream side use the library as usual.</para>
+/// <para>The server must be configured explicitly in
+/// <paramref name="upstream"/>, because the relay would discover itself
+/// otherwise. The callbacks in <paramref name="upstream"/> are invoked like
+/// for a client, and setting <see cref="mmp_flag_reconnect"/> is
+/// recommended such that the relay survives restarts of the server.</para>
+/// </remarks>
+/// <param name="handle">Receives the handle for the relay.</param>
+/// <param name="upstream">The configuration for subscribing to the magic
+/// mouse pad.</param>
+/// <param name="downstream">The address to serve clients on. If the port is
+/// zero, <see cref="mmp_default_port"/> is used.</param>
+/// <returns>Zero in case of success, a system error code otherwise.</returns>
+_Success_(return == 0) MMPCLI_API int mmp_relay_start(
+    _Out_ mmp_relay_handle *handle,
+    _In_ mmp_configuration *upstream,
+    _In_ const struct sockaddr_storage *downstream);
+
+
+/// <summary>
+/// Stops the relay and releases all of its resources.
+/// </summary>
+/// <param name="handle">The handle of the relay to be stopped.</param>
+/// <returns>Zero in case of success, a system error code otherwise.</returns>
+_Success_(return == 0) MMPCLI_API int mmp_relay_stop(
+    _In_ mmp_relay_handle handle);
+
+
+/// <summary>
+/// Waits for a connection attempt started by <see cref="mmp_connect_async"/>
+/// to complete.
+/// </summary>
+/// <param name="handle">The handle of the client.</param>
+/// <param name="timeout">The time to wait in milliseconds. If this is zero,
+/// the function only checks the status. If this is <c>UINT32_MAX</c>, the
+/// function waits indefinitely.</param>
+/// <returns>Zero if the client is connected, the code for
+/// <c>ERROR_TIMEOUT</c> if the connection attempt is still pending, or the
+/// system error code that made the connection attempt fail.</returns>
+_Success_(return == 0) MMPCLI_API int mmp_wait(
+    _In_ mmp_handle handle,
+    _In_ const uint32_t timeout);
+
 #if defined(__cplusplus)
 } /* extern "C" */
-#endif define(__cplusplus)
+#endif /* defined(__cplusplus) */
 
 
 #if defined(__cplusplus)
@@ -65,6 +236,13 @@ namespace detail {
         void operator ()(_In_opt_ mmp_handle handle) const noexcept;
     };
 
+    /// <summary>
+    /// A deleter for magic mouse pad relay handles.
+    /// </summary>
+    struct MMPCLI_API delete_mmp_relay_handle final {
+        void operator ()(_In_opt_ mmp_relay_handle handle) const noexcept;
+    };
+
 } /* namespace detail */
 
     /// <summary>
@@ -73,6 +251,13 @@ namespace detail {
     /// </summary>
     typedef std::unique_ptr<mmp_client, detail::delete_mmp_handle> unique_handle;
 
+    /// <summary>
+    /// A unique pointer that automatically stops the relay when being
+    /// destroyed.
+    /// </summary>
+    typedef std::unique_ptr<mmp_relay, detail::delete_mmp_relay_handle>
+        unique_relay_handle;
+
 
     /// <summary>
     /// Connects to the magic mouse pad configured in
@@ -94,8 +279,60 @@ namespace detail {
         return unique_handle(handle);
     }
 
+
+    /// <summary>
+    /// Starts connecting to the magic mouse pad configured in
+    /// <paramref name="configuration"/> in the background and returns a handle
+    /// to the connection immediately.
+    /// </summary>
+    /// <param name="configuration">The configuration for the mouse pad.</param>
+    /// <param name="completion">An optional callback that is invoked once the
+    /// connection has been established or has failed.</param>
+    /// <param name="context">A user-defined context pointer that is passed to
+    /// <paramref name="completion"/>.</param>
+    /// <returns>A handle for the connection.</returns>
+    /// <exception cref="std::system_error">If the connection attempt could
+    /// not be started.</exception>
+    inline unique_handle connect_async(_In_ mmp_configuration& configuration,
+            _In_opt_ mmp_connect_completion completion = nullptr,
+            _In_opt_ void *context = nullptr) {
+        mmp_handle handle;
+        auto status = ::mmp_connect_async(&handle, &configuration, completion,
+            context);
+
+        if (status != 0) {
+            throw std::system_error(status, std::system_category());
+        }
+
+        return unique_handle(handle);
+    }
+
+
+    /// <summary>
+    /// Starts a relay subscribing to the magic mouse pad configured in
+    /// <paramref name="upstream"/> and serving clients on
+    /// <paramref name="downstream"/>.
+    /// </summary>
+    /// <param name="upstream">The configuration for subscribing to the magic
+    /// mouse pad.</param>
+    /// <param name="downstream">The address to serve clients on.</param>
+    /// <returns>A handle for the relay.</returns>
+    /// <exception cref="std::system_error">If the relay could not be
+    /// started.</exception>
+    inline unique_relay_handle relay(_In_ mmp_configuration& upstream,
+            _In_ const sockaddr_storage& downstream) {
+        mmp_relay_handle handle;
+        auto status = ::mmp_relay_start(&handle, &upstream, &downstream);
+
+        if (status != 0) {
+            throw std::system_error(status, std::system_category());
+        }
+
+        return unique_relay_handle(handle);
+    }
+
 } /* namespace mmp */
 } /* namespace visus */
-#endif define(__cplusplus)
+#endif /* defined(__cplusplus) */
 
 #endif /* !defined(_MMPCLI_H) */
@@ -13,7 +13,7 @@
 
 #if defined(__cplusplus)
 extern "C" {
-#endif define(__cplusplus)
+#endif /* defined(__cplusplus) */
 
 /// <summary>
 /// Parses the given string as end point (service) address, either IPv4 or
@@ -48,6 +48,6 @@ int MMPCLI_API mmp_parse_end_pointw(
 
 #if defined(__cplusplus)
 } /* extern "C" */
-#endif define(__cplusplus)
+#endif /* defined(__cplusplus) */
 
 #endif /* !defined(_MMPENDPOINT_H) */
@@ -0,0 +1,405 @@
+﻿// <copyright file="mmpinproc.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#if !defined(_MMPINPROC_H)
+#define _MMPINPROC_H
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cinttypes>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mmpapi.h"
+
+
+namespace visus {
+namespace mmp {
+namespace inproc {
+
+    class endpoint;
+
+    /// <summary>
+    /// The possible outcomes of sending a datagram through a
+    /// <see cref="network"/>.
+    /// </summary>
+    enum class delivery {
+        /// <summary>
+        /// The datagram has been queued at the receiver.
+        /// </summary>
+        delivered,
+
+        /// <summary>
+        /// The queue of the receiver is full, which corresponds to a socket
+        /// that would block.
+        /// </summary>
+        full,
+
+        /// <summary>
+        /// No endpoint is bound to the destination address.
+        /// </summary>
+        unreachable
+    };
+
+    /// <summary>
+    /// A datagram waiting in the queue of an <see cref="endpoint"/>.
+    /// </summary>
+    struct datagram {
+        std::vector<char> data;
+        sockaddr_storage peer;
+    };
+
+    /// <summary>
+    /// Connects servers and clients in the same process through memory
+    /// queues instead of sockets.
+    /// </summary>
+    /// <remarks>
+    /// <para>The network delivers datagrams between the
+    /// <see cref="endpoint"/>s bound to it in the order they were sent and
+    /// never loses one unless the queue of the receiver is full, which makes
+    /// benchmarks and tests of the protocol independent of the network stack
+    /// and reproducible on any machine.</para>
+    /// <para>Endpoints are identified by their socket addresses, which do not
+    /// need to exist on the machine. All methods are thread-safe.</para>
+    /// </remarks>
+    class network final : public std::enable_shared_from_this<network> {
+
+    public:
+
+        /// <summary>
+        /// The number of datagrams an endpoint queues before the network
+        /// reports it as <see cref="delivery::full"/>.
+        /// </summary>
+        static constexpr std::size_t capacity = 4096;
+
+        /// <summary>
+        /// Creates a new network without any endpoints.
+        /// </summary>
+        static inline std::shared_ptr<network> create(void) {
+            return std::shared_ptr<network>(new network());
+        }
+
+        /// <summary>
+        /// Binds a new endpoint to the given <paramref name="address"/>. If
+        /// the port of the address is zero, a unique one is chosen.
+        /// </summary>
+        /// <returns>The new endpoint, or <see langword="nullptr" /> if the
+        /// address is already in use or of an unsupported family.</returns>
+        std::shared_ptr<endpoint> bind(_In_ const sockaddr_storage& address);
+
+        /// <summary>
+        /// Queues a copy of the given datagram at the endpoint bound to
+        /// <paramref name="to"/>.
+        /// </summary>
+        delivery send(_In_ const sockaddr_storage& from,
+            _In_ const sockaddr_storage& to,
+            _In_reads_bytes_(size) const void *data,
+            _In_ const std::size_t size);
+
+        /// <summary>
+        /// Releases the address of an endpoint that is being destroyed.
+        /// </summary>
+        void unbind(_In_ const sockaddr_storage& address);
+
+    private:
+
+        /// <summary>
+        /// Answer the bytes identifying the given <paramref name="address"/>,
+        /// which are empty for unsupported families.
+        /// </summary>
+        static inline std::string key(_In_ const sockaddr_storage& address) {
+            switch (address.ss_family) {
+                case AF_INET: {
+                    auto& a = reinterpret_cast<const sockaddr_in&>(address);
+                    std::string retval(sizeof(a.sin_port)
+                        + sizeof(a.sin_addr), '\0');
+                    std::memcpy(&retval[0], &a.sin_port, sizeof(a.sin_port));
+                    std::memcpy(&retval[sizeof(a.sin_port)], &a.sin_addr,
+                        sizeof(a.sin_addr));
+                    return retval;
+                    }
+
+                case AF_INET6: {
+                    auto& a = reinterpret_cast<const sockaddr_in6&>(address);
+                    std::string retval(sizeof(a.sin6_port)
+                        + sizeof(a.sin6_addr), '\0');
+                    std::memcpy(&retval[0], &a.sin6_port,
+                        sizeof(a.sin6_port));
+                    std::memcpy(&retval[sizeof(a.sin6_port)], &a.sin6_addr,
+                        sizeof(a.sin6_addr));
+                    return retval;
+                    }
+
+                default:
+                    return std::string();
+            }
+        }
+
+        inline network(void) : _next_port(49152) { }
+
+        std::map<std::string, std::weak_ptr<endpoint>> _endpoints;
+        std::mutex _lock;
+        std::uint16_t _next_port;
+    };
+
+
+    /// <summary>
+    /// The address of a server or a client in a <see cref="network"/>, which
+    /// receives the datagrams sent to it in a queue.
+    /// </summary>
+    class endpoint final {
+
+    public:
+
+        /// <summary>
+        /// Initialises a new instance. Use <see cref="network::bind"/> to
+        /// create endpoints.
+        /// </summary>
+        inline endpoint(_In_ std::shared_ptr<network> network,
+                _In_ const sockaddr_storage& address)
+            : _address(address),
+            _closed(false),
+            _network(std::move(network)) { }
+
+        endpoint(const endpoint&) = delete;
+
+        /// <summary>
+        /// Finalises the instance, which releases its address.
+        /// </summary>
+        inline ~endpoint(void) noexcept {
+            try {
+                this->_network->unbind(this->_address);
+            } catch (...) { /* Nothing we can do here. */ }
+        }
+
+        /// <summary>
+        /// Answer the address the endpoint is bound to.
+        /// </summary>
+        inline const sockaddr_storage& address(void) const noexcept {
+            return this->_address;
+        }
+
+        /// <summary>
+        /// Discards all queued datagrams as well as any future ones and wakes
+        /// all threads waiting for the endpoint.
+        /// </summary>
+        inline void close(void) noexcept {
+            std::lock_guard<std::mutex> l(this->_lock);
+            this->_closed = true;
+            this->_queue.clear();
+            this->_signal.notify_all();
+        }
+
+        /// <summary>
+        /// Queues a copy of the given datagram from <paramref name="from"/>.
+        /// </summary>
+        delivery deliver(_In_ const sockaddr_storage& from,
+            _In_reads_bytes_(size) const void *data,
+            _In_ const std::size_t size);
+
+        /// <summary>
+        /// Answer the network the endpoint is bound to.
+        /// </summary>
+        inline network& owner(void) const noexcept {
+            return *this->_network;
+        }
+
+        /// <summary>
+        /// Dequeues the oldest datagram, waiting at most for
+        /// <paramref name="timeout"/> for one to arrive.
+        /// </summary>
+        /// <returns><see langword="true" /> if <paramref name="dst"/> has
+        /// received a datagram, <see langword="false" /> if none has arrived
+        /// in time or if the endpoint has been closed.</returns>
+        bool receive(_Out_ datagram& dst,
+            _In_ const std::chrono::microseconds timeout);
+
+        /// <summary>
+        /// Sends the given datagram from this endpoint to
+        /// <paramref name="to"/>.
+        /// </summary>
+        inline delivery send(_In_ const sockaddr_storage& to,
+                _In_reads_bytes_(size) const void *data,
+                _In_ const std::size_t size) {
+            return this->_network->send(this->_address, to, data, size);
+        }
+
+        /// <summary>
+        /// Waits at most for <paramref name="timeout"/> until a datagram is
+        /// queued.
+        /// </summary>
+        /// <returns><see langword="true" /> if a datagram can be received
+        /// without blocking, <see langword="false" /> otherwise.</returns>
+        bool wait(_In_ const std::chrono::microseconds timeout);
+
+        endpoint& operator =(const endpoint&) = delete;
+
+    private:
+
+        const sockaddr_storage _address;
+        bool _closed;
+        std::mutex _lock;
+        std::shared_ptr<network> _network;
+        std::deque<datagram> _queue;
+        std::condition_variable _signal;
+    };
+
+
+    /*
+     * network::bind
+     */
+    inline std::shared_ptr<endpoint> network::bind(
+            _In_ const sockaddr_storage& address) {
+        auto a = address;
+        auto port = (a.ss_family == AF_INET6)
+            ? &reinterpret_cast<sockaddr_in6&>(a).sin6_port
+            : &reinterpret_cast<sockaddr_in&>(a).sin_port;
+
+        std::lock_guard<std::mutex> l(this->_lock);
+        if (*port == 0) {
+            // Ephemeral ports are assigned like the network stack does, i.e.
+            // from the dynamic range upwards.
+            do {
+                *port = htons(this->_next_port++);
+                if (this->_next_port == 0) {
+                    this->_next_port = 49152;
+                }
+            } while (this->_endpoints.find(key(a)) != this->_endpoints.end());
+        }
+
+        const auto k = key(a);
+        if (k.empty()) {
+            return nullptr;
+        }
+
+        auto& e = this->_endpoints[k];
+        if (!e.expired()) {
+            return nullptr;
+        }
+
+        auto retval = std::make_shared<endpoint>(this->shared_from_this(), a);
+        e = retval;
+        return retval;
+    }
+
+
+    /*
+     * network::send
+     */
+    inline delivery network::send(_In_ const sockaddr_storage& from,
+            _In_ const sockaddr_storage& to,
+            _In_reads_bytes_(size) const void *data,
+            _In_ const std::size_t size) {
+        std::shared_ptr<endpoint> destination;
+
+        {
+            std::lock_guard<std::mutex> l(this->_lock);
+            auto it = this->_endpoints.find(key(to));
+            if (it != this->_endpoints.end()) {
+                destination = it->second.lock();
+            }
+        }
+
+        return destination
+            ? destination->deliver(from, data, size)
+            : delivery::unreachable;
+    }
+
+
+    /*
+     * network::unbind
+     */
+    inline void network::unbind(_In_ const sockaddr_storage& address) {
+        std::lock_guard<std::mutex> l(this->_lock);
+        auto it = this->_endpoints.find(key(address));
+        if ((it != this->_endpoints.end()) && it->second.expired()) {
+            this->_endpoints.erase(it);
+        }
+    }
+
+
+    /*
+     * endpoint::deliver
+     */
+    inline delivery endpoint::deliver(_In_ const sockaddr_storage& from,
+            _In_reads_bytes_(size) const void *data,
+            _In_ const std::size_t size) {
+        auto d = static_cast<const char *>(data);
+        std::lock_guard<std::mutex> l(this->_lock);
+
+        if (this->_closed) {
+            return delivery::unreachable;
+        }
+
+        if (this->_queue.size() >= network::capacity) {
+            return delivery::full;
+        }
+
+        this->_queue.emplace_back();
+        this->_queue.back().data.assign(d, d + size);
+        this->_queue.back().peer = from;
+        this->_signal.notify_one();
+
+        return delivery::delivered;
+    }
+
+
+    /*
+     * endpoint::receive
+     */
+    inline bool endpoint::receive(_Out_ datagram& dst,
+            _In_ const std::chrono::microseconds timeout) {
+        std::unique_lock<std::mutex> l(this->_lock);
+        const auto ready = [this](void) {
+            return this->_closed || !this->_queue.empty();
+        };
+
+        if (timeout == (std::chrono::microseconds::max)()) {
+            this->_signal.wait(l, ready);
+        } else {
+            this->_signal.wait_for(l, timeout, ready);
+        }
+
+        if (this->_closed || this->_queue.empty()) {
+            return false;
+        }
+
+        dst = std::move(this->_queue.front());
+        this->_queue.pop_front();
+        return true;
+    }
+
+
+    /*
+     * endpoint::wait
+     */
+    inline bool endpoint::wait(_In_ const std::chrono::microseconds timeout) {
+        std::unique_lock<std::mutex> l(this->_lock);
+        const auto ready = [this](void) {
+            return this->_closed || !this->_queue.empty();
+        };
+
+        if (timeout == (std::chrono::microseconds::max)()) {
+            this->_signal.wait(l, ready);
+        } else {
+            this->_signal.wait_for(l, timeout, ready);
+        }
+
+        return !this->_closed && !this->_queue.empty();
+    }
+
+} /* namespace inproc */
+} /* namespace mmp */
+} /* namespace visus */
+
+#endif /* !defined(_MMPINPROC_H) */
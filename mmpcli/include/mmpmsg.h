@@ -16,6 +16,13 @@
 #include "mmp_mouse_button.h"
 
 
+/*
+ * All messages have an explicit layout without implicit padding, which is
+ * verified at compile time in mmpwire.h. Fields that are not a single byte
+ * are in network-byte order on the wire.
+ */
+
+
 /// <summary>
 /// The type used to identify the message type.
 /// </summary>
@@ -28,6 +35,131 @@ typedef uint32_t mmp_msg_id;
 typedef uint32_t mmp_seq_no;
 
 
+/// <summary>
+/// The type used for the capability bitfield negotiated between the client and
+/// the magic mouse pad.
+/// </summary>
+typedef uint32_t mmp_capabilities;
+
+
+/// <summary>
+/// The version of the wire protocol implemented by this library. Peers that
+/// do not send a version, because their messages predate the negotiation, are
+/// treated as version zero.
+/// </summary>
+#define mmp_protocol_version ((uint32_t) 1)
+
+/// <summary>
+/// Indicates that a peer does not support any of the optional message formats.
+/// </summary>
+#define mmp_capability_none ((mmp_capabilities) 0x00000000)
+
+/// <summary>
+/// Indicates that a peer supports mouse messages carrying the timestamp of the
+/// server, i.e. <see cref="mmp_msg_mouse_move_ts"/> and
+/// <see cref="mmp_msg_mouse_button_ts"/>.
+/// </summary>
+#define mmp_capability_timestamp ((mmp_capabilities) 0x00000001)
+
+/// <summary>
+/// Indicates that a peer supports the <see cref="mmp_msg_state"/> snapshot the
+/// server sends in response to a <see cref="mmp_msg_connect"/> message.
+/// </summary>
+#define mmp_capability_state ((mmp_capabilities) 0x00000002)
+
+/// <summary>
+/// Indicates that a peer supports <see cref="mmp_msg_mouse_history"/>, which
+/// the server sends instead of all other mouse messages.
+/// </summary>
+#define mmp_capability_history ((mmp_capabilities) 0x00000004)
+
+/// <summary>
+/// Indicates that a peer acknowledges button events using
+/// <see cref="mmp_msg_ack"/>, which enables the server to retransmit button
+/// events that were lost.
+/// </summary>
+#define mmp_capability_ack ((mmp_capabilities) 0x00000008)
+
+/// <summary>
+/// Indicates that a peer supports <see cref="mmp_msg_heartbeat"/>, which the
+/// server sends periodically such that clients can detect that the server
+/// has restarted or is gone.
+/// </summary>
+#define mmp_capability_heartbeat ((mmp_capabilities) 0x00000010)
+
+/// <summary>
+/// Indicates that a peer supports <see cref="mmp_msg_ping"/> and
+/// <see cref="mmp_msg_pong"/>, which clients use to estimate the offset of
+/// the clock of the server relative to their own.
+/// </summary>
+#define mmp_capability_clock ((mmp_capabilities) 0x00000020)
+
+/// <summary>
+/// Indicates that a peer supports the region of interest in
+/// <see cref="mmp_msg_connect"/>, in which case the server only sends moves
+/// to a client while the mouse is within its region or is just leaving it.
+/// </summary>
+#define mmp_capability_region ((mmp_capabilities) 0x00000040)
+
+/// <summary>
+/// Indicates that a peer supports the maximum update rate in
+/// <see cref="mmp_msg_connect"/> and its updates in <see cref="mmp_msg_rate"/>,
+/// in which case the server coalesces moves down to the rate of the client.
+/// </summary>
+#define mmp_capability_rate ((mmp_capabilities) 0x00000080)
+
+/// <summary>
+/// The set of all capabilities implemented by this version of the library.
+/// </summary>
+#define mmp_capabilities_supported (mmp_capability_timestamp \
+    | mmp_capability_state \
+    | mmp_capability_history \
+    | mmp_capability_ack \
+    | mmp_capability_heartbeat \
+    | mmp_capability_clock \
+    | mmp_capability_region \
+    | mmp_capability_rate)
+
+/// <summary>
+/// The maximum number of past events a server may append to a
+/// <see cref="mmp_msg_mouse_history"/>, which keeps the datagram well below
+/// the typical MTU of an Ethernet link.
+/// </summary>
+#define mmp_history_max ((uint32_t) 64)
+
+
+/// <summary>
+/// Answer whether the sequence number <paramref name="lhs"/> is newer than
+/// <paramref name="rhs"/> using serial number arithmetic as in RFC 1982, which
+/// remains valid when the counter wraps around as long as the two numbers are
+/// less than half the range apart.
+/// </summary>
+/// <param name="lhs">A sequence number in host-byte order.</param>
+/// <param name="rhs">A sequence number in host-byte order.</param>
+/// <returns>Non-zero if <paramref name="lhs"/> is newer, zero if it is the
+/// same or older.</returns>
+static inline int mmp_seq_newer(const mmp_seq_no lhs, const mmp_seq_no rhs) {
+    return ((int32_t) (uint32_t) (lhs - rhs)) > 0;
+}
+
+/// <summary>
+/// Converts a 64-bit integer from host-byte order to network-byte order.
+/// </summary>
+static inline uint64_t mmp_hton64(const uint64_t value) {
+    return (htonl(1) == 1)
+        ? value
+        : ((((uint64_t) htonl((uint32_t) value)) << 32)
+            | htonl((uint32_t) (value >> 32)));
+}
+
+/// <summary>
+/// Converts a 64-bit integer from network-byte order to host-byte order.
+/// </summary>
+static inline uint64_t mmp_ntoh64(const uint64_t value) {
+    return mmp_hton64(value);
+}
+
+
 #define mmp_msgid_discover ((mmp_msg_id) 0x00000001)
 
 /// <summary>
@@ -39,12 +171,21 @@ typedef struct MMPCLI_API mmp_msg_discover_t {
     /// </summary>
     mmp_msg_id id;
 
+    /// <summary>
+    /// An opaque value the magic mouse pad echoes in its
+    /// <see cref="mmp_msg_announce"/>, which allows the client to match the
+    /// response to its request and to measure the round-trip time. The value
+    /// is in network-byte order. Clients that predate the server selection do
+    /// not send this field.
+    /// </summary>
+    uint32_t token;
+
 #if defined(__cplusplus)
     /// <summary>
     /// Initialises a new instance.
     /// </summary>
-    inline mmp_msg_discover_t(void) noexcept
-        : id(::htonl(mmp_msgid_discover)) { }
+    inline mmp_msg_discover_t(const uint32_t token = 0) noexcept
+        : id(::htonl(mmp_msgid_discover)), token(::htonl(token)) { }
 #endif /* defined(__cplusplus) */
 } mmp_msg_discover;
 
@@ -53,7 +194,8 @@ typedef struct MMPCLI_API mmp_msg_discover_t {
 
 /// <summary>
 /// The response the magic mouse pad sends when it receives a
-/// <see cref="mmp_msg_discover"/> message.
+/// <see cref="mmp_msg_discover"/> message, and which it optionally broadcasts
+/// periodically as a beacon.
 /// </summary>
 typedef struct MMPCLI_API mmp_msg_announce_t {
     /// <summary>
@@ -67,12 +209,50 @@ typedef struct MMPCLI_API mmp_msg_announce_t {
     /// </summary>
     mmp_seq_no sequence_number;
 
+    /// <summary>
+    /// The protocol version of the server, in network-byte order. Servers that
+    /// predate the negotiation do not send this field.
+    /// </summary>
+    uint32_t version;
+
+    /// <summary>
+    /// The capabilities supported by the server, in network-byte order.
+    /// Servers that predate the negotiation do not send this field.
+    /// </summary>
+    mmp_capabilities capabilities;
+
+    /// <summary>
+    /// The number of clients the server is currently serving, in network-byte
+    /// order. Servers that predate the server selection do not send this
+    /// field.
+    /// </summary>
+    uint32_t load;
+
+    /// <summary>
+    /// The <see cref="mmp_msg_discover::token"/> of the request this is the
+    /// response to, or zero if the announcement is a beacon, in network-byte
+    /// order.
+    /// </summary>
+    uint32_t token;
+
+    /// <summary>
+    /// The random session epoch the server has chosen when it was started, in
+    /// network-byte order, which changes if the server restarts. Servers that
+    /// predate sessions do not send this field.
+    /// </summary>
+    uint32_t epoch;
+
 #if defined(__cplusplus)
     /// <summary>
     /// Initialises a new instance.
     /// </summary>
     inline mmp_msg_announce_t(void) noexcept : id(::htonl(mmp_msgid_announce)),
-        sequence_number(0) { }
+        sequence_number(0),
+        version(::htonl(mmp_protocol_version)),
+        capabilities(::htonl(mmp_capabilities_supported)),
+        load(0),
+        token(0),
+        epoch(0) { }
 #endif /* defined(__cplusplus) */
 } mmp_msg_announce;
 
@@ -89,15 +269,465 @@ typedef struct MMPCLI_API mmp_msg_connect_t {
     /// </summary>
     mmp_msg_id id;
 
+    /// <summary>
+    /// The protocol version of the client, in network-byte order. Clients that
+    /// predate the negotiation do not send this field.
+    /// </summary>
+    uint32_t version;
+
+    /// <summary>
+    /// The capabilities the client supports, in network-byte order. The server
+    /// will only send message formats the client has declared here and falls
+    /// back to the basic messages for all clients that predate the
+    /// negotiation.
+    /// </summary>
+    mmp_capabilities capabilities;
+
+    /// <summary>
+    /// The left edge of the region of interest of the client in the
+    /// coordinates of the server, in network-byte order.
+    /// </summary>
+    int32_t left;
+
+    /// <summary>
+    /// The top edge of the region of interest of the client in the
+    /// coordinates of the server, in network-byte order.
+    /// </summary>
+    int32_t top;
+
+    /// <summary>
+    /// The width of the region of interest in pixels, in network-byte order.
+    /// If this is zero, the client is interested in all moves.
+    /// </summary>
+    uint32_t width;
+
+    /// <summary>
+    /// The height of the region of interest in pixels, in network-byte order.
+    /// If this is zero, the client is interested in all moves.
+    /// </summary>
+    uint32_t height;
+
+    /// <summary>
+    /// The maximum number of moves per second the client wants to receive,
+    /// in network-byte order. If this is zero, the client receives all moves.
+    /// </summary>
+    uint32_t rate;
+
 #if defined(__cplusplus)
     /// <summary>
     /// Initialises a new instance.
     /// </summary>
-    inline mmp_msg_connect_t(void) noexcept : id(::htonl(mmp_msgid_connect)) { }
+    inline mmp_msg_connect_t(void) noexcept : id(::htonl(mmp_msgid_connect)),
+        version(::htonl(mmp_protocol_version)),
+        capabilities(::htonl(mmp_capabilities_supported)),
+        left(0),
+        top(0),
+        width(0),
+        height(0),
+        rate(0) { }
 #endif /* defined(__cplusplus) */
 } mmp_msg_connect;
 
 
+#define mmp_msgid_state ((mmp_msg_id) 0x00000101)
+
+/// <summary>
+/// The server sends a snapshot of the current state of the mouse to clients
+/// having negotiated <see cref="mmp_capability_state"/> in response to their
+/// <see cref="mmp_msg_connect"/> message.
+/// </summary>
+typedef struct MMPCLI_API mmp_msg_state_t {
+    /// <summary>
+    /// The message ID, which must be in network-byte order on the wire.
+    /// </summary>
+    mmp_msg_id id;
+
+    /// <summary>
+    /// The sequence number of the last event reflected in the snapshot, in
+    /// network-byte order.
+    /// </summary>
+    mmp_seq_no sequence_number;
+
+    /// <summary>
+    /// The horizontal position in pixels, in network-byte order.
+    /// </summary>
+    int32_t x;
+
+    /// <summary>
+    /// The horizontal position in pixels, in network-byte order.
+    /// </summary>
+    int32_t y;
+
+    /// <summary>
+    /// The bitmask of all <see cref="mmp_mouse_button"/>s that are currently
+    /// held down, in network-byte order.
+    /// </summary>
+    uint32_t buttons;
+
+    /// <summary>
+    /// The session epoch of the server as in
+    /// <see cref="mmp_msg_announce::epoch"/>, in network-byte order. Servers
+    /// that predate sessions do not send this field.
+    /// </summary>
+    uint32_t epoch;
+
+#if defined(__cplusplus)
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    inline mmp_msg_state_t(void) noexcept : id(::htonl(mmp_msgid_state)),
+        sequence_number(0), x(0), y(0), buttons(0), epoch(0) { }
+#endif /* defined(__cplusplus) */
+} mmp_msg_state;
+
+
+#define mmp_msgid_ack ((mmp_msg_id) 0x00000102)
+
+/// <summary>
+/// The client sends this message to confirm the reception of a button event
+/// if it has negotiated <see cref="mmp_capability_ack"/>. The server
+/// retransmits button events until they are acknowledged. Clients must also
+/// acknowledge retransmissions they have already processed, because the
+/// original acknowledgement might have been lost.
+/// </summary>
+typedef struct MMPCLI_API mmp_msg_ack_t {
+    /// <summary>
+    /// The message ID, which must be in network-byte order on the wire.
+    /// </summary>
+    mmp_msg_id id;
+
+    /// <summary>
+    /// The sequence number of the button event being acknowledged, in
+    /// network-byte order.
+    /// </summary>
+    mmp_seq_no sequence_number;
+
+#if defined(__cplusplus)
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    inline mmp_msg_ack_t(_In_ const mmp_seq_no sequence_number = 0) noexcept
+        : id(::htonl(mmp_msgid_ack)),
+        sequence_number(::htonl(sequence_number)) { }
+#endif /* defined(__cplusplus) */
+} mmp_msg_ack;
+
+
+#define mmp_msgid_heartbeat ((mmp_msg_id) 0x00000103)
+
+/// <summary>
+/// The server sends this message periodically to clients having negotiated
+/// <see cref="mmp_capability_heartbeat"/>. A client that does not receive it
+/// anymore assumes the server to be gone, and a client that receives it with
+/// a different epoch knows that the server has restarted.
+/// </summary>
+typedef struct MMPCLI_API mmp_msg_heartbeat_t {
+    /// <summary>
+    /// The message ID, which must be in network-byte order on the wire.
+    /// </summary>
+    mmp_msg_id id;
+
+    /// <summary>
+    /// The sequence number of the last event the server has sent, in
+    /// network-byte order. The heartbeat itself does not consume a sequence
+    /// number.
+    /// </summary>
+    mmp_seq_no sequence_number;
+
+    /// <summary>
+    /// The session epoch of the server as in
+    /// <see cref="mmp_msg_announce::epoch"/>, in network-byte order.
+    /// </summary>
+    uint32_t epoch;
+
+#if defined(__cplusplus)
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    inline mmp_msg_heartbeat_t(void) noexcept
+        : id(::htonl(mmp_msgid_heartbeat)), sequence_number(0), epoch(0) { }
+#endif /* defined(__cplusplus) */
+} mmp_msg_heartbeat;
+
+
+#define mmp_msgid_ping ((mmp_msg_id) 0x00000104)
+
+/// <summary>
+/// A client having negotiated <see cref="mmp_capability_clock"/> sends this
+/// message periodically in order to sample the clock of the server, which
+/// answers with <see cref="mmp_msg_pong"/>.
+/// </summary>
+typedef struct MMPCLI_API mmp_msg_ping_t {
+    /// <summary>
+    /// The message ID, which must be in network-byte order on the wire.
+    /// </summary>
+    mmp_msg_id id;
+
+    /// <summary>
+    /// An arbitrary value identifying the probe, which the server echoes, in
+    /// network-byte order.
+    /// </summary>
+    uint32_t token;
+
+    /// <summary>
+    /// The time in microseconds on the monotonic clock of the client when the
+    /// message was sent, in network-byte order.
+    /// </summary>
+    uint64_t origin;
+
+#if defined(__cplusplus)
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    inline mmp_msg_ping_t(_In_ const uint32_t token = 0,
+            _In_ const uint64_t origin = 0) noexcept
+        : id(::htonl(mmp_msgid_ping)),
+        token(::htonl(token)),
+        origin(::mmp_hton64(origin)) { }
+#endif /* defined(__cplusplus) */
+} mmp_msg_ping;
+
+
+#define mmp_msgid_pong ((mmp_msg_id) 0x00000105)
+
+/// <summary>
+/// The server answers a <see cref="mmp_msg_ping"/> with this message, which
+/// allows the client to compute the round-trip time and the offset between
+/// the clocks like in NTP.
+/// </summary>
+typedef struct MMPCLI_API mmp_msg_pong_t {
+    /// <summary>
+    /// The message ID, which must be in network-byte order on the wire.
+    /// </summary>
+    mmp_msg_id id;
+
+    /// <summary>
+    /// The token of the ping, in network-byte order.
+    /// </summary>
+    uint32_t token;
+
+    /// <summary>
+    /// The origin timestamp of the ping, in network-byte order.
+    /// </summary>
+    uint64_t origin;
+
+    /// <summary>
+    /// The time in microseconds on the monotonic clock of the server when the
+    /// ping was received, in network-byte order.
+    /// </summary>
+    uint64_t receive;
+
+    /// <summary>
+    /// The time in microseconds on the monotonic clock of the server when the
+    /// pong was sent, in network-byte order.
+    /// </summary>
+    uint64_t transmit;
+
+#if defined(__cplusplus)
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    inline mmp_msg_pong_t(void) noexcept : id(::htonl(mmp_msgid_pong)),
+        token(0), origin(0), receive(0), transmit(0) { }
+#endif /* defined(__cplusplus) */
+} mmp_msg_pong;
+
+
+#define mmp_msgid_rate ((mmp_msg_id) 0x00000106)
+
+/// <summary>
+/// A client having negotiated <see cref="mmp_capability_rate"/> sends this
+/// message to change the maximum update rate it has declared when
+/// connecting, e.g. because it cannot keep up with the moves it receives.
+/// </summary>
+typedef struct MMPCLI_API mmp_msg_rate_t {
+    /// <summary>
+    /// The message ID, which must be in network-byte order on the wire.
+    /// </summary>
+    mmp_msg_id id;
+
+    /// <summary>
+    /// The maximum number of moves per second the client wants to receive,
+    /// in network-byte order. If this is zero, the client receives all moves.
+    /// </summary>
+    uint32_t rate;
+
+#if defined(__cplusplus)
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    inline mmp_msg_rate_t(_In_ const uint32_t rate = 0) noexcept
+        : id(::htonl(mmp_msgid_rate)), rate(::htonl(rate)) { }
+#endif /* defined(__cplusplus) */
+} mmp_msg_rate;
+
+
+#define mmp_msgid_standby ((mmp_msg_id) 0x00000200)
+
+/// <summary>
+/// A server running as hot standby sends this message to its primary server
+/// once per heartbeat in order to receive <see cref="mmp_msg_replica"/>.
+/// Clients never send or receive this message.
+/// </summary>
+typedef struct MMPCLI_API mmp_msg_standby_t {
+    /// <summary>
+    /// The message ID, which must be in network-byte order on the wire.
+    /// </summary>
+    mmp_msg_id id;
+
+#if defined(__cplusplus)
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    inline mmp_msg_standby_t(void) noexcept : id(::htonl(mmp_msgid_standby)) { }
+#endif /* defined(__cplusplus) */
+} mmp_msg_standby;
+
+
+/// <summary>
+/// A client registered with the primary server as replicated in a
+/// <see cref="mmp_msg_replica"/>. This is not a message on its own.
+/// </summary>
+typedef struct MMPCLI_API mmp_msg_replica_client_t {
+    /// <summary>
+    /// The IP version of the address, which is either 4 or 6, in
+    /// network-byte order.
+    /// </summary>
+    uint16_t family;
+
+    /// <summary>
+    /// The port of the client, in network-byte order.
+    /// </summary>
+    uint16_t port;
+
+    /// <summary>
+    /// The scope of an IPv6 address, in network-byte order.
+    /// </summary>
+    uint32_t scope_id;
+
+    /// <summary>
+    /// The IP address of the client. IPv4 addresses use the first four bytes.
+    /// </summary>
+    uint8_t address[16];
+
+    /// <summary>
+    /// The protocol version the client has announced, in network-byte order.
+    /// </summary>
+    uint32_t version;
+
+    /// <summary>
+    /// The capabilities negotiated with the client, in network-byte order.
+    /// </summary>
+    mmp_capabilities capabilities;
+
+    /// <summary>
+    /// The left edge of the region of interest of the client, in
+    /// network-byte order.
+    /// </summary>
+    int32_t left;
+
+    /// <summary>
+    /// The top edge of the region of interest of the client, in network-byte
+    /// order.
+    /// </summary>
+    int32_t top;
+
+    /// <summary>
+    /// The width of the region of interest in pixels, in network-byte order.
+    /// If this is zero, the client is interested in all moves.
+    /// </summary>
+    uint32_t width;
+
+    /// <summary>
+    /// The height of the region of interest in pixels, in network-byte order.
+    /// If this is zero, the client is interested in all moves.
+    /// </summary>
+    uint32_t height;
+
+    /// <summary>
+    /// The current maximum number of moves per second the client receives,
+    /// in network-byte order. If this is zero, the client receives all moves.
+    /// </summary>
+    uint32_t rate;
+
+#if defined(__cplusplus)
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    inline mmp_msg_replica_client_t(void) noexcept : family(0), port(0),
+        scope_id(0), address(), version(0), capabilities(0), left(0),
+        top(0), width(0), height(0), rate(0) { }
+#endif /* defined(__cplusplus) */
+} mmp_msg_replica_client;
+
+
+#define mmp_msgid_replica ((mmp_msg_id) 0x00000201)
+
+/// <summary>
+/// The primary server sends its session and its clients to every hot standby
+/// once per heartbeat such that the standby can take over if the primary
+/// fails. Clients never send or receive this message.
+/// </summary>
+/// <remarks>
+/// The header is followed by <see cref="clients"/> instances of
+/// <see cref="mmp_msg_replica_client"/>.
+/// </remarks>
+typedef struct MMPCLI_API mmp_msg_replica_t {
+    /// <summary>
+    /// The message ID, which must be in network-byte order on the wire.
+    /// </summary>
+    mmp_msg_id id;
+
+    /// <summary>
+    /// The sequence number of the last event the primary has sent, in
+    /// network-byte order.
+    /// </summary>
+    mmp_seq_no sequence_number;
+
+    /// <summary>
+    /// The session epoch of the primary, in network-byte order.
+    /// </summary>
+    uint32_t epoch;
+
+    /// <summary>
+    /// The horizontal position in pixels, in network-byte order.
+    /// </summary>
+    int32_t x;
+
+    /// <summary>
+    /// The vertical position in pixels, in network-byte order.
+    /// </summary>
+    int32_t y;
+
+    /// <summary>
+    /// The bitmask of all <see cref="mmp_mouse_button"/>s that are held down,
+    /// in network-byte order.
+    /// </summary>
+    uint32_t buttons;
+
+    /// <summary>
+    /// The number of <see cref="mmp_msg_replica_client"/> instances following
+    /// the message, in network-byte order.
+    /// </summary>
+    uint32_t clients;
+
+#if defined(__cplusplus)
+    /// <summary>
+    /// Initialises a new instance from a state snapshot.
+    /// </summary>
+    inline mmp_msg_replica_t(_In_ const mmp_msg_state& state,
+            _In_ const uint32_t clients) noexcept
+        : id(::htonl(mmp_msgid_replica)),
+        sequence_number(state.sequence_number),
+        epoch(state.epoch),
+        x(state.x),
+        y(state.y),
+        buttons(state.buttons),
+        clients(::htonl(clients)) { }
+#endif /* defined(__cplusplus) */
+} mmp_msg_replica;
+
+
 #define mmp_msgid_mouse_move ((mmp_msg_id) 0x00001000)
 
 /// <summary>
@@ -160,10 +790,14 @@ typedef struct MMPCLI_API mmp_msg_mouse_button_t {
     mmp_mouse_button button;
 
     /// <summary>
-    /// Indicates whether the button was pressed (<see langword="true"/>) or
-    /// released (<see langword="false"/>).
+    /// Indicates whether the button was pressed (non-zero) or released (zero).
+    /// </summary>
+    uint8_t down;
+
+    /// <summary>
+    /// Explicit padding such that the position is aligned. This must be zero.
     /// </summary>
-    bool down;
+    uint8_t reserved[2];
 
     /// <summary>
     /// The horizontal position in pixels, in network-byte order.
@@ -183,10 +817,286 @@ typedef struct MMPCLI_API mmp_msg_mouse_button_t {
         : id(::htonl(mmp_msgid_mouse_button)),
         sequence_number(0),
         button(mmp_mouse_button_none),
-        down(false),
+        down(0),
+        reserved(),
         x(0),
         y(0) { }
 #endif /* defined(__cplusplus) */
 } mmp_msg_mouse_button;
 
+
+#define mmp_msgid_mouse_move_ts ((mmp_msg_id) 0x00001100)
+
+/// <summary>
+/// The variant of <see cref="mmp_msg_mouse_move"/> that the server sends to
+/// clients having negotiated <see cref="mmp_capability_timestamp"/>.
+/// </summary>
+typedef struct MMPCLI_API mmp_msg_mouse_move_ts_t {
+    /// <summary>
+    /// The message ID, which must be in network-byte order on the wire.
+    /// </summary>
+    mmp_msg_id id;
+
+    /// <summary>
+    /// The sequence number of the server, in network-byte order. Clients can
+    /// use this information to discard outdated messages.
+    /// </summary>
+    mmp_seq_no sequence_number;
+
+    /// <summary>
+    /// The time in microseconds on the monotonic clock of the server when the
+    /// event was generated, in network-byte order.
+    /// </summary>
+    uint64_t timestamp;
+
+    /// <summary>
+    /// The horizontal position in pixels, in network-byte order.
+    /// </summary>
+    int32_t x;
+
+    /// <summary>
+    /// The horizontal position in pixels, in network-byte order.
+    /// </summary>
+    int32_t y;
+
+#if defined(__cplusplus)
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    inline mmp_msg_mouse_move_ts_t(void) noexcept
+        : id(::htonl(mmp_msgid_mouse_move_ts)), sequence_number(0),
+        timestamp(0), x(0), y(0) { }
+
+    /// <summary>
+    /// Initialises a new instance from the basic message.
+    /// </summary>
+    inline mmp_msg_mouse_move_ts_t(_In_ const mmp_msg_mouse_move& msg,
+            _In_ const uint64_t timestamp) noexcept
+        : id(::htonl(mmp_msgid_mouse_move_ts)),
+        sequence_number(msg.sequence_number),
+        timestamp(::mmp_hton64(timestamp)),
+        x(msg.x),
+        y(msg.y) { }
+#endif /* defined(__cplusplus) */
+} mmp_msg_mouse_move_ts;
+
+
+#define mmp_msgid_mouse_button_ts ((mmp_msg_id) 0x00001101)
+
+/// <summary>
+/// The variant of <see cref="mmp_msg_mouse_button"/> that the server sends to
+/// clients having negotiated <see cref="mmp_capability_timestamp"/>.
+/// </summary>
+typedef struct MMPCLI_API mmp_msg_mouse_button_ts_t {
+    /// <summary>
+    /// The message ID, which must be in network-byte order on the wire.
+    /// </summary>
+    mmp_msg_id id;
+
+    /// <summary>
+    /// The sequence number of the server, in network-byte order. Clients can
+    /// use this information to discard outdated messages.
+    /// </summary>
+    mmp_seq_no sequence_number;
+
+    /// <summary>
+    /// The time in microseconds on the monotonic clock of the server when the
+    /// event was generated, in network-byte order.
+    /// </summary>
+    uint64_t timestamp;
+
+    /// <summary>
+    /// The horizontal position in pixels, in network-byte order.
+    /// </summary>
+    int32_t x;
+
+    /// <summary>
+    /// The horizontal position in pixels, in network-byte order.
+    /// </summary>
+    int32_t y;
+
+    /// <summary>
+    /// Identifies the button that was pressed or released.
+    /// </summary>
+    mmp_mouse_button button;
+
+    /// <summary>
+    /// Indicates whether the button was pressed (non-zero) or released (zero).
+    /// </summary>
+    uint8_t down;
+
+    /// <summary>
+    /// Explicit padding to the alignment of the timestamp. This must be zero.
+    /// </summary>
+    uint8_t reserved[6];
+
+#if defined(__cplusplus)
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    inline mmp_msg_mouse_button_ts_t(void) noexcept
+        : id(::htonl(mmp_msgid_mouse_button_ts)),
+        sequence_number(0),
+        timestamp(0),
+        x(0),
+        y(0),
+        button(mmp_mouse_button_none),
+        down(0),
+        reserved() { }
+
+    /// <summary>
+    /// Initialises a new instance from the basic message.
+    /// </summary>
+    inline mmp_msg_mouse_button_ts_t(_In_ const mmp_msg_mouse_button& msg,
+            _In_ const uint64_t timestamp) noexcept
+        : id(::htonl(mmp_msgid_mouse_button_ts)),
+        sequence_number(msg.sequence_number),
+        timestamp(::mmp_hton64(timestamp)),
+        x(msg.x),
+        y(msg.y),
+        button(msg.button),
+        down(msg.down),
+        reserved() { }
+#endif /* defined(__cplusplus) */
+} mmp_msg_mouse_button_ts;
+
+
+/// <summary>
+/// A past event that the server repeats in a
+/// <see cref="mmp_msg_mouse_history"/>. This is not a message on its own.
+/// </summary>
+typedef struct MMPCLI_API mmp_msg_history_entry_t {
+    /// <summary>
+    /// The sequence number of the event, in network-byte order.
+    /// </summary>
+    mmp_seq_no sequence_number;
+
+    /// <summary>
+    /// The horizontal position in pixels, in network-byte order.
+    /// </summary>
+    int32_t x;
+
+    /// <summary>
+    /// The horizontal position in pixels, in network-byte order.
+    /// </summary>
+    int32_t y;
+
+    /// <summary>
+    /// The bitmask of all <see cref="mmp_mouse_button"/>s that were held down
+    /// after the event, in network-byte order.
+    /// </summary>
+    uint32_t buttons;
+
+#if defined(__cplusplus)
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    inline mmp_msg_history_entry_t(void) noexcept : sequence_number(0),
+        x(0), y(0), buttons(0) { }
+#endif /* defined(__cplusplus) */
+} mmp_msg_history_entry;
+
+
+/// <summary>
+/// The flag in <see cref="mmp_msg_mouse_history::flags"/> indicating that the
+/// message is a button event, which the client must acknowledge if it has
+/// negotiated <see cref="mmp_capability_ack"/>.
+/// </summary>
+#define mmp_history_flag_ack ((uint16_t) 0x0001)
+
+
+#define mmp_msgid_mouse_history ((mmp_msg_id) 0x00001200)
+
+/// <summary>
+/// The loss-resilient format for mouse moves and button events, which the
+/// server sends to clients having negotiated
+/// <see cref="mmp_capability_history"/>.
+/// </summary>
+/// <remarks>
+/// <para>The message always carries the complete bitmask of the buttons held
+/// down, so a client that misses a button event does not believe the button
+/// to be stuck. Button events are recognised by the bitmask changing.</para>
+/// <para>The header is followed by <see cref="history"/> instances of
+/// <see cref="mmp_msg_history_entry"/> describing the events immediately
+/// preceding this one, ordered from newest to oldest. A client can replay the
+/// ones it has missed.</para>
+/// </remarks>
+typedef struct MMPCLI_API mmp_msg_mouse_history_t {
+    /// <summary>
+    /// The message ID, which must be in network-byte order on the wire.
+    /// </summary>
+    mmp_msg_id id;
+
+    /// <summary>
+    /// The sequence number of the server, in network-byte order. Clients can
+    /// use this information to discard outdated messages.
+    /// </summary>
+    mmp_seq_no sequence_number;
+
+    /// <summary>
+    /// The time in microseconds on the monotonic clock of the server when the
+    /// event was generated, in network-byte order.
+    /// </summary>
+    uint64_t timestamp;
+
+    /// <summary>
+    /// The horizontal position in pixels, in network-byte order.
+    /// </summary>
+    int32_t x;
+
+    /// <summary>
+    /// The horizontal position in pixels, in network-byte order.
+    /// </summary>
+    int32_t y;
+
+    /// <summary>
+    /// The bitmask of all <see cref="mmp_mouse_button"/>s that are held down
+    /// after the event, in network-byte order.
+    /// </summary>
+    uint32_t buttons;
+
+    /// <summary>
+    /// The number of <see cref="mmp_msg_history_entry"/> instances following
+    /// the message, in network-byte order.
+    /// </summary>
+    uint16_t history;
+
+    /// <summary>
+    /// A combination of flags like <see cref="mmp_history_flag_ack"/>, in
+    /// network-byte order.
+    /// </summary>
+    uint16_t flags;
+
+#if defined(__cplusplus)
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    inline mmp_msg_mouse_history_t(void) noexcept
+        : id(::htonl(mmp_msgid_mouse_history)),
+        sequence_number(0),
+        timestamp(0),
+        x(0),
+        y(0),
+        buttons(0),
+        history(0),
+        flags(0) { }
+
+    /// <summary>
+    /// Initialises a new instance from a state snapshot.
+    /// </summary>
+    inline mmp_msg_mouse_history_t(_In_ const mmp_msg_state& state,
+            _In_ const uint64_t timestamp,
+            _In_ const uint16_t history,
+            _In_ const uint16_t flags = 0) noexcept
+        : id(::htonl(mmp_msgid_mouse_history)),
+        sequence_number(state.sequence_number),
+        timestamp(::mmp_hton64(timestamp)),
+        x(state.x),
+        y(state.y),
+        buttons(state.buttons),
+        history(::htons(history)),
+        flags(::htons(flags)) { }
+#endif /* defined(__cplusplus) */
+} mmp_msg_mouse_history;
+
 #endif /* !defined(_MMPMSG_H) */
@@ -0,0 +1,417 @@
+﻿// <copyright file="mmpshm.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#if !defined(_MMPSHM_H)
+#define _MMPSHM_H
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include "mmpmsg.h"
+
+
+namespace visus {
+namespace mmp {
+namespace shm {
+
+    /// <summary>
+    /// The number of events retained in the ring.
+    /// </summary>
+    constexpr std::size_t capacity = 256;
+
+    /// <summary>
+    /// Identifies a mapping holding a <see cref="ring"/>.
+    /// </summary>
+    constexpr std::uint32_t magic = 0x4d4d5052;
+
+    /// <summary>
+    /// The size of the largest datagram that fits into a slot of the ring.
+    /// </summary>
+    constexpr std::size_t max_datagram = 112;
+
+    /// <summary>
+    /// The maximum number of processes that can read the ring at the same
+    /// time.
+    /// </summary>
+    constexpr std::size_t max_subscribers = 16;
+
+    /// <summary>
+    /// The version of the layout of the <see cref="ring"/>, which must be
+    /// increased whenever the layout changes.
+    /// </summary>
+    constexpr std::uint32_t version = 1;
+
+    /// <summary>
+    /// The possible results of reading from the ring.
+    /// </summary>
+    enum class read_status {
+        /// <summary>
+        /// The reader is up to date.
+        /// </summary>
+        empty,
+
+        /// <summary>
+        /// An event has been read.
+        /// </summary>
+        read,
+
+        /// <summary>
+        /// The writer has overtaken the reader, which has skipped to the
+        /// oldest event still available. Any button event in between is
+        /// lost, so the reader should resynchronise from
+        /// <see cref="ring::load_state"/>.
+        /// </summary>
+        lapped
+    };
+
+    /// <summary>
+    /// Copies <paramref name="src"/>, which is guarded by the sequence lock
+    /// <paramref name="sequence"/>, into <paramref name="dst"/>, retrying
+    /// until the copy is consistent.
+    /// </summary>
+    /// <typeparam name="TValue">The type of the value, which must be
+    /// trivially copyable as it might be torn while being copied.
+    /// </typeparam>
+    template<class TValue>
+    void seqlock_load(_In_ const std::atomic<std::uint64_t>& sequence,
+            _In_ const TValue& src,
+            _Out_ TValue& dst) noexcept {
+        static_assert(std::is_trivially_copyable<TValue>::value,
+            "Values must be trivially copyable to be read under a sequence "
+            "lock.");
+        std::uint64_t before = 0;
+        std::uint64_t after = 0;
+        do {
+            before = sequence.load(std::memory_order_acquire);
+            std::memcpy(&dst, &src, sizeof(dst));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while (((before & 1) != 0) || (before != after));
+    }
+
+    /// <summary>
+    /// Copies the event at <paramref name="cursor"/> from a ring of
+    /// <paramref name="capacity"/> slots, each of which is guarded by a
+    /// sequence lock written by <see cref="seqlock_publish"/>, and advances
+    /// the cursor.
+    /// </summary>
+    /// <typeparam name="TSlot">The type of a slot, which must have an atomic
+    /// member <c>sequence</c>.</typeparam>
+    /// <typeparam name="TCopy">A functor copying the event out of a slot,
+    /// which must cope with the slot being modified while it copies.
+    /// </typeparam>
+    /// <param name="published">The number of events the writer has
+    /// published.</param>
+    /// <param name="slots">The slots of the ring.</param>
+    /// <param name="capacity">The number of slots.</param>
+    /// <param name="cursor">The cursor of the reader.</param>
+    /// <param name="copy">The functor copying the event.</param>
+    /// <returns>Whether an event was read and whether events have been lost
+    /// before it.</returns>
+    template<class TSlot, class TCopy>
+    read_status seqlock_read(
+            _In_ const std::atomic<std::uint64_t>& published,
+            _In_ const TSlot *slots,
+            _In_ const std::size_t capacity,
+            _Inout_ std::uint64_t& cursor,
+            _In_ TCopy&& copy) noexcept {
+        auto retval = read_status::read;
+
+        while (true) {
+            const auto end = published.load(std::memory_order_acquire);
+            if (cursor >= end) {
+                // A new writer starting over must not stall the reader.
+                if (cursor > end) {
+                    cursor = end;
+                }
+                return read_status::empty;
+            }
+
+            if (end - cursor > capacity) {
+                cursor = end - capacity;
+                retval = read_status::lapped;
+            }
+
+            auto& s = slots[cursor % capacity];
+            const auto before = s.sequence.load(std::memory_order_acquire);
+            if (before == 2 * cursor + 2) {
+                copy(s);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (s.sequence.load(std::memory_order_relaxed) == before) {
+                    ++cursor;
+                    return retval;
+                }
+            }
+
+            // The writer has reused the slot in the meantime, so we skip to
+            // the oldest event that it cannot be writing to.
+            const auto latest = published.load(std::memory_order_acquire);
+            cursor = (latest >= capacity) ? latest - capacity + 1 : 0;
+            retval = read_status::lapped;
+        }
+    }
+
+    /// <summary>
+    /// Appends an event to a ring of <paramref name="capacity"/> slots such
+    /// that <see cref="seqlock_read"/> can read it.
+    /// </summary>
+    /// <typeparam name="TSlot">The type of a slot, which must have an atomic
+    /// member <c>sequence</c>.</typeparam>
+    /// <typeparam name="TCopy">A functor copying the event into a slot.
+    /// </typeparam>
+    /// <param name="published">The number of events the writer has
+    /// published, which is incremented sequentially consistent such that a
+    /// reader registering as waiting afterwards sees the event.</param>
+    /// <param name="slots">The slots of the ring.</param>
+    /// <param name="capacity">The number of slots.</param>
+    /// <param name="copy">The functor copying the event.</param>
+    template<class TSlot, class TCopy>
+    void seqlock_publish(_Inout_ std::atomic<std::uint64_t>& published,
+            _Inout_ TSlot *slots,
+            _In_ const std::size_t capacity,
+            _In_ TCopy&& copy) noexcept {
+        const auto position = published.load(std::memory_order_relaxed);
+        auto& s = slots[position % capacity];
+        s.sequence.store(2 * position + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        copy(s);
+        s.sequence.store(2 * position + 2, std::memory_order_release);
+        published.store(position + 1);
+    }
+
+    /// <summary>
+    /// Copies <paramref name="src"/> into <paramref name="dst"/>, which is
+    /// guarded by the sequence lock <paramref name="sequence"/>. There must
+    /// only be one writer at a time.
+    /// </summary>
+    /// <typeparam name="TValue">The type of the value, which must be
+    /// trivially copyable.</typeparam>
+    template<class TValue>
+    void seqlock_store(_Inout_ std::atomic<std::uint64_t>& sequence,
+            _Out_ TValue& dst,
+            _In_ const TValue& src) noexcept {
+        static_assert(std::is_trivially_copyable<TValue>::value,
+            "Values must be trivially copyable to be read under a sequence "
+            "lock.");
+        const auto s = sequence.load(std::memory_order_relaxed);
+        sequence.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&dst, &src, sizeof(dst));
+        sequence.store(s + 2, std::memory_order_release);
+    }
+
+    /// <summary>
+    /// An event in the ring.
+    /// </summary>
+    /// <remarks>
+    /// The <see cref="sequence"/> is a sequence lock, which is odd while the
+    /// writer modifies the slot and twice the position of the event in the
+    /// ring plus two once it is complete.
+    /// </remarks>
+    struct slot {
+        std::atomic<std::uint64_t> sequence;
+        std::uint32_t size;
+        std::uint32_t reserved;
+        char data[max_datagram];
+    };
+
+    /// <summary>
+    /// A process reading the ring.
+    /// </summary>
+    /// <remarks>
+    /// <para>A reader claims a free entry by storing its process ID and
+    /// creates the auto-reset event named by <see cref="event_name"/> for the
+    /// index of the entry before it increments the
+    /// <see cref="generation"/>, which tells the writer to open the event
+    /// anew.</para>
+    /// <para>The reader sets <see cref="waiting"/> before it checks for new
+    /// events and goes to sleep. The writer resets the flag after each event
+    /// and sets the event only if the flag was set, so a reader that is
+    /// busy costs the writer no system call, and none can miss a wakeup.
+    /// </para>
+    /// </remarks>
+    struct subscriber {
+        std::atomic<std::uint32_t> generation;
+        std::atomic<std::uint32_t> process;
+        std::atomic<std::uint32_t> waiting;
+        std::uint32_t reserved;
+    };
+
+    /// <summary>
+    /// The shared memory a magic mouse pad publishes its events in for the
+    /// processes on the same machine, which receive them without going
+    /// through the network stack.
+    /// </summary>
+    /// <remarks>
+    /// <para>There is a single writer, namely the server bound to the port
+    /// in the name of the mapping, and any number of readers, each of which
+    /// keeps its own cursor. The events are the timestamped datagrams the
+    /// server sends via UDP as well as its heartbeats. The state the server
+    /// sends to new clients is kept alongside such that readers can start
+    /// from and resynchronise with it.</para>
+    /// <para>The layout is the same for all processes on the machine, which
+    /// is why the atomics must be lock-free.</para>
+    /// </remarks>
+    struct ring {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t capacity;
+        std::uint32_t max_datagram;
+        std::atomic<std::uint64_t> published;
+        std::atomic<std::uint64_t> state_sequence;
+        mmp_msg_state state;
+        std::uint32_t reserved;
+        subscriber subscribers[max_subscribers];
+        slot slots[shm::capacity];
+
+        /// <summary>
+        /// Prepares the ring for the writer, keeping the events of a previous
+        /// writer if the layout is the same such that the readers can carry
+        /// on.
+        /// </summary>
+        inline void initialise(void) noexcept {
+            if ((this->magic != shm::magic)
+                    || (this->version != shm::version)
+                    || (this->capacity != shm::capacity)
+                    || (this->max_datagram != shm::max_datagram)) {
+                // Note: the atomics are objects rather than plain bytes, so
+                // they must be reset by storing to them instead of being
+                // overwritten with memset.
+                this->magic = 0;
+                this->version = shm::version;
+                this->capacity = shm::capacity;
+                this->max_datagram = shm::max_datagram;
+                this->published.store(0, std::memory_order_relaxed);
+                this->state_sequence.store(0, std::memory_order_relaxed);
+                this->state = mmp_msg_state();
+                this->reserved = 0;
+
+                for (auto& r : this->subscribers) {
+                    r.generation.store(0, std::memory_order_relaxed);
+                    r.process.store(0, std::memory_order_relaxed);
+                    r.waiting.store(0, std::memory_order_relaxed);
+                    r.reserved = 0;
+                }
+
+                for (auto& s : this->slots) {
+                    s.sequence.store(0, std::memory_order_relaxed);
+                    s.size = 0;
+                    s.reserved = 0;
+                    std::memset(s.data, 0, sizeof(s.data));
+                }
+
+                std::atomic_thread_fence(std::memory_order_release);
+                this->magic = shm::magic;
+            }
+        }
+
+        /// <summary>
+        /// Copies the state published by <see cref="store_state"/>.
+        /// </summary>
+        inline void load_state(_Out_ mmp_msg_state& state) const noexcept {
+            seqlock_load(this->state_sequence, this->state, state);
+        }
+
+        /// <summary>
+        /// Appends the given datagram, which must not be larger than
+        /// <see cref="max_datagram"/>, and resets the waiting flags of all
+        /// subscribers.
+        /// </summary>
+        /// <typeparam name="TWake">A functor accepting the index of a
+        /// subscriber that is waiting to be woken.</typeparam>
+        /// <returns><see langword="false" /> if the datagram is too large,
+        /// <see langword="true" /> otherwise.</returns>
+        template<class TWake>
+        bool publish(_In_reads_bytes_(size) const void *data,
+                _In_ const std::size_t size,
+                _In_ TWake&& wake) noexcept {
+            if (size > shm::max_datagram) {
+                return false;
+            }
+
+            // Note: publishing is sequentially consistent with setting the
+            // waiting flag in the readers.
+            seqlock_publish(this->published, this->slots, shm::capacity,
+                    [data, size](slot& s) {
+                s.size = static_cast<std::uint32_t>(size);
+                std::memcpy(s.data, data, size);
+            });
+
+            for (std::size_t i = 0; i < max_subscribers; ++i) {
+                auto& r = this->subscribers[i];
+                if ((r.waiting.load() != 0) && (r.waiting.exchange(0) != 0)) {
+                    wake(i);
+                }
+            }
+
+            return true;
+        }
+
+        /// <summary>
+        /// Copies the event at <paramref name="cursor"/> and advances the
+        /// cursor.
+        /// </summary>
+        /// <param name="cursor">The cursor of the reader.</param>
+        /// <param name="dst">A buffer of at least <see cref="max_datagram"/>
+        /// bytes.</param>
+        /// <param name="size">Receives the size of the datagram.</param>
+        inline read_status read(_Inout_ std::uint64_t& cursor,
+                _Out_writes_bytes_(max_datagram) char *dst,
+                _Out_ std::size_t& size) const noexcept {
+            size = 0;
+            const auto retval = seqlock_read(this->published, this->slots,
+                    shm::capacity, cursor, [dst, &size](const slot& s) {
+                // The size might be torn, so it must be clamped.
+                size = (std::min)(static_cast<std::size_t>(s.size),
+                    shm::max_datagram);
+                std::memcpy(dst, s.data, size);
+            });
+            if (retval == read_status::empty) {
+                size = 0;
+            }
+            return retval;
+        }
+
+        /// <summary>
+        /// Records the state sent to new clients.
+        /// </summary>
+        inline void store_state(_In_ const mmp_msg_state& state) noexcept {
+            seqlock_store(this->state_sequence, this->state, state);
+        }
+    };
+
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+        "The ring requires lock-free atomics to be shared between processes.");
+
+    /// <summary>
+    /// Answer the name of the auto-reset event of the subscriber with the
+    /// given <paramref name="index"/> on the given <paramref name="port"/>.
+    /// </summary>
+    inline std::wstring event_name(_In_ const std::uint16_t port,
+            _In_ const std::size_t index) {
+        return L"Local\\MagicMousePad-" + std::to_wstring(port) + L"-"
+            + std::to_wstring(index);
+    }
+
+    /// <summary>
+    /// Answer the name of the file mapping holding the <see cref="ring"/> of
+    /// the server on the given <paramref name="port"/>.
+    /// </summary>
+    inline std::wstring mapping_name(_In_ const std::uint16_t port) {
+        return L"Local\\MagicMousePad-" + std::to_wstring(port);
+    }
+
+} /* namespace shm */
+} /* namespace mmp */
+} /* namespace visus */
+
+#endif /* !defined(_MMPSHM_H) */
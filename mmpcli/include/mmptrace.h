@@ -8,8 +8,14 @@
 
 #if defined(__cplusplus)
 #include <cstdio>
+#include <cwchar>
+#include <string>
 #include <vector>
 
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif /* !defined(_WIN32) */
+
 #include "mmpapi.h"
 
 
@@ -50,6 +56,15 @@ public:
 
 private:
 
+#if !defined(_WIN32)
+    /// <summary>
+    /// Converts a wide format string using the conventions of Visual C++,
+    /// where <c>%s</c> designates a wide and <c>%hs</c> a narrow string, to
+    /// the conventions of the C standard.
+    /// </summary>
+    static std::wstring posix_format(_In_z_ const wchar_t *format);
+#endif /* !defined(_WIN32) */
+
     const char *const _file;
     const int _line;
 
@@ -60,10 +75,14 @@ private:
 
 #if (defined(_DEBUG) || defined(DEBUG))
 #define MMP_TRACE mmp_tracer(__FILE__, __LINE__)
-#else /* (defined(_DEBUG) || defined(DEBUG)) */
+#elif defined(_MSC_VER)
 #define MMP_TRACE __noop
+#else /* (defined(_DEBUG) || defined(DEBUG)) */
+#define MMP_TRACE(...) ((void) 0)
 #endif /* (defined(_DEBUG) || defined(DEBUG)) */
 
-#else /* defined(__cplusplus) */
+#elif defined(_MSC_VER)
 #define MMP_TRACE __noop
+#else /* defined(__cplusplus) */
+#define MMP_TRACE(...) ((void) 0)
 #endif /* defined(__cplusplus) */
@@ -11,6 +11,7 @@
 template<class... TArguments>
 void mmp_tracer::operator ()(_In_z_ const char *const format,
         TArguments&&... arguments) noexcept {
+#if defined(_WIN32)
     constexpr const char *const prefix = "[0x%08x, %s:%d] ";
     const auto tid = ::GetCurrentThreadId();
     std::vector<char> buffer(::_scprintf(prefix, tid, this->_file,
@@ -40,6 +41,26 @@ void mmp_tracer::operator ()(_In_z_ const char *const format,
     ::strcat_s(buffer.data(), buffer.size(), "\r\n");
 
     ::OutputDebugStringA(buffer.data());
+
+#else /* defined(_WIN32) */
+    const auto size = std::snprintf(nullptr, 0, format,
+        std::forward<TArguments>(arguments)...);
+    if (size < 0) {
+        return;
+    }
+
+    std::vector<char> buffer(size + 1);
+    std::snprintf(buffer.data(), buffer.size(), format,
+        std::forward<TArguments>(arguments)...);
+
+    // Format everything into a single call such that the traces of
+    // concurrent threads do not interleave.
+    std::fprintf(stderr, "[0x%08lx, %s:%d] %s\n",
+        static_cast<unsigned long>(::pthread_self()),
+        this->_file,
+        this->_line,
+        buffer.data());
+#endif /* defined(_WIN32) */
 }
 
 
@@ -49,6 +70,7 @@ void mmp_tracer::operator ()(_In_z_ const char *const format,
 template<class... TArguments>
 void mmp_tracer::operator ()(_In_z_ const wchar_t *const format,
         TArguments&&... arguments) noexcept {
+#if defined(_WIN32)
     constexpr const wchar_t *const prefix = L"[0x%08x, %hs:%d] ";
     const auto tid = ::GetCurrentThreadId();
     std::vector<wchar_t> buffer(::_scwprintf(prefix, tid, this->_file,
@@ -78,4 +100,63 @@ void mmp_tracer::operator ()(_In_z_ const wchar_t *const format,
     ::wcscat_s(buffer.data(), buffer.size(), L"\r\n");
 
     ::OutputDebugStringW(buffer.data());
+
+#else /* defined(_WIN32) */
+    try {
+        const auto f = posix_format(format);
+
+        // There is no way to measure the output of swprintf, so we grow the
+        // buffer until the message fits.
+        std::vector<wchar_t> buffer(256);
+        while (std::swprintf(buffer.data(), buffer.size(), f.c_str(),
+                std::forward<TArguments>(arguments)...) < 0) {
+            if (buffer.size() >= 64 * 1024) {
+                return;
+            }
+            buffer.resize(2 * buffer.size());
+        }
+
+        std::fprintf(stderr, "[0x%08lx, %s:%d] %ls\n",
+            static_cast<unsigned long>(::pthread_self()),
+            this->_file,
+            this->_line,
+            buffer.data());
+    } catch (...) { /* Tracing is best effort. */ }
+#endif /* defined(_WIN32) */
+}
+
+
+#if !defined(_WIN32)
+/*
+ * tracer::posix_format
+ */
+inline std::wstring mmp_tracer::posix_format(_In_z_ const wchar_t *format) {
+    std::wstring retval;
+    retval.reserve(::wcslen(format) + 8);
+
+    for (auto c = format; *c != 0; ++c) {
+        retval += *c;
+        if (*c != L'%') {
+            continue;
+        }
+
+        // Copy flags, width and precision verbatim.
+        while ((c[1] != 0)
+                && (::wcschr(L"-+ #0123456789.*", c[1]) != nullptr)) {
+            retval += *++c;
+        }
+
+        if ((c[1] == L'h') && ((c[2] == L's') || (c[2] == L'c'))) {
+            // Narrow strings and characters have no length modifier.
+            ++c;
+        } else if ((c[1] == L's') || (c[1] == L'c')) {
+            // Wide strings and characters need an explicit one.
+            retval += L'l';
+        } else if (c[1] == L'%') {
+            retval += *++c;
+        }
+    }
+
+    return retval;
 }
+#endif /* !defined(_WIN32) */
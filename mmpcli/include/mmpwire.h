@@ -0,0 +1,694 @@
+﻿// <copyright file="mmpwire.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#if !defined(_MMPWIRE_H)
+#define _MMPWIRE_H
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include "mmpmsg.h"
+
+
+namespace visus {
+namespace mmp {
+namespace wire {
+
+namespace detail {
+
+    inline std::uint8_t swap_bytes(_In_ const std::uint8_t value) noexcept {
+        return value;
+    }
+
+    inline std::uint16_t swap_bytes(_In_ const std::uint16_t value) noexcept {
+        return ntohs(value);
+    }
+
+    inline std::uint32_t swap_bytes(_In_ const std::uint32_t value) noexcept {
+        return ntohl(value);
+    }
+
+    inline std::uint64_t swap_bytes(_In_ const std::uint64_t value) noexcept {
+        return ::mmp_ntoh64(value);
+    }
+
+} /* namespace detail */
+
+    /// <summary>
+    /// Converts an integral <paramref name="value"/> of any size from
+    /// network-byte order to host-byte order.
+    /// </summary>
+    /// <typeparam name="TValue">An integral type of 1, 2, 4 or 8 bytes.
+    /// </typeparam>
+    /// <param name="value">The value in network-byte order.</param>
+    /// <returns>The value in host-byte order.</returns>
+    template<class TValue>
+    inline TValue network_to_host(_In_ TValue value) noexcept {
+        static_assert(std::is_integral<TValue>::value,
+            "Only integral fields can be converted between byte orders.");
+        typedef typename std::make_unsigned<TValue>::type unsigned_type;
+        unsigned_type v;
+        std::memcpy(&v, &value, sizeof(v));
+        v = detail::swap_bytes(v);
+        std::memcpy(&value, &v, sizeof(value));
+        return value;
+    }
+
+
+    /// <summary>
+    /// Describes the wire format of a message. There must be a specialisation
+    /// for every message that can be dispatched, which is typically created
+    /// using <see cref="MMP_WIRE_MESSAGE"/>.
+    /// </summary>
+    /// <remarks>
+    /// The specialisations provide the message ID <c>id</c>, the size
+    /// <c>size</c> of the current version of the message and the size
+    /// <c>min_size</c> of the oldest version of the message that peers might
+    /// still be sending.
+    /// </remarks>
+    /// <typeparam name="TMessage">The message structure.</typeparam>
+    template<class TMessage> struct message_traits;
+
+
+    /// <summary>
+    /// The base class for read-only, zero-copy views over a received datagram,
+    /// which provides the byte-order aware access to the fields.
+    /// </summary>
+    /// <typeparam name="TMessage">The message structure describing the layout
+    /// of the datagram.</typeparam>
+    template<class TMessage> class basic_view {
+
+    public:
+
+        /// <summary>
+        /// The message structure describing the layout of the datagram.
+        /// </summary>
+        typedef TMessage message_type;
+
+        /// <summary>
+        /// The traits of the message.
+        /// </summary>
+        typedef message_traits<TMessage> traits_type;
+
+        /// <summary>
+        /// Initialises a new instance.
+        /// </summary>
+        /// <param name="data">The received datagram, which must live as long
+        /// as the view.</param>
+        /// <param name="size">The size of the received datagram in bytes.
+        /// </param>
+        inline basic_view(_In_reads_bytes_(size) const char *data,
+                _In_ const std::size_t size) noexcept
+            : _data(data), _size(size) { }
+
+        /// <summary>
+        /// Answer the raw datagram.
+        /// </summary>
+        inline const char *data(void) const noexcept {
+            return this->_data;
+        }
+
+        /// <summary>
+        /// Answer the size of the datagram in bytes.
+        /// </summary>
+        inline std::size_t size(void) const noexcept {
+            return this->_size;
+        }
+
+        /// <summary>
+        /// Answer whether the datagram is large enough to hold at least the
+        /// oldest version of the message.
+        /// </summary>
+        inline bool valid(void) const noexcept {
+            return (this->_size >= traits_type::min_size);
+        }
+
+    protected:
+
+        /// <summary>
+        /// Reads the field of type <typeparamref name="TValue"/> at
+        /// <typeparamref name="Offset"/> and converts it to host-byte order.
+        /// Fields that are not part of the datagram, because the peer sent an
+        /// older version of the message, are reported as zero.
+        /// </summary>
+        template<class TValue, std::size_t Offset>
+        inline TValue get(void) const noexcept {
+            static_assert(Offset + sizeof(TValue) <= sizeof(TMessage),
+                "The field is outside the message.");
+            TValue retval = 0;
+            if (Offset + sizeof(TValue) <= this->_size) {
+                std::memcpy(&retval, this->_data + Offset, sizeof(TValue));
+                retval = network_to_host(retval);
+            }
+            return retval;
+        }
+
+    private:
+
+        const char *_data;
+        std::size_t _size;
+    };
+
+
+    /// <summary>
+    /// The read-only view for a specific message. There must be a
+    /// specialisation for every message, which adds the accessors created by
+    /// <see cref="MMP_WIRE_FIELD"/>.
+    /// </summary>
+    /// <typeparam name="TMessage">The message structure.</typeparam>
+    template<class TMessage> class view;
+
+
+    /// <summary>
+    /// The possible outcomes of <see cref="dispatch_table::dispatch"/>.
+    /// </summary>
+    enum class dispatch_status {
+        /// <summary>
+        /// The datagram was passed to the handler.
+        /// </summary>
+        handled,
+
+        /// <summary>
+        /// The datagram is shorter than the message its ID designates.
+        /// </summary>
+        truncated,
+
+        /// <summary>
+        /// The ID of the datagram does not match any message in the table.
+        /// </summary>
+        unknown
+    };
+
+
+    /// <summary>
+    /// A table that maps the message IDs of all
+    /// <typeparamref name="TMessages"/> to a handler at compile time.
+    /// </summary>
+    /// <typeparam name="TMessages">The messages that can be dispatched.
+    /// </typeparam>
+    template<class... TMessages> struct dispatch_table;
+
+    /// <summary>
+    /// Terminates the recursion of the dispatch table.
+    /// </summary>
+    template<> struct dispatch_table<> {
+        template<class THandler>
+        static inline dispatch_status dispatch(_In_ const mmp_msg_id id,
+                _In_reads_bytes_(size) const char *data,
+                _In_ const std::size_t size,
+                _In_ THandler&& handler) {
+            (void) id;
+            (void) data;
+            (void) size;
+            (void) handler;
+            return dispatch_status::unknown;
+        }
+    };
+
+    /// <summary>
+    /// Dispatches <typeparamref name="TMessage"/> or delegates to the rest of
+    /// the table.
+    /// </summary>
+    template<class TMessage, class... TMessages>
+    struct dispatch_table<TMessage, TMessages...> {
+
+        /// <summary>
+        /// Validates that <paramref name="data"/> is a datagram of the message
+        /// type identified by <paramref name="id"/> and passes a view on it to
+        /// the <paramref name="handler"/>.
+        /// </summary>
+        /// <typeparam name="THandler">A functor accepting views of all
+        /// messages in the table.</typeparam>
+        /// <param name="id">The message ID in host-byte order.</param>
+        /// <param name="data">The datagram.</param>
+        /// <param name="size">The size of the datagram in bytes.</param>
+        /// <param name="handler">The handler to be invoked.</param>
+        /// <returns>Whether the datagram was passed to the handler.</returns>
+        template<class THandler>
+        static inline dispatch_status dispatch(_In_ const mmp_msg_id id,
+                _In_reads_bytes_(size) const char *data,
+                _In_ const std::size_t size,
+                _In_ THandler&& handler) {
+            if (id == message_traits<TMessage>::id) {
+                view<TMessage> msg(data, size);
+                if (!msg.valid()) {
+                    return dispatch_status::truncated;
+                }
+
+                handler(msg);
+                return dispatch_status::handled;
+            }
+
+            return dispatch_table<TMessages...>::dispatch(id, data, size,
+                std::forward<THandler>(handler));
+        }
+
+        /// <summary>
+        /// Reads the message ID from the datagram and passes a view on it to
+        /// the <paramref name="handler"/> if it is one of the messages in the
+        /// table and has a valid size.
+        /// </summary>
+        /// <typeparam name="THandler">A functor accepting views of all
+        /// messages in the table.</typeparam>
+        /// <param name="data">The datagram.</param>
+        /// <param name="size">The size of the datagram in bytes.</param>
+        /// <param name="handler">The handler to be invoked.</param>
+        /// <returns>Whether the datagram was passed to the handler.</returns>
+        template<class THandler>
+        static inline dispatch_status dispatch(
+                _In_reads_bytes_(size) const char *data,
+                _In_ const std::size_t size,
+                _In_ THandler&& handler) {
+            if (size < sizeof(mmp_msg_id)) {
+                return dispatch_status::truncated;
+            }
+
+            mmp_msg_id id;
+            std::memcpy(&id, data, sizeof(id));
+            id = network_to_host(id);
+
+            return dispatch(id, data, size, std::forward<THandler>(handler));
+        }
+    };
+
+} /* namespace wire */
+} /* namespace mmp */
+} /* namespace visus */
+
+
+/// <summary>
+/// Specialises <see cref="visus::mmp::wire::message_traits"/> for the given
+/// message and verifies that the layout of the structure matches the wire
+/// format of <paramref name="wire_size"/> bytes. This macro must be used in
+/// the namespace <c>visus::mmp::wire</c>.
+/// </summary>
+#define MMP_WIRE_MESSAGE(type, message_id, wire_size, min_wire_size)          \
+    static_assert(std::is_standard_layout<type>::value,                        \
+        #type " must have a standard layout.");                                \
+    static_assert(sizeof(type) == (wire_size),                                 \
+        "The layout of " #type " does not match the wire format.");            \
+    static_assert((min_wire_size) <= (wire_size),                              \
+        "The oldest version of " #type " cannot be larger than the current.");\
+    template<> struct message_traits<type> {                                   \
+        static constexpr mmp_msg_id id = (message_id);                         \
+        static constexpr std::size_t size = (wire_size);                       \
+        static constexpr std::size_t min_size = (min_wire_size);               \
+    }
+
+/// <summary>
+/// Specialises <see cref="visus::mmp::wire::message_traits"/> for a structure
+/// that is not a message on its own, but is embedded in the variable part of a
+/// message, and verifies its layout like <see cref="MMP_WIRE_MESSAGE"/>.
+/// </summary>
+#define MMP_WIRE_ELEMENT(type, wire_size)                                      \
+    static_assert(std::is_standard_layout<type>::value,                        \
+        #type " must have a standard layout.");                                \
+    static_assert(sizeof(type) == (wire_size),                                 \
+        "The layout of " #type " does not match the wire format.");            \
+    template<> struct message_traits<type> {                                   \
+        static constexpr std::size_t size = (wire_size);                       \
+        static constexpr std::size_t min_size = (wire_size);                   \
+    }
+
+/// <summary>
+/// Creates an accessor for the field <paramref name="name"/> of the message
+/// in a specialisation of <see cref="visus::mmp::wire::view"/>, which returns
+/// the field in host-byte order.
+/// </summary>
+#define MMP_WIRE_FIELD(name)                                                   \
+    inline decltype(message_type::name) name(void) const noexcept {            \
+        return this->template get<decltype(message_type::name),               \
+            offsetof(message_type, name)>();                                   \
+    }
+
+/// <summary>
+/// Verifies at compile time that the field <paramref name="name"/> of the
+/// message <paramref name="type"/> is at the specified byte
+/// <paramref name="offset"/>.
+/// </summary>
+#define MMP_WIRE_OFFSET(type, name, offset)                                    \
+    static_assert(offsetof(type, name) == (offset),                            \
+        "The field " #name " of " #type " is not at offset " #offset ".")
+
+
+namespace visus {
+namespace mmp {
+namespace wire {
+
+    MMP_WIRE_MESSAGE(mmp_msg_discover, mmp_msgid_discover, 8, 4);
+    MMP_WIRE_OFFSET(mmp_msg_discover, token, 4);
+    template<> class view<mmp_msg_discover> final
+            : public basic_view<mmp_msg_discover> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(token);
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_announce, mmp_msgid_announce, 28, 8);
+    MMP_WIRE_OFFSET(mmp_msg_announce, sequence_number, 4);
+    MMP_WIRE_OFFSET(mmp_msg_announce, version, 8);
+    MMP_WIRE_OFFSET(mmp_msg_announce, capabilities, 12);
+    MMP_WIRE_OFFSET(mmp_msg_announce, load, 16);
+    MMP_WIRE_OFFSET(mmp_msg_announce, token, 20);
+    MMP_WIRE_OFFSET(mmp_msg_announce, epoch, 24);
+    template<> class view<mmp_msg_announce> final
+            : public basic_view<mmp_msg_announce> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(sequence_number);
+        MMP_WIRE_FIELD(version);
+        MMP_WIRE_FIELD(capabilities);
+        MMP_WIRE_FIELD(load);
+        MMP_WIRE_FIELD(token);
+        MMP_WIRE_FIELD(epoch);
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_connect, mmp_msgid_connect, 32, 4);
+    MMP_WIRE_OFFSET(mmp_msg_connect, version, 4);
+    MMP_WIRE_OFFSET(mmp_msg_connect, capabilities, 8);
+    MMP_WIRE_OFFSET(mmp_msg_connect, left, 12);
+    MMP_WIRE_OFFSET(mmp_msg_connect, top, 16);
+    MMP_WIRE_OFFSET(mmp_msg_connect, width, 20);
+    MMP_WIRE_OFFSET(mmp_msg_connect, height, 24);
+    MMP_WIRE_OFFSET(mmp_msg_connect, rate, 28);
+    template<> class view<mmp_msg_connect> final
+            : public basic_view<mmp_msg_connect> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(version);
+        MMP_WIRE_FIELD(capabilities);
+        MMP_WIRE_FIELD(left);
+        MMP_WIRE_FIELD(top);
+        MMP_WIRE_FIELD(width);
+        MMP_WIRE_FIELD(height);
+        MMP_WIRE_FIELD(rate);
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_ack, mmp_msgid_ack, 8, 8);
+    MMP_WIRE_OFFSET(mmp_msg_ack, sequence_number, 4);
+    template<> class view<mmp_msg_ack> final
+            : public basic_view<mmp_msg_ack> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(sequence_number);
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_heartbeat, mmp_msgid_heartbeat, 12, 12);
+    MMP_WIRE_OFFSET(mmp_msg_heartbeat, sequence_number, 4);
+    MMP_WIRE_OFFSET(mmp_msg_heartbeat, epoch, 8);
+    template<> class view<mmp_msg_heartbeat> final
+            : public basic_view<mmp_msg_heartbeat> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(sequence_number);
+        MMP_WIRE_FIELD(epoch);
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_ping, mmp_msgid_ping, 16, 16);
+    MMP_WIRE_OFFSET(mmp_msg_ping, token, 4);
+    MMP_WIRE_OFFSET(mmp_msg_ping, origin, 8);
+    template<> class view<mmp_msg_ping> final
+            : public basic_view<mmp_msg_ping> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(token);
+        MMP_WIRE_FIELD(origin);
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_pong, mmp_msgid_pong, 32, 32);
+    MMP_WIRE_OFFSET(mmp_msg_pong, token, 4);
+    MMP_WIRE_OFFSET(mmp_msg_pong, origin, 8);
+    MMP_WIRE_OFFSET(mmp_msg_pong, receive, 16);
+    MMP_WIRE_OFFSET(mmp_msg_pong, transmit, 24);
+    template<> class view<mmp_msg_pong> final
+            : public basic_view<mmp_msg_pong> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(token);
+        MMP_WIRE_FIELD(origin);
+        MMP_WIRE_FIELD(receive);
+        MMP_WIRE_FIELD(transmit);
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_rate, mmp_msgid_rate, 8, 8);
+    MMP_WIRE_OFFSET(mmp_msg_rate, rate, 4);
+    template<> class view<mmp_msg_rate> final
+            : public basic_view<mmp_msg_rate> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(rate);
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_standby, mmp_msgid_standby, 4, 4);
+    template<> class view<mmp_msg_standby> final
+            : public basic_view<mmp_msg_standby> {
+    public:
+        using basic_view::basic_view;
+    };
+
+
+    MMP_WIRE_ELEMENT(mmp_msg_replica_client, 52);
+    MMP_WIRE_OFFSET(mmp_msg_replica_client, family, 0);
+    MMP_WIRE_OFFSET(mmp_msg_replica_client, port, 2);
+    MMP_WIRE_OFFSET(mmp_msg_replica_client, scope_id, 4);
+    MMP_WIRE_OFFSET(mmp_msg_replica_client, address, 8);
+    MMP_WIRE_OFFSET(mmp_msg_replica_client, version, 24);
+    MMP_WIRE_OFFSET(mmp_msg_replica_client, capabilities, 28);
+    MMP_WIRE_OFFSET(mmp_msg_replica_client, left, 32);
+    MMP_WIRE_OFFSET(mmp_msg_replica_client, top, 36);
+    MMP_WIRE_OFFSET(mmp_msg_replica_client, width, 40);
+    MMP_WIRE_OFFSET(mmp_msg_replica_client, height, 44);
+    MMP_WIRE_OFFSET(mmp_msg_replica_client, rate, 48);
+    template<> class view<mmp_msg_replica_client> final
+            : public basic_view<mmp_msg_replica_client> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(family);
+        MMP_WIRE_FIELD(port);
+        MMP_WIRE_FIELD(scope_id);
+        MMP_WIRE_FIELD(version);
+        MMP_WIRE_FIELD(capabilities);
+        MMP_WIRE_FIELD(left);
+        MMP_WIRE_FIELD(top);
+        MMP_WIRE_FIELD(width);
+        MMP_WIRE_FIELD(height);
+        MMP_WIRE_FIELD(rate);
+
+        /// <summary>
+        /// Answer the raw bytes of the IP address, which are not subject to
+        /// byte-order conversion.
+        /// </summary>
+        inline const std::uint8_t *address(void) const noexcept {
+            return reinterpret_cast<const std::uint8_t *>(this->data()
+                + offsetof(message_type, address));
+        }
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_replica, mmp_msgid_replica, 28, 28);
+    MMP_WIRE_OFFSET(mmp_msg_replica, sequence_number, 4);
+    MMP_WIRE_OFFSET(mmp_msg_replica, epoch, 8);
+    MMP_WIRE_OFFSET(mmp_msg_replica, x, 12);
+    MMP_WIRE_OFFSET(mmp_msg_replica, y, 16);
+    MMP_WIRE_OFFSET(mmp_msg_replica, buttons, 20);
+    MMP_WIRE_OFFSET(mmp_msg_replica, clients, 24);
+    template<> class view<mmp_msg_replica> final
+            : public basic_view<mmp_msg_replica> {
+    public:
+        typedef message_traits<mmp_msg_replica_client> client_traits;
+
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(sequence_number);
+        MMP_WIRE_FIELD(epoch);
+        MMP_WIRE_FIELD(x);
+        MMP_WIRE_FIELD(y);
+        MMP_WIRE_FIELD(buttons);
+        MMP_WIRE_FIELD(clients);
+
+        /// <summary>
+        /// Answer a view on the <paramref name="i"/>th client, which must be
+        /// less than <see cref="clients"/>.
+        /// </summary>
+        inline view<mmp_msg_replica_client> client(
+                _In_ const std::size_t i) const noexcept {
+            return view<mmp_msg_replica_client>(this->data()
+                + traits_type::size + i * client_traits::size,
+                client_traits::size);
+        }
+
+        /// <summary>
+        /// Answer whether the datagram holds the header and all of the
+        /// clients it announces.
+        /// </summary>
+        inline bool valid(void) const noexcept {
+            return basic_view::valid() && ((this->size() - traits_type::size)
+                / client_traits::size >= this->clients());
+        }
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_state, mmp_msgid_state, 24, 20);
+    MMP_WIRE_OFFSET(mmp_msg_state, sequence_number, 4);
+    MMP_WIRE_OFFSET(mmp_msg_state, x, 8);
+    MMP_WIRE_OFFSET(mmp_msg_state, y, 12);
+    MMP_WIRE_OFFSET(mmp_msg_state, buttons, 16);
+    MMP_WIRE_OFFSET(mmp_msg_state, epoch, 20);
+    template<> class view<mmp_msg_state> final
+            : public basic_view<mmp_msg_state> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(sequence_number);
+        MMP_WIRE_FIELD(x);
+        MMP_WIRE_FIELD(y);
+        MMP_WIRE_FIELD(buttons);
+        MMP_WIRE_FIELD(epoch);
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_mouse_move, mmp_msgid_mouse_move, 16, 16);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_move, sequence_number, 4);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_move, x, 8);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_move, y, 12);
+    template<> class view<mmp_msg_mouse_move> final
+            : public basic_view<mmp_msg_mouse_move> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(sequence_number);
+        MMP_WIRE_FIELD(x);
+        MMP_WIRE_FIELD(y);
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_mouse_button, mmp_msgid_mouse_button, 20, 20);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_button, sequence_number, 4);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_button, button, 8);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_button, down, 9);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_button, x, 12);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_button, y, 16);
+    template<> class view<mmp_msg_mouse_button> final
+            : public basic_view<mmp_msg_mouse_button> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(sequence_number);
+        MMP_WIRE_FIELD(button);
+        MMP_WIRE_FIELD(down);
+        MMP_WIRE_FIELD(x);
+        MMP_WIRE_FIELD(y);
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_mouse_move_ts, mmp_msgid_mouse_move_ts, 24, 24);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_move_ts, sequence_number, 4);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_move_ts, timestamp, 8);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_move_ts, x, 16);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_move_ts, y, 20);
+    template<> class view<mmp_msg_mouse_move_ts> final
+            : public basic_view<mmp_msg_mouse_move_ts> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(sequence_number);
+        MMP_WIRE_FIELD(timestamp);
+        MMP_WIRE_FIELD(x);
+        MMP_WIRE_FIELD(y);
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_mouse_button_ts, mmp_msgid_mouse_button_ts,
+        32, 32);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_button_ts, sequence_number, 4);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_button_ts, timestamp, 8);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_button_ts, x, 16);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_button_ts, y, 20);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_button_ts, button, 24);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_button_ts, down, 25);
+    template<> class view<mmp_msg_mouse_button_ts> final
+            : public basic_view<mmp_msg_mouse_button_ts> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(sequence_number);
+        MMP_WIRE_FIELD(timestamp);
+        MMP_WIRE_FIELD(x);
+        MMP_WIRE_FIELD(y);
+        MMP_WIRE_FIELD(button);
+        MMP_WIRE_FIELD(down);
+    };
+
+
+    MMP_WIRE_ELEMENT(mmp_msg_history_entry, 16);
+    MMP_WIRE_OFFSET(mmp_msg_history_entry, sequence_number, 0);
+    MMP_WIRE_OFFSET(mmp_msg_history_entry, x, 4);
+    MMP_WIRE_OFFSET(mmp_msg_history_entry, y, 8);
+    MMP_WIRE_OFFSET(mmp_msg_history_entry, buttons, 12);
+    template<> class view<mmp_msg_history_entry> final
+            : public basic_view<mmp_msg_history_entry> {
+    public:
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(sequence_number);
+        MMP_WIRE_FIELD(x);
+        MMP_WIRE_FIELD(y);
+        MMP_WIRE_FIELD(buttons);
+    };
+
+
+    MMP_WIRE_MESSAGE(mmp_msg_mouse_history, mmp_msgid_mouse_history, 32, 32);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_history, sequence_number, 4);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_history, timestamp, 8);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_history, x, 16);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_history, y, 20);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_history, buttons, 24);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_history, history, 28);
+    MMP_WIRE_OFFSET(mmp_msg_mouse_history, flags, 30);
+    template<> class view<mmp_msg_mouse_history> final
+            : public basic_view<mmp_msg_mouse_history> {
+    public:
+        typedef message_traits<mmp_msg_history_entry> entry_traits;
+
+        using basic_view::basic_view;
+        MMP_WIRE_FIELD(sequence_number);
+        MMP_WIRE_FIELD(timestamp);
+        MMP_WIRE_FIELD(x);
+        MMP_WIRE_FIELD(y);
+        MMP_WIRE_FIELD(buttons);
+        MMP_WIRE_FIELD(history);
+        MMP_WIRE_FIELD(flags);
+
+        /// <summary>
+        /// Answer a view on the <paramref name="i"/>th entry of the history,
+        /// which must be less than <see cref="history"/>.
+        /// </summary>
+        inline view<mmp_msg_history_entry> entry(
+                _In_ const std::size_t i) const noexcept {
+            return view<mmp_msg_history_entry>(this->data() + traits_type::size
+                + i * entry_traits::size, entry_traits::size);
+        }
+
+        /// <summary>
+        /// Answer whether the datagram holds the header and all of the
+        /// entries it announces.
+        /// </summary>
+        inline bool valid(void) const noexcept {
+            return basic_view::valid() && ((this->size() - traits_type::size)
+                / entry_traits::size >= this->history());
+        }
+    };
+
+} /* namespace wire */
+} /* namespace mmp */
+} /* namespace visus */
+
+#endif /* !defined(_MMPWIRE_H) */
@@ -4,6 +4,7 @@
 // </copyright>
 // <author>Christoph Müller</author>
 
+#if defined(_WIN32)
 #include <sal.h>
 #include <Windows.h>
 
@@ -20,3 +21,4 @@ BOOL APIENTRY DllMain(_In_ const HMODULE module,
     }
     return TRUE;
 }
+#endif /* defined(_WIN32) */
@@ -6,17 +6,27 @@
 
 #include "mmp_client.h"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cstring>
 #include <limits>
 #include <memory>
 
+#if defined(_WIN32)
 #include <WinSock2.h>
 #include <Windows.h>
 #include <iphlpapi.h>
 #include <WS2tcpip.h>
-
+#else /* defined(_WIN32) */
+#include <ifaddrs.h>
+#include <net/if.h>
+#endif /* defined(_WIN32) */
+
+#include "mmp_discovery.h"
+#include "mmp_discovery_cache.h"
+#include "mmp_udp_transport.h"
+#include "mmp_uring_transport.h"
 #include "mmpcli.h"
 #include "mmpmsg.h"
 #include "mmpthreadname.h"
@@ -26,28 +36,142 @@
  * mmp_client::mmp_client
  */
 mmp_client::mmp_client(_In_ const mmp_configuration& config)
-    : _config(config),
+    : _accepted(false),
+    _button_sequence_numbers(),
+    _buttons(0),
+    _cancelled(false),
+    _capabilities(mmp_capabilities_supported),
+    _config(config),
+    _configured_server(config.server),
+    _connect_status(0),
+    _consumption(0.0),
+    _epoch(0),
+    _heartbeat(false),
     _offset(0, 0),
+    _probe(0),
+    _rate(config.max_rate),
+    _rate_check(0),
+    _received(0),
+    _rediscover(false),
     _running(false),
+    _sender(),
     _sequence_number(0),
+    _server_capabilities(mmp_capability_none),
+    _server_version(0),
+    _shared_cursor(0),
+    _timestamp(0),
     _update_offset(false),
-    _wsa_data({ 0 }) { }
+    _update_state(false)
+#if defined(_WIN32)
+    , _wsa_data({ 0 })
+#endif /* defined(_WIN32) */
+    { }
 
 
 /*
  * mmp_client::~mmp_client
  */
 mmp_client::~mmp_client(void) noexcept {
+    MMP_TRACE(L"Cancelling pending connection attempt.");
+    {
+        std::lock_guard<std::mutex> l(this->_connect_lock);
+        this->_cancelled.store(true, std::memory_order_release);
+        this->_connect_signal.notify_all();
+    }
+
+    if (this->_connector.joinable()) {
+        if (this->_connector.get_id() == std::this_thread::get_id()) {
+            // This should not happen, because the completion callback must not
+            // disconnect, but we prefer leaking the thread over terminating.
+            this->_connector.detach();
+        } else {
+            this->_connector.join();
+        }
+    }
+
     MMP_TRACE(L"Stopping client receiver thread.");
     this->_running.store(false, std::memory_order_release);
-    this->_socket.reset();
+    if (this->_transport) {
+        this->_transport->close();
+    }
+    if (this->_shared) {
+        this->_shared->wake();
+    }
 
     if (this->_receiver.joinable()) {
         this->_receiver.join();
     }
 
+#if defined(_WIN32)
     MMP_TRACE(L"Cleaning up Winsock.");
     ::WSACleanup();
+#endif /* defined(_WIN32) */
+}
+
+
+/*
+ * mmp_client::clock
+ */
+_Success_(return == 0) int mmp_client::clock(_Out_ std::int64_t& offset,
+        _Out_ std::uint32_t& rtt,
+        _Out_ std::uint32_t& jitter) const noexcept {
+    if (!this->_clock.get(offset, rtt, jitter)) {
+        RETURN_WIN32(ERROR_NOT_READY);
+    }
+
+    return 0;
+}
+
+
+/*
+ * mmp_client::connect_async
+ */
+_Success_(return == 0) int mmp_client::connect_async(
+        _In_opt_ mmp_connect_completion completion,
+        _In_opt_ void *context) noexcept {
+    this->_connect_status = HRESULT_FROM_WIN32(ERROR_IO_PENDING);
+
+    MMP_TRACE(L"Starting client connector thread.");
+    try {
+        this->_connector = std::thread([this, completion, context](void) {
+            ::mmp_set_thread_name(-1, "Magic mouse pad connector");
+            int status = 0;
+
+            try {
+                status = this->discover();
+                if (status == 0) {
+                    status = this->start();
+                }
+            } catch (...) {
+                status = wil::ResultFromCaughtException();
+            }
+
+            if (this->cancelled()) {
+                status = HRESULT_FROM_WIN32(ERROR_CANCELLED);
+            }
+
+            MMP_TRACE(L"The connection attempt completed with status 0x%x.",
+                status);
+            {
+                std::lock_guard<std::mutex> l(this->_connect_lock);
+                this->_connect_status = status;
+                this->_connect_signal.notify_all();
+            }
+
+            // Note: the client must not be used after the callback, because
+            // the callback is the first point where the caller might
+            // legitimately expect to be able to disconnect.
+            if (completion != nullptr) {
+                completion(this, status, context);
+            }
+        });
+    } catch (const std::system_error& ex) {
+        MMP_TRACE(L"Failed to start the client connector thread: %hs",
+            ex.what());
+        RETURN_WIN32(ex.code().value());
+    }
+
+    return 0;
 }
 
 
@@ -70,7 +194,7 @@ _Success_(return == 0) int mmp_client::discover(void) {
                 ::memset(&this->_config.client, 0,
                     sizeof(this->_config.client));
                 this->_config.client.ss_family = this->_config.server.ss_family;
-                return 0;
+                return this->identify();
 
             } else if (this->_config.client.ss_family
                     != this->_config.server.ss_family) {
@@ -83,7 +207,7 @@ _Success_(return == 0) int mmp_client::discover(void) {
             } else {
                 MMP_TRACE(L"An IPv4 address was provided for the magic mouse "
                     L"pad, so no discovery is necessary.");
-                return 0;
+                return this->identify();
             }
             } break;
 
@@ -100,7 +224,7 @@ _Success_(return == 0) int mmp_client::discover(void) {
                 ::memset(&this->_config.client, 0,
                     sizeof(this->_config.client));
                 this->_config.client.ss_family = this->_config.server.ss_family;
-                return 0;
+                return this->identify();
 
             } else if (this->_config.client.ss_family
                     != this->_config.server.ss_family) {
@@ -113,7 +237,7 @@ _Success_(return == 0) int mmp_client::discover(void) {
             } else {
                 MMP_TRACE(L"An IPv6 address was provided for the magic mouse "
                     L"pad, so no discovery is necessary.");
-                return 0;
+                return this->identify();
             }
             } break;
 
@@ -130,111 +254,127 @@ _Success_(return == 0) int mmp_client::discover(void) {
         port = ::htons(mmp_default_port);
     }
 
-    // Get all possible bradcast addresses for the given port.
-    std::vector<sockaddr_in> addresses;
-    try {
-        addresses = bcast_addresses(port);
-    } catch (const wil::ResultException& e) {
-        MMP_TRACE(L"Failed to retrieve broadcast addresses: %hs", e.what());
-        return e.GetErrorCode();
-    }
-
-    // Prepare a socket that we will solely use for discovery.
-    wil::unique_socket socket(::WSASocket(AF_INET,
-        SOCK_DGRAM,
-        IPPROTO_UDP,
-        nullptr,
-        0,
-        WSA_FLAG_OVERLAPPED));
-    if (!socket) {
-        auto retval = ::WSAGetLastError();
-        MMP_TRACE(L"Failed to create a UDP socket for discovery: 0x%x.",
-            retval);
-        RETURN_WIN32(retval);
+    // The initial interval between requests also is the time we wait for
+    // beacons and other servers once the first one has responded.
+    typedef mmp_discovery::clock clock;
+    const auto interval = (this->_config.rate_limit > 0)
+        ? clock::duration(std::chrono::milliseconds(this->_config.rate_limit))
+        : clock::duration(std::chrono::milliseconds(100));
+    const auto cancelled = [this](void) { return this->cancelled(); };
+
+    // If enabled, try the server we found last time before broadcasting.
+    const auto cache = ((this->_config.flags & mmp_flag_discovery_cache) != 0);
+    const auto ttl = (this->_config.cache_ttl > 0)
+        ? std::chrono::seconds(this->_config.cache_ttl)
+        : mmp_discovery_cache::default_ttl;
+    if (cache) {
+        sockaddr_storage cached;
+        if (mmp_discovery_cache::load(::ntohs(port), cached)) {
+#if (defined(_DEBUG) || defined(DEBUG))
+            auto addr = to_string(cached);
+            MMP_TRACE(L"Probing cached magic mouse pad at %s.", addr.c_str());
+#endif /* defined(_DEBUG) || defined(DEBUG) */
+            mmp_discovery probe(this->_config.client, interval,
+                clock::duration::zero());
+            auto status = probe.add_target(cached);
+            if (status == 0) {
+                status = probe.run(clock::now() + interval, cancelled);
+            }
+
+            if (status == HRESULT_FROM_WIN32(ERROR_CANCELLED)) {
+                return status;
+            }
+
+            if (status == 0) {
+                this->on_discovered(probe);
+                mmp_discovery_cache::store(::ntohs(port), this->_config.server,
+                    ttl);
+                return 0;
+            }
+
+            MMP_TRACE(L"The cached magic mouse pad did not respond, so we "
+                L"fall back to broadcast discovery.");
+            mmp_discovery_cache::invalidate(::ntohs(port));
+        }
     }
 
+    // Unless the client is bound to a specific address, we search via IPv4
+    // broadcasts and IPv6 link-local multicasts in parallel.
+    const auto any_client = is_unspecified(this->_config.client);
+    const auto ipv4 = any_client || (this->_config.client.ss_family == AF_INET);
+    const auto ipv6 = any_client
+        || (this->_config.client.ss_family == AF_INET6);
+    mmp_discovery discovery(this->_config.client, interval, interval);
+
     MMP_TRACE(L"Discovering magic mouse pad at port %d.", ::ntohs(port));
-    RETURN_IF_WIN32_ERROR(!bind(socket, this->_config.client));
-
-    // Start a thread that receives the responses.
-    std::atomic<bool> found(false);
-    std::thread([&found, &socket, this](void) {
-        ::mmp_set_thread_name(-1, "Magic mouse pad discovery");
-        constexpr int cnt_buffer = (std::numeric_limits<std::uint16_t>::max)();
-        std::vector<char> buffer(cnt_buffer);
-        sockaddr_storage peer;
 
-        while (true) {
-            int cnt_peer = sizeof(peer);
-            auto len = ::recvfrom(socket.get(),
-                buffer.data(),
-                cnt_buffer,
-                0,
-                reinterpret_cast<sockaddr *>(&peer),
-                &cnt_peer);
-            if (len == SOCKET_ERROR) {
-                MMP_TRACE(L"The receive failed with error %d, so the "
-                    L"discovery receiver is leaving now.", ::WSAGetLastError());
-                return;
-            }
-            if (len < sizeof(mmp_msg_announce)) {
-                MMP_TRACE(L"Received an invalid datagram.");
-                continue;
-            }
+    if (ipv4) {
+        std::vector<sockaddr_in> addresses;
+        try {
+            addresses = bcast_addresses(port);
+        } catch (const wil::ResultException& e) {
+            MMP_TRACE(L"Failed to retrieve broadcast addresses: %hs",
+                e.what());
+            return e.GetErrorCode();
+        }
 
-            const auto id = ::ntohl(*as<mmp_msg_id>(buffer));
-            MMP_TRACE(L"Received message 0x%x.", id);
-
-            if (id == mmp_msgid_announce) {
-                MMP_TRACE(L"Received a mouse pad announcement.");
-                this->_config.server = peer;
-                auto connect = as<mmp_msg_announce>(buffer);
-                this->_sequence_number.store(
-                    ::ntohl(connect->sequence_number),
-                    std::memory_order_release);
-                found.store(true, std::memory_order_release);
-                return;
-            }
+        for (auto& a : addresses) {
+            sockaddr_storage target { };
+            ::memcpy(&target, &a, sizeof(a));
+            RETURN_IF_WIN32_ERROR(discovery.add_target(target));
         }
-    }).detach();
+    }
 
-    // Compute the deadline until which we need to be ready.
-    const std::chrono::milliseconds rate_limit(this->_config.rate_limit);
-    auto deadline = std::chrono::system_clock::now();
-    if (this->_config.timeout > 0) {
-        deadline += std::chrono::milliseconds(this->_config.timeout);
-    } else {
-        deadline = (decltype(deadline)::max)();
-    }
-
-    while ((std::chrono::system_clock::now() < deadline)
-            && !found.load(std::memory_order_acquire)) {
-        mmp_msg_discover msg;
-
-        for (auto it = addresses.begin(); it != addresses.end();) {
-            MMP_TRACE(L"Sending discovery message.");
-            if (::sendto(socket.get(),
-                    reinterpret_cast<const char *>(&msg),
-                    sizeof(msg),
-                    0,
-                    reinterpret_cast<const sockaddr *>(&*it),
-                    sizeof(sockaddr_in))
-                    == SOCKET_ERROR) {
-                it = addresses.erase(it);
-            } else {
-                ++it;
+    // IPv6 might not be available at all, which is not fatal as long as we
+    // can use IPv4.
+    if (ipv6) {
+        try {
+            for (auto& g : mcast_addresses(port)) {
+                sockaddr_storage target { };
+                ::memcpy(&target, &g, sizeof(g));
+                if (discovery.add_target(target) != 0) {
+                    MMP_TRACE(L"Failed to prepare IPv6 discovery.");
+                    break;
+                }
             }
+        } catch (const wil::ResultException& e) {
+            MMP_TRACE(L"Failed to retrieve IPv6 interfaces: %hs", e.what());
         }
+    }
 
-        if (addresses.empty()) {
-            MMP_TRACE(L"No working broadcast addresses available.");
-            RETURN_LAST_ERROR();
+    // If passive discovery is enabled, listen for beacons on a shared port.
+    // Failing to do so is not fatal, because we can still broadcast.
+    if (((this->_config.flags & mmp_flag_passive_discovery) != 0) && ipv4) {
+        const auto beacon_port = ::ntohs(port) + mmp_beacon_port_offset;
+        if (discovery.listen(static_cast<std::uint16_t>(beacon_port)) != 0) {
+            MMP_TRACE(L"Failed to listen for beacons on port %u.",
+                beacon_port);
         }
+    }
+
+    const auto deadline = (this->_config.timeout > 0)
+        ? clock::now() + std::chrono::milliseconds(this->_config.timeout)
+        : (clock::time_point::max)();
+    RETURN_IF_WIN32_ERROR(discovery.run(deadline, cancelled));
+    this->on_discovered(discovery);
 
-        std::this_thread::sleep_for(rate_limit);
+    if (cache) {
+        mmp_discovery_cache::store(::ntohs(port), this->_config.server, ttl);
     }
 
-    return found ? 0 : HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+    return 0;
+}
+
+
+/*
+ * mmp_client::forward
+ */
+void mmp_client::forward(
+        _In_ std::function<void(const char *, const DWORD)>&& forward,
+        _In_ const mmp_capabilities capabilities) {
+    assert(!this->_running.load(std::memory_order_acquire));
+    this->_capabilities = capabilities & mmp_capabilities_supported;
+    this->_forward = std::move(forward);
 }
 
 
@@ -242,6 +382,12 @@ _Success_(return == 0) int mmp_client::discover(void) {
  * mmp_client::start
  */
 _Success_(return == 0) int mmp_client::start(void) noexcept {
+    if (this->cancelled()) {
+        MMP_TRACE(L"The connection attempt was cancelled before the client "
+            L"could be started.");
+        RETURN_WIN32(ERROR_CANCELLED);
+    }
+
     bool expected = false;
     if (!this->_running.compare_exchange_strong(expected,
             true,
@@ -254,7 +400,7 @@ _Success_(return == 0) int mmp_client::start(void) noexcept {
 
     try {
         this->_reordering_buffer.resize(this->_config.reordering_buffer);
-    } catch (std::bad_alloc) {
+    } catch (const std::bad_alloc&) {
         MMP_TRACE(L"Insufficient memory to allocate a reordering buffer "
             L"for %u elements.", this->_config.reordering_buffer);
         RETURN_WIN32(ERROR_OUTOFMEMORY);
@@ -273,33 +419,92 @@ _Success_(return == 0) int mmp_client::start(void) noexcept {
             break;
     }
 
-    MMP_TRACE(L"Creating socket of family %d.", this->_config.client.ss_family);
-    this->_socket.reset(::WSASocket(
-        this->_config.client.ss_family,
-        SOCK_DGRAM,
-        IPPROTO_UDP,
-        nullptr,
-        0,
-        WSA_FLAG_OVERLAPPED));
-    RETURN_LAST_ERROR_IF(!this->_socket);
+    const auto injected = static_cast<bool>(this->_transport);
+    if (!injected) {
+        MMP_TRACE(L"Creating socket of family %d.",
+            this->_config.client.ss_family);
+        wil::unique_socket socket(::WSASocket(
+            this->_config.client.ss_family,
+            SOCK_DGRAM,
+            IPPROTO_UDP,
+            nullptr,
+            0,
+            WSA_FLAG_OVERLAPPED));
+        RETURN_LAST_ERROR_IF(!socket);
+
+        MMP_TRACE(L"Binding receiver socket to configured address.");
+        RETURN_IF_WIN32_ERROR(bind(socket, this->_config.client));
+
+#if defined(MMP_IO_URING)
+        // io_uring saves most of the system calls for receiving, but it might
+        // be unavailable or disabled, in which case the socket is left to the
+        // regular transport.
+        if ((this->_config.flags & mmp_flag_no_io_uring) == 0) {
+            std::unique_ptr<mmp_uring_transport> uring(new (std::nothrow)
+                mmp_uring_transport());
+            const auto status = (uring != nullptr)
+                ? uring->open(socket)
+                : HRESULT_FROM_WIN32(ERROR_OUTOFMEMORY);
+            if (status == 0) {
+                MMP_TRACE(L"Receiving datagrams via io_uring.");
+                this->_transport = std::move(uring);
+            } else {
+                MMP_TRACE(L"io_uring is not available (error %d), so the "
+                    L"client receives from the socket.", status);
+            }
+        }
+#endif /* defined(MMP_IO_URING) */
+
+        if (!this->_transport) {
+            std::unique_ptr<mmp_udp_transport> udp(new (std::nothrow)
+                mmp_udp_transport(std::move(socket)));
+            RETURN_IF_NULL_ALLOC(udp);
+            RETURN_IF_WIN32_ERROR(udp->open());
+            this->_transport = std::move(udp);
+        }
 
-    MMP_TRACE(L"Binding receiver socket to configured address.");
-    RETURN_IF_WIN32_ERROR(bind(this->_socket, this->_config.client));
+    } else {
+        MMP_TRACE(L"Using the transport injected before the client was "
+            L"started.");
+    }
 
-    MMP_TRACE(L"Allocating kernel event for asynchronous I/O.");
-    RETURN_IF_FAILED(this->_event.create());
+    // A server on the same machine might publish its events in shared
+    // memory, which spares both of us the round trip through the network
+    // stack. If it does not, we just use the socket. An injected transport
+    // is used for everything, because it is meant to replace the network.
+    if (((this->_config.flags & mmp_flag_no_shared_memory) == 0)
+            && !injected
+            && is_local(this->_config.server)) {
+        const auto port = (this->_config.server.ss_family == AF_INET6)
+            ? reinterpret_cast<sockaddr_in6&>(this->_config.server).sin6_port
+            : reinterpret_cast<sockaddr_in&>(this->_config.server).sin_port;
+        std::unique_ptr<mmp_shared_ring> shared(
+            new (std::nothrow) mmp_shared_ring());
+        if ((shared != nullptr) && (shared->open(::ntohs(port)) == 0)) {
+            this->_shared = std::move(shared);
+        } else {
+            MMP_TRACE(L"The magic mouse pad is local, but its shared memory "
+                L"is not available, so the client uses the network.");
+        }
+    }
 
     // If we are supposed to set an explicit start position, we need to remember
     // this before we receive the first message from the server.
     this->_update_offset = ((this->_config.flags & mmp_flag_set_start) != 0);
 
-    MMP_TRACE(L"Announcing client to Magic Mouse Pad.");
-    RETURN_IF_WIN32_ERROR(this->connect());
+    if ((this->_server_capabilities & mmp_capability_state) != 0) {
+        MMP_TRACE(L"Announcing client to Magic Mouse Pad and waiting for the "
+            L"state snapshot.");
+        RETURN_IF_WIN32_ERROR(this->wait_for_state());
+    } else {
+        MMP_TRACE(L"Announcing client to Magic Mouse Pad.");
+        RETURN_IF_WIN32_ERROR(this->connect());
+    }
 
     MMP_TRACE(L"Starting client receiver thread.");
     try {
         this->_receiver = std::thread(&mmp_client::receive, this);
-    } catch (std::system_error ex) {
+    } catch (const std::system_error& ex) {
         MMP_TRACE(L"Failed to start the client receiver thread: %hs",
             ex.what());
         RETURN_WIN32(ex.code().value());
@@ -309,14 +514,47 @@ _Success_(return == 0) int mmp_client::start(void) noexcept {
 }
 
 
+/*
+ * mmp_client::transport
+ */
+void mmp_client::transport(_In_ std::unique_ptr<mmp_transport>&& transport) {
+    assert(!this->_running.load(std::memory_order_acquire));
+    this->_transport = std::move(transport);
+}
+
+
+/*
+ * mmp_client::wait
+ */
+_Success_(return == 0) int mmp_client::wait(
+        _In_ const std::uint32_t timeout) noexcept {
+    const auto pending = HRESULT_FROM_WIN32(ERROR_IO_PENDING);
+    const auto done = [this, pending](void) {
+        return (this->_connect_status != pending);
+    };
+
+    std::unique_lock<std::mutex> l(this->_connect_lock);
+    if (timeout == (std::numeric_limits<std::uint32_t>::max)()) {
+        this->_connect_signal.wait(l, done);
+
+    } else if (!this->_connect_signal.wait_for(l,
+            std::chrono::milliseconds(timeout), done)) {
+        return HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+    }
+
+    return this->_connect_status;
+}
+
+
 /*
  * mmp_client::bcast_addresses
  */
 std::vector<sockaddr_in> mmp_client::bcast_addresses(
         _In_ const std::uint16_t port) {
     std::vector<sockaddr_in> retval;
-
     const auto family = AF_INET;
+
+#if defined(_WIN32)
     const auto flags = GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST
         | GAA_FLAG_SKIP_DNS_SERVER;
     ULONG len = 0;
@@ -379,6 +617,47 @@ std::vector<sockaddr_in> mmp_client::bcast_addresses(
         }
     }
 
+#else /* defined(_WIN32) */
+    ifaddrs *interfaces = nullptr;
+    THROW_LAST_ERROR_IF(::getifaddrs(&interfaces) != 0);
+    auto free_interfaces = wil::scope_exit(
+        [interfaces](void) { ::freeifaddrs(interfaces); });
+
+    for (auto i = interfaces; i != nullptr; i = i->ifa_next) {
+        if ((i->ifa_flags & IFF_UP) == 0) {
+            // Skip interfaces that are not up, because the client cannot
+            // connect to them.
+            MMP_TRACE(L"Skipping interface %hs because it is not up.",
+                i->ifa_name);
+            continue;
+        }
+        if ((i->ifa_addr == nullptr) || (i->ifa_addr->sa_family != family)) {
+            // Broadcast works only with IPv4. Note that getifaddrs reports
+            // every address of an interface as an entry of its own.
+            continue;
+        }
+        if (i->ifa_netmask == nullptr) {
+            MMP_TRACE(L"Skipping invalid address on interface %hs.",
+                i->ifa_name);
+            continue;
+        }
+
+        // Compute the broadcast address from the network mask rather than
+        // using ifa_broadaddr, which is not set for the loopback interface.
+        auto mask = reinterpret_cast<const sockaddr_in *>(
+            i->ifa_netmask)->sin_addr.s_addr;
+        MMP_TRACE(L"Interface %hs has the netmask 0x%08x in network byte "
+            L"order.", i->ifa_name, mask);
+
+        retval.emplace_back();
+        retval.back().sin_family = family;
+        retval.back().sin_addr = reinterpret_cast<const sockaddr_in *>(
+            i->ifa_addr)->sin_addr;
+        retval.back().sin_addr.s_addr |= ~mask;
+        retval.back().sin_port = port;
+    }
+#endif /* defined(_WIN32) */
+
     return retval;
 }
 
@@ -414,8 +693,8 @@ int mmp_client::bind(_In_ wil::unique_socket& socket,
 
 #if (defined(_DEBUG) || defined(DEBUG))
     {
-        sockaddr_storage addr { 0 };
-        int cnt_addr = sizeof(addr);
+        sockaddr_storage addr { };
+        socklen_t cnt_addr = sizeof(addr);
         ::getsockname(socket.get(),
             reinterpret_cast<sockaddr *>(&addr),
             &cnt_addr);
@@ -459,6 +738,287 @@ bool mmp_client::clip(_Inout_ std::int32_t& x,
 }
 
 
+/*
+ * mmp_client::desktop
+ */
+std::pair<std::int32_t, std::int32_t> mmp_client::desktop(
+        _In_ const mmp_configuration& config) noexcept {
+#if defined(_WIN32)
+    (void) config;
+    return std::make_pair(::GetSystemMetrics(SM_CXVIRTUALSCREEN),
+        ::GetSystemMetrics(SM_CYVIRTUALSCREEN));
+#else /* defined(_WIN32) */
+    return std::make_pair(static_cast<std::int32_t>(config.width),
+        static_cast<std::int32_t>(config.height));
+#endif /* defined(_WIN32) */
+}
+
+
+/*
+ * mmp_client::is_local
+ */
+bool mmp_client::is_local(_In_ const sockaddr_storage& address) noexcept {
+    switch (address.ss_family) {
+        case AF_INET: {
+            auto& a = reinterpret_cast<const sockaddr_in&>(address);
+            if ((::ntohl(a.sin_addr.s_addr) >> 24) == IN_LOOPBACKNET) {
+                return true;
+            }
+            } break;
+
+        case AF_INET6: {
+            auto& a = reinterpret_cast<const sockaddr_in6&>(address);
+            if (IN6_IS_ADDR_LOOPBACK(&a.sin6_addr)) {
+                return true;
+            }
+            } break;
+
+        default:
+            return false;
+    }
+
+    try {
+#if defined(_WIN32)
+        const auto flags = GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST
+            | GAA_FLAG_SKIP_DNS_SERVER;
+        ULONG len = 0;
+
+        {
+            auto status = ::GetAdaptersAddresses(address.ss_family, flags,
+                nullptr, nullptr, &len);
+            if (status != ERROR_BUFFER_OVERFLOW) {
+                return false;
+            }
+        }
+
+        std::vector<BYTE> buffer(len);
+        auto adapters = reinterpret_cast<IP_ADAPTER_ADDRESSES *>(
+            buffer.data());
+        if (::GetAdaptersAddresses(address.ss_family, flags, nullptr,
+                adapters, &len) != ERROR_SUCCESS) {
+            return false;
+        }
+
+        for (auto adapter = adapters;
+                adapter != nullptr;
+                adapter = adapter->Next) {
+            for (auto a = adapter->FirstUnicastAddress;
+                    a != nullptr;
+                    a = a->Next) {
+                auto sa = a->Address.lpSockaddr;
+                if ((sa == nullptr) || (sa->sa_family != address.ss_family)) {
+                    continue;
+                }
+
+                if (address.ss_family == AF_INET6) {
+                    auto& l = reinterpret_cast<const sockaddr_in6&>(address);
+                    auto r = reinterpret_cast<const sockaddr_in6 *>(sa);
+                    if (::memcmp(&l.sin6_addr, &r->sin6_addr,
+                            sizeof(in6_addr)) == 0) {
+                        return true;
+                    }
+                } else {
+                    auto& l = reinterpret_cast<const sockaddr_in&>(address);
+                    auto r = reinterpret_cast<const sockaddr_in *>(sa);
+                    if (l.sin_addr.s_addr == r->sin_addr.s_addr) {
+                        return true;
+                    }
+                }
+            }
+        }
+
+#else /* defined(_WIN32) */
+        ifaddrs *interfaces = nullptr;
+        if (::getifaddrs(&interfaces) != 0) {
+            return false;
+        }
+        auto free_interfaces = wil::scope_exit(
+            [interfaces](void) { ::freeifaddrs(interfaces); });
+
+        for (auto i = interfaces; i != nullptr; i = i->ifa_next) {
+            auto sa = i->ifa_addr;
+            if ((sa == nullptr) || (sa->sa_family != address.ss_family)) {
+                continue;
+            }
+
+            if (address.ss_family == AF_INET6) {
+                auto& l = reinterpret_cast<const sockaddr_in6&>(address);
+                auto r = reinterpret_cast<const sockaddr_in6 *>(sa);
+                if (::memcmp(&l.sin6_addr, &r->sin6_addr,
+                        sizeof(in6_addr)) == 0) {
+                    return true;
+                }
+            } else {
+                auto& l = reinterpret_cast<const sockaddr_in&>(address);
+                auto r = reinterpret_cast<const sockaddr_in *>(sa);
+                if (l.sin_addr.s_addr == r->sin_addr.s_addr) {
+                    return true;
+                }
+            }
+        }
+#endif /* defined(_WIN32) */
+    } catch (...) {
+        MMP_TRACE(L"Failed to determine whether the magic mouse pad is "
+            L"local.");
+    }
+
+    return false;
+}
+
+
+/*
+ * mmp_client::is_same
+ */
+bool mmp_client::is_same(_In_ const sockaddr_storage& lhs,
+        _In_ const sockaddr_storage& rhs) noexcept {
+    if (lhs.ss_family != rhs.ss_family) {
+        return false;
+    }
+
+    switch (lhs.ss_family) {
+        case AF_INET: {
+            auto& l = reinterpret_cast<const sockaddr_in&>(lhs);
+            auto& r = reinterpret_cast<const sockaddr_in&>(rhs);
+            return (l.sin_port == r.sin_port)
+                && (l.sin_addr.s_addr == r.sin_addr.s_addr);
+            }
+
+        case AF_INET6: {
+            // A configured address might not specify the scope, in which case
+            // it matches the one the datagram was received on.
+            auto& l = reinterpret_cast<const sockaddr_in6&>(lhs);
+            auto& r = reinterpret_cast<const sockaddr_in6&>(rhs);
+            return (l.sin6_port == r.sin6_port)
+                && ((l.sin6_scope_id == 0) || (r.sin6_scope_id == 0)
+                    || (l.sin6_scope_id == r.sin6_scope_id))
+                && (::memcmp(&l.sin6_addr, &r.sin6_addr,
+                    sizeof(l.sin6_addr)) == 0);
+            }
+
+        default:
+            return false;
+    }
+}
+
+
+/*
+ * mmp_client::is_unspecified
+ */
+bool mmp_client::is_unspecified(_In_ const sockaddr_storage& address) noexcept {
+    switch (address.ss_family) {
+        case AF_INET: {
+            auto& a = reinterpret_cast<const sockaddr_in&>(address);
+            return (a.sin_addr.s_addr == INADDR_ANY);
+            }
+
+        case AF_INET6: {
+            auto& a = reinterpret_cast<const sockaddr_in6&>(address);
+            return (::memcmp(&a.sin6_addr, &in6addr_any, sizeof(in6addr_any))
+                == 0);
+            }
+
+        default:
+            return true;
+    }
+}
+
+
+/*
+ * mmp_client::mcast_addresses
+ */
+std::vector<sockaddr_in6> mmp_client::mcast_addresses(
+        _In_ const std::uint16_t port) {
+    std::vector<sockaddr_in6> retval;
+
+    in6_addr group;
+    THROW_LAST_ERROR_IF(::inet_pton(AF_INET6, mmp_discovery_group_ipv6,
+        &group) != 1);
+
+    const auto family = AF_INET6;
+
+#if defined(_WIN32)
+    const auto flags = GAA_FLAG_SKIP_UNICAST | GAA_FLAG_SKIP_ANYCAST
+        | GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_DNS_SERVER;
+    ULONG len = 0;
+
+    {
+        auto status = ::GetAdaptersAddresses(family, flags, nullptr, nullptr,
+            &len);
+        THROW_WIN32_IF(status, status != ERROR_BUFFER_OVERFLOW);
+    }
+
+    std::vector<BYTE> buffer(len);
+    auto adapters = reinterpret_cast<IP_ADAPTER_ADDRESSES *>(buffer.data());
+
+    THROW_IF_WIN32_ERROR(::GetAdaptersAddresses(family, flags, nullptr,
+        adapters, &len));
+
+    for (auto adapter = adapters;
+            adapter != nullptr;
+            adapter = adapter->Next) {
+        if ((adapter->OperStatus != IfOperStatusUp)
+                || (adapter->Ipv6IfIndex == 0)
+                || ((adapter->Flags & IP_ADAPTER_NO_MULTICAST) != 0)) {
+            MMP_TRACE(L"Skipping adapter %hs because it cannot send IPv6 "
+                L"multicasts.", adapter->AdapterName);
+            continue;
+        }
+
+        // The group is link-local, so the scope determines the interface
+        // the datagram is sent on.
+        retval.emplace_back();
+        ::memset(&retval.back(), 0, sizeof(sockaddr_in6));
+        retval.back().sin6_family = family;
+        retval.back().sin6_addr = group;
+        retval.back().sin6_port = port;
+        retval.back().sin6_scope_id = adapter->Ipv6IfIndex;
+    }
+
+#else /* defined(_WIN32) */
+    ifaddrs *interfaces = nullptr;
+    THROW_LAST_ERROR_IF(::getifaddrs(&interfaces) != 0);
+    auto free_interfaces = wil::scope_exit(
+        [interfaces](void) { ::freeifaddrs(interfaces); });
+
+    for (auto i = interfaces; i != nullptr; i = i->ifa_next) {
+        // There is an entry for each address of an interface, so we only
+        // use the first IPv6 one to get every interface once.
+        if ((i->ifa_addr == nullptr) || (i->ifa_addr->sa_family != family)) {
+            continue;
+        }
+
+        const auto index = ::if_nametoindex(i->ifa_name);
+        if (((i->ifa_flags & IFF_UP) == 0)
+                || ((i->ifa_flags & IFF_MULTICAST) == 0)
+                || (index == 0)) {
+            MMP_TRACE(L"Skipping interface %hs because it cannot send IPv6 "
+                L"multicasts.", i->ifa_name);
+            continue;
+        }
+
+        const auto duplicate = std::any_of(retval.begin(), retval.end(),
+            [index](const sockaddr_in6& a) {
+                return (a.sin6_scope_id == index);
+            });
+        if (duplicate) {
+            continue;
+        }
+
+        // The group is link-local, so the scope determines the interface
+        // the datagram is sent on.
+        retval.emplace_back();
+        ::memset(&retval.back(), 0, sizeof(sockaddr_in6));
+        retval.back().sin6_family = family;
+        retval.back().sin6_addr = group;
+        retval.back().sin6_port = port;
+        retval.back().sin6_scope_id = index;
+    }
+#endif /* defined(_WIN32) */
+
+    return retval;
+}
+
+
 /*
  * mmp_client::to_string
  */
@@ -495,31 +1055,163 @@ std::wstring mmp_client::to_string(_In_ const sockaddr_storage& address) {
 }
 
 
+/*
+ * mmp_client::acknowledge
+ */
+void mmp_client::acknowledge(_In_ const mmp_seq_no sequence_number) {
+    if (this->_shared) {
+        // Nothing in shared memory is lost unless we fall behind, in which
+        // case the server would not know anything we had not received.
+        return;
+    }
+
+    if ((this->_capabilities & this->_server_capabilities
+            & mmp_capability_ack) == 0) {
+        // A server that has not negotiated acknowledgements does not
+        // retransmit and might not even know the message.
+        return;
+    }
+
+    const mmp_msg_ack msg(sequence_number);
+
+    const auto status = this->_transport->send(this->_config.server,
+        reinterpret_cast<const char *>(&msg),
+        sizeof(msg));
+    if (status != 0) {
+        MMP_TRACE(L"Acknowledging message %u failed with error code %d.",
+            sequence_number, status);
+    }
+}
+
+
+/*
+ * mmp_client::adapt
+ */
+void mmp_client::adapt(_In_ const std::uint64_t now) {
+    if ((this->_rate == 0)
+            || (this->_shared != nullptr)
+            || ((this->_capabilities & mmp_capability_rate) == 0)
+            || (now < this->_rate_check)) {
+        return;
+    }
+
+    this->_rate_check = now + rate_interval;
+
+    // Leave a fifth of the time for the application, but never declare zero,
+    // which would lift the limit altogether.
+    const auto sustainable = (this->_consumption > 0.0)
+        ? 0.8 * 1000.0 * 1000.0 / this->_consumption
+        : static_cast<double>(this->_config.max_rate);
+    const auto rate = (std::max)(static_cast<std::uint32_t>(1),
+        static_cast<std::uint32_t>((std::min)(sustainable,
+        static_cast<double>(this->_config.max_rate))));
+
+    // Small changes are not worth a message and would only make the server
+    // oscillate.
+    const auto delta = (rate > this->_rate)
+        ? (rate - this->_rate)
+        : (this->_rate - rate);
+    if (delta <= this->_rate / 4) {
+        return;
+    }
+
+    MMP_TRACE(L"Changing the rate from %u to %u moves per second.",
+        this->_rate, rate);
+    this->_rate = rate;
+
+    const mmp_msg_rate msg(rate);
+    const auto status = this->_transport->send(this->_config.server,
+        reinterpret_cast<const char *>(&msg),
+        sizeof(msg));
+    if (status != 0) {
+        MMP_TRACE(L"Declaring the rate failed with error code %d.", status);
+    }
+}
+
+
 /*
  * mmp_client::connect
  */
 int mmp_client::connect(void) {
-    const auto server_addr = reinterpret_cast<const sockaddr *>(
-        std::addressof(this->_config.server));
-    const auto server_addr_len = static_cast<int>(
-        sizeof(sockaddr_storage));
+    if (this->_shared) {
+        // Take the position before the state such that no event after the
+        // state is skipped. Older events are rejected by their sequence
+        // numbers anyway.
+        this->_shared_cursor = this->_shared->published();
+        mmp_msg_state state;
+        this->_shared->state(state);
+        this->_update_state = true;
+        this->dispatch(reinterpret_cast<const char *>(&state), sizeof(state),
+            this->_config.server);
+        return 0;
+    }
 
     mmp_msg_connect msg;
     assert(msg.id == ::ntohl(mmp_msgid_connect));
+    {
+        auto capabilities = this->_capabilities;
+        if ((this->_config.flags & mmp_flag_history) == 0) {
+            capabilities &= ~mmp_capability_history;
+        }
+        if ((this->_config.flags & mmp_flag_reconnect) == 0) {
+            capabilities &= ~mmp_capability_heartbeat;
+        }
+        if ((this->_config.flags & mmp_flag_clock) == 0) {
+            capabilities &= ~mmp_capability_clock;
+        }
+        if (this->_config.max_rate == 0) {
+            capabilities &= ~mmp_capability_rate;
+        }
+        if ((this->_server_capabilities & mmp_capability_ack) == 0) {
+            // We only acknowledge if the server has announced that it
+            // expects it, so we must not make it wait for acknowledgements
+            // that never come. A configured server is asked for its
+            // announcement by identify, so this only affects servers that
+            // did not answer.
+            capabilities &= ~mmp_capability_ack;
+        }
+        if ((capabilities & mmp_capability_rate) != 0) {
+            msg.rate = ::htonl(this->_rate);
+        }
+        msg.capabilities = ::htonl(capabilities);
+    }
+
+    // The region of interest is the local desktop in the coordinates of the
+    // server, which only differ from the global ones by the offset of the
+    // local instance as long as there is no start offset.
+    {
+        const auto required = mmp_flag_local | mmp_flag_region;
+        if (((this->_config.flags & required) == required)
+                && ((this->_config.flags & mmp_flag_set_start) == 0)) {
+            const auto margin = static_cast<std::int32_t>(
+                this->_config.margin);
+            const auto desktop = mmp_client::desktop(this->_config);
+            const auto w = desktop.first;
+            const auto h = desktop.second;
+            msg.left = ::htonl(this->_config.offset_x - margin);
+            msg.top = ::htonl(this->_config.offset_y - margin);
+            msg.width = ::htonl(w + 2 * margin);
+            msg.height = ::htonl(h + 2 * margin);
+            MMP_TRACE(L"Subscribing to the region (%d, %d) of %d x %d "
+                L"pixels.", this->_config.offset_x - margin,
+                this->_config.offset_y - margin, w + 2 * margin,
+                h + 2 * margin);
+        } else {
+            msg.capabilities &= ~::htonl(mmp_capability_region);
+        }
+    }
+    MMP_TRACE(L"Requesting protocol version %u with capabilities 0x%x.",
+        ::ntohl(msg.version), ::ntohl(msg.capabilities));
 
 #if (defined(_DEBUG) || defined(DEBUG))
     auto addr = to_string(this->_config.server);
     MMP_TRACE(L"Sending connect message to %s.", addr.c_str());
 #endif /* defined(_DEBUG) || defined(DEBUG) */
 
-    if (::sendto(this->_socket.get(),
-            reinterpret_cast<const char *>(&msg),
-            sizeof(msg),
-            0,
-            server_addr,
-            server_addr_len)
-            == SOCKET_ERROR) {
-        auto retval = ::WSAGetLastError();
+    const auto retval = this->_transport->send(this->_config.server,
+        reinterpret_cast<const char *>(&msg),
+        sizeof(msg));
+    if (retval != 0) {
         MMP_TRACE("Announcement failed with error code %d.", retval);
         RETURN_WIN32(retval);
     }
@@ -529,42 +1221,382 @@ int mmp_client::connect(void) {
 
 
 /*
- * mmp_client::on_mouse_button
+ * mmp_client::dispatch
+ */
+void mmp_client::dispatch(_In_reads_bytes_(size) const char *data,
+        _In_ const DWORD size,
+        _In_ const sockaddr_storage& peer) {
+    this->_accepted = false;
+    this->_sender = peer;
+
+    const auto begin = mmp_clock::now();
+    const auto status = dispatch_table::dispatch(data, size,
+        [this](const auto& msg) { this->on_message(msg); });
+    const auto end = mmp_clock::now();
+
+    // Only what the client has accepted from its server is forwarded, because
+    // the recipients trust us. Note that a heartbeat might have made the
+    // client follow its sender, which is the server now.
+    if (this->_forward
+            && this->_accepted
+            && is_same(peer, this->_config.server)) {
+        this->_forward(data, size);
+    }
+
+    // The time spent in the callbacks is tracked as a moving average, which
+    // is the basis for the rate the client can sustain.
+    {
+        const auto sample = static_cast<double>(end - begin);
+        this->_consumption = (this->_consumption == 0.0)
+            ? sample
+            : (7.0 * this->_consumption + sample) / 8.0;
+    }
+    this->adapt(end);
+
+    switch (status) {
+        case visus::mmp::wire::dispatch_status::handled:
+            break;
+
+        case visus::mmp::wire::dispatch_status::truncated:
+            MMP_TRACE(L"Received a truncated datagram of %u bytes, which "
+                L"will be ignored.", size);
+            break;
+
+        case visus::mmp::wire::dispatch_status::unknown:
+            MMP_TRACE(L"Received a datagram of unknown type, which will be "
+                L"ignored.");
+            break;
+    }
+}
+
+
+/*
+ * mmp_client::identify
+ */
+_Success_(return == 0) int mmp_client::identify(void) {
+    typedef mmp_discovery::clock clock;
+    const auto interval = (this->_config.rate_limit > 0)
+        ? clock::duration(std::chrono::milliseconds(this->_config.rate_limit))
+        : clock::duration(std::chrono::milliseconds(100));
+    const auto cancelled = [this](void) { return this->cancelled(); };
+
+#if (defined(_DEBUG) || defined(DEBUG))
+    auto addr = to_string(this->_config.server);
+    MMP_TRACE(L"Probing configured magic mouse pad at %s.", addr.c_str());
+#endif /* defined(_DEBUG) || defined(DEBUG) */
+
+    // The server answers a unicast discovery request like a broadcast one,
+    // which gives us its capabilities. The request is repeated with backoff
+    // for four intervals in case it or the answer was lost.
+    mmp_discovery probe(this->_config.client, interval,
+        clock::duration::zero());
+    auto status = probe.add_target(this->_config.server);
+    if (status == 0) {
+        status = probe.run(clock::now() + 4 * interval, cancelled);
+    }
+
+    if (status == HRESULT_FROM_WIN32(ERROR_CANCELLED)) {
+        return status;
+    }
+
+    if (status == 0) {
+        this->on_announce(*probe.best());
+    } else {
+        MMP_TRACE(L"The configured magic mouse pad did not announce itself "
+            L"(error %d), so the client connects without knowing its "
+            L"capabilities.", status);
+    }
+
+    return 0;
+}
+
+
+/*
+ * mmp_client::is_trusted
  */
-void mmp_client::on_mouse_button(_In_ const mmp_msg_mouse_button *msg) {
-    assert(msg != nullptr);
-    assert(msg->id == ::htonl(mmp_msgid_mouse_button));
-    if (this->track_sequence_number(msg)) {
-        MMP_TRACE("Button %d %s at (%d, %d).", msg->button,
-            msg->down ? "pressed" : "released", ::ntohl(msg->x),
-            ::ntohl(msg->y));
+bool mmp_client::is_trusted(
+        _In_ const sockaddr_storage& address) const noexcept {
+    if (is_same(address, this->_config.server)
+            || is_same(address, this->_config.standby)) {
+        return true;
+    }
 
-        if (this->_config.on_mouse_button != nullptr) {
-            auto p = this->xform_position(msg);
-            MMP_TRACE("Reporting button event at (%d, %d).", p.first, p.second);
-            this->_config.on_mouse_button(msg->button, msg->down, p.first,
-                p.second, this->_config.context);
+    for (auto& d : this->_discovered) {
+        if (is_same(address, d)) {
+            return true;
         }
     }
+
+    return false;
 }
 
 
 /*
- * mmp_client::on_mouse_move
+ * mmp_client::on_announce
  */
-void mmp_client::on_mouse_move(_In_ const mmp_msg_mouse_move *msg) {
-    assert(msg != nullptr);
-    assert(msg->id == ::htonl(mmp_msgid_mouse_move));
-    if (this->track_sequence_number(msg)) {
-        MMP_TRACE("Mouse moved to (%d, %d).", ::ntohl(msg->x), ::ntohl(msg->y));
+void mmp_client::on_announce(_In_ const mmp_discovery::candidate& server) {
+    // Note: the view reports the version and the capabilities of servers that
+    // predate the negotiation as zero.
+    this->_config.server = server.address;
+
+    // If the client was not bound to a specific address, it needs to use the
+    // address family of the server we found, which might be any.
+    if ((this->_config.client.ss_family != server.address.ss_family)
+            && is_unspecified(this->_config.client)) {
+        MMP_TRACE(L"Switching the client to the address family %d of the "
+            L"magic mouse pad.", server.address.ss_family);
+        const auto port = (this->_config.client.ss_family == AF_INET6)
+            ? reinterpret_cast<sockaddr_in6&>(this->_config.client).sin6_port
+            : reinterpret_cast<sockaddr_in&>(this->_config.client).sin_port;
+        ::memset(&this->_config.client, 0, sizeof(this->_config.client));
+        this->_config.client.ss_family = server.address.ss_family;
+
+        if (server.address.ss_family == AF_INET6) {
+            reinterpret_cast<sockaddr_in6&>(this->_config.client).sin6_port
+                = port;
+        } else {
+            reinterpret_cast<sockaddr_in&>(this->_config.client).sin_port
+                = port;
+        }
+    }
+
+    this->_epoch = server.epoch;
+    this->_sequence_number.store(server.sequence_number,
+        std::memory_order_release);
+    this->_server_version = server.version;
+    this->_server_capabilities = server.capabilities;
+    MMP_TRACE(L"The server implements protocol version %u with "
+        L"capabilities 0x%x.", this->_server_version,
+        this->_server_capabilities);
+}
+
+
+/*
+ * mmp_client::on_discovered
+ */
+void mmp_client::on_discovered(_In_ const mmp_discovery& discovery) {
+    this->on_announce(*discovery.best());
+
+    // Any of the servers that answered might take over later, and we know
+    // that they are genuine magic mouse pads, so we may follow them.
+    this->_discovered.clear();
+    for (auto& c : discovery.candidates()) {
+        this->_discovered.push_back(c.address);
+    }
+}
 
-        if (this->_config.on_mouse_move != nullptr) {
-            auto p = this->xform_position(msg);
-            MMP_TRACE("Reporting mouse position (%d, %d).", p.first, p.second);
-            this->_config.on_mouse_move(p.first, p.second,
-                this->_config.context);
+
+/*
+ * mmp_client::on_message
+ */
+void mmp_client::on_message(_In_ const view<mmp_msg_heartbeat>& msg) {
+    const auto epoch = msg.epoch();
+    this->_heartbeat = true;
+
+    if (this->_epoch == 0) {
+        this->_epoch = epoch;
+        this->_accepted = true;
+
+    } else if (epoch == this->_epoch) {
+        // A heartbeat that was overtaken by an event carries an outdated
+        // sequence number, which must not be passed on.
+        this->_accepted = !::mmp_seq_newer(
+            this->_sequence_number.load(std::memory_order_acquire),
+            msg.sequence_number());
+
+    } else if (!this->is_trusted(this->_sender)) {
+        // Anyone can send a heartbeat, so we do not follow a server we do not
+        // know. If the server has really moved, we will find it again.
+        MMP_TRACE(L"A magic mouse pad the client does not know claims to have "
+            L"started the new session 0x%08x.", epoch);
+        this->_rediscover = true;
+
+    } else {
+        // The server has restarted and restored us from its registry, or a
+        // standby has taken over, so its sequence numbers are unrelated to
+        // what we have seen. We continue from where the new session is and
+        // ask the sender, which might be a different machine now, for its
+        // current state.
+        MMP_TRACE(L"The magic mouse pad has started the new session 0x%08x "
+            L"at sequence number %u.", epoch, msg.sequence_number());
+        this->_config.server = this->_sender;
+        this->_clock.reset();
+        this->_epoch = epoch;
+        this->_sequence_number.store(msg.sequence_number(),
+            std::memory_order_release);
+        this->_received = ~static_cast<std::uint64_t>(0);
+        this->_update_state = true;
+        this->_accepted = true;
+        this->connect();
+    }
+}
+
+
+/*
+ * mmp_client::on_message
+ */
+void mmp_client::on_message(_In_ const view<mmp_msg_mouse_button>& msg) {
+    this->on_mouse_button(msg);
+}
+
+
+/*
+ * mmp_client::on_message
+ */
+void mmp_client::on_message(_In_ const view<mmp_msg_mouse_button_ts>& msg) {
+    this->_timestamp.store(this->_clock.to_local(msg.timestamp()),
+        std::memory_order_release);
+    this->on_mouse_button(msg);
+}
+
+
+/*
+ * mmp_client::on_message
+ */
+void mmp_client::on_message(_In_ const view<mmp_msg_mouse_history>& msg) {
+    // Button events must be acknowledged even if they are outdated, because
+    // the bitmask in any later message has already told us about the button.
+    if ((msg.flags() & mmp_history_flag_ack) != 0) {
+        this->acknowledge(msg.sequence_number());
+    }
+
+    const auto e = this->_sequence_number.load(std::memory_order_acquire);
+    if (!this->track_sequence_number(msg)) {
+        return;
+    }
+
+    this->_accepted = true;
+    this->_timestamp.store(this->_clock.to_local(msg.timestamp()),
+        std::memory_order_release);
+
+    // The history is ordered from newest to oldest, but the events need to be
+    // reported in the order they happened.
+    for (auto i = static_cast<std::size_t>(msg.history()); i > 0; --i) {
+        const auto h = msg.entry(i - 1);
+        if (::mmp_seq_newer(h.sequence_number(), e)) {
+            MMP_TRACE(L"Recovering lost event %u from the history.",
+                h.sequence_number());
+            this->on_mouse_state(h);
         }
     }
+
+    this->on_mouse_state(msg);
+}
+
+
+/*
+ * mmp_client::on_message
+ */
+void mmp_client::on_message(_In_ const view<mmp_msg_mouse_move>& msg) {
+    this->on_mouse_move(msg);
+}
+
+
+/*
+ * mmp_client::on_message
+ */
+void mmp_client::on_message(_In_ const view<mmp_msg_mouse_move_ts>& msg) {
+    this->_timestamp.store(this->_clock.to_local(msg.timestamp()),
+        std::memory_order_release);
+    this->on_mouse_move(msg);
+}
+
+
+/*
+ * mmp_client::on_message
+ */
+void mmp_client::on_message(_In_ const view<mmp_msg_pong>& msg) {
+    const auto destination = mmp_clock::now();
+
+    // Only the answer to the last probe is meaningful, because a late pong
+    // has spent most of its round trip in some queue.
+    if (msg.token() != this->_probe) {
+        MMP_TRACE(L"Ignoring pong %u while waiting for %u.", msg.token(),
+            this->_probe);
+        return;
+    }
+
+    this->_clock.update(msg.origin(), msg.receive(), msg.transmit(),
+        destination);
+}
+
+
+/*
+ * mmp_client::on_message
+ */
+void mmp_client::on_message(_In_ const view<mmp_msg_state>& msg) {
+    const auto s = msg.sequence_number();
+    const auto epoch = msg.epoch();
+
+    // A snapshot from a new session of the server replaces everything we
+    // know, because its sequence numbers are unrelated to the ones we have
+    // seen. Servers that predate sessions always report epoch zero.
+    const auto restarted = (epoch != 0) && (epoch != this->_epoch);
+    if (restarted) {
+        MMP_TRACE(L"Received state snapshot of session 0x%08x.", epoch);
+        this->_clock.reset();
+        this->_epoch = epoch;
+        this->_sequence_number.store(s, std::memory_order_release);
+    }
+
+    // The snapshot we are waiting for typically carries the sequence number
+    // we learnt from the announcement, because both reflect the last event
+    // the server sent. Any later snapshot, which might result from a
+    // retransmitted connect, must be newer than what we have seen.
+    auto e = this->_sequence_number.load(std::memory_order_acquire);
+    const auto accept = restarted || (this->_update_state
+        ? (!::mmp_seq_newer(e, s)
+            && this->_sequence_number.compare_exchange_strong(e, s,
+                std::memory_order_release, std::memory_order_relaxed))
+        : this->track_sequence_number(msg));
+    if (accept && (this->_update_state || restarted)) {
+        // Nothing before the snapshot can be received anymore.
+        this->_received = ~static_cast<std::uint64_t>(0);
+    }
+    this->_update_state = false;
+
+    if (!accept) {
+        MMP_TRACE(L"Ignoring outdated state snapshot %u.", s);
+        return;
+    }
+
+    this->_accepted = true;
+
+    const auto buttons = msg.buttons();
+    this->_buttons = buttons;
+    MMP_TRACE(L"Received state snapshot at (%d, %d) with buttons 0x%x.",
+        msg.x(), msg.y(), buttons);
+    const auto p = this->xform_position(msg);
+
+    if (this->_config.on_mouse_move != nullptr) {
+        this->_config.on_mouse_move(p.first, p.second, this->_config.context);
+    }
+
+    if (this->_config.on_mouse_button != nullptr) {
+        for (std::uint32_t b = 1; b <= (std::numeric_limits<
+                mmp_mouse_button>::max)(); b <<= 1) {
+            if ((buttons & b) != 0) {
+                this->_config.on_mouse_button(static_cast<mmp_mouse_button>(b),
+                    true, p.first, p.second, this->_config.context);
+            }
+        }
+    }
+}
+
+
+/*
+ * mmp_client::probe
+ */
+void mmp_client::probe(void) {
+    const mmp_msg_ping msg(++this->_probe, mmp_clock::now());
+
+    const auto status = this->_transport->send(this->_config.server,
+        reinterpret_cast<const char *>(&msg),
+        sizeof(msg));
+    if (status != 0) {
+        MMP_TRACE(L"Probing the clock of the server failed with error code "
+            L"%d.", status);
+    }
 }
 
 
@@ -576,6 +1608,8 @@ void mmp_client::receive(void) {
 
     constexpr int cnt_buffer = (std::numeric_limits<std::uint16_t>::max)();
     buffer_type buffer(cnt_buffer);
+
+#if defined(_WIN32)
     WSADATA wsa_data;
 
     MMP_TRACE(L"The client receiver thread 0x%08x is running. Initialising "
@@ -588,33 +1622,119 @@ void mmp_client::receive(void) {
         }
     }
     auto wsa_cleanup = wil::scope_exit([](void) { ::WSACleanup(); });
+#endif /* defined(_WIN32) */
+
+    const auto resume = ((this->_config.flags & mmp_flag_reconnect) != 0);
+    const std::chrono::milliseconds silence(
+        (this->_config.heartbeat_timeout > 0)
+        ? this->_config.heartbeat_timeout
+        : 3000);
+    auto last_received = std::chrono::steady_clock::now();
+    auto next_probe = last_received;
+    auto next_rediscovery = last_received;
 
     MMP_TRACE(L"Entering the receive loop.");
     while (this->_running.load(std::memory_order_acquire)) {
         sockaddr_storage peer;
         DWORD len = 0;
 
-        if (!this->receive_from(buffer, len, peer)) {
-            MMP_TRACE(L"The receiver thread is leaving because receiving a "
-                L"datagram failed.");
-            return;
+        // The server might change its capabilities when we reconnect, so we
+        // need to check every time whether it still answers pings.
+        const auto probe = ((this->_config.flags & mmp_flag_clock) != 0)
+            && ((this->_server_capabilities & mmp_capability_clock) != 0);
+
+        if (this->_shared && !resume && !probe) {
+            if (this->_shared->wait(this->_shared_cursor, INFINITE)) {
+                last_received = std::chrono::steady_clock::now();
+                this->receive_shared();
+            }
+            continue;
+        }
+
+        if (resume || probe) {
+            auto now = std::chrono::steady_clock::now();
+            if (probe && (now >= next_probe)) {
+                this->probe();
+                next_probe = now + mmp_clock::probe_interval;
+            }
+
+            auto deadline = resume
+                ? last_received + silence
+                : (std::chrono::steady_clock::time_point::max)();
+            if (probe && (next_probe < deadline)) {
+                deadline = next_probe;
+            }
+
+            const auto wait = std::chrono::duration_cast<
+                std::chrono::microseconds>((std::max)(deadline - now,
+                std::chrono::steady_clock::duration::zero()));
+
+            auto status = 0;
+            if (this->_shared) {
+                // The wait is rounded up such that we do not spin while the
+                // deadline is less than a millisecond away.
+                const auto timeout = (std::min)(
+                    (wait.count() + 999) / 1000,
+                    static_cast<decltype(wait.count())>(INFINITE - 1));
+                status = this->_shared->wait(this->_shared_cursor,
+                    static_cast<DWORD>(timeout)) ? 1 : 0;
+
+            } else {
+                auto readable = false;
+                const auto error = this->_transport->wait(wait, readable);
+                if (error != 0) {
+                    MMP_TRACE(L"The receiver thread is leaving because "
+                        L"waiting for a datagram failed with error %d.",
+                        error);
+                    return;
+                }
+                status = readable ? 1 : 0;
+            }
+
+            // Silence is only suspicious if the server has promised to send
+            // heartbeats. If reconnecting fails, we remain armed and try again
+            // after the next timeout.
+            if (status == 0) {
+                now = std::chrono::steady_clock::now();
+                if (resume && (now - last_received >= silence)) {
+                    if (this->_heartbeat && (this->reconnect() != 0)) {
+                        MMP_TRACE(L"Reconnecting to the magic mouse pad "
+                            L"failed, retrying in %u ms.",
+                            static_cast<unsigned int>(silence.count()));
+                    }
+                    last_received = std::chrono::steady_clock::now();
+                }
+                continue;
+            }
         }
-        if (len < sizeof(mmp_msg_id)) {
-            MMP_TRACE(L"Received an invalid datagram (%u bytes instead of the "
-                L"minimum reqired %u bytes), which will be ignored.", len,
-                sizeof(mmp_msg_id));
+
+        if (this->_shared) {
+            last_received = std::chrono::steady_clock::now();
+            this->receive_shared();
             continue;
         }
 
-        const auto id = ::ntohl(*as<mmp_msg_id>(buffer));
-        switch (id) {
-            case mmp_msgid_mouse_button:
-                this->on_mouse_button(as<mmp_msg_mouse_button>(buffer));
-                break;
+        const char *data = nullptr;
+        if (!this->receive_from(buffer, data, len, peer)) {
+            MMP_TRACE(L"The receiver thread is leaving because receiving a "
+                L"datagram failed.");
+            return;
+        }
 
-            case mmp_msgid_mouse_move:
-                this->on_mouse_move(as<mmp_msg_mouse_move>(buffer));
-                break;
+        last_received = std::chrono::steady_clock::now();
+        this->dispatch(data, len, peer);
+
+        // An unknown server has claimed to have taken over, so we check
+        // whether our server has actually moved. This is rate-limited such
+        // that no one can keep us busy by sending bogus heartbeats.
+        if (this->_rediscover) {
+            this->_rediscover = false;
+            if (last_received >= next_rediscovery) {
+                next_rediscovery = last_received + silence;
+                if (this->reconnect() != 0) {
+                    MMP_TRACE(L"Searching the magic mouse pad failed.");
+                }
+            }
         }
     }
 }
@@ -624,56 +1744,162 @@ void mmp_client::receive(void) {
  * mmp_client::receive_from
  */
 _Success_(return == true) bool mmp_client::receive_from(
-        _In_ std::vector<char>& buffer,
+        _Inout_ buffer_type& buffer,
+        _Out_ const char *& data,
         _Out_ DWORD& size,
         _Out_ sockaddr_storage& peer) {
-    auto peer_len = static_cast<int>(sizeof(peer));
-    const auto len = ::recvfrom(this->_socket.get(),
-        buffer.data(),
-        static_cast<int>(buffer.size()),
-        0,
-        reinterpret_cast<sockaddr *>(&peer),
-        &peer_len);
-    if (len == SOCKET_ERROR) {
-        MMP_TRACE(L"Receiving a datagram failed with error %d.",
-            ::WSAGetLastError());
+    const auto status = this->_transport->borrow(buffer, data, size, peer);
+    if (status != 0) {
+        MMP_TRACE(L"Receiving a datagram failed with error %d.", status);
+        ::SetLastError(status);
         return false;
     }
 
-    size = static_cast<DWORD>(len);
     return true;
+}
+
+
+/*
+ * mmp_client::receive_shared
+ */
+void mmp_client::receive_shared(void) {
+    using visus::mmp::shm::read_status;
+    char buffer[visus::mmp::shm::max_datagram];
+
+    while (this->_running.load(std::memory_order_acquire)) {
+        std::size_t size = 0;
+
+        switch (this->_shared->read(this->_shared_cursor, buffer, size)) {
+            case read_status::empty:
+                return;
+
+            case read_status::lapped: {
+                // Button events might have been overwritten, so we need to
+                // start over from what the server knows is current.
+                MMP_TRACE(L"The client has fallen behind the shared memory "
+                    L"and resynchronises from the state of the server.");
+                mmp_msg_state state;
+                this->_shared->state(state);
+                this->_update_state = true;
+                this->dispatch(reinterpret_cast<const char *>(&state),
+                    sizeof(state), this->_config.server);
+                } break;
+
+            default:
+                break;
+        }
+
+        this->dispatch(buffer, static_cast<DWORD>(size),
+            this->_config.server);
+    }
+}
+
+
+/*
+ * mmp_client::reconnect
+ */
+_Success_(return == 0) int mmp_client::reconnect(void) {
+    MMP_TRACE(L"The magic mouse pad has been silent, so the client tries to "
+        L"reconnect.");
+    const auto client = this->_config.client;
+
+    // The server might have moved to a different machine, so we need to search
+    // it again unless its address was configured explicitly.
+    this->_config.server = this->_configured_server;
+    RETURN_IF_WIN32_ERROR(this->discover());
+
+    // The socket cannot be recreated, because the destructor might close it
+    // concurrently, so the server must use the same address family.
+    if (this->_config.client.ss_family != client.ss_family) {
+        MMP_TRACE(L"The magic mouse pad was found for address family %d, but "
+            L"the client socket uses %d.", this->_config.client.ss_family,
+            client.ss_family);
+        this->_config.client = client;
+        RETURN_WIN32(WSAEAFNOSUPPORT);
+    }
+
+    // For the same reason, the shared memory cannot be released, so a
+    // client reading from it can only follow a server on this machine.
+    if (this->_shared && !is_local(this->_config.server)) {
+        MMP_TRACE(L"The magic mouse pad has moved to another machine, but "
+            L"the client reads from shared memory.");
+        RETURN_WIN32(ERROR_NOT_SUPPORTED);
+    }
 
-    //WSABUF buf;
-    //OVERLAPPED overlapped = { 0 };
-    //DWORD flags = 0;
-    //INT peer_len = sizeof(peer);
-
-    //buf.buf = buffer.data();
-    //buf.len = static_cast<ULONG>(buffer.size());
-
-    //overlapped.hEvent = this->_event.get();
-
-    //if (::WSARecvFrom(this->_socket.get(),
-    //        &buf, 1,
-    //        &size,
-    //        &flags,
-    //        reinterpret_cast<sockaddr *>(&peer),
-    //        &peer_len,
-    //        &overlapped,
-    //        nullptr) == 0) {
-    //    return true;
-    //}
-
-    //auto error = ::WSAGetLastError();
-    //if (error == WSA_IO_PENDING) {
-    //    if (::WaitForSingleObject(overlapped.hEvent, INFINITE)
-    //            == WAIT_OBJECT_0) {
-    //        return true;
-    //    }
-
-    //    error = ::WSAGetLastError();
-    //}
-
-    //MMP_TRACE(L"Receiving a datagram failed with error %d.", error);
-    //return false;
+    // Everything the server sent before it announced itself again is lost
+    // anyway, so we start over from its current sequence number. The server
+    // might be a different machine, so its clock needs to be estimated anew.
+    this->_received = ~static_cast<std::uint64_t>(0);
+    this->_clock.reset();
+
+    if ((this->_server_capabilities & mmp_capability_state) != 0) {
+        RETURN_IF_WIN32_ERROR(this->wait_for_state());
+    } else {
+        RETURN_IF_WIN32_ERROR(this->connect());
+    }
+
+    this->_heartbeat = false;
+    return 0;
+}
+
+
+/*
+ * mmp_client::wait_for_state
+ */
+int mmp_client::wait_for_state(void) {
+    if (this->_shared) {
+        // The state is already there, so there is nothing to wait for.
+        return this->connect();
+    }
+
+    constexpr int cnt_buffer = (std::numeric_limits<std::uint16_t>::max)();
+    buffer_type buffer(cnt_buffer);
+
+    // Without a configured rate limit and timeout, we retransmit the connect
+    // message every 100 ms for a second, which is plenty on a local network.
+    const std::chrono::milliseconds rate_limit((this->_config.rate_limit > 0)
+        ? this->_config.rate_limit
+        : 100);
+    const auto deadline = std::chrono::steady_clock::now()
+        + std::chrono::milliseconds((this->_config.timeout > 0)
+        ? this->_config.timeout
+        : 1000);
+
+    this->_update_state = true;
+    auto resend = true;
+
+    while (this->_update_state
+            && !this->cancelled()
+            && (std::chrono::steady_clock::now() < deadline)) {
+        if (resend) {
+            RETURN_IF_WIN32_ERROR(this->connect());
+        }
+
+        auto readable = false;
+        RETURN_IF_WIN32_ERROR(this->_transport->wait(rate_limit, readable));
+
+        // If nothing arrived within the rate limit, the connect or the
+        // snapshot might have been lost, so we need to try again.
+        resend = !readable;
+
+        if (readable) {
+            const char *data = nullptr;
+            sockaddr_storage peer;
+            DWORD len = 0;
+
+            if (!this->receive_from(buffer, data, len, peer)) {
+                RETURN_LAST_ERROR();
+            }
+
+            this->dispatch(data, len, peer);
+        }
+    }
+
+    if (this->_update_state) {
+        MMP_TRACE(L"The server did not send a state snapshot in time, so the "
+            L"client starts without it.");
+        this->_update_state = false;
+    }
+
+    return 0;
 }
@@ -8,15 +8,26 @@
 
 #include "mmpcli.h"
 
+#include <array>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "mmp_clock.h"
+#include "mmp_discovery.h"
+#include "mmp_platform.h"
+#include "mmp_shared_ring.h"
+#include "mmp_transport.h"
 #include "mmpmsg.h"
 #include "mmptrace.h"
-
-#include <wil/resource.h>
+#include "mmpwire.h"
 
 
 /// <summary>
@@ -26,6 +37,14 @@ struct mmp_client final {
 
 public:
 
+    /// <summary>
+    /// Answer whether <paramref name="lhs"/> and <paramref name="rhs"/>
+    /// designate the same end point, regardless of anything in the storage
+    /// beyond the address and the port.
+    /// </summary>
+    static bool is_same(_In_ const sockaddr_storage& lhs,
+        _In_ const sockaddr_storage& rhs) noexcept;
+
     /// <summary>
     /// Initialises a new instance.
     /// </summary>
@@ -38,23 +57,111 @@ public:
     /// </summary>
     ~mmp_client(void) noexcept;
 
+    /// <summary>
+    /// Answer the current estimate of the clock of the server.
+    /// </summary>
+    /// <param name="offset">Receives the time in microseconds the clock of
+    /// the server is ahead of the local monotonic clock.</param>
+    /// <param name="rtt">Receives the round-trip time in microseconds.</param>
+    /// <param name="jitter">Receives the jitter of the offset in
+    /// microseconds.</param>
+    /// <returns>Zero in case of success, the code for <c>ERROR_NOT_READY</c>
+    /// if the server has not answered any probe yet.</returns>
+    _Success_(return == 0) int clock(_Out_ std::int64_t& offset,
+        _Out_ std::uint32_t& rtt,
+        _Out_ std::uint32_t& jitter) const noexcept;
+
+    /// <summary>
+    /// Performs <see cref="discover"/> and <see cref="start"/> on a background
+    /// thread and invokes <paramref name="completion"/> with the result.
+    /// </summary>
+    /// <param name="completion">An optional callback to be invoked once the
+    /// connection attempt has completed.</param>
+    /// <param name="context">A user-defined pointer passed to the
+    /// <paramref name="completion"/> callback.</param>
+    /// <returns>Zero if the background thread was started, a system error code
+    /// otherwise.</returns>
+    _Success_(return == 0) int connect_async(
+        _In_opt_ mmp_connect_completion completion,
+        _In_opt_ void *context) noexcept;
+
     /// <summary>
     /// If no specific IP address is specified in the
     /// <see cref="mmp_configuration"/> of the client, try to discover the magic
-    /// mouse pad using UDP broadcast messages.
+    /// mouse pad using UDP broadcast messages. Otherwise, ask the configured
+    /// server for its capabilities.
     /// </summary>
     /// <param name="config"></param>
     /// <returns></returns>
     _Success_(return == 0) int discover(void);
 
+    /// <summary>
+    /// Makes the client pass every datagram it has accepted from its server
+    /// to <paramref name="forward"/> after processing it, and restricts the
+    /// capabilities it requests to <paramref name="capabilities"/>.
+    /// </summary>
+    /// <remarks>
+    /// <para>This must be called before the client is started. The callback
+    /// is invoked on the thread receiving the datagram.</para>
+    /// <para>Datagrams from any other sender and messages that the client
+    /// has discarded, e.g. because they are outdated or duplicates, are not
+    /// forwarded, because the recipients trust the forwarder like a server.
+    /// </para>
+    /// </remarks>
+    /// <param name="forward">The callback receiving the datagrams.</param>
+    /// <param name="capabilities">The capabilities the recipient of the
+    /// datagrams can handle.</param>
+    void forward(
+        _In_ std::function<void(const char *, const DWORD)>&& forward,
+        _In_ const mmp_capabilities capabilities);
+
     /// <summary>
     /// Announces the client to the configured server and starts the receiver
     /// thread.
     /// </summary>
+    /// <remarks>
+    /// If the server announced that it supports state snapshots, the method
+    /// waits for the snapshot before it returns such that the callbacks have
+    /// already been invoked with the current position and the buttons that
+    /// are being held down. If the snapshot does not arrive within the
+    /// configured timeout, the client starts without it.
+    /// </remarks>
     /// <returns>Zero in case of success, a system error code otherwise.
     /// </returns>
     _Success_(return == 0) int start(void) noexcept;
 
+    /// <summary>
+    /// Answer the time when the server generated the last timestamped event
+    /// in microseconds on the local monotonic clock.
+    /// </summary>
+    /// <returns>The time of the event, or zero if no timestamped event has
+    /// been received since the clock of the server was estimated.</returns>
+    inline std::uint64_t timestamp(void) const noexcept {
+        return this->_timestamp.load(std::memory_order_acquire);
+    }
+
+    /// <summary>
+    /// Makes the client exchange all datagrams with the server via the given
+    /// <paramref name="transport"/> instead of a UDP socket.
+    /// </summary>
+    /// <remarks>
+    /// This must be called before the client is started. The client does
+    /// not try to use shared memory if a transport has been injected, and
+    /// it only uses UDP for discovering servers.
+    /// </remarks>
+    /// <param name="transport">The transport to be used.</param>
+    void transport(_In_ std::unique_ptr<mmp_transport>&& transport);
+
+    /// <summary>
+    /// Waits for the connection attempt started by
+    /// <see cref="connect_async"/> to complete.
+    /// </summary>
+    /// <param name="timeout">The timeout in milliseconds, which is infinite
+    /// if all bits are set.</param>
+    /// <returns>The result of the connection attempt, or the code for
+    /// <c>ERROR_TIMEOUT</c> if it is still in progress.</returns>
+    _Success_(return == 0) int wait(_In_ const std::uint32_t timeout) noexcept;
+
 #if defined(_WIN32)
     /// <summary>
     /// Answer the Winsock initialisation data used by the client. The caller
@@ -74,17 +181,21 @@ private:
     typedef std::vector<char> buffer_type;
 
     /// <summary>
-    /// Answer the contents of <paramref name="buffer"/> as a pointer to the
-    /// specified <typeparamref name="TType"/>.
+    /// The messages the receiver thread can process.
     /// </summary>
-    /// <typeparam name="TType"></typeparam>
-    /// <param name="buffer"></param>
-    /// <returns></returns>
-    template<class TType>
-    static const TType *as(_In_ const std::vector<char>& buffer) {
-        assert(buffer.size() >= sizeof(TType));
-        return reinterpret_cast<const TType *>(buffer.data());
-    }
+    typedef visus::mmp::wire::dispatch_table<mmp_msg_mouse_button,
+        mmp_msg_mouse_move,
+        mmp_msg_mouse_button_ts,
+        mmp_msg_mouse_move_ts,
+        mmp_msg_mouse_history,
+        mmp_msg_state,
+        mmp_msg_heartbeat,
+        mmp_msg_pong> dispatch_table;
+
+    /// <summary>
+    /// The zero-copy view on a received message.
+    /// </summary>
+    template<class TMessage> using view = visus::mmp::wire::view<TMessage>;
 
     /// <summary>
     /// Find the broadcast addresses using the given <paramref name="port"/> for
@@ -95,6 +206,18 @@ private:
     static std::vector<sockaddr_in> bcast_addresses(
         _In_ const std::uint16_t port);
 
+    /// <summary>
+    /// The number of sequence numbers preceding the most recent one for which
+    /// the client remembers whether they have been received.
+    /// </summary>
+    static constexpr mmp_seq_no received_window = 64;
+
+    /// <summary>
+    /// The minimum time in microseconds between two evaluations of the rate
+    /// the client can sustain.
+    /// </summary>
+    static constexpr std::uint64_t rate_interval = 1000 * 1000;
+
     /// <summary>
     /// Bind the given <paramref name="socket"/> to the specified
     /// <paramref name="address"/>.
@@ -124,6 +247,42 @@ private:
         _In_ const std::uint32_t width,
         _In_ const std::uint32_t height) noexcept;
 
+    /// <summary>
+    /// Answer the size of the local desktop in pixels.
+    /// </summary>
+    /// <remarks>
+    /// On Windows, this is the size of the virtual screen. Other platforms
+    /// have no notion of a desktop the library could query without depending
+    /// on a specific windowing system, so the size configured by the
+    /// application is used there.
+    /// </remarks>
+    /// <param name="config">The configuration of the client.</param>
+    /// <returns>The width and height of the desktop.</returns>
+    static std::pair<std::int32_t, std::int32_t> desktop(
+        _In_ const mmp_configuration& config) noexcept;
+
+    /// <summary>
+    /// Answer whether the given <paramref name="address"/> is a loopback
+    /// address or one of the addresses of this machine.
+    /// </summary>
+    static bool is_local(_In_ const sockaddr_storage& address) noexcept;
+
+    /// <summary>
+    /// Answer whether the given <paramref name="address"/> is the wildcard
+    /// address of its family or has no valid family at all.
+    /// </summary>
+    static bool is_unspecified(_In_ const sockaddr_storage& address) noexcept;
+
+    /// <summary>
+    /// Find the IPv6 discovery group <see cref="mmp_discovery_group_ipv6"/>
+    /// using the given <paramref name="port"/> on all active interfaces
+    /// that support multicast.
+    /// </summary>
+    /// <param name="port">The port in network-byte order.</param>
+    /// <returns>The group address scoped to each of the interfaces.</returns>
+    static std::vector<sockaddr_in6> mcast_addresses(
+        _In_ const std::uint16_t port);
+
     /// <summary>
     /// Convert the given socket <paramref name="address"/> into a
     /// human-readable representation.
@@ -132,67 +291,327 @@ private:
     /// <returns></returns>
     static std::wstring to_string(_In_ const sockaddr_storage& address);
 
+    /// <summary>
+    /// Acknowledges the button event with the given
+    /// <paramref name="sequence_number"/> to the server if both sides have
+    /// negotiated <see cref="mmp_capability_ack"/>.
+    /// </summary>
+    /// <param name="sequence_number">The sequence number of the event in
+    /// host-byte order.</param>
+    void acknowledge(_In_ const mmp_seq_no sequence_number);
+
     /// <summary>
     /// Sends an announcement message to the mouse pad server in order to
     /// receive updates from it.
     /// </summary>
+    /// <remarks>
+    /// If the client reads from shared memory, it does not need to announce
+    /// itself, but starts from the most recent event and the state published
+    /// alongside it.
+    /// </remarks>
     /// <returns>Zero in case of success, a system error code otherwise.
     /// </returns>
     int connect(void);
 
+    /// <summary>
+    /// Derives the rate the client can sustain from the time spent
+    /// processing datagrams and declares it to the server if it differs
+    /// considerably from the rate declared before.
+    /// </summary>
+    /// <remarks>
+    /// This method must only be called on the receiver thread.
+    /// </remarks>
+    /// <param name="now">The current time as reported by
+    /// <see cref="mmp_clock::now"/>.</param>
+    void adapt(_In_ const std::uint64_t now);
+
+    /// <summary>
+    /// Answer whether <see cref="mmp_disconnect"/> has been called while a
+    /// connection attempt was still in progress.
+    /// </summary>
+    inline bool cancelled(void) const noexcept {
+        return this->_cancelled.load(std::memory_order_acquire);
+    }
+
+    /// <summary>
+    /// Dispatches the datagram in <paramref name="data"/> to the matching
+    /// <see cref="on_message"/> overload.
+    /// </summary>
+    /// <param name="data">The datagram received from the server.</param>
+    /// <param name="size">The size of the datagram in bytes.</param>
+    /// <param name="peer">The address the datagram was received from, which
+    /// is available as <see cref="_sender"/> while the message is processed.
+    /// If the datagram is from the server and the message handler has set
+    /// <see cref="_accepted"/>, it is passed to <see cref="_forward"/>.
+    /// </param>
+    void dispatch(_In_reads_bytes_(size) const char *data,
+        _In_ const DWORD size,
+        _In_ const sockaddr_storage& peer);
+
+    /// <summary>
+    /// Sends a discovery request to the configured server, which answers
+    /// with its version, capabilities and current sequence number like a
+    /// server that has been discovered.
+    /// </summary>
+    /// <remarks>
+    /// A server that does not answer is not an error, because it might still
+    /// accept the connect message. The client then connects without knowing
+    /// the capabilities of the server, i.e. it neither waits for the state
+    /// snapshot nor acknowledges button events.
+    /// </remarks>
+    /// <returns>Zero unless the probe was cancelled, in which case the code
+    /// for <c>ERROR_CANCELLED</c> is returned.</returns>
+    _Success_(return == 0) int identify(void);
+
+    /// <summary>
+    /// Answer whether the client may follow the server at the given
+    /// <paramref name="address"/> if it starts a new session, which is the
+    /// case for the current server, the configured standby and the servers
+    /// found by the most recent discovery.
+    /// </summary>
+    bool is_trusted(_In_ const sockaddr_storage& address) const noexcept;
+
+    /// <summary>
+    /// Records the given <paramref name="server"/> as the one to connect to
+    /// along with its state and capabilities.
+    /// </summary>
+    void on_announce(_In_ const mmp_discovery::candidate& server);
+
+    /// <summary>
+    /// Connects to the best server the given <paramref name="discovery"/>
+    /// has found and remembers all others as servers the client may follow.
+    /// </summary>
+    void on_discovered(_In_ const mmp_discovery& discovery);
+
+    /// <summary>
+    /// Processes a heartbeat, which arms the detection of a silent server
+    /// and, if the server has started a new session, resumes it from the
+    /// current state. As a standby that has taken over starts a new session,
+    /// too, the client follows the sender of such a heartbeat if it
+    /// <see cref="is_trusted"/>. Otherwise, the receiver thread searches the
+    /// server again.
+    /// </summary>
+    void on_message(_In_ const view<mmp_msg_heartbeat>& msg);
+
+    /// <summary>
+    /// Processes a message received by the receiver thread.
+    /// </summary>
+    void on_message(_In_ const view<mmp_msg_mouse_button>& msg);
+
+    /// <summary>
+    /// Processes a message received by the receiver thread.
+    /// </summary>
+    void on_message(_In_ const view<mmp_msg_mouse_button_ts>& msg);
+
+    /// <summary>
+    /// Processes a loss-resilient message by replaying the events from its
+    /// history that the client has missed before processing the message
+    /// itself.
+    /// </summary>
+    void on_message(_In_ const view<mmp_msg_mouse_history>& msg);
+
+    /// <summary>
+    /// Processes a message received by the receiver thread.
+    /// </summary>
+    void on_message(_In_ const view<mmp_msg_mouse_move>& msg);
+
+    /// <summary>
+    /// Processes a message received by the receiver thread.
+    /// </summary>
+    void on_message(_In_ const view<mmp_msg_mouse_move_ts>& msg);
+
+    /// <summary>
+    /// Processes the answer to the last <see cref="probe"/> by adding the
+    /// sample to the estimate of the clock of the server.
+    /// </summary>
+    void on_message(_In_ const view<mmp_msg_pong>& msg);
+
+    /// <summary>
+    /// Processes a state snapshot by reporting the position and all buttons
+    /// that are being held down.
+    /// </summary>
+    void on_message(_In_ const view<mmp_msg_state>& msg);
+
     /// <summary>
     /// Processes a button press or release message.
     /// </summary>
-    void on_mouse_button(_In_ const mmp_msg_mouse_button *msg);
+    /// <typeparam name="TView">The view of any of the button messages, which
+    /// must have a <c>button</c> and a <c>down</c> field as well as a
+    /// position.</typeparam>
+    template<class TView>
+    void on_mouse_button(_In_ const TView& msg);
 
     /// <summary>
     /// Processes a mouse move message.
     /// </summary>
-    void on_mouse_move(_In_ const mmp_msg_mouse_move *msg);
+    /// <typeparam name="TView">The view of any of the messages carrying a
+    /// position.</typeparam>
+    template<class TView>
+    void on_mouse_move(_In_ const TView& msg);
+
+    /// <summary>
+    /// Reports the button bitmask and position in <paramref name="msg"/>,
+    /// either as the button transitions relative to the last known bitmask
+    /// or, if no button has changed, as a move.
+    /// </summary>
+    /// <typeparam name="TView">The view of any of the messages carrying a
+    /// <c>buttons</c> bitmask as well as a position.</typeparam>
+    template<class TView>
+    void on_mouse_state(_In_ const TView& msg);
+
+    /// <summary>
+    /// Sends a ping to the server in order to sample its clock.
+    /// </summary>
+    void probe(void);
 
     /// <summary>
     /// Receives messages from the magic mouse pad in a separate thread.
     /// </summary>
+    /// <remarks>
+    /// <para>If <see cref="mmp_flag_reconnect"/> is set and the server has
+    /// sent a heartbeat before, the thread <see cref="reconnect"/>s once the
+    /// server has been silent for the configured heartbeat timeout. It also
+    /// reconnects if an unknown server claims to have started a new session,
+    /// but at most once per heartbeat timeout.</para>
+    /// <para>If <see cref="mmp_flag_clock"/> is set and the server supports
+    /// it, the thread also <see cref="probe"/>s the clock of the server every
+    /// <see cref="mmp_clock::probe_interval"/>.</para>
+    /// <para>If the client reads from shared memory, the thread waits for
+    /// the server to publish events rather than for datagrams.</para>
+    /// </remarks>
     void receive(void);
 
     /// <summary>
-    /// Receives a datagram into <paramref name="buffer"/>.
+    /// Borrows the next datagram from the transport, which receives it into
+    /// <paramref name="buffer"/> unless it can lend its own memory.
+    /// </summary>
+    _Success_(return == true) bool receive_from(_Inout_ buffer_type& buffer,
+        _Out_ const char *& data,
+        _Out_ DWORD& size,
+        _Out_ sockaddr_storage& peer);
+
+    /// <summary>
+    /// Dispatches all events available in shared memory, resynchronising
+    /// from the state of the server if the client has fallen so far behind
+    /// that events have been overwritten.
+    /// </summary>
+    void receive_shared(void);
+
+    /// <summary>
+    /// Discovers the server again and announces the client to it on the
+    /// existing socket after the server has fallen silent.
+    /// </summary>
+    /// <remarks>
+    /// This method must only be called on the receiver thread.
+    /// </remarks>
+    /// <returns>Zero in case of success, a system error code otherwise, in
+    /// which case the caller should try again later.</returns>
+    _Success_(return == 0) int reconnect(void);
+
+    /// <summary>
+    /// Tracks the sequence number of the last transition of the button in
+    /// the given <paramref name="message"/>, which must have been accepted
+    /// by <see cref="track_reliable_sequence_number"/> before.
     /// </summary>
-    _Success_(return == true) bool receive_from(_In_ std::vector<char>& buffer,
-        _Out_ DWORD&size, _Out_ sockaddr_storage& peer);
+    /// <remarks>
+    /// A retransmission arriving late must not be applied if the server has
+    /// since reported a newer transition of the same button, because the
+    /// button would otherwise remain in the state of the older one.
+    /// </remarks>
+    /// <typeparam name="TView">The view of any of the button messages.
+    /// </typeparam>
+    /// <param name="message">The button message.</param>
+    /// <returns><see langword="true" /> if the message needs to be
+    /// processed, <see langword="false" /> if it is outdated by a newer
+    /// transition of the same button.</returns>
+    template<class TView>
+    bool track_button(_In_ const TView& message);
 
     /// <summary>
     /// Tracks whether the sequence number in the given
     /// <paramref name="message"/> is not from the past and updates the current
     /// state.
     /// </summary>
-    /// <typeparam name="TMessage"></typeparam>
+    /// <typeparam name="TView"></typeparam>
     /// <param name="message"></param>
     /// <returns></returns>
-    template<class TMessage>
-    bool track_sequence_number(_In_ const TMessage *message);
+    template<class TView>
+    bool track_sequence_number(_In_ const TView& message);
+
+    /// <summary>
+    /// Tracks the sequence number of a message that must not be lost, which
+    /// is accepted if it is newer than the current state like in
+    /// <see cref="track_sequence_number"/> or if it is a retransmission
+    /// arriving late, which the client has not yet processed.
+    /// </summary>
+    /// <typeparam name="TView"></typeparam>
+    /// <param name="message"></param>
+    /// <returns><see langword="true" /> if the message needs to be
+    /// processed, <see langword="false" /> if it is a duplicate or too old.
+    /// </returns>
+    template<class TView>
+    bool track_reliable_sequence_number(_In_ const TView& message);
+
+    /// <summary>
+    /// Sends the connect message to the server and waits until the server
+    /// responds with a state snapshot, retransmitting the connect message
+    /// at the configured rate limit.
+    /// </summary>
+    /// <returns>Zero in case of success, a system error code otherwise. A
+    /// missing snapshot is not considered an error.</returns>
+    int wait_for_state(void);
 
     /// <summary>
     /// Transforms the position in the given <paramref name="message"/>
     /// according to the rules specified in <see cref="_config"/>.
     /// </summary>
-    /// <typeparam name="TMessage"></typeparam>
+    /// <typeparam name="TView"></typeparam>
     /// <param name="message"></param>
     /// <returns></returns>
-    template<class TMessage>
+    template<class TView>
     std::pair<std::int32_t, std::int32_t> xform_position(
-        _In_ const TMessage *message);
+        _In_ const TView& message);
 
+    bool _accepted;
+    std::array<mmp_seq_no, std::numeric_limits<mmp_mouse_button>::digits>
+        _button_sequence_numbers;
+    std::uint32_t _buttons;
+    std::atomic<bool> _cancelled;
+    mmp_capabilities _capabilities;
+    mmp_clock _clock;
     mmp_configuration _config;
-    wil::unique_event_nothrow _event;
+    const sockaddr_storage _configured_server;
+    std::condition_variable _connect_signal;
+    std::mutex _connect_lock;
+    int _connect_status;
+    std::thread _connector;
+    double _consumption;
+    std::vector<sockaddr_storage> _discovered;
+    std::uint32_t _epoch;
+    std::function<void(const char *, const DWORD)> _forward;
+    bool _heartbeat;
     std::pair<std::int32_t, std::int32_t> _offset;
+    std::uint32_t _probe;
+    std::uint32_t _rate;
+    std::uint64_t _rate_check;
+    std::uint64_t _received;
     std::thread _receiver;
+    bool _rediscover;
     std::vector<buffer_type> _reordering_buffer;
     std::atomic<bool> _running;
+    sockaddr_storage _sender;
     std::atomic<mmp_seq_no> _sequence_number;
-    wil::unique_socket _socket;
+    mmp_capabilities _server_capabilities;
+    std::uint32_t _server_version;
+    std::unique_ptr<mmp_shared_ring> _shared;
+    std::uint64_t _shared_cursor;
+    std::atomic<std::uint64_t> _timestamp;
+    std::unique_ptr<mmp_transport> _transport;
     bool _update_offset;
+    bool _update_state;
+#if defined(_WIN32)
     WSADATA _wsa_data;
+#endif /* defined(_WIN32) */
 };
 
 #include "mmp_client.inl"
@@ -5,34 +5,201 @@
 // <author>Christoph Müller</author>
 
 
+/*
+ * mmp_client::on_mouse_button
+ */
+template<class TView>
+void mmp_client::on_mouse_button(_In_ const TView& msg) {
+    // Acknowledge before checking the sequence number, because the server
+    // retransmits until it gets an acknowledgement even for duplicates. This
+    // does nothing unless the server has negotiated acknowledgements.
+    this->acknowledge(msg.sequence_number());
+
+    if (this->track_reliable_sequence_number(msg)
+            && this->track_button(msg)) {
+        this->_accepted = true;
+        const auto down = (msg.down() != 0);
+        MMP_TRACE("Button %d %s at (%d, %d).", msg.button(),
+            down ? "pressed" : "released", msg.x(), msg.y());
+
+        if (down) {
+            this->_buttons |= msg.button();
+        } else {
+            this->_buttons &= ~static_cast<std::uint32_t>(msg.button());
+        }
+
+        if (this->_config.on_mouse_button != nullptr) {
+            auto p = this->xform_position(msg);
+            MMP_TRACE("Reporting button event at (%d, %d).", p.first, p.second);
+            this->_config.on_mouse_button(msg.button(), down, p.first,
+                p.second, this->_config.context);
+        }
+    }
+}
+
+
+/*
+ * mmp_client::on_mouse_move
+ */
+template<class TView>
+void mmp_client::on_mouse_move(_In_ const TView& msg) {
+    if (this->track_sequence_number(msg)) {
+        this->_accepted = true;
+        MMP_TRACE("Mouse moved to (%d, %d).", msg.x(), msg.y());
+
+        if (this->_config.on_mouse_move != nullptr) {
+            auto p = this->xform_position(msg);
+            MMP_TRACE("Reporting mouse position (%d, %d).", p.first, p.second);
+            this->_config.on_mouse_move(p.first, p.second,
+                this->_config.context);
+        }
+    }
+}
+
+
+/*
+ * mmp_client::on_mouse_state
+ */
+template<class TView>
+void mmp_client::on_mouse_state(_In_ const TView& msg) {
+    const auto buttons = msg.buttons();
+    const auto changed = buttons ^ this->_buttons;
+    this->_buttons = buttons;
+
+    if (changed == 0) {
+        MMP_TRACE("Mouse moved to (%d, %d).", msg.x(), msg.y());
+
+        if (this->_config.on_mouse_move != nullptr) {
+            auto p = this->xform_position(msg);
+            MMP_TRACE("Reporting mouse position (%d, %d).", p.first, p.second);
+            this->_config.on_mouse_move(p.first, p.second,
+                this->_config.context);
+        }
+
+    } else {
+        MMP_TRACE("Buttons changed from 0x%x to 0x%x at (%d, %d).",
+            buttons ^ changed, buttons, msg.x(), msg.y());
+
+        if (this->_config.on_mouse_button != nullptr) {
+            auto p = this->xform_position(msg);
+
+            for (std::uint32_t b = 1; b <= (std::numeric_limits<
+                    mmp_mouse_button>::max)(); b <<= 1) {
+                if ((changed & b) != 0) {
+                    MMP_TRACE("Reporting button event at (%d, %d).", p.first,
+                        p.second);
+                    this->_config.on_mouse_button(
+                        static_cast<mmp_mouse_button>(b), (buttons & b) != 0,
+                        p.first, p.second, this->_config.context);
+                }
+            }
+        }
+    }
+}
+
+
+/*
+ * mmp_client::track_button
+ */
+template<class TView>
+bool mmp_client::track_button(_In_ const TView& message) {
+    const auto s = message.sequence_number();
+    const auto e = this->_sequence_number.load(std::memory_order_acquire);
+    const auto button = static_cast<std::uint32_t>(message.button());
+    auto& t = this->_button_sequence_numbers;
+
+    // Only transitions within the receive window can be newer than a message
+    // that is accepted. Anything older stems from a previous session or
+    // would compare wrongly after the sequence numbers wrapped around.
+    for (std::size_t i = 0; i < t.size(); ++i) {
+        if (((button & (1u << i)) != 0)
+                && (e - t[i] < received_window)
+                && ::mmp_seq_newer(t[i], s)) {
+            MMP_TRACE(L"Discarding message %u, because button %u has "
+                L"changed in message %u since.", s, 1u << i, t[i]);
+            return false;
+        }
+    }
+
+    for (std::size_t i = 0; i < t.size(); ++i) {
+        if ((button & (1u << i)) != 0) {
+            t[i] = s;
+        }
+    }
+
+    return true;
+}
+
+
 /*
  * mmp_client::track_sequence_number
  */
-template<class TMessage>
-bool mmp_client::track_sequence_number(_In_ const TMessage *message) {
-    assert(message != nullptr);
-    const auto s = ::ntohl(message->sequence_number);
+template<class TView>
+bool mmp_client::track_sequence_number(_In_ const TView& message) {
+    const auto s = message.sequence_number();
     auto e = this->_sequence_number.load(std::memory_order_acquire);
     MMP_TRACE(L"Received sequence number %u, current sequence number is %u.",
         s, e);
     // TODO: implement reordering here.
-    return (s > e) && this->_sequence_number.compare_exchange_strong(
-        e, s, std::memory_order_release, std::memory_order_relaxed);
+    const auto retval = ::mmp_seq_newer(s, e)
+        && this->_sequence_number.compare_exchange_strong(e, s,
+            std::memory_order_release, std::memory_order_relaxed);
+
+    if (retval) {
+        // Bit i of the window marks whether the message i sequence numbers
+        // before the most recent one has been received. The unsigned
+        // difference remains correct if the sequence numbers wrapped around.
+        const auto d = s - e;
+        this->_received = (d < received_window)
+            ? ((this->_received << d) | 1)
+            : 1;
+    }
+
+    return retval;
+}
+
+
+/*
+ * mmp_client::track_reliable_sequence_number
+ */
+template<class TView>
+bool mmp_client::track_reliable_sequence_number(_In_ const TView& message) {
+    if (this->track_sequence_number(message)) {
+        return true;
+    }
+
+    const auto s = message.sequence_number();
+    const auto e = this->_sequence_number.load(std::memory_order_acquire);
+    const auto d = e - s;
+
+    if (::mmp_seq_newer(s, e) || (d >= received_window)) {
+        MMP_TRACE(L"Sequence number %u is outside the receive window.", s);
+        return false;
+    }
+
+    const auto bit = static_cast<std::uint64_t>(1) << d;
+    if ((this->_received & bit) != 0) {
+        MMP_TRACE(L"Discarding duplicate of message %u.", s);
+        return false;
+    }
+
+    MMP_TRACE(L"Accepting message %u, which arrived late.", s);
+    this->_received |= bit;
+    return true;
 }
 
 
 /*
  * mmp_client::xform_position
  */
-template<class TMessage>
+template<class TView>
 std::pair<std::int32_t, std::int32_t> mmp_client::xform_position(
-        _In_ const TMessage *message) {
-    assert(message != nullptr);
+        _In_ const TView& message) {
     const auto clip = ((this->_config.flags & mmp_flag_clip) != 0);
     const auto hide = ((this->_config.flags & mmp_flag_hide_remote) != 0);
 
-    std::int32_t x = ::ntohl(message->x);
-    std::int32_t y = ::ntohl(message->y);
+    std::int32_t x = message.x();
+    std::int32_t y = message.y();
 
     if (this->_update_offset) {
         this->_update_offset = false;
@@ -60,16 +227,24 @@ std::pair<std::int32_t, std::int32_t> mmp_client::xform_position(
             // If requested, clip the position to the local screen. Furthermore,
             // hide the cursor if it is outside the local screen if that was
             // requested, too.
-            const auto w = ::GetSystemMetrics(SM_CXVIRTUALSCREEN);
-            const auto h = ::GetSystemMetrics(SM_CYVIRTUALSCREEN);
+            const auto desktop = mmp_client::desktop(this->_config);
+            const auto w = desktop.first;
+            const auto h = desktop.second;
 
             MMP_TRACE(L"Clipping mouse position (%d, %d) to [%u, %u].", x, y,
                 w, h);
             const auto clipped = mmp_client::clip(x, y, w, h);
 
+#if defined(_WIN32)
             if (hide) {
                 ::ShowCursor(!clipped);
             }
+#else /* defined(_WIN32) */
+            // Hiding the cursor is up to the windowing system of the
+            // application on all other platforms.
+            (void) clipped;
+            (void) hide;
+#endif /* defined(_WIN32) */
         }
     }
 
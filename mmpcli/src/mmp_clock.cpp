@@ -0,0 +1,167 @@
+﻿// <copyright file="mmp_clock.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "mmp_clock.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+/*
+ * mmp_clock::probe_interval
+ */
+constexpr std::chrono::milliseconds mmp_clock::probe_interval;
+
+
+/*
+ * mmp_clock::window
+ */
+constexpr std::size_t mmp_clock::window;
+
+
+/*
+ * mmp_clock::now
+ */
+std::uint64_t mmp_clock::now(void) noexcept {
+    using namespace std::chrono;
+    const auto now = clock::now().time_since_epoch();
+    return duration_cast<microseconds>(now).count();
+}
+
+
+/*
+ * mmp_clock::mmp_clock
+ */
+mmp_clock::mmp_clock(void) noexcept
+    : _count(0),
+    _drift(0.0),
+    _estimate(),
+    _jitter(0.0),
+    _next(0),
+    _samples() { }
+
+
+/*
+ * mmp_clock::get
+ */
+_Success_(return == true) bool mmp_clock::get(_Out_ std::int64_t& offset,
+        _Out_ std::uint32_t& rtt,
+        _Out_ std::uint32_t& jitter) const noexcept {
+    const auto local = now();
+    std::lock_guard<std::mutex> l(this->_lock);
+    if (this->_count == 0) {
+        return false;
+    }
+
+    offset = this->offset(local);
+    rtt = static_cast<std::uint32_t>((std::min)(this->_estimate.delay,
+        static_cast<std::uint64_t>(UINT32_MAX)));
+    jitter = static_cast<std::uint32_t>((std::min)(this->_jitter,
+        static_cast<double>(UINT32_MAX)));
+    return true;
+}
+
+
+/*
+ * mmp_clock::reset
+ */
+void mmp_clock::reset(void) noexcept {
+    std::lock_guard<std::mutex> l(this->_lock);
+    this->_count = 0;
+    this->_drift = 0.0;
+    this->_jitter = 0.0;
+    this->_next = 0;
+}
+
+
+/*
+ * mmp_clock::to_local
+ */
+std::uint64_t mmp_clock::to_local(
+        _In_ const std::uint64_t timestamp) const noexcept {
+    std::lock_guard<std::mutex> l(this->_lock);
+    if (this->_count == 0) {
+        return 0;
+    }
+
+    // The drift needs to be extrapolated to the local time we are looking
+    // for, which the last offset approximates well enough.
+    const auto local = timestamp - this->_estimate.offset;
+    return timestamp - this->offset(local);
+}
+
+
+/*
+ * mmp_clock::update
+ */
+void mmp_clock::update(_In_ const std::uint64_t origin,
+        _In_ const std::uint64_t receive,
+        _In_ const std::uint64_t transmit,
+        _In_ const std::uint64_t destination) noexcept {
+    // The time the server took to answer must be part of the round trip, or
+    // the timestamps are bogus.
+    if ((destination < origin) || (transmit < receive)
+            || (transmit - receive > destination - origin)) {
+        return;
+    }
+
+    // Note: the differences are computed unsigned, which yields the correct
+    // signed result, because the clocks are unrelated and either one might be
+    // ahead.
+    sample s;
+    s.delay = (destination - origin) - (transmit - receive);
+    s.local = destination;
+    s.offset = (static_cast<std::int64_t>(receive - origin)
+        + static_cast<std::int64_t>(transmit - destination)) / 2;
+
+    std::lock_guard<std::mutex> l(this->_lock);
+    this->_samples[this->_next] = s;
+    this->_next = (this->_next + 1) % this->_samples.size();
+    this->_count = (std::min)(this->_count + 1, this->_samples.size());
+
+    auto best = this->_samples.begin();
+    for (auto it = best; it != best + this->_count; ++it) {
+        if (it->delay < best->delay) {
+            best = it;
+        }
+    }
+
+    {
+        auto sum = 0.0;
+        for (auto it = this->_samples.begin();
+                it != this->_samples.begin() + this->_count; ++it) {
+            const auto d = static_cast<double>(it->offset - best->offset);
+            sum += d * d;
+        }
+        this->_jitter = std::sqrt(sum / this->_count);
+    }
+
+    // The best sample only changes if a sample with a shorter round trip
+    // arrived or if the previous one left the window, so in both cases it
+    // is newer than the estimate. The first sample cannot tell us anything
+    // about the drift, and implausible slopes are outliers.
+    if ((this->_count > 1) && (best->local > this->_estimate.local)) {
+        const auto drift = static_cast<double>(best->offset
+            - this->_estimate.offset)
+            / static_cast<double>(best->local - this->_estimate.local);
+        if (std::abs(drift) <= max_drift) {
+            this->_drift += (drift - this->_drift) / 4.0;
+        }
+    }
+
+    this->_estimate = *best;
+}
+
+
+/*
+ * mmp_clock::offset
+ */
+std::int64_t mmp_clock::offset(_In_ const std::uint64_t local) const noexcept {
+    const auto elapsed = static_cast<std::int64_t>(local
+        - this->_estimate.local);
+    return this->_estimate.offset + static_cast<std::int64_t>(
+        this->_drift * static_cast<double>(elapsed));
+}
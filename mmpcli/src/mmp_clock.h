@@ -0,0 +1,138 @@
+﻿// <copyright file="mmp_clock.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cinttypes>
+#include <mutex>
+
+#include "mmpapi.h"
+
+
+/// <summary>
+/// Estimates the offset and the drift of the clock of the magic mouse pad
+/// relative to the monotonic clock of the client from the timestamps of
+/// ping/pong exchanges like a minimal NTP clock filter.
+/// </summary>
+/// <remarks>
+/// <para>The estimator keeps the last <see cref="window"/> samples and uses
+/// the one with the lowest round-trip time, because queueing delays are the
+/// main source of error on a local network and they only ever make the
+/// round trip longer. The drift is derived from consecutive best samples and
+/// smoothed exponentially. The jitter is the root mean square of the offsets
+/// in the window relative to the best sample.</para>
+/// <para>The instance is thread-safe. It is updated by the receiver thread
+/// and queried by the application.</para>
+/// </remarks>
+class mmp_clock final {
+
+public:
+
+    /// <summary>
+    /// The monotonic clock of the client.
+    /// </summary>
+    typedef std::chrono::steady_clock clock;
+
+    /// <summary>
+    /// The interval between two probes of the clock of the server.
+    /// </summary>
+    static constexpr std::chrono::milliseconds probe_interval
+        = std::chrono::milliseconds(1000);
+
+    /// <summary>
+    /// The number of samples the estimator considers.
+    /// </summary>
+    static constexpr std::size_t window = 8;
+
+    /// <summary>
+    /// Answer the current time in microseconds on the monotonic clock of the
+    /// client, which is the time base of all local timestamps.
+    /// </summary>
+    static std::uint64_t now(void) noexcept;
+
+    /// <summary>
+    /// Initialises a new instance without any sample.
+    /// </summary>
+    mmp_clock(void) noexcept;
+
+    /// <summary>
+    /// Answer the current estimate.
+    /// </summary>
+    /// <param name="offset">Receives the time in microseconds the clock of
+    /// the server is ahead of the local one.</param>
+    /// <param name="rtt">Receives the round-trip time in microseconds of the
+    /// sample the estimate is based on.</param>
+    /// <param name="jitter">Receives the jitter of the offset in
+    /// microseconds.</param>
+    /// <returns><see langword="true" /> if there is an estimate,
+    /// <see langword="false" /> if no sample has been recorded yet.</returns>
+    _Success_(return == true) bool get(_Out_ std::int64_t& offset,
+        _Out_ std::uint32_t& rtt,
+        _Out_ std::uint32_t& jitter) const noexcept;
+
+    /// <summary>
+    /// Discards all samples, which must be done when the client starts
+    /// talking to a different server.
+    /// </summary>
+    void reset(void) noexcept;
+
+    /// <summary>
+    /// Converts the given <paramref name="timestamp"/> of the server into the
+    /// local time base.
+    /// </summary>
+    /// <param name="timestamp">A time in microseconds on the monotonic clock
+    /// of the server.</param>
+    /// <returns>The same time in microseconds on the monotonic clock of the
+    /// client, or zero if there is no estimate yet.</returns>
+    std::uint64_t to_local(_In_ const std::uint64_t timestamp) const noexcept;
+
+    /// <summary>
+    /// Records the sample obtained from a ping/pong exchange.
+    /// </summary>
+    /// <param name="origin">The local time when the ping was sent.</param>
+    /// <param name="receive">The server time when the ping was received.
+    /// </param>
+    /// <param name="transmit">The server time when the pong was sent.</param>
+    /// <param name="destination">The local time when the pong was received.
+    /// </param>
+    void update(_In_ const std::uint64_t origin,
+        _In_ const std::uint64_t receive,
+        _In_ const std::uint64_t transmit,
+        _In_ const std::uint64_t destination) noexcept;
+
+private:
+
+    /// <summary>
+    /// The result of a single ping/pong exchange.
+    /// </summary>
+    struct sample {
+        std::uint64_t delay;
+        std::uint64_t local;
+        std::int64_t offset;
+    };
+
+    /// <summary>
+    /// The largest drift in seconds per second that is considered plausible,
+    /// which is the tolerance of NTP.
+    /// </summary>
+    static constexpr double max_drift = 500e-6;
+
+    /// <summary>
+    /// Answer the offset extrapolated to the given <paramref name="local"/>
+    /// time. The caller must hold <see cref="_lock"/>.
+    /// </summary>
+    std::int64_t offset(_In_ const std::uint64_t local) const noexcept;
+
+    std::size_t _count;
+    double _drift;
+    sample _estimate;
+    double _jitter;
+    mutable std::mutex _lock;
+    std::size_t _next;
+    std::array<sample, window> _samples;
+};
@@ -6,9 +6,13 @@
 
 #include "mmp_configuration.h"
 
+#include <cstring>
+
+#if defined(_WIN32)
 #include <wil/registry.h>
-#include <wil/result.h>
+#endif /* defined(_WIN32) */
 
+#include "mmp_platform.h"
 #include "mmpendpoint.h"
 #include "mmptrace.h"
 
@@ -90,6 +94,7 @@ _Success_(return == 0) int mmp_configure_discovery(
 }
 
 
+#if defined(_WIN32)
 /*
  * ::mmp_configure_from_registry_key
  */
@@ -129,8 +134,22 @@ _Success_(return == 0) int mmp_configure_from_registry_key(
         }
     }
 
+    {
+        wil::unique_cotaskmem_string value;
+        if (SUCCEEDED(wil::reg::get_value_string_nothrow(key,
+                L"Standby",
+                value))) {
+            RETURN_IF_WIN32_ERROR(::mmp_parse_end_pointw(
+                &configuration->standby, value.get()));
+        }
+    }
+
+    get_uint(L"CacheTtl", configuration->cache_ttl);
     get_uint(L"Flags", configuration->flags);
+    get_uint(L"HeartbeatTimeout", configuration->heartbeat_timeout);
     get_uint(L"Height", configuration->height);
+    get_uint(L"Margin", configuration->margin);
+    get_uint(L"MaxRate", configuration->max_rate);
     get_int(L"OffsetX", configuration->offset_x);
     get_int(L"OffsetY", configuration->offset_y);
     get_uint(L"RateLimit", configuration->rate_limit);
@@ -141,6 +160,7 @@ _Success_(return == 0) int mmp_configure_from_registry_key(
 
     return 0;
 }
+#endif /* defined(_WIN32) */
 
 
 /*
@@ -0,0 +1,408 @@
+﻿// <copyright file="mmp_discovery.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "mmp_discovery.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+/*
+ * mmp_discovery::cancellation_poll
+ */
+constexpr std::chrono::milliseconds mmp_discovery::cancellation_poll;
+
+
+/*
+ * mmp_discovery::mmp_discovery
+ */
+mmp_discovery::mmp_discovery(_In_ const sockaddr_storage& client,
+        _In_ const duration interval,
+        _In_ const duration window)
+    : _client(client),
+    _interval(interval),
+    _max_interval(max_backoff * interval),
+    _next_request((time_point::min)()),
+    _rng(token(clock::now())),
+    _selection((time_point::max)()),
+    _state(state::requesting),
+    _window(window) { }
+
+
+/*
+ * mmp_discovery::add_target
+ */
+_Success_(return == 0) int mmp_discovery::add_target(
+        _In_ const sockaddr_storage& target) {
+    auto& socket = this->socket(target.ss_family);
+
+    if (!socket) {
+        switch (target.ss_family) {
+            case AF_INET:
+            case AF_INET6:
+                break;
+
+            default:
+                MMP_TRACE(L"Incompatible address family %d.",
+                    target.ss_family);
+                RETURN_WIN32(WSAEAFNOSUPPORT);
+        }
+
+        wil::unique_socket s(::WSASocket(target.ss_family,
+            SOCK_DGRAM,
+            IPPROTO_UDP,
+            nullptr,
+            0,
+            WSA_FLAG_OVERLAPPED));
+        RETURN_LAST_ERROR_IF(!s);
+
+        // Bind to the configured client address if it is of the same family,
+        // to an ephemeral port on the wildcard address otherwise.
+        sockaddr_storage address;
+        ::memset(&address, 0, sizeof(address));
+        if (this->_client.ss_family == target.ss_family) {
+            address = this->_client;
+        } else {
+            address.ss_family = target.ss_family;
+        }
+
+        const auto len = static_cast<int>((address.ss_family == AF_INET6)
+            ? sizeof(sockaddr_in6)
+            : sizeof(sockaddr_in));
+        RETURN_LAST_ERROR_IF(::bind(s.get(),
+            reinterpret_cast<const sockaddr *>(&address),
+            len) == SOCKET_ERROR);
+
+        // Broadcasts need to be enabled explicitly. This does not hurt if the
+        // target is a unicast address.
+        if (target.ss_family == AF_INET) {
+            const BOOL broadcast = TRUE;
+            RETURN_LAST_ERROR_IF(::setsockopt(s.get(),
+                SOL_SOCKET,
+                SO_BROADCAST,
+                reinterpret_cast<const char *>(&broadcast),
+                sizeof(broadcast)) == SOCKET_ERROR);
+        }
+
+        u_long non_blocking = 1;
+        RETURN_LAST_ERROR_IF(::ioctlsocket(s.get(), FIONBIO, &non_blocking)
+            == SOCKET_ERROR);
+
+        socket = std::move(s);
+    }
+
+    this->_targets.push_back(target);
+    return 0;
+}
+
+
+/*
+ * mmp_discovery::best
+ */
+const mmp_discovery::candidate *mmp_discovery::best(void) const noexcept {
+    // Prefer the closest server, but penalise each client it is already
+    // serving by a millisecond. If we only heard a beacon, we do not know the
+    // round-trip time, so we assume the worst we could have measured.
+    const auto window = this->_window;
+    auto retval = std::min_element(this->_candidates.begin(),
+            this->_candidates.end(),
+            [window](const candidate& l, const candidate& r) {
+        const auto score = [window](const candidate& c) {
+            const auto rtt = (std::min)(c.rtt, window);
+            return rtt + std::chrono::milliseconds(1) * c.load;
+        };
+        return (score(l) < score(r));
+    });
+
+    return (retval != this->_candidates.end()) ? &*retval : nullptr;
+}
+
+
+/*
+ * mmp_discovery::listen
+ */
+_Success_(return == 0) int mmp_discovery::listen(
+        _In_ const std::uint16_t port) {
+    wil::unique_socket s(::WSASocket(AF_INET,
+        SOCK_DGRAM,
+        IPPROTO_UDP,
+        nullptr,
+        0,
+        WSA_FLAG_OVERLAPPED));
+    RETURN_LAST_ERROR_IF(!s);
+
+    // Other clients on the same machine might be listening as well.
+    const BOOL reuse = TRUE;
+    RETURN_LAST_ERROR_IF(::setsockopt(s.get(),
+        SOL_SOCKET,
+        SO_REUSEADDR,
+        reinterpret_cast<const char *>(&reuse),
+        sizeof(reuse)) == SOCKET_ERROR);
+
+    sockaddr_in address;
+    ::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = ::htons(port);
+    RETURN_LAST_ERROR_IF(::bind(s.get(),
+        reinterpret_cast<const sockaddr *>(&address),
+        sizeof(address)) == SOCKET_ERROR);
+
+    u_long non_blocking = 1;
+    RETURN_LAST_ERROR_IF(::ioctlsocket(s.get(), FIONBIO, &non_blocking)
+        == SOCKET_ERROR);
+
+    MMP_TRACE(L"Listening for beacons on port %u.", port);
+    this->_beacon = std::move(s);
+    this->_state = state::listening;
+    return 0;
+}
+
+
+/*
+ * mmp_discovery::step
+ */
+_Success_(return == 0) int mmp_discovery::step(_In_ const time_point now,
+        _In_ const time_point deadline,
+        _Out_ time_point& wakeup) {
+    wakeup = deadline;
+
+    if (now >= deadline) {
+        MMP_TRACE(L"The discovery deadline has passed.");
+        this->_state = state::done;
+        return 0;
+    }
+
+    switch (this->_state) {
+        case state::listening:
+            // The listening period starts with the first step, not when the
+            // instance was created.
+            if (this->_next_request == (time_point::min)()) {
+                this->_next_request = now + this->_interval;
+            }
+
+            if (now < this->_next_request) {
+                break;
+            }
+
+            MMP_TRACE(L"No beacon was received, so we start requesting.");
+            this->_state = state::requesting;
+            // Fall through.
+
+        case state::requesting:
+            if (now >= this->_next_request) {
+                RETURN_IF_WIN32_ERROR(this->send(now));
+
+                // Spread the requests of many clients starting at the same
+                // time by up to a quarter of the interval in either
+                // direction before backing off.
+                const auto us = std::chrono::duration_cast<
+                    std::chrono::microseconds>(this->_interval).count();
+                typedef std::chrono::microseconds::rep rep;
+                std::uniform_int_distribution<rep> jitter(-us / 4, us / 4);
+                this->_next_request = now + this->_interval
+                    + std::chrono::microseconds(jitter(this->_rng));
+                this->_interval = (std::min)(2 * this->_interval,
+                    this->_max_interval);
+            }
+            break;
+
+        case state::selecting:
+            if (now >= this->_selection) {
+                this->_state = state::done;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    switch (this->_state) {
+        case state::listening:
+        case state::requesting:
+            wakeup = (std::min)(wakeup, this->_next_request);
+            break;
+
+        case state::selecting:
+            wakeup = (std::min)(wakeup, this->_selection);
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+
+/*
+ * mmp_discovery::wait
+ */
+_Success_(return == 0) int mmp_discovery::wait(_In_ const time_point until) {
+    const SOCKET sockets[] = {
+        this->_socket4.get(),
+        this->_socket6.get(),
+        this->_beacon.get()
+    };
+
+    // Note: Winsock ignores the number of descriptors, but POSIX does not.
+    fd_set fds;
+    int nfds = 0;
+    FD_ZERO(&fds);
+    for (auto s : sockets) {
+        if (s != INVALID_SOCKET) {
+            FD_SET(s, &fds);
+            nfds = (std::max)(nfds, static_cast<int>(s) + 1);
+        }
+    }
+
+    auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(
+        until - clock::now()).count();
+    if (remaining < 0) {
+        remaining = 0;
+    }
+
+    timeval tv;
+    tv.tv_sec = static_cast<long>(remaining / 1000000);
+    tv.tv_usec = static_cast<long>(remaining % 1000000);
+
+    const auto status = ::select(nfds, &fds, nullptr, nullptr, &tv);
+    RETURN_LAST_ERROR_IF(status == SOCKET_ERROR);
+
+    for (auto s : sockets) {
+        if ((s != INVALID_SOCKET) && FD_ISSET(s, &fds)) {
+            this->receive(s);
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * mmp_discovery::token
+ */
+std::uint32_t mmp_discovery::token(_In_ const time_point time) noexcept {
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        time.time_since_epoch()).count();
+    // Setting the lowest bit makes the round-trip time off by at most one
+    // microsecond, which is irrelevant for choosing the server.
+    return static_cast<std::uint32_t>(us) | 1;
+}
+
+
+/*
+ * mmp_discovery::receive
+ */
+void mmp_discovery::receive(_In_ const SOCKET socket) {
+    while (true) {
+        sockaddr_storage peer;
+        ::memset(&peer, 0, sizeof(peer));
+        socklen_t peer_len = sizeof(peer);
+        auto len = ::recvfrom(socket,
+            this->_buffer.data(),
+            static_cast<int>(this->_buffer.size()),
+            0,
+            reinterpret_cast<sockaddr *>(&peer),
+            &peer_len);
+
+        if (len == SOCKET_ERROR) {
+            const auto error = ::WSAGetLastError();
+            if (error == WSAEMSGSIZE) {
+                // The datagram is larger than any announcement we know, but
+                // its beginning might still be one from a newer server.
+                len = static_cast<int>(this->_buffer.size());
+            } else if (error == WSAEWOULDBLOCK) {
+                return;
+            } else {
+                MMP_TRACE(L"Receiving an announcement failed with error %d.",
+                    error);
+                return;
+            }
+        }
+
+        const auto now = clock::now();
+        const auto status = visus::mmp::wire::dispatch_table<
+            mmp_msg_announce>::dispatch(this->_buffer.data(), len,
+                [this, &peer, now](
+                    const visus::mmp::wire::view<mmp_msg_announce>& msg) {
+            // The token is the time when the request was sent, so the
+            // difference to the current time is the round-trip time. Beacons
+            // and servers that predate the selection do not provide a token.
+            auto rtt = (duration::max)();
+            if (msg.token() != 0) {
+                rtt = std::chrono::microseconds(static_cast<std::uint32_t>(
+                    token(now) - msg.token()));
+            }
+
+            candidate c(msg, peer, rtt);
+            auto it = std::find_if(this->_candidates.begin(),
+                this->_candidates.end(),
+                [&peer](const candidate& e) {
+                    return (::memcmp(&e.address, &peer, sizeof(peer)) == 0);
+                });
+            if (it == this->_candidates.end()) {
+                MMP_TRACE(L"A magic mouse pad serving %u client(s) announced "
+                    L"itself.", c.load);
+                this->_candidates.push_back(c);
+            } else {
+                c.rtt = (std::min)(c.rtt, it->rtt);
+                *it = c;
+            }
+        });
+
+        if (status != visus::mmp::wire::dispatch_status::handled) {
+            MMP_TRACE(L"Ignoring an invalid or unexpected datagram of %d "
+                L"bytes.", len);
+
+        } else if ((this->_state == state::listening)
+                || (this->_state == state::requesting)) {
+            this->_selection = now + this->_window;
+            this->_state = state::selecting;
+        }
+    }
+}
+
+
+/*
+ * mmp_discovery::send
+ */
+_Success_(return == 0) int mmp_discovery::send(_In_ const time_point now) {
+    const mmp_msg_discover msg(token(now));
+
+    for (auto it = this->_targets.begin(); it != this->_targets.end();) {
+        const auto len = static_cast<int>((it->ss_family == AF_INET6)
+            ? sizeof(sockaddr_in6)
+            : sizeof(sockaddr_in));
+        if (::sendto(this->socket(it->ss_family).get(),
+                reinterpret_cast<const char *>(&msg),
+                sizeof(msg),
+                0,
+                reinterpret_cast<const sockaddr *>(&*it),
+                len) == SOCKET_ERROR) {
+            MMP_TRACE(L"Removing discovery target that failed with error %d.",
+                ::WSAGetLastError());
+            it = this->_targets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (this->_targets.empty() && !this->_beacon) {
+        MMP_TRACE(L"No working discovery targets available.");
+        RETURN_WIN32(ERROR_NETWORK_UNREACHABLE);
+    }
+
+    return 0;
+}
+
+
+/*
+ * mmp_discovery::socket
+ */
+wil::unique_socket& mmp_discovery::socket(_In_ const int family) noexcept {
+    return (family == AF_INET6) ? this->_socket6 : this->_socket4;
+}
@@ -0,0 +1,282 @@
+﻿// <copyright file="mmp_discovery.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cinttypes>
+#include <random>
+#include <vector>
+
+#include "mmp_platform.h"
+#include "mmpapi.h"
+#include "mmpmsg.h"
+#include "mmptrace.h"
+#include "mmpwire.h"
+
+
+/// <summary>
+/// A single-threaded state machine that discovers magic mouse pads by sending
+/// discovery requests to a set of targets and collecting their announcements.
+/// </summary>
+/// <remarks>
+/// <para>The state machine starts in <see cref="state::listening"/> if it
+/// listens for beacons and in <see cref="state::requesting"/> otherwise. While
+/// requesting, it sends a discovery request to all targets and repeats it
+/// with jittered exponential backoff. Once the first server has announced
+/// itself, the machine enters <see cref="state::selecting"/> for the
+/// selection window, after which it is <see cref="state::done"/>.</para>
+/// <para>All sockets are non-blocking and owned by the instance, and no
+/// thread is created, so no resources outlive the discovery. The targets can
+/// be broadcast, multicast or unicast addresses, which allows for probing a
+/// known server as well as for testing against a local server on the
+/// loopback interface.</para>
+/// </remarks>
+class mmp_discovery final {
+
+public:
+
+    /// <summary>
+    /// The clock used for all timers of the state machine.
+    /// </summary>
+    typedef std::chrono::steady_clock clock;
+
+    /// <summary>
+    /// The type used for intervals.
+    /// </summary>
+    typedef clock::duration duration;
+
+    /// <summary>
+    /// The type used for deadlines.
+    /// </summary>
+    typedef clock::time_point time_point;
+
+    /// <summary>
+    /// A magic mouse pad that has announced itself during discovery along
+    /// with the information used to choose between several servers.
+    /// </summary>
+    struct candidate {
+        sockaddr_storage address;
+        mmp_capabilities capabilities;
+        std::uint32_t epoch;
+        std::uint32_t load;
+        duration rtt;
+        mmp_seq_no sequence_number;
+        std::uint32_t version;
+
+        /// <summary>
+        /// Initialises a new instance from the announcement
+        /// <paramref name="msg"/> sent by <paramref name="peer"/>.
+        /// </summary>
+        /// <param name="msg">The announcement of the server.</param>
+        /// <param name="peer">The address the announcement was received
+        /// from.</param>
+        /// <param name="rtt">The measured round-trip time, or
+        /// <see cref="duration::max"/> if the announcement was not a response
+        /// to a request of this client.</param>
+        inline candidate(
+                _In_ const visus::mmp::wire::view<mmp_msg_announce>& msg,
+                _In_ const sockaddr_storage& peer,
+                _In_ const duration rtt) noexcept
+            : address(peer),
+            capabilities(msg.capabilities()),
+            epoch(msg.epoch()),
+            load(msg.load()),
+            rtt(rtt),
+            sequence_number(msg.sequence_number()),
+            version(msg.version()) { }
+    };
+
+    /// <summary>
+    /// The possible states of the discovery.
+    /// </summary>
+    enum class state {
+        /// <summary>
+        /// Waiting for beacons before sending any request.
+        /// </summary>
+        listening,
+
+        /// <summary>
+        /// Sending requests until the first server responds.
+        /// </summary>
+        requesting,
+
+        /// <summary>
+        /// Collecting further announcements for the selection window.
+        /// </summary>
+        selecting,
+
+        /// <summary>
+        /// The discovery has ended, either because the selection window or
+        /// the overall deadline has passed.
+        /// </summary>
+        done
+    };
+
+    /// <summary>
+    /// The maximum factor by which the interval between two requests grows
+    /// relative to the initial interval.
+    /// </summary>
+    static constexpr unsigned int max_backoff = 16;
+
+    /// <summary>
+    /// The maximum time the state machine blocks before it checks whether it
+    /// has been cancelled.
+    /// </summary>
+    static constexpr std::chrono::milliseconds cancellation_poll
+        = std::chrono::milliseconds(100);
+
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    /// <param name="client">The address of the client. Sockets of the same
+    /// family are bound to it, those of other families to the wildcard
+    /// address.</param>
+    /// <param name="interval">The initial interval between two requests,
+    /// which also is the time to listen for beacons. This should be greater
+    /// than zero.</param>
+    /// <param name="window">The time to wait for further announcements after
+    /// the first server has responded. If this is zero, the first server
+    /// wins.</param>
+    mmp_discovery(_In_ const sockaddr_storage& client,
+        _In_ const duration interval,
+        _In_ const duration window);
+
+    /// <summary>
+    /// Adds an address to send discovery requests to.
+    /// </summary>
+    /// <param name="target">The broadcast, multicast or unicast address of
+    /// the target.</param>
+    /// <returns>Zero in case of success, a system error code if no socket
+    /// for the address family of <paramref name="target"/> could be
+    /// created.</returns>
+    _Success_(return == 0) int add_target(
+        _In_ const sockaddr_storage& target);
+
+    /// <summary>
+    /// Answer the best of the servers that have announced themselves, i.e.
+    /// the one with the lowest round-trip time penalised by its load.
+    /// </summary>
+    /// <returns>The best candidate, or <see langword="nullptr" /> if no
+    /// server has been found.</returns>
+    const candidate *best(void) const noexcept;
+
+    /// <summary>
+    /// Answer all servers that have answered so far.
+    /// </summary>
+    inline const std::vector<candidate>& candidates(void) const noexcept {
+        return this->_candidates;
+    }
+
+    /// <summary>
+    /// Answer the current state.
+    /// </summary>
+    inline state current_state(void) const noexcept {
+        return this->_state;
+    }
+
+    /// <summary>
+    /// Listens for beacons on the given IPv4 <paramref name="port"/> before
+    /// sending the first request.
+    /// </summary>
+    /// <param name="port">The beacon port in host-byte order.</param>
+    /// <returns>Zero in case of success, a system error code otherwise.
+    /// </returns>
+    _Success_(return == 0) int listen(_In_ const std::uint16_t port);
+
+    /// <summary>
+    /// Runs the state machine on the calling thread until it is done.
+    /// </summary>
+    /// <typeparam name="TCancel">A functor returning whether the discovery
+    /// should be aborted.</typeparam>
+    /// <param name="deadline">The time when the discovery ends even if no
+    /// server has been found.</param>
+    /// <param name="cancelled">The functor checking for cancellation, which
+    /// is invoked at least every <see cref="cancellation_poll"/>.</param>
+    /// <returns>Zero if a server has been found, the code for
+    /// <c>ERROR_TIMEOUT</c> if none has responded before the
+    /// <paramref name="deadline"/>, the code for <c>ERROR_CANCELLED</c> if
+    /// the discovery was cancelled or another system error code.</returns>
+    template<class TCancel>
+    _Success_(return == 0) int run(_In_ const time_point deadline,
+        _In_ TCancel&& cancelled);
+
+    /// <summary>
+    /// Advances the timers of the state machine, which includes sending
+    /// requests that are due.
+    /// </summary>
+    /// <param name="now">The current time.</param>
+    /// <param name="deadline">The time when the discovery ends.</param>
+    /// <param name="wakeup">Receives the time when the next timer expires.
+    /// </param>
+    /// <returns>Zero in case of success, a system error code if no target
+    /// could be reached.</returns>
+    _Success_(return == 0) int step(_In_ const time_point now,
+        _In_ const time_point deadline,
+        _Out_ time_point& wakeup);
+
+    /// <summary>
+    /// Waits until any of the sockets becomes readable or
+    /// <paramref name="until"/> has passed and processes all datagrams
+    /// received.
+    /// </summary>
+    /// <param name="until">The time when to stop waiting.</param>
+    /// <returns>Zero in case of success, a system error code otherwise.
+    /// </returns>
+    _Success_(return == 0) int wait(_In_ const time_point until);
+
+private:
+
+    /// <summary>
+    /// Derives the token for a discovery request sent at the given
+    /// <paramref name="time"/>, from which the round-trip time can be computed
+    /// when the token is echoed by the server.
+    /// </summary>
+    /// <param name="time">The time when the request is sent.</param>
+    /// <returns>The lower 32 bits of the time in microseconds, which are
+    /// never zero, because zero designates beacons.</returns>
+    static std::uint32_t token(_In_ const time_point time) noexcept;
+
+    /// <summary>
+    /// Reads all datagrams that are pending on <paramref name="socket"/> and
+    /// records the servers that announced themselves.
+    /// </summary>
+    /// <param name="socket">A readable socket.</param>
+    void receive(_In_ const SOCKET socket);
+
+    /// <summary>
+    /// Sends a discovery request to all targets and removes those that
+    /// cannot be reached.
+    /// </summary>
+    /// <param name="now">The current time, which is encoded in the request.
+    /// </param>
+    /// <returns>Zero in case of success, a system error code if no target
+    /// is left.</returns>
+    _Success_(return == 0) int send(_In_ const time_point now);
+
+    /// <summary>
+    /// Answer the socket for the given address <paramref name="family"/>.
+    /// </summary>
+    wil::unique_socket& socket(_In_ const int family) noexcept;
+
+    wil::unique_socket _beacon;
+    std::array<char, 2 * sizeof(mmp_msg_announce)> _buffer;
+    std::vector<candidate> _candidates;
+    sockaddr_storage _client;
+    duration _interval;
+    const duration _max_interval;
+    time_point _next_request;
+    std::minstd_rand _rng;
+    time_point _selection;
+    wil::unique_socket _socket4;
+    wil::unique_socket _socket6;
+    state _state;
+    std::vector<sockaddr_storage> _targets;
+    const duration _window;
+};
+
+#include "mmp_discovery.inl"
@@ -0,0 +1,33 @@
+﻿// <copyright file="mmp_discovery.inl" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+
+/*
+ * mmp_discovery::run
+ */
+template<class TCancel>
+_Success_(return == 0) int mmp_discovery::run(_In_ const time_point deadline,
+        _In_ TCancel&& cancelled) {
+    while (true) {
+        if (cancelled()) {
+            MMP_TRACE(L"The discovery was cancelled.");
+            RETURN_WIN32(ERROR_CANCELLED);
+        }
+
+        const auto now = clock::now();
+        time_point wakeup;
+        RETURN_IF_WIN32_ERROR(this->step(now, deadline, wakeup));
+
+        if (this->_state == state::done) {
+            return this->_candidates.empty()
+                ? HRESULT_FROM_WIN32(ERROR_TIMEOUT)
+                : 0;
+        }
+
+        RETURN_IF_WIN32_ERROR(this->wait((std::min)(wakeup,
+            now + cancellation_poll)));
+    }
+}
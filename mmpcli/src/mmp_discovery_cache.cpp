@@ -0,0 +1,175 @@
+﻿// <copyright file="mmp_discovery_cache.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "mmp_discovery_cache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif /* !defined(_WIN32) */
+
+#include "mmptrace.h"
+
+
+/*
+ * mmp_discovery_cache::default_ttl
+ */
+constexpr std::chrono::seconds mmp_discovery_cache::default_ttl;
+
+
+/*
+ * mmp_discovery_cache::invalidate
+ */
+void mmp_discovery_cache::invalidate(_In_ const std::uint16_t port) noexcept {
+    try {
+        const auto p = path(port, false);
+        if (!p.empty()) {
+            MMP_TRACE(L"Invalidating discovery cache for port %u.", port);
+#if defined(_WIN32)
+            ::DeleteFileW(p.c_str());
+#else /* defined(_WIN32) */
+            std::remove(p.c_str());
+#endif /* defined(_WIN32) */
+        }
+    } catch (...) {
+        MMP_TRACE(L"Failed to invalidate the discovery cache.");
+    }
+}
+
+
+/*
+ * mmp_discovery_cache::load
+ */
+bool mmp_discovery_cache::load(_In_ const std::uint16_t port,
+        _Out_ sockaddr_storage& server) noexcept {
+    ::memset(&server, 0, sizeof(server));
+
+    try {
+        const auto p = path(port, false);
+        if (p.empty()) {
+            return false;
+        }
+
+        record r;
+        std::ifstream stream(p, std::ios::binary);
+        if (!stream.read(reinterpret_cast<char *>(&r), sizeof(r))) {
+            MMP_TRACE(L"No discovery cache for port %u.", port);
+            return false;
+        }
+
+        if (r.magic != magic) {
+            MMP_TRACE(L"The discovery cache for port %u is invalid.", port);
+            return false;
+        }
+
+        const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+            clock::now().time_since_epoch()).count();
+        if (r.expiry <= now) {
+            MMP_TRACE(L"The discovery cache for port %u has expired.", port);
+            return false;
+        }
+
+        switch (r.server.ss_family) {
+            case AF_INET:
+            case AF_INET6:
+                server = r.server;
+                return true;
+
+            default:
+                return false;
+        }
+    } catch (...) {
+        MMP_TRACE(L"Failed to read the discovery cache.");
+        return false;
+    }
+}
+
+
+/*
+ * mmp_discovery_cache::store
+ */
+void mmp_discovery_cache::store(_In_ const std::uint16_t port,
+        _In_ const sockaddr_storage& server,
+        _In_ const std::chrono::seconds ttl) noexcept {
+    try {
+        const auto p = path(port, true);
+        if (p.empty()) {
+            return;
+        }
+
+        record r;
+        ::memset(&r, 0, sizeof(r));
+        r.magic = magic;
+        r.expiry = std::chrono::duration_cast<std::chrono::seconds>(
+            (clock::now() + ttl).time_since_epoch()).count();
+        r.server = server;
+
+        MMP_TRACE(L"Updating discovery cache for port %u.", port);
+        std::ofstream stream(p, std::ios::binary | std::ios::trunc);
+        stream.write(reinterpret_cast<const char *>(&r), sizeof(r));
+    } catch (...) {
+        MMP_TRACE(L"Failed to update the discovery cache.");
+    }
+}
+
+
+/*
+ * mmp_discovery_cache::path
+ */
+mmp_discovery_cache::path_type mmp_discovery_cache::path(
+        _In_ const std::uint16_t port,
+        _In_ const bool create) {
+#if defined(_WIN32)
+    path_type retval(MAX_PATH, L'\0');
+    auto len = ::GetEnvironmentVariableW(L"LOCALAPPDATA", &retval[0],
+        static_cast<DWORD>(retval.size()));
+    if (len > retval.size()) {
+        retval.resize(len);
+        len = ::GetEnvironmentVariableW(L"LOCALAPPDATA", &retval[0],
+            static_cast<DWORD>(retval.size()));
+    }
+    if ((len == 0) || (len > retval.size())) {
+        return path_type();
+    }
+
+    retval.resize(len);
+    retval += L"\\Magic Mouse Pad";
+
+    if (create) {
+        // Note: this fails if the directory already exists, which is fine.
+        ::CreateDirectoryW(retval.c_str(), nullptr);
+    }
+
+    retval += L"\\discovery-" + std::to_wstring(port) + L".bin";
+    return retval;
+
+#else /* defined(_WIN32) */
+    path_type retval;
+
+    if (auto xdg = std::getenv("XDG_CACHE_HOME")) {
+        retval = xdg;
+    } else if (auto home = std::getenv("HOME")) {
+        retval = home;
+        retval += "/.cache";
+    } else {
+        return path_type();
+    }
+
+    retval += "/magicmousepad";
+
+    if (create) {
+        // Note: this fails if the directory already exists, which is fine.
+        ::mkdir(retval.c_str(), 0700);
+    }
+
+    retval += "/discovery-" + std::to_string(port) + ".bin";
+    return retval;
+#endif /* defined(_WIN32) */
+}
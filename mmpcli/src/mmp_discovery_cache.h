@@ -0,0 +1,99 @@
+﻿// <copyright file="mmp_discovery_cache.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <chrono>
+#include <cinttypes>
+#include <string>
+
+#include "mmpapi.h"
+
+
+/// <summary>
+/// Persists the end point of the magic mouse pad last discovered on a given
+/// port such that the next client can probe it directly instead of
+/// broadcasting.
+/// </summary>
+/// <remarks>
+/// There is one file per port in the local application data of the user.
+/// All failures to read or write the cache are silently ignored, because the
+/// client can always fall back to broadcast discovery.
+/// </remarks>
+class mmp_discovery_cache final {
+
+public:
+
+    /// <summary>
+    /// The clock used for the expiry of the entries, which must be valid
+    /// across processes and reboots.
+    /// </summary>
+    typedef std::chrono::system_clock clock;
+
+    /// <summary>
+    /// The time to live of an entry if none is configured.
+    /// </summary>
+    static constexpr std::chrono::seconds default_ttl = std::chrono::hours(24);
+
+    /// <summary>
+    /// Removes the entry for the given <paramref name="port"/>.
+    /// </summary>
+    /// <param name="port">The discovery port in host-byte order.</param>
+    static void invalidate(_In_ const std::uint16_t port) noexcept;
+
+    /// <summary>
+    /// Retrieves the server cached for the given <paramref name="port"/>.
+    /// </summary>
+    /// <param name="port">The discovery port in host-byte order.</param>
+    /// <param name="server">Receives the address of the server.</param>
+    /// <returns><see langword="true" /> if a valid entry that has not yet
+    /// expired was found, <see langword="false" /> otherwise.</returns>
+    static bool load(_In_ const std::uint16_t port,
+        _Out_ sockaddr_storage& server) noexcept;
+
+    /// <summary>
+    /// Remembers the <paramref name="server"/> discovered on the given
+    /// <paramref name="port"/>.
+    /// </summary>
+    /// <param name="port">The discovery port in host-byte order.</param>
+    /// <param name="server">The address of the server.</param>
+    /// <param name="ttl">The time until the entry expires.</param>
+    static void store(_In_ const std::uint16_t port,
+        _In_ const sockaddr_storage& server,
+        _In_ const std::chrono::seconds ttl) noexcept;
+
+private:
+
+#if defined(_WIN32)
+    typedef std::wstring path_type;
+#else /* defined(_WIN32) */
+    typedef std::string path_type;
+#endif /* defined(_WIN32) */
+
+    /// <summary>
+    /// The content of a cache file.
+    /// </summary>
+    struct record {
+        std::uint32_t magic;
+        std::uint32_t reserved;
+        std::int64_t expiry;
+        sockaddr_storage server;
+    };
+
+    /// <summary>
+    /// Identifies a valid cache file of the current layout.
+    /// </summary>
+    static constexpr std::uint32_t magic = 0x434d4d01;
+
+    /// <summary>
+    /// Answer the path of the cache file for the given
+    /// <paramref name="port"/>, optionally creating the directory.
+    /// </summary>
+    /// <returns>The path of the cache file, or an empty string if the
+    /// location for application data could not be determined.</returns>
+    static path_type path(_In_ const std::uint16_t port,
+        _In_ const bool create);
+};
@@ -0,0 +1,94 @@
+﻿// <copyright file="mmp_inproc_transport.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "mmp_inproc_transport.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "mmptrace.h"
+
+
+/*
+ * mmp_inproc_transport::mmp_inproc_transport
+ */
+mmp_inproc_transport::mmp_inproc_transport(
+        _In_ std::shared_ptr<visus::mmp::inproc::endpoint> endpoint) noexcept
+    : _endpoint(std::move(endpoint)) { }
+
+
+/*
+ * mmp_inproc_transport::close
+ */
+void mmp_inproc_transport::close(void) noexcept {
+    this->_endpoint->close();
+}
+
+
+/*
+ * mmp_inproc_transport::receive
+ */
+_Success_(return == 0) int mmp_inproc_transport::receive(
+        _Out_writes_bytes_(size) char *buffer,
+        _Inout_ DWORD& size,
+        _Out_ sockaddr_storage& peer) noexcept {
+    visus::mmp::inproc::datagram datagram;
+
+    try {
+        if (!this->_endpoint->receive(datagram,
+                (std::chrono::microseconds::max)())) {
+            RETURN_WIN32(ERROR_OPERATION_ABORTED);
+        }
+    } catch (...) {
+        RETURN_WIN32(ERROR_OUTOFMEMORY);
+    }
+
+    // Like a socket, the transport truncates datagrams that do not fit.
+    size = (std::min)(size, static_cast<DWORD>(datagram.data.size()));
+    std::memcpy(buffer, datagram.data.data(), size);
+    peer = datagram.peer;
+    return 0;
+}
+
+
+/*
+ * mmp_inproc_transport::send
+ */
+_Success_(return == 0) int mmp_inproc_transport::send(
+        _In_ const sockaddr_storage& peer,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const DWORD size) noexcept {
+    using visus::mmp::inproc::delivery;
+
+    try {
+        // A full queue loses the datagram like UDP would.
+        if (this->_endpoint->send(peer, data, size)
+                == delivery::unreachable) {
+            RETURN_WIN32(WSAECONNRESET);
+        }
+    } catch (...) {
+        RETURN_WIN32(ERROR_OUTOFMEMORY);
+    }
+
+    return 0;
+}
+
+
+/*
+ * mmp_inproc_transport::wait
+ */
+_Success_(return == 0) int mmp_inproc_transport::wait(
+        _In_ const std::chrono::microseconds timeout,
+        _Out_ bool& readable) noexcept {
+    try {
+        readable = this->_endpoint->wait(timeout);
+    } catch (...) {
+        readable = false;
+        RETURN_WIN32(ERROR_OUTOFMEMORY);
+    }
+
+    return 0;
+}
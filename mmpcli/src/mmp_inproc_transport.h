@@ -0,0 +1,53 @@
+﻿// <copyright file="mmp_inproc_transport.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <memory>
+
+#include "mmp_transport.h"
+#include "mmpinproc.h"
+
+
+/// <summary>
+/// The transport exchanging datagrams with a server in the same process
+/// through the memory queues of a <see cref="visus::mmp::inproc::network"/>.
+/// </summary>
+/// <remarks>
+/// This transport is meant for tests and benchmarks of the protocol, which
+/// should not depend on the network stack of the machine they run on.
+/// </remarks>
+class mmp_inproc_transport final : public mmp_transport {
+
+public:
+
+    /// <summary>
+    /// Initialises a new instance sending from and receiving at the given
+    /// <paramref name="endpoint"/>.
+    /// </summary>
+    explicit mmp_inproc_transport(
+        _In_ std::shared_ptr<visus::mmp::inproc::endpoint> endpoint) noexcept;
+
+    void close(void) noexcept override;
+
+    _Success_(return == 0) int receive(
+        _Out_writes_bytes_(size) char *buffer,
+        _Inout_ DWORD& size,
+        _Out_ sockaddr_storage& peer) noexcept override;
+
+    _Success_(return == 0) int send(
+        _In_ const sockaddr_storage& peer,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const DWORD size) noexcept override;
+
+    _Success_(return == 0) int wait(
+        _In_ const std::chrono::microseconds timeout,
+        _Out_ bool& readable) noexcept override;
+
+private:
+
+    std::shared_ptr<visus::mmp::inproc::endpoint> _endpoint;
+};
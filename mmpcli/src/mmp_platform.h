@@ -0,0 +1,327 @@
+﻿// <copyright file="mmp_platform.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#if defined(_WIN32)
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <Windows.h>
+
+#include <wil/resource.h>
+#include <wil/result.h>
+
+#else /* defined(_WIN32) */
+#include <cerrno>
+#include <cinttypes>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <system_error>
+#include <utility>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "mmpapi.h"
+
+
+/*
+ * On POSIX systems, the library reports errno values wherever Windows would
+ * report a Win32 error code. The codes are wrapped into HRESULTs the same way
+ * as on Windows, so callers can test the results of the API the same way on
+ * all platforms.
+ */
+
+typedef int BOOL;
+typedef std::uint8_t BYTE;
+typedef std::uint32_t DWORD;
+typedef int SOCKET;
+
+#define FALSE (0)
+#define INFINITE (0xFFFFFFFF)
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define TRUE (1)
+
+#define ERROR_SUCCESS (0)
+#define ERROR_CANCELLED ECANCELED
+#define ERROR_INVALID_OPERATION EPERM
+#define ERROR_INVALID_PARAMETER EINVAL
+#define ERROR_IO_PENDING EINPROGRESS
+#define ERROR_NETWORK_UNREACHABLE ENETUNREACH
+#define ERROR_NOT_READY ENODATA
+#define ERROR_NOT_SUPPORTED ENOTSUP
+#define ERROR_OPERATION_ABORTED ECONNABORTED
+#define ERROR_OUTOFMEMORY ENOMEM
+#define ERROR_REVISION_MISMATCH EPROTO
+#define ERROR_TIMEOUT ETIMEDOUT
+#define ERROR_TOO_MANY_OPEN_FILES EMFILE
+
+#define WSAEAFNOSUPPORT EAFNOSUPPORT
+#define WSAECONNRESET ECONNRESET
+#define WSAEMSGSIZE EMSGSIZE
+#define WSAEWOULDBLOCK EWOULDBLOCK
+
+#define WSA_FLAG_OVERLAPPED (0)
+
+#define HRESULT_FROM_WIN32(e) (static_cast<int>(e) <= 0                        \
+    ? static_cast<int>(e)                                                      \
+    : static_cast<int>((static_cast<unsigned int>(e) & 0x0000FFFF)             \
+        | 0x80070000))
+#define FAILED(hr) (static_cast<int>(hr) < 0)
+#define SUCCEEDED(hr) (static_cast<int>(hr) >= 0)
+
+
+/*
+ * The subset of the error handling macros of the Windows Implementation
+ * Library that the client library uses. The "last error" is errno.
+ */
+
+#define RETURN_HR(hr) return (hr)
+#define RETURN_IF_FAILED(hr) do {                                              \
+    const auto _hr = static_cast<int>(hr);                                     \
+    if (FAILED(_hr)) { return _hr; }                                           \
+} while (false)
+#define RETURN_IF_NULL_ALLOC(p) do {                                           \
+    if ((p) == nullptr) { return HRESULT_FROM_WIN32(ENOMEM); }                 \
+} while (false)
+#define RETURN_IF_WIN32_ERROR(e) do {                                          \
+    const auto _e = static_cast<int>(e);                                       \
+    if (_e != 0) { return HRESULT_FROM_WIN32(_e); }                            \
+} while (false)
+#define RETURN_LAST_ERROR() return HRESULT_FROM_WIN32(::mmp_last_error())
+#define RETURN_LAST_ERROR_IF(c) do {                                           \
+    if (c) { RETURN_LAST_ERROR(); }                                            \
+} while (false)
+#define RETURN_WIN32(e) return HRESULT_FROM_WIN32(e)
+
+#define THROW_IF_WIN32_ERROR(e) do {                                           \
+    const auto _e = static_cast<int>(e);                                       \
+    if (_e != 0) { throw wil::ResultException(_e); }                           \
+} while (false)
+#define THROW_LAST_ERROR_IF(c) do {                                            \
+    if (c) {                                                                   \
+        throw wil::ResultException(::mmp_last_error());                        \
+    }                                                                          \
+} while (false)
+#define THROW_WIN32_IF(e, c) do {                                              \
+    if (c) { throw wil::ResultException(e); }                                  \
+} while (false)
+
+
+/// <summary>
+/// Answer errno, or <c>EIO</c> if a call failed without setting it.
+/// </summary>
+inline int mmp_last_error(void) noexcept {
+    return (errno != 0) ? errno : EIO;
+}
+
+inline int closesocket(_In_ const SOCKET socket) noexcept {
+    return ::close(socket);
+}
+
+inline DWORD GetCurrentThreadId(void) noexcept {
+    return static_cast<DWORD>(::pthread_self());
+}
+
+inline int GetLastError(void) noexcept {
+    return ::mmp_last_error();
+}
+
+inline const wchar_t *InetNtopW(_In_ const int family,
+        _In_ const void *address, _Out_ wchar_t *dst,
+        _In_ const std::size_t size) noexcept {
+    char buffer[INET6_ADDRSTRLEN];
+    if (::inet_ntop(family, address, buffer, sizeof(buffer)) == nullptr) {
+        return nullptr;
+    }
+
+    // The textual representation of addresses is ASCII only.
+    std::size_t i = 0;
+    for (; (i + 1 < size) && (buffer[i] != 0); ++i) {
+        dst[i] = static_cast<wchar_t>(buffer[i]);
+    }
+    if (i < size) {
+        dst[i] = 0;
+    }
+
+    return dst;
+}
+
+inline int ioctlsocket(_In_ const SOCKET socket, _In_ const long command,
+        _Inout_ unsigned long *argument) noexcept {
+    int value = static_cast<int>(*argument);
+    const auto retval = ::ioctl(socket, command, &value);
+    *argument = static_cast<unsigned long>(value);
+    return retval;
+}
+
+inline void SetLastError(_In_ const int error) noexcept {
+    errno = error;
+}
+
+inline int WSAGetLastError(void) noexcept {
+    return ::mmp_last_error();
+}
+
+inline SOCKET WSASocket(_In_ const int family, _In_ const int type,
+        _In_ const int protocol, _In_opt_ void *, _In_ const unsigned int,
+        _In_ const DWORD) noexcept {
+    return ::socket(family, type | SOCK_CLOEXEC, protocol);
+}
+
+
+namespace wil {
+
+    /// <summary>
+    /// The exception thrown by the <c>THROW_*</c> macros.
+    /// </summary>
+    class ResultException final : public std::system_error {
+
+    public:
+
+        inline explicit ResultException(_In_ const int error)
+            : std::system_error(error, std::system_category()) { }
+
+        inline int GetErrorCode(void) const noexcept {
+            return HRESULT_FROM_WIN32(this->code().value());
+        }
+    };
+
+    /// <summary>
+    /// Owns a socket, which is closed when the instance is destroyed.
+    /// </summary>
+    class unique_socket final {
+
+    public:
+
+        inline explicit unique_socket(
+            _In_ const SOCKET socket = INVALID_SOCKET) noexcept
+            : _socket(socket) { }
+
+        unique_socket(const unique_socket&) = delete;
+
+        inline unique_socket(_Inout_ unique_socket&& rhs) noexcept
+            : _socket(rhs.release()) { }
+
+        inline ~unique_socket(void) noexcept {
+            this->reset();
+        }
+
+        inline SOCKET get(void) const noexcept {
+            return this->_socket;
+        }
+
+        inline SOCKET release(void) noexcept {
+            const auto retval = this->_socket;
+            this->_socket = INVALID_SOCKET;
+            return retval;
+        }
+
+        inline void reset(_In_ const SOCKET socket = INVALID_SOCKET) noexcept {
+            if (this->_socket != INVALID_SOCKET) {
+                ::closesocket(this->_socket);
+            }
+            this->_socket = socket;
+        }
+
+        unique_socket& operator =(const unique_socket&) = delete;
+
+        inline unique_socket& operator =(
+                _Inout_ unique_socket&& rhs) noexcept {
+            if (this != std::addressof(rhs)) {
+                this->reset(rhs.release());
+            }
+            return *this;
+        }
+
+        inline explicit operator bool(void) const noexcept {
+            return (this->_socket != INVALID_SOCKET);
+        }
+
+    private:
+
+        SOCKET _socket;
+    };
+
+
+    /// <summary>
+    /// Invokes a functor when the instance goes out of scope unless it has
+    /// been dismissed.
+    /// </summary>
+    template<class TFunctor> class scope_exit_type final {
+
+    public:
+
+        inline explicit scope_exit_type(_In_ TFunctor&& functor) noexcept
+            : _active(true), _functor(std::move(functor)) { }
+
+        scope_exit_type(const scope_exit_type&) = delete;
+
+        inline scope_exit_type(_Inout_ scope_exit_type&& rhs) noexcept
+                : _active(rhs._active), _functor(std::move(rhs._functor)) {
+            rhs._active = false;
+        }
+
+        inline ~scope_exit_type(void) noexcept {
+            this->reset();
+        }
+
+        inline void release(void) noexcept {
+            this->_active = false;
+        }
+
+        inline void reset(void) noexcept {
+            if (this->_active) {
+                this->_active = false;
+                this->_functor();
+            }
+        }
+
+        scope_exit_type& operator =(const scope_exit_type&) = delete;
+
+    private:
+
+        bool _active;
+        TFunctor _functor;
+    };
+
+    /// <summary>
+    /// Creates a guard that invokes <paramref name="functor"/> when it goes
+    /// out of scope.
+    /// </summary>
+    template<class TFunctor>
+    inline scope_exit_type<TFunctor> scope_exit(
+            _In_ TFunctor&& functor) noexcept {
+        return scope_exit_type<TFunctor>(std::forward<TFunctor>(functor));
+    }
+
+    /// <summary>
+    /// Converts the exception being handled into an HRESULT.
+    /// </summary>
+    inline int ResultFromCaughtException(void) noexcept {
+        try {
+            throw;
+        } catch (const std::system_error& ex) {
+            return HRESULT_FROM_WIN32(ex.code().value());
+        } catch (const std::bad_alloc&) {
+            return HRESULT_FROM_WIN32(ENOMEM);
+        } catch (...) {
+            return HRESULT_FROM_WIN32(EIO);
+        }
+    }
+
+} /* namespace wil */
+
+#endif /* defined(_WIN32) */
@@ -0,0 +1,405 @@
+﻿// <copyright file="mmp_relay.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "mmp_relay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+
+#include "mmpthreadname.h"
+#include "mmptrace.h"
+
+
+/*
+ * mmp_relay::capabilities
+ */
+constexpr mmp_capabilities mmp_relay::capabilities;
+
+
+/*
+ * mmp_relay::mmp_relay
+ */
+mmp_relay::mmp_relay(_In_ const mmp_configuration& upstream,
+        _In_ const sockaddr_storage& downstream)
+    : _downstream(downstream),
+    _latency_max(0),
+    _latency_mean(0),
+    _probation((clock::time_point::max)()),
+    _probation_period(std::chrono::milliseconds(
+        (upstream.heartbeat_timeout > 0) ? upstream.heartbeat_timeout : 3000)),
+    _running(false),
+    _upstream(upstream)
+#if defined(_WIN32)
+    , _wsa_data({ 0 })
+#endif /* defined(_WIN32) */
+    {
+    auto& port = (this->_downstream.ss_family == AF_INET6)
+        ? reinterpret_cast<sockaddr_in6&>(this->_downstream).sin6_port
+        : reinterpret_cast<sockaddr_in&>(this->_downstream).sin_port;
+    if (port == 0) {
+        port = ::htons(mmp_default_port);
+    }
+
+    this->_upstream.forward([this](const char *data, const DWORD size) {
+        this->forward(data, size);
+    }, capabilities);
+}
+
+
+/*
+ * mmp_relay::~mmp_relay
+ */
+mmp_relay::~mmp_relay(void) noexcept {
+    MMP_TRACE(L"Stopping relay server thread.");
+    this->_running.store(false, std::memory_order_release);
+#if !defined(_WIN32)
+    // Closing the socket does not wake the server thread if it is blocked in
+    // recvfrom, but shutting it down does. The kernel wakes the readers even
+    // though it reports that an unconnected socket is not connected.
+    if (this->_socket) {
+        ::shutdown(this->_socket.get(), SHUT_RDWR);
+    }
+#endif /* !defined(_WIN32) */
+    this->_socket.reset();
+
+    if (this->_server.joinable()) {
+        this->_server.join();
+    }
+
+    // Note: the upstream client is destroyed before anything the forwarding
+    // callback uses, because it is declared after all of it.
+#if defined(_WIN32)
+    MMP_TRACE(L"Cleaning up Winsock.");
+    ::WSACleanup();
+#endif /* defined(_WIN32) */
+}
+
+
+/*
+ * mmp_relay::latency
+ */
+void mmp_relay::latency(_Out_ std::uint32_t& mean,
+        _Out_ std::uint32_t& max) const noexcept {
+    mean = this->_latency_mean.load(std::memory_order_acquire);
+    max = this->_latency_max.load(std::memory_order_acquire);
+}
+
+
+/*
+ * mmp_relay::start
+ */
+_Success_(return == 0) int mmp_relay::start(void) noexcept {
+    // The downstream socket must exist before the upstream client forwards
+    // anything, but it must not answer requests before we know the state of
+    // the server.
+    MMP_TRACE(L"Creating downstream socket of family %d.",
+        this->_downstream.ss_family);
+    this->_socket.reset(::WSASocket(this->_downstream.ss_family,
+        SOCK_DGRAM,
+        IPPROTO_UDP,
+        nullptr,
+        0,
+        WSA_FLAG_OVERLAPPED));
+    RETURN_LAST_ERROR_IF(!this->_socket);
+
+    {
+        const auto len = (this->_downstream.ss_family == AF_INET6)
+            ? sizeof(sockaddr_in6)
+            : sizeof(sockaddr_in);
+        if (::bind(this->_socket.get(),
+                reinterpret_cast<const sockaddr *>(&this->_downstream),
+                static_cast<int>(len)) == SOCKET_ERROR) {
+            const auto retval = ::WSAGetLastError();
+            MMP_TRACE(L"Binding the downstream socket failed with error %d.",
+                retval);
+            RETURN_WIN32(retval);
+        }
+    }
+
+#if defined(_WIN32)
+    // The relay initialises Winsock on behalf of the upstream client, which
+    // releases it in its destructor.
+    RETURN_IF_WIN32_ERROR(::WSAStartup(MAKEWORD(2, 2), this->_upstream));
+#endif /* defined(_WIN32) */
+    RETURN_IF_WIN32_ERROR(this->_upstream.discover());
+    RETURN_IF_WIN32_ERROR(this->_upstream.start());
+
+    MMP_TRACE(L"Starting relay server thread.");
+    this->_running.store(true, std::memory_order_release);
+    try {
+        this->_server = std::thread(&mmp_relay::serve, this);
+    } catch (const std::system_error& ex) {
+        MMP_TRACE(L"Failed to start the relay server thread: %hs",
+            ex.what());
+        this->_running.store(false, std::memory_order_release);
+        RETURN_WIN32(ex.code().value());
+    }
+
+    return 0;
+}
+
+
+/*
+ * mmp_relay::announcement
+ */
+mmp_msg_announce mmp_relay::announcement(
+        _In_ const std::uint32_t token) const noexcept {
+    mmp_msg_announce retval;
+    retval.sequence_number = this->_state.sequence_number;
+    retval.capabilities = ::htonl(capabilities);
+    retval.load = ::htonl(static_cast<std::uint32_t>(this->_clients.size()));
+    retval.token = ::htonl(token);
+    retval.epoch = this->_state.epoch;
+    return retval;
+}
+
+
+/*
+ * mmp_relay::expire
+ */
+void mmp_relay::expire(void) noexcept {
+    const auto session = this->_session;
+    const auto it = std::remove_if(this->_clients.begin(),
+        this->_clients.end(),
+        [session](const client& c) { return (c.connected < session); });
+    MMP_TRACE(L"Removing %u clients that have not connected to the new "
+        L"session.", static_cast<unsigned int>(this->_clients.end() - it));
+    this->_clients.erase(it, this->_clients.end());
+    this->_probation = (clock::time_point::max)();
+}
+
+
+/*
+ * mmp_relay::forward
+ */
+void mmp_relay::forward(_In_reads_bytes_(size) const char *data,
+        _In_ const DWORD size) {
+    using namespace std::chrono;
+    const auto begin = steady_clock::now();
+
+    std::lock_guard<std::mutex> l(this->_lock);
+    const auto epoch = this->_state.epoch;
+    const auto status = forward_table::dispatch(data, size,
+        [this](const auto& msg) { this->update_state(msg); });
+    if (status != visus::mmp::wire::dispatch_status::handled) {
+        // Anything else, e.g. the answers to the clock probes of the upstream
+        // client, is meant for the relay only.
+        return;
+    }
+
+    // The clients connect again once the datagram announcing a new session
+    // reaches them. Those that do not are considered gone.
+    if ((epoch != 0) && (this->_state.epoch != epoch)) {
+        MMP_TRACE(L"The server has started a new session, so all clients "
+            L"must connect again.");
+        this->_session = begin;
+        this->_probation = begin + this->_probation_period;
+    } else if (begin >= this->_probation) {
+        this->expire();
+    }
+
+    // The datagram is forwarded byte for byte, so the clients see the
+    // sequence numbers and timestamps of the server.
+    for (auto it = this->_clients.begin(); it != this->_clients.end();) {
+        const auto len = (it->address.ss_family == AF_INET6)
+            ? sizeof(sockaddr_in6)
+            : sizeof(sockaddr_in);
+        if (::sendto(this->_socket.get(),
+                data, static_cast<int>(size),
+                0,
+                reinterpret_cast<const sockaddr *>(&it->address),
+                static_cast<int>(len)) == SOCKET_ERROR) {
+            // Like the server, we just remove all clients that have failed.
+            it = this->_clients.erase(it);
+            continue;
+        }
+
+        ++it;
+    }
+
+    // The mean is smoothed like the round-trip time in RFC 6298.
+    const auto elapsed = static_cast<std::uint32_t>((std::min)(
+        duration_cast<microseconds>(steady_clock::now() - begin).count(),
+        static_cast<microseconds::rep>(
+            (std::numeric_limits<std::uint32_t>::max)())));
+    const auto mean = this->_latency_mean.load(std::memory_order_relaxed);
+    this->_latency_mean.store((mean == 0)
+        ? elapsed
+        : mean - mean / 8 + elapsed / 8,
+        std::memory_order_release);
+    if (elapsed > this->_latency_max.load(std::memory_order_relaxed)) {
+        this->_latency_max.store(elapsed, std::memory_order_release);
+    }
+}
+
+
+/*
+ * mmp_relay::serve
+ */
+void mmp_relay::serve(void) {
+    ::mmp_set_thread_name(-1, "Magic mouse pad relay");
+
+    constexpr int cnt_buffer = (std::numeric_limits<std::uint16_t>::max)();
+    std::vector<char> buffer(cnt_buffer);
+
+    MMP_TRACE(L"Entering the relay loop.");
+    while (this->_running.load(std::memory_order_acquire)) {
+        // recvfrom leaves everything beyond the address it writes as it is,
+        // which must not be garbage from a previous datagram.
+        sockaddr_storage peer { };
+        auto cnt_peer = static_cast<socklen_t>(sizeof(peer));
+
+        const auto cnt = ::recvfrom(this->_socket.get(),
+            buffer.data(),
+            static_cast<int>(buffer.size()),
+            0,
+            reinterpret_cast<sockaddr *>(&peer),
+            &cnt_peer);
+        if (cnt == SOCKET_ERROR) {
+            MMP_TRACE(L"Receiving a request failed with error %d.",
+                ::WSAGetLastError());
+            continue;
+        }
+        if (static_cast<std::size_t>(cnt) < sizeof(mmp_msg_id)) {
+            continue;
+        }
+
+        const auto id = ::ntohl(*reinterpret_cast<const mmp_msg_id *>(
+            buffer.data()));
+
+        switch (id) {
+            case mmp_msgid_discover: {
+                const view<mmp_msg_discover> msg(buffer.data(), cnt);
+                mmp_msg_announce response;
+                {
+                    std::lock_guard<std::mutex> l(this->_lock);
+                    response = this->announcement(msg.token());
+                }
+                MMP_TRACE(L"Responding to discovery request.");
+                ::sendto(this->_socket.get(),
+                    reinterpret_cast<const char *>(&response),
+                    sizeof(response),
+                    0,
+                    reinterpret_cast<const sockaddr *>(&peer),
+                    cnt_peer);
+                } break;
+
+            case mmp_msgid_connect: {
+                // The relay cannot translate the datagrams it forwards, so
+                // clients get whatever the relay negotiated with the server.
+                const view<mmp_msg_connect> msg(buffer.data(), cnt);
+                const auto now = clock::now();
+                std::lock_guard<std::mutex> l(this->_lock);
+                const auto it = std::find_if(this->_clients.begin(),
+                    this->_clients.end(),
+                    [&peer](const client& c) {
+                        return mmp_client::is_same(c.address, peer);
+                    });
+                if (it != this->_clients.end()) {
+                    it->connected = now;
+                } else {
+                    MMP_TRACE(L"Adding new client with protocol version %u "
+                        L"and capabilities 0x%x.", msg.version(),
+                        msg.capabilities());
+                    this->_clients.push_back(client { peer, now });
+                }
+
+                if ((msg.capabilities() & mmp_capability_state) != 0) {
+                    ::sendto(this->_socket.get(),
+                        reinterpret_cast<const char *>(&this->_state),
+                        sizeof(this->_state),
+                        0,
+                        reinterpret_cast<const sockaddr *>(&peer),
+                        cnt_peer);
+                }
+                } break;
+        }
+    }
+}
+
+
+/*
+ * mmp_relay::update_state
+ */
+void mmp_relay::update_state(
+        _In_ const view<mmp_msg_heartbeat>& msg) noexcept {
+    this->_state.sequence_number = ::htonl(msg.sequence_number());
+    this->_state.epoch = ::htonl(msg.epoch());
+}
+
+
+/*
+ * mmp_relay::update_state
+ */
+void mmp_relay::update_state(
+        _In_ const view<mmp_msg_mouse_button>& msg) noexcept {
+    auto buttons = ::ntohl(this->_state.buttons);
+    if (msg.down()) {
+        buttons |= msg.button();
+    } else {
+        buttons &= ~static_cast<std::uint32_t>(msg.button());
+    }
+
+    this->_state.sequence_number = ::htonl(msg.sequence_number());
+    this->_state.x = ::htonl(msg.x());
+    this->_state.y = ::htonl(msg.y());
+    this->_state.buttons = ::htonl(buttons);
+}
+
+
+/*
+ * mmp_relay::update_state
+ */
+void mmp_relay::update_state(
+        _In_ const view<mmp_msg_mouse_button_ts>& msg) noexcept {
+    auto buttons = ::ntohl(this->_state.buttons);
+    if (msg.down()) {
+        buttons |= msg.button();
+    } else {
+        buttons &= ~static_cast<std::uint32_t>(msg.button());
+    }
+
+    this->_state.sequence_number = ::htonl(msg.sequence_number());
+    this->_state.x = ::htonl(msg.x());
+    this->_state.y = ::htonl(msg.y());
+    this->_state.buttons = ::htonl(buttons);
+}
+
+
+/*
+ * mmp_relay::update_state
+ */
+void mmp_relay::update_state(
+        _In_ const view<mmp_msg_mouse_move>& msg) noexcept {
+    this->_state.sequence_number = ::htonl(msg.sequence_number());
+    this->_state.x = ::htonl(msg.x());
+    this->_state.y = ::htonl(msg.y());
+}
+
+
+/*
+ * mmp_relay::update_state
+ */
+void mmp_relay::update_state(
+        _In_ const view<mmp_msg_mouse_move_ts>& msg) noexcept {
+    this->_state.sequence_number = ::htonl(msg.sequence_number());
+    this->_state.x = ::htonl(msg.x());
+    this->_state.y = ::htonl(msg.y());
+}
+
+
+/*
+ * mmp_relay::update_state
+ */
+void mmp_relay::update_state(_In_ const view<mmp_msg_state>& msg) noexcept {
+    this->_state.sequence_number = ::htonl(msg.sequence_number());
+    this->_state.x = ::htonl(msg.x());
+    this->_state.y = ::htonl(msg.y());
+    this->_state.buttons = ::htonl(msg.buttons());
+    this->_state.epoch = ::htonl(msg.epoch());
+}
@@ -0,0 +1,224 @@
+﻿// <copyright file="mmp_relay.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include "mmpcli.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mmp_client.h"
+#include "mmp_platform.h"
+#include "mmpmsg.h"
+#include "mmpwire.h"
+
+
+/// <summary>
+/// A relay subscribes to a magic mouse pad like an ordinary client and
+/// forwards the datagrams it receives unchanged to its own clients, which
+/// makes it a local fan-out point for a subnet.
+/// </summary>
+/// <remarks>
+/// <para>The relay answers discovery and connect requests on its downstream
+/// address like the server does. It only requests the capabilities whose
+/// messages it can forward as they are, i.e. the timestamped mouse messages,
+/// state snapshots and heartbeats. As it does not negotiate acknowledgements,
+/// button events lost on either hop are not retransmitted.</para>
+/// <para>The upstream server must be configured explicitly, because the
+/// relay would answer its own discovery requests otherwise.</para>
+/// <para>Sending to a client that has gone rarely fails, so the relay learns
+/// about departed clients only once the server starts a new session. Like
+/// the server does with the clients it restored, the relay drops every
+/// client that has not connected again within the heartbeat timeout of the
+/// upstream configuration after the first datagram of the new session.
+/// </para>
+/// </remarks>
+struct mmp_relay final {
+
+public:
+
+    /// <summary>
+    /// The capabilities the relay requests from the server and offers to its
+    /// clients.
+    /// </summary>
+    static constexpr mmp_capabilities capabilities = mmp_capability_timestamp
+        | mmp_capability_state
+        | mmp_capability_heartbeat;
+
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    /// <param name="upstream">The configuration for subscribing to the
+    /// server.</param>
+    /// <param name="downstream">The address the relay serves its clients on.
+    /// If the port is zero, <see cref="mmp_default_port"/> is used.</param>
+    mmp_relay(_In_ const mmp_configuration& upstream,
+        _In_ const sockaddr_storage& downstream);
+
+    /// <summary>
+    /// Finalises the instance.
+    /// </summary>
+    ~mmp_relay(void) noexcept;
+
+    /// <summary>
+    /// Answer the latency the relay adds to every datagram, which is the time
+    /// from receiving it until it has been sent to all clients.
+    /// </summary>
+    /// <param name="mean">Receives the smoothed mean latency in
+    /// microseconds.</param>
+    /// <param name="max">Receives the maximum latency in microseconds.
+    /// </param>
+    void latency(_Out_ std::uint32_t& mean,
+        _Out_ std::uint32_t& max) const noexcept;
+
+    /// <summary>
+    /// Subscribes to the server and starts serving clients.
+    /// </summary>
+    /// <returns>Zero in case of success, a system error code otherwise.
+    /// </returns>
+    _Success_(return == 0) int start(void) noexcept;
+
+#if defined(_WIN32)
+    /// <summary>
+    /// Answer the Winsock initialisation data used by the relay. The caller
+    /// must initialise Winsock using this structure before starting the
+    /// relay.
+    /// </summary>
+    _Ret_valid_ operator WSADATA *(void) noexcept {
+        return std::addressof(this->_wsa_data);
+    }
+#endif /* defined(_WIN32) */
+
+private:
+
+    /// <summary>
+    /// The clock used for tracking when clients have connected.
+    /// </summary>
+    typedef std::chrono::steady_clock clock;
+
+    /// <summary>
+    /// A client of the relay.
+    /// </summary>
+    struct client {
+        sockaddr_storage address;
+        clock::time_point connected;
+    };
+
+    /// <summary>
+    /// The zero-copy view on a received message.
+    /// </summary>
+    template<class TMessage> using view = visus::mmp::wire::view<TMessage>;
+
+    /// <summary>
+    /// The messages the relay forwards to its clients.
+    /// </summary>
+    typedef visus::mmp::wire::dispatch_table<mmp_msg_mouse_button,
+        mmp_msg_mouse_move,
+        mmp_msg_mouse_button_ts,
+        mmp_msg_mouse_move_ts,
+        mmp_msg_state,
+        mmp_msg_heartbeat> forward_table;
+
+    /// <summary>
+    /// Answer the announcement describing the relay.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    mmp_msg_announce announcement(
+        _In_ const std::uint32_t token) const noexcept;
+
+    /// <summary>
+    /// Removes all clients that have not connected since the server started
+    /// its current session.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void expire(void) noexcept;
+
+    /// <summary>
+    /// Sends the datagram received from the server to all clients if it is
+    /// one of the messages in <see cref="forward_table"/>.
+    /// </summary>
+    void forward(_In_reads_bytes_(size) const char *data,
+        _In_ const DWORD size);
+
+    /// <summary>
+    /// Answers discovery and connect requests on the downstream socket in a
+    /// separate thread.
+    /// </summary>
+    void serve(void);
+
+    /// <summary>
+    /// Records the message in the state snapshot sent to new clients.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void update_state(_In_ const view<mmp_msg_heartbeat>& msg) noexcept;
+
+    /// <summary>
+    /// Records the message in the state snapshot sent to new clients.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void update_state(_In_ const view<mmp_msg_mouse_button>& msg) noexcept;
+
+    /// <summary>
+    /// Records the message in the state snapshot sent to new clients.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void update_state(_In_ const view<mmp_msg_mouse_button_ts>& msg) noexcept;
+
+    /// <summary>
+    /// Records the message in the state snapshot sent to new clients.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void update_state(_In_ const view<mmp_msg_mouse_move>& msg) noexcept;
+
+    /// <summary>
+    /// Records the message in the state snapshot sent to new clients.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void update_state(_In_ const view<mmp_msg_mouse_move_ts>& msg) noexcept;
+
+    /// <summary>
+    /// Records the message in the state snapshot sent to new clients.
+    /// </summary>
+    /// <remarks>
+    /// The caller must hold <see cref="_lock"/>.
+    /// </remarks>
+    void update_state(_In_ const view<mmp_msg_state>& msg) noexcept;
+
+    std::vector<client> _clients;
+    sockaddr_storage _downstream;
+    std::atomic<std::uint32_t> _latency_max;
+    std::atomic<std::uint32_t> _latency_mean;
+    std::mutex _lock;
+    clock::time_point _probation;
+    const clock::duration _probation_period;
+    std::atomic<bool> _running;
+    std::thread _server;
+    clock::time_point _session;
+    wil::unique_socket _socket;
+    mmp_msg_state _state;
+    mmp_client _upstream;
+#if defined(_WIN32)
+    WSADATA _wsa_data;
+#endif /* defined(_WIN32) */
+};
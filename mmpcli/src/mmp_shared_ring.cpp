@@ -0,0 +1,243 @@
+﻿// <copyright file="mmp_shared_ring.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "mmp_shared_ring.h"
+
+#include <cassert>
+
+#if !defined(_WIN32)
+#include <signal.h>
+#endif /* !defined(_WIN32) */
+
+#include "mmptrace.h"
+
+
+/*
+ * mmp_shared_ring::mmp_shared_ring
+ */
+mmp_shared_ring::mmp_shared_ring(void) noexcept
+    : _index(visus::mmp::shm::max_subscribers) { }
+
+
+/*
+ * mmp_shared_ring::~mmp_shared_ring
+ */
+mmp_shared_ring::~mmp_shared_ring(void) noexcept {
+    if (this->_view && (this->_index < visus::mmp::shm::max_subscribers)) {
+        auto& s = this->_view->subscribers[this->_index];
+        s.waiting.store(0);
+        s.process.store(0, std::memory_order_release);
+    }
+}
+
+
+/*
+ * mmp_shared_ring::open
+ */
+_Success_(return == 0) int mmp_shared_ring::open(
+        _In_ const std::uint16_t port) noexcept {
+    using namespace visus::mmp;
+    assert(!this->_view);
+
+#if defined(_WIN32)
+    try {
+        const auto name = shm::mapping_name(port);
+        this->_mapping.reset(::OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE,
+            FALSE,
+            name.c_str()));
+        RETURN_LAST_ERROR_IF(!this->_mapping);
+    } catch (...) {
+        RETURN_WIN32(ERROR_OUTOFMEMORY);
+    }
+
+    this->_view.reset(static_cast<ring_type *>(::MapViewOfFile(
+        this->_mapping.get(),
+        FILE_MAP_READ | FILE_MAP_WRITE,
+        0,
+        0,
+        sizeof(ring_type))));
+    RETURN_LAST_ERROR_IF(!this->_view);
+
+    // The magic number is written last by the server, so the rest of the
+    // header is valid once we see it.
+    const auto magic = this->_view->magic;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if ((magic != shm::magic)
+            || (this->_view->version != shm::version)
+            || (this->_view->capacity != shm::capacity)
+            || (this->_view->max_datagram != shm::max_datagram)) {
+        MMP_TRACE(L"The shared memory of the magic mouse pad on port %u has "
+            L"an incompatible layout.", port);
+        this->_view.reset();
+        RETURN_WIN32(ERROR_REVISION_MISMATCH);
+    }
+
+    this->_index = this->claim();
+    if (this->_index >= shm::max_subscribers) {
+        MMP_TRACE(L"All %u subscribers of the shared memory of the magic "
+            L"mouse pad on port %u are in use.",
+            static_cast<unsigned int>(shm::max_subscribers), port);
+        this->_view.reset();
+        RETURN_WIN32(ERROR_TOO_MANY_OPEN_FILES);
+    }
+
+    // The server opens the event anew once the generation changes, so the
+    // event must exist before we increment it.
+    auto& s = this->_view->subscribers[this->_index];
+    try {
+        const auto name = shm::event_name(port, this->_index);
+        const auto status = this->_event.create(wil::EventOptions::None,
+            name.c_str());
+        if (FAILED(status)) {
+            s.process.store(0, std::memory_order_release);
+            this->_view.reset();
+            RETURN_HR(status);
+        }
+    } catch (...) {
+        s.process.store(0, std::memory_order_release);
+        this->_view.reset();
+        RETURN_WIN32(ERROR_OUTOFMEMORY);
+    }
+
+    s.waiting.store(0);
+    s.generation.fetch_add(1, std::memory_order_release);
+    MMP_TRACE(L"Reading events of the magic mouse pad on port %u from "
+        L"shared memory as subscriber %u.", port,
+        static_cast<unsigned int>(this->_index));
+
+    return 0;
+
+#else /* defined(_WIN32) */
+    (void) port;
+    MMP_TRACE(L"Shared memory of the magic mouse pad on port %u is not "
+        L"supported on this platform.", port);
+    RETURN_WIN32(ERROR_NOT_SUPPORTED);
+#endif /* defined(_WIN32) */
+}
+
+
+/*
+ * mmp_shared_ring::published
+ */
+std::uint64_t mmp_shared_ring::published(void) const noexcept {
+    assert(this->_view);
+    return this->_view->published.load(std::memory_order_acquire);
+}
+
+
+/*
+ * mmp_shared_ring::read
+ */
+visus::mmp::shm::read_status mmp_shared_ring::read(
+        _Inout_ std::uint64_t& cursor,
+        _Out_writes_bytes_(visus::mmp::shm::max_datagram) char *dst,
+        _Out_ std::size_t& size) const noexcept {
+    assert(this->_view);
+    return this->_view->read(cursor, dst, size);
+}
+
+
+/*
+ * mmp_shared_ring::state
+ */
+void mmp_shared_ring::state(_Out_ mmp_msg_state& state) const noexcept {
+    assert(this->_view);
+    this->_view->load_state(state);
+}
+
+
+/*
+ * mmp_shared_ring::wait
+ */
+bool mmp_shared_ring::wait(_In_ const std::uint64_t cursor,
+        _In_ const DWORD timeout) noexcept {
+    assert(this->_view);
+    auto& s = this->_view->subscribers[this->_index];
+
+    // Note: announcing that we are waiting must be sequentially consistent
+    // with the check for new events, because the server checks the flag
+    // after it has published the event, so either of us sees the other.
+    s.waiting.store(1);
+#if defined(_WIN32)
+    if (this->published() <= cursor) {
+        ::WaitForSingleObject(this->_event.get(), timeout);
+    }
+#else /* defined(_WIN32) */
+    (void) timeout;
+#endif /* defined(_WIN32) */
+    s.waiting.store(0);
+
+    return (this->published() > cursor);
+}
+
+
+/*
+ * mmp_shared_ring::wake
+ */
+void mmp_shared_ring::wake(void) noexcept {
+#if defined(_WIN32)
+    if (this->_event) {
+        this->_event.SetEvent();
+    }
+#endif /* defined(_WIN32) */
+}
+
+
+/*
+ * mmp_shared_ring::terminated
+ */
+bool mmp_shared_ring::terminated(_In_ const std::uint32_t process) noexcept {
+#if defined(_WIN32)
+    wil::unique_handle handle(::OpenProcess(SYNCHRONIZE, FALSE, process));
+    if (!handle) {
+        // If we are not allowed to open the process, it is still there.
+        return (::GetLastError() == ERROR_INVALID_PARAMETER);
+    }
+
+    return (::WaitForSingleObject(handle.get(), 0) == WAIT_OBJECT_0);
+
+#else /* defined(_WIN32) */
+    // If we are not allowed to signal the process, it is still there.
+    return ((::kill(static_cast<pid_t>(process), 0) == -1)
+        && (errno == ESRCH));
+#endif /* defined(_WIN32) */
+}
+
+
+/*
+ * mmp_shared_ring::claim
+ */
+std::size_t mmp_shared_ring::claim(void) noexcept {
+    using namespace visus::mmp;
+#if defined(_WIN32)
+    const auto process = static_cast<std::uint32_t>(::GetCurrentProcessId());
+#else /* defined(_WIN32) */
+    const auto process = static_cast<std::uint32_t>(::getpid());
+#endif /* defined(_WIN32) */
+
+    for (std::size_t i = 0; i < shm::max_subscribers; ++i) {
+        std::uint32_t expected = 0;
+        if (this->_view->subscribers[i].process.compare_exchange_strong(
+                expected, process)) {
+            return i;
+        }
+    }
+
+    // Clients that crashed did not release their entries, so we take over
+    // the first one whose owner has gone.
+    for (std::size_t i = 0; i < shm::max_subscribers; ++i) {
+        auto& s = this->_view->subscribers[i];
+        auto owner = s.process.load();
+        if ((owner != process) && terminated(owner)
+                && s.process.compare_exchange_strong(owner, process)) {
+            MMP_TRACE(L"Reclaiming subscriber %u from terminated process %u.",
+                static_cast<unsigned int>(i), owner);
+            return i;
+        }
+    }
+
+    return shm::max_subscribers;
+}
@@ -0,0 +1,129 @@
+﻿// <copyright file="mmp_shared_ring.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <memory>
+
+#include "mmp_platform.h"
+#include "mmpmsg.h"
+#include "mmpshm.h"
+
+
+/// <summary>
+/// The view of a client on the events a magic mouse pad on the same machine
+/// publishes in shared memory.
+/// </summary>
+/// <remarks>
+/// <para>The instance owns one of the subscriber entries of the ring while it
+/// is open. It is not thread-safe, except for <see cref="wake"/>, which can be
+/// called from any thread.</para>
+/// <para>Only the server publishes its events in shared memory, and the
+/// server only exists for Windows. Therefore, the ring cannot be opened on
+/// any other platform.</para>
+/// </remarks>
+class mmp_shared_ring final {
+
+public:
+
+    /// <summary>
+    /// Initialises a new instance that is not attached to any ring.
+    /// </summary>
+    mmp_shared_ring(void) noexcept;
+
+    mmp_shared_ring(const mmp_shared_ring&) = delete;
+
+    /// <summary>
+    /// Finalises the instance, which releases its subscriber entry.
+    /// </summary>
+    ~mmp_shared_ring(void) noexcept;
+
+    /// <summary>
+    /// Attaches to the ring of the server on the given
+    /// <paramref name="port"/>.
+    /// </summary>
+    /// <param name="port">The port of the server in host-byte order.</param>
+    /// <returns>Zero in case of success, a system error code if there is no
+    /// such server on this machine, if it uses a different layout or if all
+    /// subscriber entries are in use.</returns>
+    _Success_(return == 0) int open(_In_ const std::uint16_t port) noexcept;
+
+    /// <summary>
+    /// Answer the position after the last event published so far, which is
+    /// where a new reader starts.
+    /// </summary>
+    std::uint64_t published(void) const noexcept;
+
+    /// <summary>
+    /// Copies the next event after <paramref name="cursor"/> into
+    /// <paramref name="dst"/>.
+    /// </summary>
+    /// <param name="cursor">The cursor of the reader, which is advanced.
+    /// </param>
+    /// <param name="dst">A buffer of at least
+    /// <see cref="visus::mmp::shm::max_datagram"/> bytes.</param>
+    /// <param name="size">Receives the size of the event.</param>
+    /// <returns>Whether an event was read and whether events were lost.
+    /// </returns>
+    visus::mmp::shm::read_status read(_Inout_ std::uint64_t& cursor,
+        _Out_writes_bytes_(visus::mmp::shm::max_datagram) char *dst,
+        _Out_ std::size_t& size) const noexcept;
+
+    /// <summary>
+    /// Retrieves the state the server would send to a new client.
+    /// </summary>
+    void state(_Out_ mmp_msg_state& state) const noexcept;
+
+    /// <summary>
+    /// Blocks until an event after <paramref name="cursor"/> is available,
+    /// the <paramref name="timeout"/> has passed or <see cref="wake"/> has
+    /// been called.
+    /// </summary>
+    /// <param name="cursor">The cursor of the reader.</param>
+    /// <param name="timeout">The timeout in milliseconds, which can be
+    /// <c>INFINITE</c>.</param>
+    /// <returns><see langword="true" /> if there is an event to read,
+    /// <see langword="false" /> otherwise.</returns>
+    bool wait(_In_ const std::uint64_t cursor,
+        _In_ const DWORD timeout) noexcept;
+
+    /// <summary>
+    /// Wakes a thread blocked in <see cref="wait"/>.
+    /// </summary>
+    void wake(void) noexcept;
+
+    mmp_shared_ring& operator =(const mmp_shared_ring&) = delete;
+
+private:
+
+    typedef visus::mmp::shm::ring ring_type;
+
+    /// <summary>
+    /// Answer whether the process with the given ID has terminated, in which
+    /// case its subscriber entry can be reused.
+    /// </summary>
+    static bool terminated(_In_ const std::uint32_t process) noexcept;
+
+    /// <summary>
+    /// Claims a free subscriber entry for the calling process.
+    /// </summary>
+    /// <returns>The index of the entry, or
+    /// <see cref="visus::mmp::shm::max_subscribers"/> if none is free.
+    /// </returns>
+    std::size_t claim(void) noexcept;
+
+#if defined(_WIN32)
+    wil::unique_event_nothrow _event;
+    std::size_t _index;
+    wil::unique_handle _mapping;
+    wil::unique_mapview_ptr<ring_type> _view;
+#else /* defined(_WIN32) */
+    std::size_t _index;
+    std::unique_ptr<ring_type> _view;
+#endif /* defined(_WIN32) */
+};
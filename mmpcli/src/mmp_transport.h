@@ -0,0 +1,108 @@
+﻿// <copyright file="mmp_transport.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include "mmp_platform.h"
+#include "mmpapi.h"
+
+
+/// <summary>
+/// The interface of the means by which a client exchanges datagrams with a
+/// magic mouse pad.
+/// </summary>
+/// <remarks>
+/// <para>The client uses exactly one transport for all unicast traffic,
+/// which is UDP unless another one has been injected before the client was
+/// started. Discovery always uses UDP, because it needs broadcasts and
+/// multicasts.</para>
+/// <para>Only <see cref="close"/> may be called concurrently with the other
+/// methods, namely in order to unblock a thread in <see cref="receive"/>.
+/// </para>
+/// </remarks>
+class mmp_transport {
+
+public:
+
+    /// <summary>
+    /// Finalises the instance.
+    /// </summary>
+    virtual ~mmp_transport(void) = default;
+
+    /// <summary>
+    /// Blocks until a datagram arrives and lends it to the caller.
+    /// </summary>
+    /// <remarks>
+    /// Transports that receive into memory of their own lend the datagram
+    /// in place, which saves copying it. The default implementation
+    /// receives into <paramref name="buffer"/>. In both cases, the datagram
+    /// remains valid until the next call to <see cref="borrow"/> or
+    /// <see cref="receive"/>.
+    /// </remarks>
+    /// <param name="buffer">The buffer the datagram is received into if the
+    /// transport cannot lend it.</param>
+    /// <param name="data">Receives a pointer to the datagram.</param>
+    /// <param name="size">Receives the size of the datagram.</param>
+    /// <param name="peer">Receives the address of the sender.</param>
+    /// <returns>Zero in case of success, a system error code otherwise.
+    /// </returns>
+    virtual _Success_(return == 0) int borrow(
+            _Inout_ std::vector<char>& buffer,
+            _Out_ const char *& data,
+            _Out_ DWORD& size,
+            _Out_ sockaddr_storage& peer) noexcept {
+        size = static_cast<DWORD>(buffer.size());
+        data = buffer.data();
+        return this->receive(buffer.data(), size, peer);
+    }
+
+    /// <summary>
+    /// Closes the transport, which makes any pending and future call to
+    /// <see cref="receive"/> fail.
+    /// </summary>
+    virtual void close(void) noexcept = 0;
+
+    /// <summary>
+    /// Blocks until a datagram arrives and copies it into
+    /// <paramref name="buffer"/>.
+    /// </summary>
+    /// <param name="buffer">The buffer receiving the datagram.</param>
+    /// <param name="size">The size of the buffer, which receives the size of
+    /// the datagram.</param>
+    /// <param name="peer">Receives the address of the sender.</param>
+    /// <returns>Zero in case of success, a system error code otherwise.
+    /// </returns>
+    virtual _Success_(return == 0) int receive(
+        _Out_writes_bytes_(size) char *buffer,
+        _Inout_ DWORD& size,
+        _Out_ sockaddr_storage& peer) noexcept = 0;
+
+    /// <summary>
+    /// Sends the given datagram to <paramref name="peer"/>.
+    /// </summary>
+    /// <returns>Zero in case of success, a system error code otherwise.
+    /// </returns>
+    virtual _Success_(return == 0) int send(
+        _In_ const sockaddr_storage& peer,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const DWORD size) noexcept = 0;
+
+    /// <summary>
+    /// Waits at most for <paramref name="timeout"/> until a datagram can be
+    /// received without blocking.
+    /// </summary>
+    /// <param name="timeout">The maximum time to wait.</param>
+    /// <param name="readable">Receives whether a datagram is available.
+    /// </param>
+    /// <returns>Zero in case of success, a system error code otherwise.
+    /// </returns>
+    virtual _Success_(return == 0) int wait(
+        _In_ const std::chrono::microseconds timeout,
+        _Out_ bool& readable) noexcept = 0;
+};
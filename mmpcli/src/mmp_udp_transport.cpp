@@ -0,0 +1,223 @@
+﻿// <copyright file="mmp_udp_transport.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "mmp_udp_transport.h"
+
+#include <algorithm>
+#include <climits>
+
+#if !defined(_WIN32)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif /* !defined(_WIN32) */
+
+#include "mmptrace.h"
+
+
+/*
+ * mmp_udp_transport::mmp_udp_transport
+ */
+mmp_udp_transport::mmp_udp_transport(
+        _In_ wil::unique_socket&& socket) noexcept
+#if defined(_WIN32)
+    : _socket(std::move(socket)) { }
+#else /* defined(_WIN32) */
+    : _epoll(-1), _socket(std::move(socket)), _wake(-1) { }
+#endif /* defined(_WIN32) */
+
+
+/*
+ * mmp_udp_transport::~mmp_udp_transport
+ */
+mmp_udp_transport::~mmp_udp_transport(void) noexcept {
+#if !defined(_WIN32)
+    if (this->_epoll != -1) {
+        ::close(this->_epoll);
+    }
+    if (this->_wake != -1) {
+        ::close(this->_wake);
+    }
+#endif /* !defined(_WIN32) */
+}
+
+
+/*
+ * mmp_udp_transport::close
+ */
+void mmp_udp_transport::close(void) noexcept {
+#if defined(_WIN32)
+    this->_socket.reset();
+#else /* defined(_WIN32) */
+    // The socket remains open until the instance is destroyed, because the
+    // receiver thread might still be using it.
+    if (this->_wake != -1) {
+        const std::uint64_t value = 1;
+        ::write(this->_wake, &value, sizeof(value));
+    }
+#endif /* defined(_WIN32) */
+}
+
+
+/*
+ * mmp_udp_transport::open
+ */
+_Success_(return == 0) int mmp_udp_transport::open(void) noexcept {
+#if !defined(_WIN32)
+    this->_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    RETURN_LAST_ERROR_IF(this->_epoll == -1);
+
+    this->_wake = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    RETURN_LAST_ERROR_IF(this->_wake == -1);
+
+    // The socket is level-triggered, because we only drain one datagram per
+    // call to receive. The eventfd is never reset, so every wait after the
+    // transport has been closed fails.
+    for (auto fd : { this->_socket.get(), this->_wake }) {
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        RETURN_LAST_ERROR_IF(::epoll_ctl(this->_epoll, EPOLL_CTL_ADD, fd,
+            &event) == -1);
+    }
+#endif /* !defined(_WIN32) */
+
+    return 0;
+}
+
+
+/*
+ * mmp_udp_transport::receive
+ */
+_Success_(return == 0) int mmp_udp_transport::receive(
+        _Out_writes_bytes_(size) char *buffer,
+        _Inout_ DWORD& size,
+        _Out_ sockaddr_storage& peer) noexcept {
+#if defined(_WIN32)
+    auto peer_len = static_cast<int>(sizeof(peer));
+    const auto len = ::recvfrom(this->_socket.get(),
+        buffer,
+        static_cast<int>(size),
+        0,
+        reinterpret_cast<sockaddr *>(&peer),
+        &peer_len);
+    if (len == SOCKET_ERROR) {
+        const auto error = ::WSAGetLastError();
+        MMP_TRACE(L"Receiving a datagram failed with error %d.", error);
+        RETURN_WIN32(error);
+    }
+
+#else /* defined(_WIN32) */
+    // Under load, the next datagram is usually there already, so we try to
+    // receive it first and only block in epoll if the socket has run dry.
+    // This way, the common case costs a single system call.
+    ssize_t len = 0;
+    while (true) {
+        auto peer_len = static_cast<socklen_t>(sizeof(peer));
+        len = ::recvfrom(this->_socket.get(),
+            buffer,
+            size,
+            MSG_DONTWAIT,
+            reinterpret_cast<sockaddr *>(&peer),
+            &peer_len);
+        if (len != SOCKET_ERROR) {
+            break;
+        }
+
+        const auto error = errno;
+        if ((error != EAGAIN) && (error != EWOULDBLOCK) && (error != EINTR)) {
+            MMP_TRACE(L"Receiving a datagram failed with error %d.", error);
+            RETURN_WIN32(error);
+        }
+
+        auto readable = false;
+        RETURN_IF_WIN32_ERROR(this->poll(-1, readable));
+    }
+#endif /* defined(_WIN32) */
+
+    size = static_cast<DWORD>(len);
+    return 0;
+}
+
+
+/*
+ * mmp_udp_transport::send
+ */
+_Success_(return == 0) int mmp_udp_transport::send(
+        _In_ const sockaddr_storage& peer,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const DWORD size) noexcept {
+    if (::sendto(this->_socket.get(),
+            data,
+            static_cast<int>(size),
+            0,
+            reinterpret_cast<const sockaddr *>(&peer),
+            static_cast<int>(sizeof(sockaddr_storage)))
+            == SOCKET_ERROR) {
+        RETURN_WIN32(::WSAGetLastError());
+    }
+
+    return 0;
+}
+
+
+/*
+ * mmp_udp_transport::wait
+ */
+_Success_(return == 0) int mmp_udp_transport::wait(
+        _In_ const std::chrono::microseconds timeout,
+        _Out_ bool& readable) noexcept {
+#if defined(_WIN32)
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(this->_socket.get(), &fds);
+
+    timeval t;
+    t.tv_sec = static_cast<long>(timeout.count() / 1000000);
+    t.tv_usec = static_cast<long>(timeout.count() % 1000000);
+
+    const auto status = ::select(0, &fds, nullptr, nullptr, &t);
+    readable = (status > 0);
+    RETURN_LAST_ERROR_IF(status == SOCKET_ERROR);
+
+    return 0;
+
+#else /* defined(_WIN32) */
+    // epoll only has a resolution of milliseconds, so we round up such that
+    // we do not spin while the deadline is less than a millisecond away.
+    const auto t = (std::min)((timeout.count() + 999) / 1000,
+        static_cast<decltype(timeout.count())>(INT_MAX));
+    return this->poll(static_cast<int>(t), readable);
+#endif /* defined(_WIN32) */
+}
+
+
+#if !defined(_WIN32)
+/*
+ * mmp_udp_transport::poll
+ */
+_Success_(return == 0) int mmp_udp_transport::poll(_In_ const int timeout,
+        _Out_ bool& readable) noexcept {
+    epoll_event events[2];
+    readable = false;
+
+    const auto cnt = ::epoll_wait(this->_epoll, events, 2, timeout);
+    if (cnt == -1) {
+        // A signal is treated like a timeout, which the caller handles anyway.
+        RETURN_LAST_ERROR_IF(errno != EINTR);
+        return 0;
+    }
+
+    for (int i = 0; i < cnt; ++i) {
+        if (events[i].data.fd == this->_wake) {
+            RETURN_WIN32(ERROR_OPERATION_ABORTED);
+        }
+
+        readable = true;
+    }
+
+    return 0;
+}
+#endif /* !defined(_WIN32) */
@@ -0,0 +1,90 @@
+﻿// <copyright file="mmp_udp_transport.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#include "mmp_platform.h"
+#include "mmp_transport.h"
+
+
+/// <summary>
+/// The transport exchanging datagrams with the server via a UDP socket.
+/// </summary>
+/// <remarks>
+/// On Linux, the transport waits for datagrams using epoll. The epoll
+/// instance also watches an eventfd that is signalled by
+/// <see cref="close"/>, because closing a socket does not wake a thread that
+/// is blocked on it there.
+/// </remarks>
+class mmp_udp_transport final : public mmp_transport {
+
+public:
+
+    /// <summary>
+    /// Initialises a new instance taking ownership of the given bound
+    /// <paramref name="socket"/>.
+    /// </summary>
+    /// <remarks>
+    /// The instance must be opened before it can be used.
+    /// </remarks>
+    explicit mmp_udp_transport(_In_ wil::unique_socket&& socket) noexcept;
+
+    mmp_udp_transport(const mmp_udp_transport&) = delete;
+
+    /// <summary>
+    /// Finalises the instance, which closes the socket.
+    /// </summary>
+    ~mmp_udp_transport(void) noexcept;
+
+    void close(void) noexcept override;
+
+    /// <summary>
+    /// Allocates the resources the transport needs to wait for datagrams.
+    /// </summary>
+    /// <returns>Zero in case of success, a system error code otherwise.
+    /// </returns>
+    _Success_(return == 0) int open(void) noexcept;
+
+    _Success_(return == 0) int receive(
+        _Out_writes_bytes_(size) char *buffer,
+        _Inout_ DWORD& size,
+        _Out_ sockaddr_storage& peer) noexcept override;
+
+    _Success_(return == 0) int send(
+        _In_ const sockaddr_storage& peer,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const DWORD size) noexcept override;
+
+    _Success_(return == 0) int wait(
+        _In_ const std::chrono::microseconds timeout,
+        _Out_ bool& readable) noexcept override;
+
+    mmp_udp_transport& operator =(const mmp_udp_transport&) = delete;
+
+private:
+
+#if !defined(_WIN32)
+    /// <summary>
+    /// Waits for at most <paramref name="timeout"/> milliseconds until the
+    /// socket becomes readable.
+    /// </summary>
+    /// <param name="timeout">The timeout in milliseconds, or -1 to wait
+    /// forever.</param>
+    /// <param name="readable">Receives whether a datagram can be received
+    /// without blocking.</param>
+    /// <returns>Zero in case of success, the code for
+    /// <c>ERROR_OPERATION_ABORTED</c> if the transport has been closed, or
+    /// another system error code.</returns>
+    _Success_(return == 0) int poll(_In_ const int timeout,
+        _Out_ bool& readable) noexcept;
+
+    int _epoll;
+#endif /* !defined(_WIN32) */
+    wil::unique_socket _socket;
+#if !defined(_WIN32)
+    int _wake;
+#endif /* !defined(_WIN32) */
+};
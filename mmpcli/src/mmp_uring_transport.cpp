@@ -0,0 +1,592 @@
+﻿// <copyright file="mmp_uring_transport.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include "mmp_uring_transport.h"
+
+#if defined(MMP_IO_URING)
+#include <algorithm>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "mmptrace.h"
+
+
+/*
+ * mmp_uring_transport::buffer_size
+ */
+constexpr std::uint32_t mmp_uring_transport::buffer_size;
+
+
+/*
+ * mmp_uring_transport::buffers
+ */
+constexpr std::uint32_t mmp_uring_transport::buffers;
+
+
+/*
+ * mmp_uring_transport::tag_cancel
+ */
+constexpr std::uint64_t mmp_uring_transport::tag_cancel;
+
+
+/*
+ * mmp_uring_transport::tag_mask
+ */
+constexpr std::uint64_t mmp_uring_transport::tag_mask;
+
+
+/*
+ * mmp_uring_transport::tag_receive
+ */
+constexpr std::uint64_t mmp_uring_transport::tag_receive;
+
+
+/*
+ * mmp_uring_transport::tag_wake
+ */
+constexpr std::uint64_t mmp_uring_transport::tag_wake;
+
+
+/*
+ * mmp_uring_transport::mmp_uring_transport
+ */
+mmp_uring_transport::mmp_uring_transport(void) noexcept
+    : _armed(false),
+    _buffer_ring(nullptr),
+    _buffer_tail(0),
+    _cq_head(0),
+    _cq_head_shared(nullptr),
+    _cq_mask(0),
+    _cq_tail(0),
+    _cq_tail_shared(nullptr),
+    _cqes(nullptr),
+    _generation(0),
+    _lent(-1),
+    _owned(false),
+    _owner(),
+    _ring(nullptr),
+    _ring_size(0),
+    _sq_array(nullptr),
+    _sq_mask(0),
+    _sq_pending(0),
+    _sq_tail(0),
+    _sq_tail_shared(nullptr),
+    _sqes(nullptr),
+    _sqes_size(0),
+    _uring(-1),
+    _wake(-1) {
+    ::memset(&this->_msg, 0, sizeof(this->_msg));
+}
+
+
+/*
+ * mmp_uring_transport::~mmp_uring_transport
+ */
+mmp_uring_transport::~mmp_uring_transport(void) noexcept {
+    // Closing the ring cancels the multishot receive, so the kernel does not
+    // touch the buffers any more once they are released below.
+    if (this->_uring != -1) {
+        ::close(this->_uring);
+    }
+    if (this->_ring != nullptr) {
+        ::munmap(this->_ring, this->_ring_size);
+    }
+    if (this->_sqes != nullptr) {
+        ::munmap(this->_sqes, this->_sqes_size);
+    }
+    if (this->_buffer_ring != nullptr) {
+        ::munmap(this->_buffer_ring, buffers * sizeof(io_uring_buf));
+    }
+    if (this->_wake != -1) {
+        ::close(this->_wake);
+    }
+}
+
+
+/*
+ * mmp_uring_transport::borrow
+ */
+_Success_(return == 0) int mmp_uring_transport::borrow(
+        _Inout_ std::vector<char>&,
+        _Out_ const char *& data,
+        _Out_ DWORD& size,
+        _Out_ sockaddr_storage& peer) noexcept {
+    // The caller is done with the datagram it borrowed last time.
+    if (this->_lent != -1) {
+        this->recycle(static_cast<std::uint16_t>(this->_lent));
+        this->_lent = -1;
+    }
+
+    while (true) {
+        const auto cqe = this->peek();
+        if (cqe == nullptr) {
+            RETURN_IF_WIN32_ERROR(this->enter(true, nullptr));
+            continue;
+        }
+
+        // The wake-up is never consumed, so every subsequent call fails, too.
+        if ((cqe->user_data & tag_mask) == tag_wake) {
+            RETURN_WIN32(ERROR_OPERATION_ABORTED);
+        }
+
+        const auto flags = cqe->flags;
+        const auto result = cqe->res;
+        ++this->_cq_head;
+
+        if (result < 0) {
+            MMP_TRACE(L"Receiving a datagram via io_uring failed with error "
+                L"%d.", -result);
+            RETURN_WIN32(-result);
+        }
+
+        const auto id = static_cast<std::uint16_t>(
+            flags >> IORING_CQE_BUFFER_SHIFT);
+        const auto b = this->_buffers.get() + id * buffer_size;
+        const auto out = reinterpret_cast<const io_uring_recvmsg_out *>(b);
+        const auto name = b + sizeof(io_uring_recvmsg_out);
+
+        ::memset(&peer, 0, sizeof(peer));
+        ::memcpy(&peer, name, (std::min)(out->namelen,
+            static_cast<std::uint32_t>(this->_msg.msg_namelen)));
+        data = name + this->_msg.msg_namelen + this->_msg.msg_controllen;
+        size = static_cast<DWORD>(out->payloadlen);
+        this->_lent = id;
+        return 0;
+    }
+}
+
+
+/*
+ * mmp_uring_transport::close
+ */
+void mmp_uring_transport::close(void) noexcept {
+    if (this->_wake != -1) {
+        const std::uint64_t value = 1;
+        ::write(this->_wake, &value, sizeof(value));
+    }
+}
+
+
+/*
+ * mmp_uring_transport::open
+ */
+_Success_(return == 0) int mmp_uring_transport::open(
+        _Inout_ wil::unique_socket& socket) noexcept {
+    this->_socket = std::move(socket);
+    auto restore = wil::scope_exit([this, &socket](void) {
+        socket = std::move(this->_socket);
+    });
+
+    // Every completion but the wake-up consumes a buffer, so the completion
+    // queue is large enough to hold all of them. Cooperative task running
+    // lets the kernel copy datagrams only when we enter it anyway, instead
+    // of interrupting the receiver thread.
+    io_uring_params params;
+    ::memset(&params, 0, sizeof(params));
+    params.cq_entries = 2 * buffers;
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+
+    this->_uring = static_cast<int>(::syscall(__NR_io_uring_setup, 8,
+        &params));
+    RETURN_LAST_ERROR_IF(this->_uring == -1);
+
+    if (((params.features & IORING_FEAT_EXT_ARG) == 0)
+            || ((params.features & IORING_FEAT_SINGLE_MMAP) == 0)) {
+        MMP_TRACE(L"io_uring lacks the features required, which are 0x%x.",
+            params.features);
+        RETURN_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    {
+        const auto sq = params.sq_off.array
+            + params.sq_entries * sizeof(std::uint32_t);
+        const auto cq = params.cq_off.cqes
+            + params.cq_entries * sizeof(io_uring_cqe);
+        this->_ring_size = (std::max)(sq, cq);
+
+        auto ring = ::mmap(nullptr,
+            this->_ring_size,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE,
+            this->_uring,
+            IORING_OFF_SQ_RING);
+        RETURN_LAST_ERROR_IF(ring == MAP_FAILED);
+        this->_ring = ring;
+    }
+
+    {
+        this->_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        auto sqes = ::mmap(nullptr,
+            this->_sqes_size,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE,
+            this->_uring,
+            IORING_OFF_SQES);
+        RETURN_LAST_ERROR_IF(sqes == MAP_FAILED);
+        this->_sqes = static_cast<io_uring_sqe *>(sqes);
+    }
+
+    {
+        auto ring = static_cast<char *>(this->_ring);
+        this->_sq_array = reinterpret_cast<std::uint32_t *>(
+            ring + params.sq_off.array);
+        this->_sq_mask = *reinterpret_cast<std::uint32_t *>(
+            ring + params.sq_off.ring_mask);
+        this->_sq_tail_shared = reinterpret_cast<std::uint32_t *>(
+            ring + params.sq_off.tail);
+        this->_sq_tail = *this->_sq_tail_shared;
+
+        this->_cq_head_shared = reinterpret_cast<std::uint32_t *>(
+            ring + params.cq_off.head);
+        this->_cq_mask = *reinterpret_cast<std::uint32_t *>(
+            ring + params.cq_off.ring_mask);
+        this->_cq_tail_shared = reinterpret_cast<std::uint32_t *>(
+            ring + params.cq_off.tail);
+        this->_cqes = reinterpret_cast<io_uring_cqe *>(
+            ring + params.cq_off.cqes);
+        this->_cq_head = this->_cq_tail = *this->_cq_head_shared;
+
+        // The submissions are used in order, so the indirection array is
+        // the identity.
+        for (std::uint32_t i = 0; i < params.sq_entries; ++i) {
+            this->_sq_array[i] = i;
+        }
+    }
+
+    {
+        auto ring = ::mmap(nullptr,
+            buffers * sizeof(io_uring_buf),
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS,
+            -1,
+            0);
+        RETURN_LAST_ERROR_IF(ring == MAP_FAILED);
+        this->_buffer_ring = static_cast<io_uring_buf *>(ring);
+
+        this->_buffers.reset(new (std::nothrow) char[buffers * buffer_size]);
+        RETURN_IF_NULL_ALLOC(this->_buffers);
+
+        // The ring must be written before it is registered, because the
+        // kernel would otherwise pin the shared zero page rather than the
+        // page we write to later.
+        for (std::uint32_t i = 0; i < buffers; ++i) {
+            this->recycle(static_cast<std::uint16_t>(i));
+        }
+
+        io_uring_buf_reg reg;
+        ::memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<std::uint64_t>(ring);
+        reg.ring_entries = buffers;
+        reg.bgid = 0;
+        RETURN_LAST_ERROR_IF(::syscall(__NR_io_uring_register,
+            this->_uring,
+            IORING_REGISTER_PBUF_RING,
+            &reg,
+            1) == -1);
+    }
+
+    this->_wake = ::eventfd(0, EFD_CLOEXEC);
+    RETURN_LAST_ERROR_IF(this->_wake == -1);
+
+    // The kernel writes the header, the address of the sender and the
+    // payload into each buffer. We do not need any control messages. The
+    // receive is armed by entering the ring, which makes the calling thread
+    // the owner.
+    this->_msg.msg_namelen = sizeof(sockaddr_storage);
+    RETURN_IF_WIN32_ERROR(this->enter(false, nullptr));
+
+    // Kernels before Linux 6.0 reject the multishot receive right away, so
+    // we check for this before we report success.
+    {
+        const auto cqe = this->peek();
+        if ((cqe != nullptr)
+                && ((cqe->user_data & tag_mask) == tag_receive)
+                && (cqe->res < 0)) {
+            MMP_TRACE(L"The kernel does not support multishot receives via "
+                L"io_uring, the error is %d.", -cqe->res);
+            RETURN_WIN32(-cqe->res);
+        }
+    }
+
+    restore.release();
+    return 0;
+}
+
+
+/*
+ * mmp_uring_transport::receive
+ */
+_Success_(return == 0) int mmp_uring_transport::receive(
+        _Out_writes_bytes_(size) char *buffer,
+        _Inout_ DWORD& size,
+        _Out_ sockaddr_storage& peer) noexcept {
+    std::vector<char> unused;
+    const char *data = nullptr;
+    DWORD len = 0;
+    RETURN_IF_WIN32_ERROR(this->borrow(unused, data, len, peer));
+
+    // Like a socket, the transport truncates datagrams that do not fit.
+    size = (std::min)(size, len);
+    std::memcpy(buffer, data, size);
+    return 0;
+}
+
+
+/*
+ * mmp_uring_transport::send
+ */
+_Success_(return == 0) int mmp_uring_transport::send(
+        _In_ const sockaddr_storage& peer,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const DWORD size) noexcept {
+    if (::sendto(this->_socket.get(),
+            data,
+            size,
+            0,
+            reinterpret_cast<const sockaddr *>(&peer),
+            static_cast<socklen_t>(sizeof(sockaddr_storage)))
+            == SOCKET_ERROR) {
+        RETURN_LAST_ERROR();
+    }
+
+    return 0;
+}
+
+
+/*
+ * mmp_uring_transport::wait
+ */
+_Success_(return == 0) int mmp_uring_transport::wait(
+        _In_ const std::chrono::microseconds timeout,
+        _Out_ bool& readable) noexcept {
+    readable = false;
+
+    auto cqe = this->peek();
+    if (cqe == nullptr) {
+        __kernel_timespec t;
+        t.tv_sec = timeout.count() / 1000000;
+        t.tv_nsec = (timeout.count() % 1000000) * 1000;
+        RETURN_IF_WIN32_ERROR(this->enter(true, &t));
+        cqe = this->peek();
+    }
+
+    if ((cqe != nullptr) && ((cqe->user_data & tag_mask) == tag_wake)) {
+        RETURN_WIN32(ERROR_OPERATION_ABORTED);
+    }
+
+    readable = (cqe != nullptr);
+    return 0;
+}
+
+
+/*
+ * mmp_uring_transport::adopt
+ */
+void mmp_uring_transport::adopt(void) noexcept {
+    if (this->_owned) {
+        for (auto tag : { tag_receive, tag_wake }) {
+            auto& sqe = this->prepare();
+            sqe.opcode = IORING_OP_ASYNC_CANCEL;
+            sqe.addr = this->user_data(tag);
+            sqe.user_data = this->user_data(tag_cancel);
+        }
+    }
+
+    ++this->_generation;
+    this->_owned = true;
+    this->_owner = ::pthread_self();
+
+    {
+        auto& sqe = this->prepare();
+        sqe.opcode = IORING_OP_POLL_ADD;
+        sqe.fd = this->_wake;
+        sqe.poll32_events = POLLIN;
+        sqe.user_data = this->user_data(tag_wake);
+    }
+
+    this->_armed = false;
+}
+
+
+/*
+ * mmp_uring_transport::enter
+ */
+_Success_(return == 0) int mmp_uring_transport::enter(
+        _In_ const bool wait,
+        _In_opt_ const __kernel_timespec *timeout) noexcept {
+    // Hand back the completion slots and buffers of the whole batch at once.
+    __atomic_store_n(this->_cq_head_shared, this->_cq_head, __ATOMIC_RELEASE);
+    __atomic_store_n(&this->_buffer_ring->resv, this->_buffer_tail,
+        __ATOMIC_RELEASE);
+
+    if (!this->_owned || !::pthread_equal(this->_owner, ::pthread_self())) {
+        this->adopt();
+    }
+
+    // The kernel terminates the multishot receive if it runs out of buffers
+    // or completion slots, in which case it needs to be armed again.
+    if (!this->_armed) {
+        this->prepare_receive();
+    }
+
+    if (this->_sq_pending > 0) {
+        __atomic_store_n(this->_sq_tail_shared, this->_sq_tail,
+            __ATOMIC_RELEASE);
+    } else if (!wait) {
+        return 0;
+    }
+
+    io_uring_getevents_arg arg;
+    ::memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<std::uint64_t>(timeout);
+
+    const auto status = ::syscall(__NR_io_uring_enter,
+        this->_uring,
+        this->_sq_pending,
+        wait ? 1 : 0,
+        wait ? (IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG) : 0,
+        wait ? &arg : nullptr,
+        wait ? sizeof(arg) : 0);
+    if (status == -1) {
+        // A signal is treated like a timeout, which the caller handles anyway.
+        const auto error = errno;
+        if ((error == ETIME) || (error == EINTR)) {
+            return 0;
+        }
+
+        MMP_TRACE(L"Entering io_uring failed with error %d.", error);
+        RETURN_WIN32(error);
+    }
+
+    this->_sq_pending -= static_cast<std::uint32_t>(status);
+    return 0;
+}
+
+
+/*
+ * mmp_uring_transport::peek
+ */
+const io_uring_cqe *mmp_uring_transport::peek(void) noexcept {
+    while (true) {
+        if (this->_cq_head == this->_cq_tail) {
+            this->_cq_tail = __atomic_load_n(this->_cq_tail_shared,
+                __ATOMIC_ACQUIRE);
+            if (this->_cq_head == this->_cq_tail) {
+                return nullptr;
+            }
+        }
+
+        const auto retval = this->_cqes + (this->_cq_head & this->_cq_mask);
+        const auto current = ((retval->user_data & ~tag_mask)
+            == this->user_data(0));
+
+        switch (retval->user_data & tag_mask) {
+            case tag_receive:
+                break;
+
+            case tag_wake:
+                // The wait of a previous owner has been cancelled unless
+                // the transport was closed before the cancellation.
+                if (retval->res >= 0) {
+                    return retval;
+                }
+                ++this->_cq_head;
+                continue;
+
+            default:
+                ++this->_cq_head;
+                continue;
+        }
+
+        if (current && ((retval->flags & IORING_CQE_F_MORE) == 0)) {
+            this->_armed = false;
+        }
+
+        // Running out of buffers only means that we need to arm the receive
+        // again once the buffers of the current batch have been recycled.
+        // The receive of a previous owner ends with a cancellation. Any
+        // datagram it has received before is still delivered.
+        if ((retval->res == -ENOBUFS) || (retval->res == -ECANCELED)) {
+            ++this->_cq_head;
+            continue;
+        }
+
+        if (retval->res < 0) {
+            return retval;
+        }
+
+        if ((retval->flags & IORING_CQE_F_BUFFER) == 0) {
+            ++this->_cq_head;
+            continue;
+        }
+
+        const auto id = static_cast<std::uint16_t>(
+            retval->flags >> IORING_CQE_BUFFER_SHIFT);
+        const auto out = reinterpret_cast<const io_uring_recvmsg_out *>(
+            this->_buffers.get() + id * buffer_size);
+        if ((out->flags & MSG_TRUNC) != 0) {
+            MMP_TRACE(L"Dropping a datagram of %u bytes, which does not fit "
+                L"into a buffer.", out->payloadlen);
+            this->recycle(id);
+            ++this->_cq_head;
+            continue;
+        }
+
+        return retval;
+    }
+}
+
+
+/*
+ * mmp_uring_transport::prepare
+ */
+io_uring_sqe& mmp_uring_transport::prepare(void) noexcept {
+    auto& retval = this->_sqes[this->_sq_tail & this->_sq_mask];
+    ::memset(&retval, 0, sizeof(retval));
+    ++this->_sq_tail;
+    ++this->_sq_pending;
+    return retval;
+}
+
+
+/*
+ * mmp_uring_transport::prepare_receive
+ */
+void mmp_uring_transport::prepare_receive(void) noexcept {
+    auto& sqe = this->prepare();
+    sqe.opcode = IORING_OP_RECVMSG;
+    sqe.fd = this->_socket.get();
+    sqe.addr = reinterpret_cast<std::uint64_t>(&this->_msg);
+    sqe.len = 1;
+    sqe.ioprio = IORING_RECV_MULTISHOT;
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = 0;
+    sqe.user_data = this->user_data(tag_receive);
+    this->_armed = true;
+}
+
+
+/*
+ * mmp_uring_transport::recycle
+ */
+void mmp_uring_transport::recycle(_In_ const std::uint16_t id) noexcept {
+    // The tail of the ring overlays the reserved field of the first entry,
+    // so we must not assign the entries as a whole. We do not use the
+    // io_uring_buf_ring from the header, because its flexible array is
+    // misplaced when it is compiled as C++.
+    auto& buffer = this->_buffer_ring[this->_buffer_tail & (buffers - 1)];
+    buffer.addr = reinterpret_cast<std::uint64_t>(this->_buffers.get()
+        + id * buffer_size);
+    buffer.len = buffer_size;
+    buffer.bid = id;
+    ++this->_buffer_tail;
+}
+
+#endif /* defined(MMP_IO_URING) */
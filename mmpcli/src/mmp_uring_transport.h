@@ -0,0 +1,222 @@
+﻿// <copyright file="mmp_uring_transport.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#pragma once
+
+#if defined(MMP_IO_URING)
+#include <cinttypes>
+#include <memory>
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+
+#include "mmp_platform.h"
+#include "mmp_transport.h"
+
+
+/// <summary>
+/// The transport receiving datagrams from the server via io_uring on Linux.
+/// </summary>
+/// <remarks>
+/// <para>A single multishot receive is armed on the socket, which makes the
+/// kernel write every datagram into a buffer it picks from a ring of
+/// provided buffers. The datagrams are lent to the client in place, and
+/// their buffers are returned to the kernel once the next datagram is
+/// borrowed. The receiver thread only enters the kernel if it has consumed
+/// all completions, so a single system call picks up all datagrams that
+/// arrived in the meantime.</para>
+/// <para>The kernel copies the datagrams in the context of the thread that
+/// has submitted the receive. Therefore, the thread waiting for datagrams
+/// always owns the requests. If another thread starts waiting, which happens
+/// once the receiver thread of the client takes over from the thread that
+/// connected, the requests are cancelled and submitted again.</para>
+/// <para>The transport requires Linux 6.0. If the kernel does not support
+/// io_uring or any of the features needed, <see cref="open"/> fails and the
+/// client falls back to <see cref="mmp_udp_transport"/>. Datagrams are only
+/// sent rarely, which is why they are sent with a plain system call.</para>
+/// </remarks>
+class mmp_uring_transport final : public mmp_transport {
+
+public:
+
+    /// <summary>
+    /// The size of each of the buffers provided to the kernel, which
+    /// includes the header of the completion and the address of the sender.
+    /// </summary>
+    static constexpr std::uint32_t buffer_size = 2048;
+
+    /// <summary>
+    /// The number of buffers provided to the kernel, which must be a power
+    /// of two.
+    /// </summary>
+    static constexpr std::uint32_t buffers = 256;
+
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    /// <remarks>
+    /// The instance must be opened before it can be used.
+    /// </remarks>
+    mmp_uring_transport(void) noexcept;
+
+    mmp_uring_transport(const mmp_uring_transport&) = delete;
+
+    /// <summary>
+    /// Finalises the instance, which closes the ring and the socket.
+    /// </summary>
+    ~mmp_uring_transport(void) noexcept;
+
+    _Success_(return == 0) int borrow(
+        _Inout_ std::vector<char>& buffer,
+        _Out_ const char *& data,
+        _Out_ DWORD& size,
+        _Out_ sockaddr_storage& peer) noexcept override;
+
+    void close(void) noexcept override;
+
+    /// <summary>
+    /// Sets up the ring, provides the receive buffers and arms the receive
+    /// on the given bound <paramref name="socket"/>.
+    /// </summary>
+    /// <param name="socket">The socket to receive from. The instance only
+    /// takes ownership of it if the method succeeds, such that the caller
+    /// can fall back to another transport otherwise.</param>
+    /// <returns>Zero in case of success, a system error code if the kernel
+    /// does not support the features needed or if the resources could not
+    /// be allocated.</returns>
+    _Success_(return == 0) int open(
+        _Inout_ wil::unique_socket& socket) noexcept;
+
+    _Success_(return == 0) int receive(
+        _Out_writes_bytes_(size) char *buffer,
+        _Inout_ DWORD& size,
+        _Out_ sockaddr_storage& peer) noexcept override;
+
+    _Success_(return == 0) int send(
+        _In_ const sockaddr_storage& peer,
+        _In_reads_bytes_(size) const char *data,
+        _In_ const DWORD size) noexcept override;
+
+    _Success_(return == 0) int wait(
+        _In_ const std::chrono::microseconds timeout,
+        _Out_ bool& readable) noexcept override;
+
+    mmp_uring_transport& operator =(const mmp_uring_transport&) = delete;
+
+private:
+
+    /// <summary>
+    /// The user data of the completions of cancellations, which are not
+    /// processed at all.
+    /// </summary>
+    static constexpr std::uint64_t tag_cancel = 3;
+
+    /// <summary>
+    /// The bits of the user data that hold the tag, the remaining ones hold
+    /// the generation of the owner.
+    /// </summary>
+    static constexpr std::uint64_t tag_mask = 3;
+
+    /// <summary>
+    /// The user data of the completions of the multishot receive.
+    /// </summary>
+    static constexpr std::uint64_t tag_receive = 1;
+
+    /// <summary>
+    /// The user data of the completion signalled by <see cref="close"/>.
+    /// </summary>
+    static constexpr std::uint64_t tag_wake = 2;
+
+    /// <summary>
+    /// Makes the calling thread the owner of the requests, which cancels
+    /// the ones submitted by the previous owner and queues the wait for
+    /// <see cref="close"/> again.
+    /// </summary>
+    void adopt(void) noexcept;
+
+    /// <summary>
+    /// Publishes the consumed completions and the recycled buffers and, if
+    /// <paramref name="wait"/> is set, waits for at most
+    /// <paramref name="timeout"/> until the next completion arrives.
+    /// </summary>
+    /// <remarks>
+    /// If the multishot receive has been terminated by the kernel, it is
+    /// armed again in the same system call.
+    /// </remarks>
+    /// <param name="wait">Whether to wait for a completion.</param>
+    /// <param name="timeout">The maximum time to wait, or
+    /// <see langword="nullptr"/> to wait forever.</param>
+    /// <returns>Zero in case of success, including a timeout or an
+    /// interrupted wait, a system error code otherwise.</returns>
+    _Success_(return == 0) int enter(_In_ const bool wait,
+        _In_opt_ const __kernel_timespec *timeout) noexcept;
+
+    /// <summary>
+    /// Answer the oldest completion that carries a datagram, an error or the
+    /// wake-up, dropping all completions that do not need to be processed
+    /// by the caller.
+    /// </summary>
+    /// <returns>The completion, which has not been consumed yet, or
+    /// <see langword="nullptr"/> if all completions have been consumed.
+    /// </returns>
+    const io_uring_cqe *peek(void) noexcept;
+
+    /// <summary>
+    /// Queues a submission.
+    /// </summary>
+    /// <returns>The submission to be filled, which is zeroed.</returns>
+    io_uring_sqe& prepare(void) noexcept;
+
+    /// <summary>
+    /// Queues the multishot receive on the socket.
+    /// </summary>
+    void prepare_receive(void) noexcept;
+
+    /// <summary>
+    /// Returns the buffer with the given ID to the kernel, which will see it
+    /// once the buffer ring is published by <see cref="enter"/>.
+    /// </summary>
+    void recycle(_In_ const std::uint16_t id) noexcept;
+
+    /// <summary>
+    /// Answer the user data for the given <paramref name="tag"/> in the
+    /// current generation.
+    /// </summary>
+    inline std::uint64_t user_data(
+            _In_ const std::uint64_t tag) const noexcept {
+        return (this->_generation << 2) | tag;
+    }
+
+    bool _armed;
+    io_uring_buf *_buffer_ring;
+    std::uint16_t _buffer_tail;
+    std::unique_ptr<char[]> _buffers;
+    std::uint32_t _cq_head;
+    std::uint32_t *_cq_head_shared;
+    std::uint32_t _cq_mask;
+    std::uint32_t _cq_tail;
+    const std::uint32_t *_cq_tail_shared;
+    const io_uring_cqe *_cqes;
+    std::uint64_t _generation;
+    int _lent;
+    msghdr _msg;
+    bool _owned;
+    pthread_t _owner;
+    void *_ring;
+    std::size_t _ring_size;
+    wil::unique_socket _socket;
+    std::uint32_t *_sq_array;
+    std::uint32_t _sq_mask;
+    std::uint32_t _sq_pending;
+    std::uint32_t _sq_tail;
+    std::uint32_t *_sq_tail_shared;
+    io_uring_sqe *_sqes;
+    std::size_t _sqes_size;
+    int _uring;
+    int _wake;
+};
+
+#endif /* defined(MMP_IO_URING) */
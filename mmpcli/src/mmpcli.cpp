@@ -7,6 +7,7 @@
 #include "mmpcli.h"
 
 #include "mmp_client.h"
+#include "mmp_relay.h"
 #include "mmpmsg.h"
 #include "mmptrace.h"
 
@@ -32,9 +33,11 @@ _Success_(return == 0) int mmp_connect(
         RETURN_WIN32(ERROR_OUTOFMEMORY);
     }
 
+#if defined(_WIN32)
     // Make sure that Winsock is initialised. The mmp_client will release it
     // in its destructor.
     RETURN_IF_WIN32_ERROR(::WSAStartup(MAKEWORD(2, 2), **handle));
+#endif /* defined(_WIN32) */
 
     // Optionally performs discovery of the server address of the mouse pad.
     RETURN_IF_WIN32_ERROR((**handle).discover());
@@ -44,6 +47,46 @@ _Success_(return == 0) int mmp_connect(
 }
 
 
+/*
+ * ::mmp_connect_async
+ */
+_Success_(return == 0) int mmp_connect_async(
+        _Out_ mmp_handle *handle,
+        _In_ mmp_configuration *configuration,
+        _In_opt_ mmp_connect_completion completion,
+        _In_opt_ void *context) {
+    if (handle == nullptr) {
+        MMP_TRACE("The output parameter for the handle is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+    if (configuration == nullptr) {
+        MMP_TRACE("The client configuration is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    MMP_TRACE(L"Allocating the magic mouse pad client context.");
+    std::unique_ptr<mmp_client> client(new (std::nothrow) mmp_client(
+        *configuration));
+    if (client == nullptr) {
+        MMP_TRACE(L"Insufficient memory to allocate client context.");
+        RETURN_WIN32(ERROR_OUTOFMEMORY);
+    }
+
+#if defined(_WIN32)
+    // Make sure that Winsock is initialised. The mmp_client will release it
+    // in its destructor.
+    RETURN_IF_WIN32_ERROR(::WSAStartup(MAKEWORD(2, 2), *client));
+#endif /* defined(_WIN32) */
+
+    // Perform discovery and connect in the background. If the thread is
+    // running, the handle is valid and must be released by the caller.
+    RETURN_IF_WIN32_ERROR(client->connect_async(completion, context));
+
+    *handle = client.release();
+    return 0;
+}
+
+
 /*
  * ::mmp_disconnect
  */
@@ -58,6 +101,164 @@ _Success_(return == 0) MMPCLI_API int mmp_disconnect(_In_ mmp_handle handle) {
 }
 
 
+/*
+ * ::mmp_get_clock
+ */
+_Success_(return == 0) MMPCLI_API int mmp_get_clock(
+        _In_ mmp_handle handle,
+        _Out_ int64_t *offset,
+        _Out_opt_ uint32_t *rtt,
+        _Out_opt_ uint32_t *jitter) {
+    if (handle == nullptr) {
+        MMP_TRACE("The handle provided to mmp_get_clock is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+    if (offset == nullptr) {
+        MMP_TRACE("The output parameter for the offset is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    std::uint32_t r, j;
+    RETURN_IF_WIN32_ERROR(handle->clock(*offset, r, j));
+
+    if (rtt != nullptr) {
+        *rtt = r;
+    }
+    if (jitter != nullptr) {
+        *jitter = j;
+    }
+
+    return 0;
+}
+
+
+/*
+ * ::mmp_get_timestamp
+ */
+_Success_(return == 0) MMPCLI_API int mmp_get_timestamp(
+        _In_ mmp_handle handle,
+        _Out_ uint64_t *timestamp) {
+    if (handle == nullptr) {
+        MMP_TRACE("The handle provided to mmp_get_timestamp is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+    if (timestamp == nullptr) {
+        MMP_TRACE("The output parameter for the timestamp is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    *timestamp = handle->timestamp();
+    if (*timestamp == 0) {
+        RETURN_WIN32(ERROR_NOT_READY);
+    }
+
+    return 0;
+}
+
+
+/*
+ * ::mmp_relay_get_latency
+ */
+_Success_(return == 0) MMPCLI_API int mmp_relay_get_latency(
+        _In_ mmp_relay_handle handle,
+        _Out_ uint32_t *mean,
+        _Out_opt_ uint32_t *max) {
+    if (handle == nullptr) {
+        MMP_TRACE("The handle provided to mmp_relay_get_latency is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+    if (mean == nullptr) {
+        MMP_TRACE("The output parameter for the latency is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    std::uint32_t m;
+    handle->latency(*mean, m);
+
+    if (max != nullptr) {
+        *max = m;
+    }
+
+    return 0;
+}
+
+
+/*
+ * ::mmp_relay_start
+ */
+_Success_(return == 0) MMPCLI_API int mmp_relay_start(
+        _Out_ mmp_relay_handle *handle,
+        _In_ mmp_configuration *upstream,
+        _In_ const struct sockaddr_storage *downstream) {
+    if (handle == nullptr) {
+        MMP_TRACE("The output parameter for the handle is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+    if (upstream == nullptr) {
+        MMP_TRACE("The upstream configuration is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+    if ((upstream->server.ss_family != AF_INET)
+            && (upstream->server.ss_family != AF_INET6)) {
+        MMP_TRACE("The upstream server must be configured explicitly.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+    if (downstream == nullptr) {
+        MMP_TRACE("The downstream address is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    MMP_TRACE(L"Allocating the magic mouse pad relay context.");
+    std::unique_ptr<mmp_relay> relay(new (std::nothrow) mmp_relay(
+        *upstream, *downstream));
+    if (relay == nullptr) {
+        MMP_TRACE(L"Insufficient memory to allocate relay context.");
+        RETURN_WIN32(ERROR_OUTOFMEMORY);
+    }
+
+#if defined(_WIN32)
+    // Make sure that Winsock is initialised. The mmp_relay will release it
+    // in its destructor.
+    RETURN_IF_WIN32_ERROR(::WSAStartup(MAKEWORD(2, 2), *relay));
+#endif /* defined(_WIN32) */
+
+    RETURN_IF_WIN32_ERROR(relay->start());
+
+    *handle = relay.release();
+    return 0;
+}
+
+
+/*
+ * ::mmp_relay_stop
+ */
+_Success_(return == 0) MMPCLI_API int mmp_relay_stop(
+        _In_ mmp_relay_handle handle) {
+    if (handle == nullptr) {
+        MMP_TRACE("The handle provided to mmp_relay_stop is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    delete handle;
+    return 0;
+}
+
+
+/*
+ * ::mmp_wait
+ */
+_Success_(return == 0) MMPCLI_API int mmp_wait(
+        _In_ mmp_handle handle,
+        _In_ const uint32_t timeout) {
+    if (handle == nullptr) {
+        MMP_TRACE("The handle provided to mmp_wait is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    return handle->wait(timeout);
+}
+
+
 #if defined(__cplusplus)
 /*
  * visus::mmp::detail::delete_mmp_handle::operator ()
@@ -68,4 +269,15 @@ void visus::mmp::detail::delete_mmp_handle::operator ()(
         ::mmp_disconnect(handle);
     }
 }
+
+
+/*
+ * visus::mmp::detail::delete_mmp_relay_handle::operator ()
+ */
+void visus::mmp::detail::delete_mmp_relay_handle::operator ()(
+        _In_opt_ mmp_relay_handle handle) const noexcept {
+    if (handle != nullptr) {
+        ::mmp_relay_stop(handle);
+    }
+}
 #endif /* defined(__cplusplus) */
@@ -7,17 +7,22 @@
 #include "mmpendpoint.h"
 
 #include <codecvt>
+#include <cstring>
+#include <locale>
+#include <string>
 
+#if defined(_WIN32)
 #include <WinDNS.h>
 #include <ws2tcpip.h>
 #include <iphlpapi.h>
+#endif /* defined(_WIN32) */
 
-#include <wil/result.h>
-#include <wil/resource.h>
-
+#include "mmp_platform.h"
 #include "mmptrace.h"
 
 
+#if defined(_WIN32)
+
 /*
  * ::parse_end_pointa
  */
@@ -100,3 +105,127 @@ int mmp_parse_end_pointw(_Out_ sockaddr_storage *end_point,
     RETURN_WIN32(ERROR_INVALID_PARAMETER);
 }
 
+#else /* defined(_WIN32) */
+/*
+ * ::parse_end_pointa
+ */
+int mmp_parse_end_pointa(_Out_ sockaddr_storage *end_point,
+        _In_z_ const char *string) {
+    if (end_point == nullptr) {
+        MMP_TRACE("The output pointer for the end point is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+    if (string == nullptr) {
+        MMP_TRACE("The input string to be parsed is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    // Like ParseNetworkString on Windows, we require a port, which is
+    // separated by a colon. IPv6 addresses must therefore be enclosed in
+    // brackets, otherwise the port would be ambiguous.
+    std::string host;
+    std::string service;
+    try {
+        const std::string s(string);
+        if (!s.empty() && (s.front() == '[')) {
+            const auto end = s.find("]:");
+            if (end != std::string::npos) {
+                host = s.substr(1, end - 1);
+                service = s.substr(end + 2);
+            }
+        } else {
+            const auto colon = s.find(':');
+            if ((colon != std::string::npos) && (s.rfind(':') == colon)) {
+                host = s.substr(0, colon);
+                service = s.substr(colon + 1);
+            }
+        }
+    } catch (...) {
+        RETURN_WIN32(ERROR_OUTOFMEMORY);
+    }
+
+    if (host.empty() || service.empty()) {
+        MMP_TRACE("The input string does not designate a valid address.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    // getaddrinfo handles numeric addresses of both families as well as
+    // names, so there is no need to distinguish them up front.
+    addrinfo *addresses = nullptr;
+    addrinfo hints;
+    ::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+    hints.ai_flags = AI_NUMERICSERV;
+
+    {
+        const auto status = ::getaddrinfo(host.c_str(), service.c_str(),
+            &hints, &addresses);
+        switch (status) {
+            case 0:
+                break;
+
+            case EAI_AGAIN:
+                RETURN_WIN32(EAGAIN);
+
+            case EAI_MEMORY:
+                RETURN_WIN32(ERROR_OUTOFMEMORY);
+
+            case EAI_NONAME:
+                MMP_TRACE("The name \"%s\" could not be resolved.",
+                    host.c_str());
+                RETURN_WIN32(EHOSTUNREACH);
+
+            case EAI_SYSTEM:
+                RETURN_LAST_ERROR();
+
+            default:
+                MMP_TRACE("Resolving \"%s\" failed: %s", string,
+                    ::gai_strerror(status));
+                RETURN_WIN32(ERROR_INVALID_PARAMETER);
+        }
+    }
+    auto free_addresses = wil::scope_exit(
+        [&addresses](void) { ::freeaddrinfo(addresses); });
+
+    ::memset(end_point, 0, sizeof(*end_point));
+
+    for (auto *a = addresses; a != nullptr; a = a->ai_next) {
+        switch (a->ai_family) {
+            case AF_INET:
+            case AF_INET6:
+                MMP_TRACE("Found end point from name.");
+                ::memcpy(end_point, a->ai_addr, a->ai_addrlen);
+                return 0;
+        }
+    }
+
+    MMP_TRACE("The input string does not designate a valid address.");
+    RETURN_WIN32(ERROR_INVALID_PARAMETER);
+}
+
+
+/*
+ * ::parse_end_pointw
+ */
+int mmp_parse_end_pointw(_Out_ sockaddr_storage *end_point,
+        _In_z_ const wchar_t *string) {
+    if (string == nullptr) {
+        MMP_TRACE("The input string to be parsed is invalid.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    }
+
+    try {
+        static std::wstring_convert<std::codecvt_utf8<wchar_t>> cvt;
+        auto s = cvt.to_bytes(string);
+        return mmp_parse_end_pointa(end_point, s.c_str());
+    } catch (const std::range_error&) {
+        MMP_TRACE("The input string is not valid Unicode.");
+        RETURN_WIN32(ERROR_INVALID_PARAMETER);
+    } catch (...) {
+        RETURN_WIN32(ERROR_OUTOFMEMORY);
+    }
+}
+#endif /* defined(_WIN32) */
+
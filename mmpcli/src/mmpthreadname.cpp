@@ -6,12 +6,19 @@
 
 #include "mmpthreadname.h"
 
+#if !defined(_WIN32)
+#include <cstring>
+
+#include <pthread.h>
+#endif /* !defined(_WIN32) */
+
 
 /*
  * ::mmp_set_thread_name
  */
 void mmp_set_thread_name(_In_ const uint32_t thread_id,
         _In_opt_z_ const char *thread_name) {
+#if defined(_WIN32)
     // See https://msdn.microsoft.com/de-de/library/xcb2z8hs.aspx?f=255&MSPPError=-2147217396
     constexpr DWORD MS_VC_EXCEPTION = 0x406D1388;
 
@@ -36,4 +43,15 @@ void mmp_set_thread_name(_In_ const uint32_t thread_id,
         } __except (EXCEPTION_EXECUTE_HANDLER) { }
 #pragma warning(pop)
     }
+
+#else /* defined(_WIN32) */
+    // POSIX threads can only name themselves, and names including the
+    // terminator must fit into 16 characters, so we truncate the rest.
+    if ((thread_name != nullptr) && (thread_id == static_cast<uint32_t>(-1))) {
+        char name[16];
+        ::strncpy(name, thread_name, sizeof(name) - 1);
+        name[sizeof(name) - 1] = 0;
+        ::pthread_setname_np(::pthread_self(), name);
+    }
+#endif /* defined(_WIN32) */
 }
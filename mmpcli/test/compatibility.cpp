@@ -0,0 +1,267 @@
+﻿// <copyright file="compatibility.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+
+#include "mmp_client.h"
+#include "mmp_inproc_transport.h"
+#include "mmpinproc.h"
+#include "mmpmsg.h"
+#include "mmptest.h"
+#include "mmpwire.h"
+
+
+/// <summary>
+/// The connect message of clients that predate the negotiation, which only
+/// consisted of the message ID.
+/// </summary>
+struct old_connect {
+    mmp_msg_id id;
+};
+
+
+/// <summary>
+/// The announcement of servers that predate the negotiation.
+/// </summary>
+struct old_announce {
+    mmp_msg_id id;
+    mmp_seq_no sequence_number;
+};
+
+
+/// <summary>
+/// What the callbacks of the client under test have seen.
+/// </summary>
+struct observation {
+    std::atomic<int> buttons;
+    std::atomic<int> moves;
+    std::atomic<std::int32_t> x;
+    std::atomic<std::int32_t> y;
+
+    inline observation(void) noexcept : buttons(0), moves(0), x(0), y(0) { }
+};
+
+
+/// <summary>
+/// Records a button event in the <see cref="observation"/>.
+/// </summary>
+static void WINAPIV on_mouse_button(_In_ const mmp_mouse_button button,
+        _In_ const bool down,
+        _In_ const int32_t x,
+        _In_ const int32_t y,
+        _In_opt_ void *context) {
+    (void) button;
+    (void) down;
+    auto o = static_cast<observation *>(context);
+    o->x = x;
+    o->y = y;
+    ++o->buttons;
+}
+
+
+/// <summary>
+/// Records a move in the <see cref="observation"/>.
+/// </summary>
+static void WINAPIV on_mouse_move(_In_ const int32_t x,
+        _In_ const int32_t y,
+        _In_opt_ void *context) {
+    auto o = static_cast<observation *>(context);
+    o->x = x;
+    o->y = y;
+    ++o->moves;
+}
+
+
+/// <summary>
+/// A server must accept the connect message of an old client, which does not
+/// contain a version, capabilities or a region, as the basic protocol.
+/// </summary>
+static void new_server_parses_old_connect(void) {
+    using namespace visus::mmp::wire;
+    old_connect msg { htonl(mmp_msgid_connect) };
+
+    view<mmp_msg_connect> v(reinterpret_cast<const char *>(&msg),
+        sizeof(msg));
+    MMP_EXPECT(v.valid());
+    MMP_EXPECT(v.version() == 0);
+    MMP_EXPECT(v.capabilities() == mmp_capability_none);
+    MMP_EXPECT(v.width() == 0);
+    MMP_EXPECT(v.height() == 0);
+    MMP_EXPECT(v.rate() == 0);
+
+    MMP_EXPECT(dispatch_table<mmp_msg_connect>::dispatch(
+        reinterpret_cast<const char *>(&msg), sizeof(msg),
+        [](const view<mmp_msg_connect>&) { })
+        == dispatch_status::handled);
+}
+
+
+/// <summary>
+/// A client must treat the announcement of an old server as a server that
+/// implements none of the optional features.
+/// </summary>
+static void new_client_parses_old_announce(void) {
+    using namespace visus::mmp::wire;
+    old_announce msg { htonl(mmp_msgid_announce), htonl(42) };
+
+    view<mmp_msg_announce> v(reinterpret_cast<const char *>(&msg),
+        sizeof(msg));
+    MMP_EXPECT(v.valid());
+    MMP_EXPECT(v.sequence_number() == 42);
+    MMP_EXPECT(v.version() == 0);
+    MMP_EXPECT(v.capabilities() == mmp_capability_none);
+    MMP_EXPECT(v.token() == 0);
+    MMP_EXPECT(v.epoch() == 0);
+}
+
+
+/// <summary>
+/// Old peers only read the prefix of the messages they know, so the new
+/// versions must leave that prefix where it was.
+/// </summary>
+static void old_peers_parse_new_messages(void) {
+    {
+        mmp_msg_announce msg;
+        msg.sequence_number = htonl(42);
+        msg.version = htonl(mmp_protocol_version);
+        msg.capabilities = htonl(mmp_capabilities_supported);
+
+        old_announce old;
+        std::memcpy(&old, &msg, sizeof(old));
+        MMP_EXPECT(ntohl(old.id) == mmp_msgid_announce);
+        MMP_EXPECT(ntohl(old.sequence_number) == 42);
+    }
+
+    {
+        mmp_msg_connect msg;
+        msg.capabilities = htonl(mmp_capabilities_supported);
+
+        old_connect old;
+        std::memcpy(&old, &msg, sizeof(old));
+        MMP_EXPECT(ntohl(old.id) == mmp_msgid_connect);
+    }
+}
+
+
+/// <summary>
+/// Connects a new client to a scripted server that behaves like one which
+/// predates the negotiation, i.e. it only understands the ID of the connect
+/// message and sends moves and button events in the basic format.
+/// </summary>
+static void new_client_old_server(void) {
+    using namespace visus::mmp;
+    using visus::mmp::test::make_address;
+    using visus::mmp::test::wait_until;
+
+    auto network = inproc::network::create();
+    const auto address = make_address(INADDR_LOOPBACK, mmp_default_port);
+    auto server = network->bind(address);
+    auto endpoint = network->bind(make_address(0x7f000002, 0));
+    if (!MMP_EXPECT(server && endpoint)) {
+        return;
+    }
+
+    observation observation;
+    mmp_configuration config;
+    config.context = &observation;
+    config.on_mouse_button = ::on_mouse_button;
+    config.on_mouse_move = ::on_mouse_move;
+    config.server = address;
+
+    mmp_client client(config);
+    client.transport(std::unique_ptr<mmp_transport>(
+        new mmp_inproc_transport(endpoint)));
+    if (!MMP_EXPECT(client.start() == 0)) {
+        return;
+    }
+
+    // The old server registers everyone who sends a datagram that starts
+    // with the ID of the connect message.
+    inproc::datagram datagram;
+    if (!MMP_EXPECT(server->receive(datagram, std::chrono::seconds(1)))) {
+        return;
+    }
+    MMP_EXPECT(datagram.data.size() >= sizeof(old_connect));
+    {
+        old_connect msg;
+        std::memcpy(&msg, datagram.data.data(), sizeof(msg));
+        MMP_EXPECT(ntohl(msg.id) == mmp_msgid_connect);
+    }
+    {
+        // The old server has not announced that it expects
+        // acknowledgements, so the client must not ask for them.
+        wire::view<mmp_msg_connect> msg(datagram.data.data(),
+            datagram.data.size());
+        MMP_EXPECT((msg.capabilities() & mmp_capability_ack) == 0);
+    }
+    const auto peer = datagram.peer;
+
+    {
+        mmp_msg_mouse_move msg;
+        msg.sequence_number = htonl(1);
+        msg.x = htonl(10);
+        msg.y = htonl(20);
+        server->send(peer, &msg, sizeof(msg));
+    }
+    MMP_EXPECT(wait_until([&observation](void) {
+        return (observation.moves == 1);
+    }, std::chrono::seconds(1)));
+    MMP_EXPECT(observation.x == 10);
+    MMP_EXPECT(observation.y == 20);
+
+    {
+        mmp_msg_mouse_button msg;
+        msg.sequence_number = htonl(2);
+        msg.button = mmp_mouse_button_left;
+        msg.down = 1;
+        msg.x = htonl(30);
+        msg.y = htonl(40);
+        server->send(peer, &msg, sizeof(msg));
+    }
+    MMP_EXPECT(wait_until([&observation](void) {
+        return (observation.buttons == 1);
+    }, std::chrono::seconds(1)));
+    MMP_EXPECT(observation.x == 30);
+    MMP_EXPECT(observation.y == 40);
+
+    // The old server has not negotiated acknowledgements, so the client must
+    // not send any.
+    while (server->receive(datagram, std::chrono::milliseconds(200))) {
+        mmp_msg_id id;
+        std::memcpy(&id, datagram.data.data(), sizeof(id));
+        MMP_EXPECT(ntohl(id) != mmp_msgid_ack);
+    }
+}
+
+
+/// <summary>
+/// Checks that new clients and servers interoperate with peers that predate
+/// the negotiation of versions and capabilities. The direction of old clients
+/// and a new server is tested against the server itself in
+/// <c>magicmousepadtest</c>.
+/// </summary>
+int main(void) {
+#if defined(_WIN32)
+    WSADATA wsa_data;
+    if (::WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        return -1;
+    }
+#endif /* defined(_WIN32) */
+
+    new_server_parses_old_connect();
+    new_client_parses_old_announce();
+    old_peers_parse_new_messages();
+    new_client_old_server();
+
+#if defined(_WIN32)
+    ::WSACleanup();
+#endif /* defined(_WIN32) */
+    return visus::mmp::test::failures();
+}
@@ -0,0 +1,452 @@
+﻿// <copyright file="discovery.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <future>
+
+#include "mmp_client.h"
+#include "mmp_discovery.h"
+#include "mmp_platform.h"
+#include "mmpmsg.h"
+#include "mmptest.h"
+
+
+/// <summary>
+/// A magic mouse pad on the loopback interface that answers discovery
+/// requests as it is told.
+/// </summary>
+class fake_server final {
+
+public:
+
+    inline fake_server(void) : _socket(::WSASocket(AF_INET, SOCK_DGRAM,
+            IPPROTO_UDP, nullptr, 0, WSA_FLAG_OVERLAPPED)) {
+        this->_address = visus::mmp::test::make_address(INADDR_LOOPBACK, 0);
+        socklen_t len = sizeof(sockaddr_in);
+        if (!this->_socket
+                || (::bind(this->_socket.get(),
+                    reinterpret_cast<const sockaddr *>(&this->_address),
+                    len) == SOCKET_ERROR)
+                || (::getsockname(this->_socket.get(),
+                    reinterpret_cast<sockaddr *>(&this->_address),
+                    &len) == SOCKET_ERROR)) {
+            this->_socket.reset();
+        }
+    }
+
+    /// <summary>
+    /// Answer the address the server is bound to.
+    /// </summary>
+    inline const sockaddr_storage& address(void) const noexcept {
+        return this->_address;
+    }
+
+    /// <summary>
+    /// Answer whether <paramref name="address"/> designates the server.
+    /// </summary>
+    inline bool is(_In_ const sockaddr_storage& address) const noexcept {
+        auto& l = reinterpret_cast<const sockaddr_in&>(this->_address);
+        auto& r = reinterpret_cast<const sockaddr_in&>(address);
+        return (r.sin_family == AF_INET)
+            && (l.sin_port == r.sin_port)
+            && (l.sin_addr.s_addr == r.sin_addr.s_addr);
+    }
+
+    /// <summary>
+    /// Waits at most <paramref name="timeout"/> for a message of the type
+    /// <typeparamref name="TMessage"/>, skipping all other datagrams.
+    /// </summary>
+    template<class TMessage>
+    bool receive(_Out_ TMessage& message,
+            _Out_ sockaddr_storage& peer,
+            _In_ const std::chrono::milliseconds timeout) {
+        const auto id = TMessage().id;
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+        while (true) {
+            const auto remaining = std::chrono::duration_cast<
+                std::chrono::microseconds>(deadline
+                - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0) {
+                return false;
+            }
+
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(this->_socket.get(), &fds);
+
+            timeval tv;
+            tv.tv_sec = static_cast<long>(remaining.count() / 1000000);
+            tv.tv_usec = static_cast<long>(remaining.count() % 1000000);
+            if (::select(static_cast<int>(this->_socket.get()) + 1, &fds,
+                    nullptr, nullptr, &tv) <= 0) {
+                return false;
+            }
+
+            std::memset(&peer, 0, sizeof(peer));
+            socklen_t len = sizeof(peer);
+            const auto size = ::recvfrom(this->_socket.get(),
+                reinterpret_cast<char *>(&message), sizeof(message), 0,
+                reinterpret_cast<sockaddr *>(&peer), &len);
+            if ((size == sizeof(message)) && (message.id == id)) {
+                return true;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Sends the first <paramref name="size"/> bytes of
+    /// <paramref name="message"/>, which allows for emulating servers that
+    /// predate the later fields.
+    /// </summary>
+    template<class TMessage>
+    void send(_In_ const sockaddr_storage& peer,
+            _In_ const TMessage& message,
+            _In_ const std::size_t size = sizeof(TMessage)) {
+        ::sendto(this->_socket.get(),
+            reinterpret_cast<const char *>(&message),
+            static_cast<int>(size), 0,
+            reinterpret_cast<const sockaddr *>(&peer),
+            (peer.ss_family == AF_INET6)
+                ? sizeof(sockaddr_in6)
+                : sizeof(sockaddr_in));
+    }
+
+    /// <summary>
+    /// Answer whether the server is usable.
+    /// </summary>
+    inline bool valid(void) const noexcept {
+        return static_cast<bool>(this->_socket);
+    }
+
+private:
+
+    sockaddr_storage _address;
+    wil::unique_socket _socket;
+};
+
+
+/// <summary>
+/// Answer the unspecified IPv4 address the discovery binds to.
+/// </summary>
+static sockaddr_storage any_address(void) {
+    return visus::mmp::test::make_address(INADDR_ANY, 0);
+}
+
+
+/// <summary>
+/// The interval between requests must double up to
+/// <see cref="mmp_discovery::max_backoff"/> times the initial one, and the
+/// jitter must not exceed a quarter of the current interval.
+/// </summary>
+static void discovery_backs_off(void) {
+    using std::chrono::milliseconds;
+    const milliseconds interval(100);
+
+    fake_server server;
+    if (!MMP_EXPECT(server.valid())) {
+        return;
+    }
+
+    mmp_discovery discovery(any_address(), interval, interval);
+    if (!MMP_EXPECT(discovery.add_target(server.address()) == 0)) {
+        return;
+    }
+
+    auto now = mmp_discovery::clock::now();
+    const auto deadline = now + std::chrono::hours(1);
+    mmp_msg_discover request;
+    sockaddr_storage peer;
+
+    for (unsigned int i = 0; i < 8; ++i) {
+        const auto expected = (std::min)(interval * (1u << i),
+            interval * mmp_discovery::max_backoff);
+
+        mmp_discovery::time_point wakeup;
+        MMP_EXPECT(discovery.step(now, deadline, wakeup) == 0);
+        MMP_EXPECT(discovery.current_state()
+            == mmp_discovery::state::requesting);
+        MMP_EXPECT(server.receive(request, peer, milliseconds(500)));
+        MMP_EXPECT(request.token != 0);
+
+        const auto backoff = wakeup - now;
+        MMP_EXPECT(backoff >= expected * 3 / 4);
+        MMP_EXPECT(backoff <= expected * 5 / 4);
+
+        // Nothing must be sent before the next request is due.
+        mmp_discovery::time_point early;
+        MMP_EXPECT(discovery.step(now + backoff / 2, deadline, early) == 0);
+        MMP_EXPECT(early == wakeup);
+        MMP_EXPECT(!server.receive(request, peer, milliseconds(20)));
+
+        now = wakeup;
+    }
+}
+
+
+/// <summary>
+/// The discovery must end when the deadline has passed, and running it
+/// without any server answering must time out when the deadline is reached.
+/// </summary>
+static void discovery_honours_deadline(void) {
+    using std::chrono::milliseconds;
+
+    fake_server server;
+    if (!MMP_EXPECT(server.valid())) {
+        return;
+    }
+
+    {
+        mmp_discovery discovery(any_address(), milliseconds(100),
+            milliseconds(100));
+        MMP_EXPECT(discovery.add_target(server.address()) == 0);
+
+        const auto now = mmp_discovery::clock::now();
+        const auto deadline = now + milliseconds(50);
+        mmp_discovery::time_point wakeup;
+        MMP_EXPECT(discovery.step(now, deadline, wakeup) == 0);
+        MMP_EXPECT(wakeup == deadline);
+
+        MMP_EXPECT(discovery.step(deadline, deadline, wakeup) == 0);
+        MMP_EXPECT(discovery.current_state() == mmp_discovery::state::done);
+        MMP_EXPECT(discovery.best() == nullptr);
+    }
+
+    {
+        mmp_discovery discovery(any_address(), milliseconds(50),
+            milliseconds(50));
+        MMP_EXPECT(discovery.add_target(server.address()) == 0);
+
+        const auto begin = mmp_discovery::clock::now();
+        const auto status = discovery.run(begin + milliseconds(300),
+            [](void) { return false; });
+        const auto elapsed = mmp_discovery::clock::now() - begin;
+        MMP_EXPECT(status == HRESULT_FROM_WIN32(ERROR_TIMEOUT));
+        MMP_EXPECT(elapsed >= milliseconds(300));
+        MMP_EXPECT(elapsed < milliseconds(1000));
+    }
+
+    {
+        mmp_discovery discovery(any_address(), milliseconds(50),
+            milliseconds(50));
+        MMP_EXPECT(discovery.add_target(server.address()) == 0);
+        const auto status = discovery.run(
+            mmp_discovery::clock::now() + std::chrono::seconds(10),
+            [](void) { return true; });
+        MMP_EXPECT(status == HRESULT_FROM_WIN32(ERROR_CANCELLED));
+    }
+}
+
+
+/// <summary>
+/// Requests a server from <paramref name="first"/> and
+/// <paramref name="second"/>, which answer with the given loads, and answer
+/// which one was selected. If <paramref name="old_second"/> is set, the
+/// second one answers like a server that predates the selection.
+/// </summary>
+static const fake_server *discover_between(_In_ fake_server& first,
+        _In_ const std::uint32_t first_load,
+        _In_ fake_server& second,
+        _In_ const std::uint32_t second_load,
+        _In_ const bool old_second) {
+    using std::chrono::milliseconds;
+
+    mmp_discovery discovery(any_address(), milliseconds(100),
+        milliseconds(100));
+    MMP_EXPECT(discovery.add_target(first.address()) == 0);
+    MMP_EXPECT(discovery.add_target(second.address()) == 0);
+
+    const auto now = mmp_discovery::clock::now();
+    const auto deadline = now + std::chrono::seconds(5);
+    mmp_discovery::time_point wakeup;
+    MMP_EXPECT(discovery.step(now, deadline, wakeup) == 0);
+
+    {
+        mmp_msg_discover request;
+        sockaddr_storage peer;
+        if (!MMP_EXPECT(first.receive(request, peer, milliseconds(500)))) {
+            return nullptr;
+        }
+
+        mmp_msg_announce announcement;
+        announcement.load = htonl(first_load);
+        announcement.token = request.token;
+        first.send(peer, announcement, sizeof(announcement));
+    }
+
+    {
+        mmp_msg_discover request;
+        sockaddr_storage peer;
+        if (!MMP_EXPECT(second.receive(request, peer, milliseconds(500)))) {
+            return nullptr;
+        }
+
+        mmp_msg_announce announcement;
+        announcement.load = htonl(second_load);
+        announcement.token = request.token;
+        second.send(peer, announcement, old_second
+            ? offsetof(mmp_msg_announce, version)
+            : sizeof(announcement));
+    }
+
+    // Both answers are collected within the selection window, after which
+    // the discovery is done.
+    MMP_EXPECT(discovery.run(deadline, [](void) { return false; }) == 0);
+    MMP_EXPECT(discovery.current_state() == mmp_discovery::state::done);
+
+    auto best = discovery.best();
+    if (!MMP_EXPECT(best != nullptr)) {
+        return nullptr;
+    }
+
+    if (first.is(best->address)) {
+        MMP_EXPECT(best->load == first_load);
+        MMP_EXPECT(best->version == mmp_protocol_version);
+        return &first;
+
+    } else if (second.is(best->address)) {
+        MMP_EXPECT(best->load == (old_second ? 0 : second_load));
+        MMP_EXPECT(best->version == (old_second ? 0 : mmp_protocol_version));
+        return &second;
+
+    } else {
+        MMP_EXPECT(!"The selected server is none of the fake ones.");
+        return nullptr;
+    }
+}
+
+
+/// <summary>
+/// Among servers on the same machine, the least loaded one must win, and a
+/// server that does not tell the round-trip time must be assumed to be far
+/// away.
+/// </summary>
+static void discovery_selects_best(void) {
+    fake_server a, b;
+    if (!MMP_EXPECT(a.valid() && b.valid())) {
+        return;
+    }
+
+    MMP_EXPECT(discover_between(a, 5, b, 0, false) == &b);
+    MMP_EXPECT(discover_between(a, 0, b, 5, false) == &a);
+    MMP_EXPECT(discover_between(a, 5, b, 0, true) == &a);
+}
+
+
+/// <summary>
+/// Counts the moves reported by the client under test.
+/// </summary>
+static void WINAPIV count_moves(_In_ const int32_t x,
+        _In_ const int32_t y,
+        _In_opt_ void *context) {
+    (void) x;
+    (void) y;
+    ++*static_cast<std::atomic<int> *>(context);
+}
+
+
+/// <summary>
+/// A client configured with the address of a server must ask it for its
+/// capabilities, report the state snapshot before the connection attempt
+/// completes and acknowledge button events if the server supports it.
+/// </summary>
+static void client_probes_configured_server(void) {
+    using std::chrono::milliseconds;
+
+    fake_server server;
+    if (!MMP_EXPECT(server.valid())) {
+        return;
+    }
+
+    std::atomic<int> moves(0);
+    mmp_configuration config;
+    config.context = &moves;
+    config.flags = mmp_flag_no_shared_memory;
+    config.on_mouse_move = ::count_moves;
+    config.server = server.address();
+
+    mmp_client client(config);
+    auto connected = std::async(std::launch::async, [&client](void) {
+        const auto retval = client.discover();
+        return (retval == 0) ? client.start() : retval;
+    });
+
+    sockaddr_storage peer;
+    {
+        mmp_msg_discover request;
+        if (!MMP_EXPECT(server.receive(request, peer, milliseconds(1000)))) {
+            return;
+        }
+
+        mmp_msg_announce announcement;
+        announcement.sequence_number = htonl(42);
+        announcement.token = request.token;
+        server.send(peer, announcement);
+    }
+
+    {
+        mmp_msg_connect request;
+        if (!MMP_EXPECT(server.receive(request, peer, milliseconds(1000)))) {
+            return;
+        }
+        MMP_EXPECT((ntohl(request.capabilities) & mmp_capability_ack) != 0);
+        MMP_EXPECT((ntohl(request.capabilities) & mmp_capability_state)
+            != 0);
+    }
+
+    // The client waits for the snapshot before it reports that it is
+    // connected.
+    MMP_EXPECT(connected.wait_for(milliseconds(50))
+        == std::future_status::timeout);
+    {
+        mmp_msg_state state;
+        state.sequence_number = htonl(42);
+        server.send(peer, state);
+    }
+    MMP_EXPECT(connected.get() == 0);
+    MMP_EXPECT(moves == 1);
+
+    {
+        mmp_msg_mouse_button msg;
+        msg.sequence_number = htonl(43);
+        msg.button = mmp_mouse_button_left;
+        msg.down = 1;
+        server.send(peer, msg);
+    }
+    {
+        mmp_msg_ack ack;
+        MMP_EXPECT(server.receive(ack, peer, milliseconds(1000)));
+        MMP_EXPECT(ntohl(ack.sequence_number) == 43);
+    }
+}
+
+
+/// <summary>
+/// Checks the timing and the selection of the discovery against fake servers
+/// on the loopback interface.
+/// </summary>
+int main(void) {
+#if defined(_WIN32)
+    WSADATA wsa_data;
+    if (::WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        return -1;
+    }
+#endif /* defined(_WIN32) */
+
+    discovery_backs_off();
+    discovery_honours_deadline();
+    discovery_selects_best();
+    client_probes_configured_server();
+
+#if defined(_WIN32)
+    ::WSACleanup();
+#endif /* defined(_WIN32) */
+    return visus::mmp::test::failures();
+}
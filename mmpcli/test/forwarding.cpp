@@ -0,0 +1,132 @@
+﻿// <copyright file="forwarding.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "mmp_client.h"
+#include "mmp_inproc_transport.h"
+#include "mmpinproc.h"
+#include "mmpmsg.h"
+#include "mmptest.h"
+
+
+/// <summary>
+/// Sends a move with the given <paramref name="sequence_number"/> from
+/// <paramref name="server"/> to <paramref name="client"/>.
+/// </summary>
+static void send_move(_In_ visus::mmp::inproc::endpoint& server,
+        _In_ const sockaddr_storage& client,
+        _In_ const mmp_seq_no sequence_number) {
+    mmp_msg_mouse_move msg;
+    msg.sequence_number = htonl(sequence_number);
+    server.send(client, &msg, sizeof(msg));
+}
+
+
+/// <summary>
+/// A client must only forward the datagrams it has accepted from its own
+/// server, because the recipients of a relay trust it like their server.
+/// Duplicates and datagrams from anyone else must not be forwarded.
+/// </summary>
+static void client_forwards_accepted_datagrams(void) {
+    using namespace visus::mmp;
+    using visus::mmp::test::make_address;
+    using visus::mmp::test::wait_until;
+
+    auto network = inproc::network::create();
+    auto server = network->bind(make_address(0x7f000001, mmp_default_port));
+    auto rogue = network->bind(make_address(0x7f000003, mmp_default_port));
+    auto endpoint = network->bind(make_address(0x7f000004, 0));
+    if (!MMP_EXPECT(server && rogue && endpoint)) {
+        return;
+    }
+
+    std::mutex lock;
+    std::vector<std::pair<mmp_msg_id, mmp_seq_no>> forwarded;
+
+    mmp_configuration config;
+    config.server = server->address();
+
+    mmp_client client(config);
+    client.transport(std::unique_ptr<mmp_transport>(
+        new mmp_inproc_transport(endpoint)));
+    client.forward([&lock, &forwarded](const char *data, const DWORD size) {
+        MMP_EXPECT(size >= 2 * sizeof(mmp_msg_id));
+        mmp_msg_id id;
+        mmp_seq_no sequence_number;
+        std::memcpy(&id, data, sizeof(id));
+        std::memcpy(&sequence_number, data + sizeof(id),
+            sizeof(sequence_number));
+        std::lock_guard<std::mutex> l(lock);
+        forwarded.emplace_back(ntohl(id), ntohl(sequence_number));
+    }, mmp_capability_heartbeat);
+    if (!MMP_EXPECT(client.start() == 0)) {
+        return;
+    }
+
+    inproc::datagram datagram;
+    if (!MMP_EXPECT(server->receive(datagram, std::chrono::seconds(1)))) {
+        return;
+    }
+    const auto peer = datagram.peer;
+
+    send_move(*server, peer, 1);
+    send_move(*server, peer, 1);
+    {
+        mmp_msg_heartbeat msg;
+        msg.sequence_number = htonl(1);
+        msg.epoch = htonl(1);
+        server->send(peer, &msg, sizeof(msg));
+    }
+    {
+        mmp_msg_heartbeat msg;
+        msg.sequence_number = htonl(1);
+        msg.epoch = htonl(2);
+        rogue->send(peer, &msg, sizeof(msg));
+    }
+    send_move(*rogue, peer, 2);
+    send_move(*server, peer, 3);
+
+    MMP_EXPECT(wait_until([&lock, &forwarded](void) {
+        std::lock_guard<std::mutex> l(lock);
+        return (forwarded.size() >= 3);
+    }, std::chrono::seconds(1)));
+
+    std::lock_guard<std::mutex> l(lock);
+    if (!MMP_EXPECT(forwarded.size() == 3)) {
+        return;
+    }
+    MMP_EXPECT(forwarded[0].first == mmp_msgid_mouse_move);
+    MMP_EXPECT(forwarded[0].second == 1);
+    MMP_EXPECT(forwarded[1].first == mmp_msgid_heartbeat);
+    MMP_EXPECT(forwarded[2].first == mmp_msgid_mouse_move);
+    MMP_EXPECT(forwarded[2].second == 3);
+}
+
+
+/// <summary>
+/// Checks which datagrams a client passes on to a relay.
+/// </summary>
+int main(void) {
+#if defined(_WIN32)
+    WSADATA wsa_data;
+    if (::WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        return -1;
+    }
+#endif /* defined(_WIN32) */
+
+    client_forwards_accepted_datagrams();
+
+#if defined(_WIN32)
+    ::WSACleanup();
+#endif /* defined(_WIN32) */
+    return visus::mmp::test::failures();
+}
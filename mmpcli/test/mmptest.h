@@ -0,0 +1,96 @@
+﻿// <copyright file="mmptest.h" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#if !defined(_MMPTEST_H)
+#define _MMPTEST_H
+#pragma once
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include "mmpapi.h"
+
+
+namespace visus {
+namespace mmp {
+namespace test {
+
+    /// <summary>
+    /// Answer the number of expectations that have failed in the current
+    /// test executable, which is what its <c>main</c> should return.
+    /// </summary>
+    inline int& failures(void) noexcept {
+        static int retval = 0;
+        return retval;
+    }
+
+    /// <summary>
+    /// Reports the given <paramref name="expression"/> if the
+    /// <paramref name="condition"/> does not hold and counts it as failure.
+    /// </summary>
+    /// <returns><paramref name="condition"/>.</returns>
+    inline bool expect(_In_ const bool condition,
+            _In_z_ const char *expression,
+            _In_z_ const char *file,
+            _In_ const int line) noexcept {
+        if (!condition) {
+            std::fprintf(stderr, "%s(%d): expectation \"%s\" failed.\n",
+                file, line, expression);
+            ++failures();
+        }
+
+        return condition;
+    }
+
+    /// <summary>
+    /// Answer an IPv4 address in host-byte order as socket address.
+    /// </summary>
+    inline sockaddr_storage make_address(_In_ const std::uint32_t host,
+            _In_ const std::uint16_t port) noexcept {
+        sockaddr_storage retval;
+        std::memset(&retval, 0, sizeof(retval));
+        auto& a = reinterpret_cast<sockaddr_in&>(retval);
+        a.sin_family = AF_INET;
+        a.sin_addr.s_addr = htonl(host);
+        a.sin_port = htons(port);
+        return retval;
+    }
+
+    /// <summary>
+    /// Polls <paramref name="predicate"/> until it holds or until the
+    /// <paramref name="timeout"/> has elapsed.
+    /// </summary>
+    /// <returns>The last result of <paramref name="predicate"/>.</returns>
+    template<class TPredicate>
+    bool wait_until(_In_ TPredicate&& predicate,
+            _In_ const std::chrono::milliseconds timeout) {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!predicate()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return predicate();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        return true;
+    }
+
+} /* namespace test */
+} /* namespace mmp */
+} /* namespace visus */
+
+
+/// <summary>
+/// Checks that <paramref name="condition"/> holds and reports the location
+/// of the check if it does not.
+/// </summary>
+#define MMP_EXPECT(condition) ::visus::mmp::test::expect(!!(condition),     \
+    #condition, __FILE__, __LINE__)
+
+#endif /* !defined(_MMPTEST_H) */
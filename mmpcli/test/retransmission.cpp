@@ -0,0 +1,146 @@
+﻿// <copyright file="retransmission.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+
+#include "mmp_client.h"
+#include "mmp_inproc_transport.h"
+#include "mmpinproc.h"
+#include "mmpmsg.h"
+#include "mmptest.h"
+
+
+/// <summary>
+/// What the callbacks of the client under test have seen.
+/// </summary>
+struct observation {
+    std::atomic<std::uint32_t> buttons;
+    std::atomic<int> events;
+
+    inline observation(void) noexcept : buttons(0), events(0) { }
+};
+
+
+/// <summary>
+/// Records a button event in the <see cref="observation"/>.
+/// </summary>
+static void WINAPIV on_mouse_button(_In_ const mmp_mouse_button button,
+        _In_ const bool down,
+        _In_ const int32_t x,
+        _In_ const int32_t y,
+        _In_opt_ void *context) {
+    (void) x;
+    (void) y;
+    auto o = static_cast<observation *>(context);
+    if (down) {
+        o->buttons |= button;
+    } else {
+        o->buttons &= ~static_cast<std::uint32_t>(button);
+    }
+    ++o->events;
+}
+
+
+/// <summary>
+/// Sends the button event with the given <paramref name="sequence_number"/>
+/// from <paramref name="server"/> to <paramref name="client"/>.
+/// </summary>
+static void send_button(_In_ visus::mmp::inproc::endpoint& server,
+        _In_ const sockaddr_storage& client,
+        _In_ const mmp_seq_no sequence_number,
+        _In_ const mmp_mouse_button button,
+        _In_ const bool down) {
+    mmp_msg_mouse_button msg;
+    msg.sequence_number = htonl(sequence_number);
+    msg.button = button;
+    msg.down = down ? 1 : 0;
+    server.send(client, &msg, sizeof(msg));
+}
+
+
+/// <summary>
+/// A retransmitted button event that arrives after a newer transition of the
+/// same button must not be reported, because the button would remain stuck
+/// in the state of the older event. A late event of another button must be
+/// reported exactly once.
+/// </summary>
+static void late_retransmission_is_ordered(void) {
+    using namespace visus::mmp;
+    using visus::mmp::test::make_address;
+    using visus::mmp::test::wait_until;
+
+    auto network = inproc::network::create();
+    const auto address = make_address(INADDR_LOOPBACK, mmp_default_port);
+    auto server = network->bind(address);
+    auto endpoint = network->bind(make_address(0x7f000002, 0));
+    if (!MMP_EXPECT(server && endpoint)) {
+        return;
+    }
+
+    observation observation;
+    mmp_configuration config;
+    config.context = &observation;
+    config.on_mouse_button = ::on_mouse_button;
+    config.server = address;
+
+    mmp_client client(config);
+    client.transport(std::unique_ptr<mmp_transport>(
+        new mmp_inproc_transport(endpoint)));
+    if (!MMP_EXPECT(client.start() == 0)) {
+        return;
+    }
+
+    inproc::datagram datagram;
+    if (!MMP_EXPECT(server->receive(datagram, std::chrono::seconds(1)))) {
+        return;
+    }
+    const auto peer = datagram.peer;
+
+    // The press 1 is lost, the release 2 is delivered and the press 1 is
+    // retransmitted afterwards.
+    send_button(*server, peer, 2, mmp_mouse_button_left, false);
+    send_button(*server, peer, 1, mmp_mouse_button_left, true);
+
+    // The press 3 of another button is lost, the press 4 of the left button
+    // is delivered, and the press 3 is retransmitted twice afterwards.
+    send_button(*server, peer, 4, mmp_mouse_button_left, true);
+    send_button(*server, peer, 3, mmp_mouse_button_right, true);
+    send_button(*server, peer, 3, mmp_mouse_button_right, true);
+
+    // The release 5 marks the end of the sequence.
+    send_button(*server, peer, 5, mmp_mouse_button_right, false);
+
+    MMP_EXPECT(wait_until([&observation](void) {
+        return (observation.events == 4);
+    }, std::chrono::seconds(1)));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    MMP_EXPECT(observation.events == 4);
+    MMP_EXPECT(observation.buttons == mmp_mouse_button_left);
+}
+
+
+/// <summary>
+/// Checks how the client orders button events that have been retransmitted.
+/// </summary>
+int main(void) {
+#if defined(_WIN32)
+    WSADATA wsa_data;
+    if (::WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        return -1;
+    }
+#endif /* defined(_WIN32) */
+
+    late_retransmission_is_ordered();
+
+#if defined(_WIN32)
+    ::WSACleanup();
+#endif /* defined(_WIN32) */
+    return visus::mmp::test::failures();
+}
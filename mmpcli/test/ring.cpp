@@ -0,0 +1,200 @@
+﻿// <copyright file="ring.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include <atomic>
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "mmpmsg.h"
+#include "mmpshm.h"
+#include "mmptest.h"
+
+
+/// <summary>
+/// Publishes an event of <see cref="visus::mmp::shm::max_datagram"/> bytes
+/// that all hold the low byte of <paramref name="value"/>.
+/// </summary>
+static void publish(_In_ visus::mmp::shm::ring& ring,
+        _In_ const std::uint64_t value) {
+    char data[visus::mmp::shm::max_datagram];
+    std::memset(data, static_cast<int>(value & 0xff), sizeof(data));
+    ring.publish(data, sizeof(data), [](const std::size_t) { });
+}
+
+
+/// <summary>
+/// Answer whether all bytes of the event in <paramref name="data"/> are the
+/// same, which they are unless the event has been torn.
+/// </summary>
+static bool consistent(_In_reads_bytes_(size) const char *data,
+        _In_ const std::size_t size) {
+    for (std::size_t i = 1; i < size; ++i) {
+        if (data[i] != data[0]) {
+            return false;
+        }
+    }
+
+    return (size == visus::mmp::shm::max_datagram);
+}
+
+
+/// <summary>
+/// A reader that has fallen further behind than the capacity must be told
+/// that it has been lapped, continue with the oldest event still available
+/// and be able to resynchronise from the state.
+/// </summary>
+static void lapped_reader_resynchronises(void) {
+    using namespace visus::mmp;
+
+    auto ring = std::make_unique<shm::ring>();
+    ring->initialise();
+
+    mmp_msg_state state;
+    state.sequence_number = htonl(42);
+    ring->store_state(state);
+
+    const std::uint64_t extra = 10;
+    for (std::uint64_t i = 0; i < shm::capacity + extra; ++i) {
+        publish(*ring, i);
+    }
+
+    char data[shm::max_datagram];
+    std::size_t size = 0;
+    std::uint64_t cursor = 0;
+    MMP_EXPECT(ring->read(cursor, data, size) == shm::read_status::lapped);
+    MMP_EXPECT(cursor == extra + 1);
+    MMP_EXPECT(consistent(data, size));
+    MMP_EXPECT(data[0] == static_cast<char>(extra));
+
+    for (std::uint64_t i = extra + 1; i < shm::capacity + extra; ++i) {
+        if (!MMP_EXPECT(ring->read(cursor, data, size)
+                == shm::read_status::read)) {
+            return;
+        }
+        MMP_EXPECT(data[0] == static_cast<char>(i & 0xff));
+    }
+
+    MMP_EXPECT(ring->read(cursor, data, size) == shm::read_status::empty);
+    MMP_EXPECT(size == 0);
+
+    mmp_msg_state resync;
+    ring->load_state(resync);
+    MMP_EXPECT(ntohl(resync.sequence_number) == 42);
+}
+
+
+/// <summary>
+/// A reader whose cursor is ahead of a writer that has started over must
+/// continue with the events of the new writer.
+/// </summary>
+static void reader_follows_new_writer(void) {
+    using namespace visus::mmp;
+
+    auto ring = std::make_unique<shm::ring>();
+    ring->initialise();
+    publish(*ring, 1);
+    publish(*ring, 2);
+
+    char data[shm::max_datagram];
+    std::size_t size = 0;
+    std::uint64_t cursor = 5;
+    MMP_EXPECT(ring->read(cursor, data, size) == shm::read_status::empty);
+    MMP_EXPECT(cursor == 2);
+
+    publish(*ring, 3);
+    MMP_EXPECT(ring->read(cursor, data, size) == shm::read_status::read);
+    MMP_EXPECT(data[0] == 3);
+}
+
+
+/// <summary>
+/// A reader that finds the writer reusing the slot at its cursor must skip to
+/// the oldest event the writer cannot be writing to.
+/// </summary>
+static void reader_skips_slot_being_written(void) {
+    using namespace visus::mmp;
+
+    auto ring = std::make_unique<shm::ring>();
+    ring->initialise();
+    for (std::uint64_t i = 0; i < shm::capacity; ++i) {
+        publish(*ring, i);
+    }
+
+    // Pretend that the writer has started to overwrite the oldest event.
+    ring->slots[0].sequence.store(2 * shm::capacity + 1);
+
+    char data[shm::max_datagram];
+    std::size_t size = 0;
+    std::uint64_t cursor = 0;
+    MMP_EXPECT(ring->read(cursor, data, size) == shm::read_status::lapped);
+    MMP_EXPECT(cursor == 2);
+    MMP_EXPECT(data[0] == 1);
+}
+
+
+/// <summary>
+/// A reader that is overtaken while the writer keeps publishing must never
+/// see a torn event and must see the events in order.
+/// </summary>
+static void racing_reader_sees_no_torn_events(void) {
+    using namespace visus::mmp;
+
+    auto ring = std::make_unique<shm::ring>();
+    ring->initialise();
+
+    const std::uint64_t total = 64 * shm::capacity;
+    std::atomic<bool> done(false);
+    std::thread writer([&ring, &done, total](void) {
+        for (std::uint64_t i = 0; i < total; ++i) {
+            publish(*ring, i);
+        }
+        done.store(true);
+    });
+
+    char data[shm::max_datagram];
+    std::size_t size = 0;
+    std::uint64_t cursor = 0;
+    std::uint64_t last = 0;
+    std::uint64_t torn = 0;
+    std::uint64_t unordered = 0;
+
+    while (!done.load() || (cursor < total)) {
+        const auto previous = cursor;
+        const auto status = ring->read(cursor, data, size);
+        if (status == shm::read_status::empty) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (!consistent(data, size)
+                || (data[0] != static_cast<char>((cursor - 1) & 0xff))) {
+            ++torn;
+        }
+        if ((previous > 0) && (cursor <= last)) {
+            ++unordered;
+        }
+        last = cursor;
+    }
+
+    writer.join();
+    MMP_EXPECT(torn == 0);
+    MMP_EXPECT(unordered == 0);
+}
+
+
+/// <summary>
+/// Checks the sequence locks of the ring in shared memory, which the server
+/// uses for its sender threads as well.
+/// </summary>
+int main(void) {
+    lapped_reader_resynchronises();
+    reader_follows_new_writer();
+    reader_skips_slot_being_written();
+    racing_reader_sees_no_torn_events();
+    return visus::mmp::test::failures();
+}
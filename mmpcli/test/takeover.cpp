@@ -0,0 +1,121 @@
+﻿// <copyright file="takeover.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+
+#include "mmp_client.h"
+#include "mmp_inproc_transport.h"
+#include "mmpinproc.h"
+#include "mmpmsg.h"
+#include "mmptest.h"
+
+
+/// <summary>
+/// Sends a heartbeat of the session <paramref name="epoch"/> from
+/// <paramref name="server"/> to <paramref name="client"/>.
+/// </summary>
+static void heartbeat(_In_ visus::mmp::inproc::endpoint& server,
+        _In_ const sockaddr_storage& client,
+        _In_ const std::uint32_t epoch) {
+    mmp_msg_heartbeat msg;
+    msg.epoch = htonl(epoch);
+    server.send(client, &msg, sizeof(msg));
+}
+
+
+/// <summary>
+/// Answer whether <paramref name="server"/> receives a connect message
+/// within <paramref name="timeout"/>, and if so, from where.
+/// </summary>
+static bool receive_connect(_In_ visus::mmp::inproc::endpoint& server,
+        _Out_ sockaddr_storage& client,
+        _In_ const std::chrono::milliseconds timeout) {
+    visus::mmp::inproc::datagram datagram;
+    while (server.receive(datagram, timeout)) {
+        mmp_msg_id id;
+        std::memcpy(&id, datagram.data.data(), sizeof(id));
+        if (ntohl(id) == mmp_msgid_connect) {
+            client = datagram.peer;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/// <summary>
+/// A client must only follow a new session started by its server, by the
+/// configured standby or by a server it has discovered. If anyone else
+/// claims to have started one, it must search its server again instead.
+/// </summary>
+static void client_follows_known_servers(void) {
+    using namespace visus::mmp;
+    using std::chrono::milliseconds;
+    using visus::mmp::test::make_address;
+
+    auto network = inproc::network::create();
+    auto primary = network->bind(make_address(0x7f000001, mmp_default_port));
+    auto standby = network->bind(make_address(0x7f000002, mmp_default_port));
+    auto rogue = network->bind(make_address(0x7f000003, mmp_default_port));
+    auto endpoint = network->bind(make_address(0x7f000004, 0));
+    if (!MMP_EXPECT(primary && standby && rogue && endpoint)) {
+        return;
+    }
+
+    mmp_configuration config;
+    config.flags = mmp_flag_reconnect;
+    config.heartbeat_timeout = 10000;
+    config.server = primary->address();
+    config.standby = standby->address();
+
+    mmp_client client(config);
+    client.transport(std::unique_ptr<mmp_transport>(
+        new mmp_inproc_transport(endpoint)));
+    if (!MMP_EXPECT(client.start() == 0)) {
+        return;
+    }
+
+    sockaddr_storage peer;
+    if (!MMP_EXPECT(receive_connect(*primary, peer, milliseconds(1000)))) {
+        return;
+    }
+    heartbeat(*primary, peer, 1);
+
+    // The rogue is ignored, but the client makes sure that its server is
+    // still there.
+    heartbeat(*rogue, peer, 2);
+    MMP_EXPECT(receive_connect(*primary, peer, milliseconds(1000)));
+    MMP_EXPECT(!receive_connect(*rogue, peer, milliseconds(100)));
+
+    // The standby is followed once it has taken over.
+    heartbeat(*standby, peer, 3);
+    MMP_EXPECT(receive_connect(*standby, peer, milliseconds(1000)));
+    MMP_EXPECT(!receive_connect(*rogue, peer, milliseconds(100)));
+}
+
+
+/// <summary>
+/// Checks whom a client follows if a server starts a new session.
+/// </summary>
+int main(void) {
+#if defined(_WIN32)
+    WSADATA wsa_data;
+    if (::WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        return -1;
+    }
+#endif /* defined(_WIN32) */
+
+    client_follows_known_servers();
+
+#if defined(_WIN32)
+    ::WSACleanup();
+#endif /* defined(_WIN32) */
+    return visus::mmp::test::failures();
+}
@@ -0,0 +1,256 @@
+﻿// <copyright file="shmbench.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <WinSock2.h>
+#include <ws2ipdef.h>
+#include <WS2tcpip.h>
+#include <Windows.h>
+
+#include "mmpshm.h"
+
+
+/// <summary>
+/// The number of events sent for each measurement.
+/// </summary>
+static constexpr std::size_t events = 2000;
+
+
+/// <summary>
+/// The latency and CPU time measured for one transport.
+/// </summary>
+struct result {
+    double mean;
+    double p99;
+    double receiver_cpu;
+    double sender_cpu;
+};
+
+
+/// <summary>
+/// Answer the current value of the performance counter.
+/// </summary>
+static std::int64_t now(void) noexcept {
+    LARGE_INTEGER retval;
+    ::QueryPerformanceCounter(&retval);
+    return retval.QuadPart;
+}
+
+
+/// <summary>
+/// Answer the user and kernel time the given <paramref name="thread"/> has
+/// consumed in microseconds.
+/// </summary>
+static double cpu_time(_In_ const HANDLE thread) noexcept {
+    FILETIME creation, exit, kernel, user;
+    if (!::GetThreadTimes(thread, &creation, &exit, &kernel, &user)) {
+        return 0.0;
+    }
+
+    const auto k = (static_cast<std::uint64_t>(kernel.dwHighDateTime) << 32)
+        | kernel.dwLowDateTime;
+    const auto u = (static_cast<std::uint64_t>(user.dwHighDateTime) << 32)
+        | user.dwLowDateTime;
+    return static_cast<double>(k + u) / 10.0;
+}
+
+
+/// <summary>
+/// Sends <see cref="events"/> events that carry the time they were sent at,
+/// pausing between them like a mouse does such that the receiver goes to
+/// sleep every time, and summarises the latencies the receiver reports.
+/// </summary>
+template<class TSend, class TReceive>
+static result measure(_In_ TSend&& send, _In_ TReceive&& receive) {
+    LARGE_INTEGER frequency;
+    ::QueryPerformanceFrequency(&frequency);
+
+    std::vector<double> latencies;
+    latencies.reserve(events);
+    double receiver_cpu = 0.0;
+
+    std::thread receiver([&](void) {
+        const auto thread = ::GetCurrentThread();
+        const auto begin = cpu_time(thread);
+        char buffer[visus::mmp::shm::max_datagram];
+
+        while (latencies.size() < events) {
+            if (!receive(buffer)) {
+                break;
+            }
+
+            std::int64_t sent;
+            std::memcpy(&sent, buffer, sizeof(sent));
+            latencies.push_back(1000.0 * 1000.0
+                * static_cast<double>(now() - sent)
+                / static_cast<double>(frequency.QuadPart));
+        }
+
+        receiver_cpu = cpu_time(thread) - begin;
+    });
+
+    // Give the receiver the chance to block before the first event.
+    ::Sleep(10);
+
+    const auto thread = ::GetCurrentThread();
+    auto sender_cpu = cpu_time(thread);
+    char datagram[sizeof(mmp_msg_mouse_move_ts)] = { 0 };
+    for (std::size_t e = 0; e < events; ++e) {
+        const auto t = now();
+        std::memcpy(datagram, &t, sizeof(t));
+        send(datagram, sizeof(datagram));
+        ::Sleep(1);
+    }
+    sender_cpu = cpu_time(thread) - sender_cpu;
+
+    receiver.join();
+
+    result retval;
+    ::ZeroMemory(&retval, sizeof(retval));
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        for (auto l : latencies) {
+            retval.mean += l;
+        }
+        retval.mean /= static_cast<double>(latencies.size());
+        retval.p99 = latencies[latencies.size() * 99 / 100];
+    }
+    retval.receiver_cpu = receiver_cpu / static_cast<double>(events);
+    retval.sender_cpu = sender_cpu / static_cast<double>(events);
+    return retval;
+}
+
+
+/// <summary>
+/// Measures the latency and the CPU time per event of a loopback UDP
+/// socket.
+/// </summary>
+static bool measure_udp(_Out_ result& result) {
+    auto client = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    auto server = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if ((client == INVALID_SOCKET) || (server == INVALID_SOCKET)) {
+        return false;
+    }
+
+    sockaddr_in address;
+    ::ZeroMemory(&address, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+    ::bind(client, reinterpret_cast<const sockaddr *>(&address),
+        sizeof(address));
+    int len = sizeof(address);
+    ::getsockname(client, reinterpret_cast<sockaddr *>(&address), &len);
+
+    result = measure([&](const char *data, const int size) {
+            ::sendto(server, data, size, 0,
+                reinterpret_cast<const sockaddr *>(&address),
+                sizeof(address));
+        },
+        [client](char *buffer) {
+            return (::recv(client, buffer,
+                static_cast<int>(visus::mmp::shm::max_datagram), 0) > 0);
+        });
+
+    ::closesocket(client);
+    ::closesocket(server);
+    return true;
+}
+
+
+/// <summary>
+/// Measures the latency and the CPU time per event of the shared memory,
+/// following the protocol of the server and the client library.
+/// </summary>
+static bool measure_shm(_Out_ result& result) {
+    using namespace visus::mmp;
+    typedef shm::ring ring_type;
+
+    const auto mapping = ::CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr,
+        PAGE_READWRITE, 0, static_cast<DWORD>(sizeof(ring_type)), nullptr);
+    if (mapping == NULL) {
+        return false;
+    }
+
+    auto ring = static_cast<ring_type *>(::MapViewOfFile(mapping,
+        FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(ring_type)));
+    const auto event = ::CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    if ((ring == nullptr) || (event == NULL)) {
+        ::CloseHandle(mapping);
+        return false;
+    }
+
+    ring->initialise();
+    auto& subscriber = ring->subscribers[0];
+    subscriber.process.store(::GetCurrentProcessId());
+    std::uint64_t cursor = ring->published.load();
+
+    result = measure([&](const char *data, const int size) {
+            ring->publish(data, static_cast<std::size_t>(size),
+                [event](const std::size_t) { ::SetEvent(event); });
+        },
+        [&](char *buffer) {
+            while (true) {
+                std::size_t size = 0;
+                const auto status = ring->read(cursor, buffer, size);
+                if (status != shm::read_status::empty) {
+                    return true;
+                }
+
+                subscriber.waiting.store(1);
+                if (ring->published.load() <= cursor) {
+                    ::WaitForSingleObject(event, INFINITE);
+                }
+                subscriber.waiting.store(0);
+            }
+        });
+
+    ::CloseHandle(event);
+    ::UnmapViewOfFile(ring);
+    ::CloseHandle(mapping);
+    return true;
+}
+
+
+/// <summary>
+/// Compares the latency and the CPU time per event of loopback UDP and the
+/// shared memory the server publishes its events in for local clients.
+/// </summary>
+int main(void) {
+    WSADATA wsa_data;
+    if (::WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        std::fprintf(stderr, "Failed to initialise Winsock.\n");
+        return -1;
+    }
+
+    std::printf("%-10s %14s %14s %18s %18s\n", "transport", "mean [us]",
+        "p99 [us]", "receiver [us/ev]", "sender [us/ev]");
+
+    result r;
+    if (measure_udp(r)) {
+        std::printf("%-10s %14.1f %14.1f %18.2f %18.2f\n", "udp", r.mean,
+            r.p99, r.receiver_cpu, r.sender_cpu);
+    } else {
+        std::fprintf(stderr, "Failed to create the loopback sockets.\n");
+    }
+
+    if (measure_shm(r)) {
+        std::printf("%-10s %14.1f %14.1f %18.2f %18.2f\n", "shm", r.mean,
+            r.p99, r.receiver_cpu, r.sender_cpu);
+    } else {
+        std::fprintf(stderr, "Failed to create the shared memory.\n");
+    }
+
+    ::WSACleanup();
+    return 0;
+}
@@ -0,0 +1,309 @@
+﻿// <copyright file="uringbench.cpp" company="Visualisierungsinstitut der Universität Stuttgart">
+// Copyright © 2025 Visualisierungsinstitut der Universität Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Müller</author>
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "mmpmsg.h"
+#include "mmp_udp_transport.h"
+#include "mmp_uring_transport.h"
+
+
+/// <summary>
+/// The number of moves sent back to back for measuring the cost under load.
+/// </summary>
+static constexpr std::size_t burst_events = 100000;
+
+/// <summary>
+/// The number of moves sent with a pause like a mouse does, such that the
+/// receiver goes to sleep for every event.
+/// </summary>
+static constexpr std::size_t paced_events = 2000;
+
+/// <summary>
+/// The pause between two moves in the paced measurement.
+/// </summary>
+static constexpr std::chrono::microseconds pace(500);
+
+
+/// <summary>
+/// Receives the sum of the decoded positions such that decoding cannot be
+/// optimised away.
+/// </summary>
+static volatile std::int64_t sink = 0;
+
+/// <summary>
+/// The number of system calls the receive engines have made on the calling
+/// thread.
+/// </summary>
+static thread_local std::uint64_t syscalls = 0;
+
+
+/*
+ * The benchmark is linked with --wrap for the functions the receive engines
+ * use to enter the kernel, which allows for counting the system calls they
+ * make without changing the engines.
+ */
+extern "C" {
+
+int __real_epoll_wait(int, epoll_event *, int, int);
+ssize_t __real_recvfrom(int, void *, std::size_t, int, sockaddr *,
+    socklen_t *);
+long __real_syscall(long, ...);
+
+int __wrap_epoll_wait(int epoll, epoll_event *events, int cnt,
+        int timeout) {
+    ++syscalls;
+    return __real_epoll_wait(epoll, events, cnt, timeout);
+}
+
+ssize_t __wrap_recvfrom(int socket, void *buffer, std::size_t size,
+        int flags, sockaddr *peer, socklen_t *peer_len) {
+    ++syscalls;
+    return __real_recvfrom(socket, buffer, size, flags, peer, peer_len);
+}
+
+long __wrap_syscall(long number, ...) {
+    // All the system calls used by io_uring have at most six arguments.
+    long args[6];
+    va_list list;
+    va_start(list, number);
+    for (auto& a : args) {
+        a = va_arg(list, long);
+    }
+    va_end(list);
+
+    ++syscalls;
+    return __real_syscall(number, args[0], args[1], args[2], args[3],
+        args[4], args[5]);
+}
+
+} /* extern "C" */
+
+
+/// <summary>
+/// The costs measured for one engine and load.
+/// </summary>
+struct result {
+    double cpu;
+    std::size_t delivered;
+    double switches;
+    double syscalls;
+};
+
+
+/// <summary>
+/// Answer the user and kernel time the calling thread has consumed in
+/// microseconds.
+/// </summary>
+static double cpu_time(void) noexcept {
+    timespec t;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return 1000.0 * 1000.0 * static_cast<double>(t.tv_sec)
+        + static_cast<double>(t.tv_nsec) / 1000.0;
+}
+
+
+/// <summary>
+/// Answer the number of context switches of the calling thread.
+/// </summary>
+static std::uint64_t context_switches(void) noexcept {
+    rusage usage;
+    ::getrusage(RUSAGE_THREAD, &usage);
+    return static_cast<std::uint64_t>(usage.ru_nvcsw + usage.ru_nivcsw);
+}
+
+
+/// <summary>
+/// Answer a bound UDP socket on the loopback interface and its address.
+/// </summary>
+static wil::unique_socket make_socket(_Out_ sockaddr_in& address) {
+    wil::unique_socket retval(::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+    if (!retval) {
+        return retval;
+    }
+
+    // The kernel caps the buffer, but the larger it is, the fewer moves are
+    // lost in the burst.
+    const int size = 8 * 1024 * 1024;
+    ::setsockopt(retval.get(), SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    ::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(address);
+    if ((::bind(retval.get(), reinterpret_cast<const sockaddr *>(&address),
+            sizeof(address)) != 0)
+            || (::getsockname(retval.get(),
+            reinterpret_cast<sockaddr *>(&address), &len) != 0)) {
+        retval.reset();
+    }
+
+    return retval;
+}
+
+
+/// <summary>
+/// Sends moves to <paramref name="address"/>, which the given
+/// <paramref name="transport"/> receives and decodes on a separate thread
+/// the same way as the receiver thread of the client does, and answer the
+/// costs of the receiver per delivered event.
+/// </summary>
+static void measure(_Out_ result& result,
+        _In_ mmp_transport& transport,
+        _In_ const sockaddr_in& address,
+        _In_ const bool paced) {
+    const auto events = paced ? paced_events : burst_events;
+    std::atomic<bool> done(false);
+    ::memset(&result, 0, sizeof(result));
+
+    std::thread receiver([&](void) {
+        std::vector<char> buffer((std::numeric_limits<std::uint16_t>::max)());
+        const auto cpu = cpu_time();
+        const auto switches = context_switches();
+        std::int64_t sum = 0;
+        syscalls = 0;
+
+        while (true) {
+            const char *data = nullptr;
+            sockaddr_storage peer;
+            DWORD size = 0;
+
+            if (transport.borrow(buffer, data, size, peer) != 0) {
+                break;
+            }
+
+            // Anything shorter than a move marks the end of the measurement.
+            if (size < sizeof(mmp_msg_mouse_move)) {
+                break;
+            }
+
+            mmp_msg_mouse_move msg;
+            std::memcpy(&msg, data, sizeof(msg));
+            sum += static_cast<std::int32_t>(::ntohl(msg.x));
+            ++result.delivered;
+        }
+
+        if (result.delivered > 0) {
+            const auto d = static_cast<double>(result.delivered);
+            result.cpu = (cpu_time() - cpu) / d;
+            result.switches = static_cast<double>(context_switches()
+                - switches) / d;
+            result.syscalls = static_cast<double>(syscalls) / d;
+        }
+
+        sink = sum;
+        done.store(true);
+    });
+
+    // Give the receiver the chance to block before the first event.
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    wil::unique_socket sender(::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+    for (std::size_t e = 0; e < events; ++e) {
+        mmp_msg_mouse_move msg;
+        msg.sequence_number = ::htonl(static_cast<std::uint32_t>(e + 1));
+        msg.x = ::htonl(static_cast<std::int32_t>(e + 1));
+        ::sendto(sender.get(), &msg, sizeof(msg), 0,
+            reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+        if (paced) {
+            std::this_thread::sleep_for(pace);
+        }
+    }
+
+    // The end marker might be lost like any other datagram, so we repeat it
+    // until the receiver has seen it.
+    while (!done.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        const char marker = 0;
+        ::sendto(sender.get(), &marker, sizeof(marker), 0,
+            reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+    }
+
+    receiver.join();
+}
+
+
+/// <summary>
+/// Prints a line of the results.
+/// </summary>
+static void print(_In_z_ const char *engine,
+        _In_ const bool paced,
+        _In_ const result& r) {
+    const auto events = paced ? paced_events : burst_events;
+    std::printf("%-10s %-6s %12zu/%-8zu %12.3f %12.2f %12.3f\n", engine,
+        paced ? "paced" : "burst", r.delivered, events, r.syscalls, r.cpu,
+        r.switches);
+}
+
+
+/// <summary>
+/// Compares the system calls, CPU time and context switches per event of
+/// the receive engines the client library uses on Linux, i.e. the socket
+/// waiting in epoll and, if the kernel supports it, io_uring.
+/// </summary>
+int main(void) {
+    std::printf("%-10s %-6s %21s %12s %12s %12s\n", "engine", "load",
+        "delivered", "syscalls/ev", "cpu [us/ev]", "switches/ev");
+
+    for (auto paced : { false, true }) {
+        sockaddr_in address;
+        auto socket = make_socket(address);
+        if (!socket) {
+            std::fprintf(stderr, "Failed to create the loopback socket.\n");
+            return -1;
+        }
+
+        mmp_udp_transport transport(std::move(socket));
+        if (transport.open() != 0) {
+            std::fprintf(stderr, "Failed to open the epoll engine.\n");
+            return -1;
+        }
+
+        result r;
+        measure(r, transport, address, paced);
+        print("epoll", paced, r);
+    }
+
+#if defined(MMP_IO_URING)
+    for (auto paced : { false, true }) {
+        sockaddr_in address;
+        auto socket = make_socket(address);
+        if (!socket) {
+            std::fprintf(stderr, "Failed to create the loopback socket.\n");
+            return -1;
+        }
+
+        mmp_uring_transport transport;
+        const auto status = transport.open(socket);
+        if (status != 0) {
+            std::printf("%-10s %-6s unavailable (error %d)\n", "io_uring",
+                paced ? "paced" : "burst", status);
+            continue;
+        }
+
+        result r;
+        measure(r, transport, address, paced);
+        print("io_uring", paced, r);
+    }
+#else /* defined(MMP_IO_URING) */
+    std::printf("%-10s not built\n", "io_uring");
+#endif /* defined(MMP_IO_URING) */
+
+    return 0;
+}